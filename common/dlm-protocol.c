@@ -13,9 +13,12 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE
 #include "dlm-protocol.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -34,12 +37,16 @@ bool receive_dlm_client_request(int socket, struct dlm_client_request *request)
 	    .msg_iovlen = 1,
 	};
 
+	memset(request, 0, sizeof(*request));
+
 	while ((len = recvmsg(socket, &msg, 0)) < 0) {
 		if (errno != EINTR)
 			return false;
 	}
 
-	if (len != sizeof(*request)) {
+	/* Older clients only send the opcode. Any fields that they don't
+	 * know about are left as 0. */
+	if (len < (ssize_t)offsetof(struct dlm_client_request, flags)) {
 		errno = EPROTO;
 		return false;
 	}
@@ -58,17 +65,36 @@ bool send_dlm_client_request(int socket, struct dlm_client_request *request)
 	    .msg_iovlen = 1,
 	};
 
-	while (sendmsg(socket, &msg, 0) < 1) {
+	while (sendmsg(socket, &msg, MSG_NOSIGNAL) < 1) {
 		if (errno != EINTR)
 			return false;
 	}
 	return true;
 }
 
-int receive_lease_fd(int socket)
+/* The topology descriptor is mapped by the client, so only accept it if
+ * the sender can no longer modify or truncate it. */
+static bool is_sealed_memfd(int fd)
+{
+	int required_seals = F_SEAL_SHRINK | F_SEAL_WRITE;
+	int seals = fcntl(fd, F_GET_SEALS);
+
+	return seals >= 0 && (seals & required_seals) == required_seals;
+}
+
+static bool is_lease_event(char data)
+{
+	return data == DLM_EVENT_LEASE_REVOKED ||
+	       data == DLM_EVENT_LEASE_AVAILABLE;
+}
+
+int receive_lease_fd(int socket, int *topology)
 {
 	int lease_fd = -1;
-	char ctrl_buf[CMSG_SPACE(sizeof(lease_fd))];
+	char ctrl_buf[CMSG_SPACE(2 * sizeof(lease_fd))];
+
+	if (topology)
+		*topology = -1;
 
 	char data;
 	struct iovec iov = {.iov_base = &data, .iov_len = sizeof(data)};
@@ -79,16 +105,22 @@ int receive_lease_fd(int socket)
 	    .msg_controllen = sizeof(ctrl_buf),
 	};
 
+	/* Events queued before the reply (e.g. an offer of the lease that is
+	 * being requested) carry no fds and are no longer relevant, so skip
+	 * them until the lease fd arrives. */
 	ssize_t len;
-	while ((len = recvmsg(socket, &msg, 0)) <= 0) {
-		if (len == 0) {
-			errno = EACCES;
-			goto err;
-		}
+	do {
+		msg.msg_controllen = sizeof(ctrl_buf);
+		while ((len = recvmsg(socket, &msg, 0)) <= 0) {
+			if (len == 0) {
+				errno = EACCES;
+				goto err;
+			}
 
-		if (errno != EINTR)
-			goto err;
-	}
+			if (errno != EINTR)
+				goto err;
+		}
+	} while (msg.msg_controllen == 0 && is_lease_event(data));
 
 	struct cmsghdr *cmsg;
 	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
@@ -103,6 +135,12 @@ int receive_lease_fd(int socket)
 				break;
 			}
 
+			if (nfds == 2 && topology && is_sealed_memfd(fds[1])) {
+				lease_fd = fds[0];
+				*topology = fds[1];
+				break;
+			}
+
 			/* Close any unexpected fds so we don't leak them. */
 			for (int i = 0; i < nfds; i++)
 				close(fds[i]);
@@ -119,31 +157,73 @@ err:
 	return lease_fd;
 }
 
-bool send_lease_fd(int socket, int lease)
+bool send_lease_fd(int socket, int lease, int topology)
 {
-	char data;
+	char data = 0;
 	struct iovec iov = {
 	    .iov_base = &data,
 	    .iov_len = sizeof(data),
 	};
 
-	char ctrl_buf[CMSG_SPACE(sizeof(lease))] = {0};
+	int fds[] = {lease, topology};
+	int nfds = topology >= 0 ? 2 : 1;
+
+	char ctrl_buf[CMSG_SPACE(sizeof(fds))] = {0};
 
 	struct msghdr msg = {
 	    .msg_iov = &iov,
 	    .msg_iovlen = 1,
-	    .msg_controllen = sizeof(ctrl_buf),
+	    .msg_controllen = CMSG_SPACE(nfds * sizeof(int)),
 	    .msg_control = ctrl_buf,
 	};
 
 	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
 	cmsg->cmsg_level = SOL_SOCKET;
 	cmsg->cmsg_type = SCM_RIGHTS;
-	cmsg->cmsg_len = CMSG_LEN(sizeof(lease));
-	*((int *)CMSG_DATA(cmsg)) = lease;
+	cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
 
 	if (sendmsg(socket, &msg, 0) < 0)
 		return false;
 
 	return true;
 }
+
+/* Non-blocking check for a pending event.
+ * Returns DLM_EVENT_NONE if there is nothing to read, and fails with
+ * EPIPE if the lease manager has closed the connection. */
+bool receive_dlm_event(int socket, enum dlm_event *event)
+{
+	uint8_t data;
+	ssize_t len;
+
+	*event = DLM_EVENT_NONE;
+
+	while ((len = recv(socket, &data, sizeof(data), MSG_DONTWAIT)) < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return true;
+		if (errno != EINTR)
+			return false;
+	}
+
+	if (len == 0) {
+		errno = EPIPE;
+		return false;
+	}
+
+	*event = data;
+	return true;
+}
+
+bool send_dlm_event(int socket, enum dlm_event event)
+{
+	uint8_t data = event;
+
+	/* Never block the lease manager on a slow client */
+	while (send(socket, &data, sizeof(data), MSG_DONTWAIT | MSG_NOSIGNAL) <
+	       0) {
+		if (errno != EINTR)
+			return false;
+	}
+	return true;
+}
@@ -17,18 +17,40 @@
 #define DLM_PROTOCOL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 enum dlm_opcode {
 	DLM_GET_LEASE,
 	DLM_RELEASE_LEASE,
+	DLM_YIELD_LEASE, /* Release the lease, but keep the connection open */
 };
 
+/* Maximum lease name length (including the terminating NUL) in a request.
+ * Matches the longest path that can be used for a lease socket. */
+#define DLM_LEASE_NAME_MAX 108
+
+/* Request flags */
+#define DLM_REQUEST_TOPOLOGY (1 << 0) /* Send topology descriptor with lease */
+
 struct dlm_client_request {
 	enum dlm_opcode opcode;
+	uint32_t flags;
+	/* Only used on the control socket */
+	char lease_name[DLM_LEASE_NAME_MAX];
+};
+
+/* Events sent by the lease manager to the client that owns a lease.
+ * The lease fd itself is sent with DLM_EVENT_NONE as the message data. */
+enum dlm_event {
+	DLM_EVENT_NONE,
+	DLM_EVENT_LEASE_REVOKED,
+	DLM_EVENT_LEASE_AVAILABLE, /* Sent to clients that yielded the lease */
 };
 
 bool receive_dlm_client_request(int socket, struct dlm_client_request *request);
 bool send_dlm_client_request(int socket, struct dlm_client_request *request);
-int receive_lease_fd(int socket);
-bool send_lease_fd(int socket, int lease);
+int receive_lease_fd(int socket, int *topology);
+bool send_lease_fd(int socket, int lease, int topology);
+bool receive_dlm_event(int socket, enum dlm_event *event);
+bool send_dlm_event(int socket, enum dlm_event event);
 #endif
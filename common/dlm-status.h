@@ -0,0 +1,77 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DLM_STATUS_H
+#define DLM_STATUS_H
+
+#include "dlm-protocol.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* Lease status page
+ * A file in the runtime directory, mapped read-only by monitoring clients,
+ * that describes the current state of every lease.
+ *
+ * Layout:
+ *   struct dlm_status_header
+ *   struct dlm_status_entry[header.nleases]
+ *
+ * Each entry is protected by a sequence lock: the lease manager makes
+ * `seq` odd while it updates the entry, and even again once the update
+ * is complete.  Readers retry if `seq` was odd or changed while they
+ * were copying the entry.
+ *
+ * The frame pacing statistics of an entry are updated by a separate
+ * thread, so they have their own sequence lock, `frame_seq`.
+ *
+ * When the lease manager exits, it clears `active`.  A new lease manager
+ * replaces the file, so readers should reopen it when `active` is 0. */
+
+#define DLM_STATUS_FILE_NAME "drm-lease-manager.status"
+#define DLM_STATUS_MAGIC 0x53534c44 /* "DLSS" */
+#define DLM_STATUS_VERSION 1
+
+/* Frame interval histogram.
+ * Bucket n counts frames that were shown for n + 1 vblank periods; the last
+ * bucket also counts all longer intervals. */
+#define DLM_STATUS_FRAME_BUCKETS 8
+
+struct dlm_status_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nleases;
+	uint32_t entry_size;
+	atomic_uint active;
+	uint32_t reserved[3]; /* keeps the entries 8 byte aligned */
+};
+
+struct dlm_status_entry {
+	atomic_uint seq;
+	uint32_t granted;
+	uint32_t lessee_id;
+	int32_t client_pid;
+	uint64_t grant_count;
+	uint64_t last_transition_ns; /* CLOCK_MONOTONIC */
+	char name[DLM_LEASE_NAME_MAX];
+
+	atomic_uint frame_seq;
+	uint32_t reserved;
+	uint64_t frame_count;
+	uint64_t missed_frames;
+	uint64_t frame_intervals[DLM_STATUS_FRAME_BUCKETS];
+};
+
+#endif
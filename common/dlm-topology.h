@@ -0,0 +1,64 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DLM_TOPOLOGY_H
+#define DLM_TOPOLOGY_H
+
+#include <stdint.h>
+
+/* Lease topology descriptor
+ *
+ * Binary description of the DRM objects in a lease, sent to clients
+ * as a sealed memfd along with the lease fd.
+ *
+ * Layout:
+ *   struct dlm_topology_header
+ *   struct dlm_topology_object[header.nobjects]
+ *   struct dlm_topology_prop[header.nprops]
+ *
+ * Each object references a contiguous range of the property table. */
+
+#define DLM_TOPOLOGY_MAGIC 0x544d4c44 /* "DLMT" */
+#define DLM_TOPOLOGY_VERSION 1
+#define DLM_TOPOLOGY_NAME_LEN 32
+
+enum dlm_topology_object_type {
+	DLM_TOPOLOGY_CRTC,
+	DLM_TOPOLOGY_CONNECTOR,
+	DLM_TOPOLOGY_PLANE,
+};
+
+struct dlm_topology_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	uint32_t nobjects;
+	uint32_t nprops;
+};
+
+struct dlm_topology_object {
+	uint32_t id;
+	uint32_t type;
+	uint32_t first_prop;
+	uint32_t nprops;
+	char name[DLM_TOPOLOGY_NAME_LEN];
+};
+
+struct dlm_topology_prop {
+	uint32_t id;
+	char name[DLM_TOPOLOGY_NAME_LEN];
+};
+
+#endif
@@ -0,0 +1,49 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "latency-stats.h"
+
+#include <stdlib.h>
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static double percentile_us(const uint64_t *sorted, size_t count, int pct)
+{
+	return sorted[(count - 1) * pct / 100] / 1000.0;
+}
+
+void latency_stats_compute(uint64_t *samples_ns, size_t count,
+			   struct latency_stats *stats)
+{
+	*stats = (struct latency_stats){.count = count};
+	if (count == 0)
+		return;
+
+	qsort(samples_ns, count, sizeof(uint64_t), compare_u64);
+
+	uint64_t total_ns = 0;
+	for (size_t i = 0; i < count; i++)
+		total_ns += samples_ns[i];
+
+	stats->min_us = samples_ns[0] / 1000.0;
+	stats->mean_us = (double)total_ns / count / 1000.0;
+	stats->p50_us = percentile_us(samples_ns, count, 50);
+	stats->p99_us = percentile_us(samples_ns, count, 99);
+	stats->max_us = samples_ns[count - 1] / 1000.0;
+}
@@ -0,0 +1,37 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Summary of a set of latency samples, in microseconds */
+struct latency_stats {
+	size_t count;
+	double min_us;
+	double mean_us;
+	double p50_us;
+	double p99_us;
+	double max_us;
+};
+
+/* Sorts the samples (in nanoseconds) and summarizes them.
+ * All values are 0 if there are no samples. */
+void latency_stats_compute(uint64_t *samples_ns, size_t count,
+			   struct latency_stats *stats);
+
+#endif
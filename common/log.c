@@ -13,26 +13,431 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE
 #include "log.h"
 
+#include <endian.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Ring size must be a power of 2 */
+#define LOG_RING_SIZE 256
+#define LOG_MSG_MAX 224
+#define LOG_LEASE_MAX 32
+
+#define RATELIMIT_INTERVAL_MS 5000
+#define RATELIMIT_BURST 10
+
+#define JOURNAL_SOCKET "/run/systemd/journal/socket"
+
+struct log_record {
+	atomic_uint_fast64_t seq;
+	enum dlm_log_level level;
+	int client;
+	int64_t latency_us;
+	char lease[LOG_LEASE_MAX];
+	char msg[LOG_MSG_MAX];
+};
+
+/* Bounded multi-producer, single-consumer queue.
+ * Each slot's sequence number tells producers whether the slot is free
+ * and the drain thread whether it has been filled, so neither side
+ * needs a lock.  Producers never wait: if the ring is full, the message
+ * is dropped and counted. */
+struct log_ring {
+	struct log_record records[LOG_RING_SIZE];
+	atomic_uint_fast64_t head;
+	uint64_t tail;
+	atomic_uint dropped;
+
+	atomic_bool running;
+	atomic_bool drain_waiting;
+	int wake_fd;
+	pthread_t thread;
+
+	enum dlm_log_sink sink;
+	int journal_fd;
+};
 
 static bool debug_log = false;
+static struct log_ring ring = {.wake_fd = -1, .journal_fd = -1};
+
+static const char *const level_prefix[] = {
+    [DLM_LOG_DEBUG] = "DEBUG: ",
+    [DLM_LOG_INFO] = "INFO: ",
+    [DLM_LOG_WARN] = "WARNING: ",
+    [DLM_LOG_ERROR] = "ERROR: ",
+};
+
+static const int level_priority[] = {
+    [DLM_LOG_DEBUG] = LOG_DEBUG,
+    [DLM_LOG_INFO] = LOG_INFO,
+    [DLM_LOG_WARN] = LOG_WARNING,
+    [DLM_LOG_ERROR] = LOG_ERR,
+};
 
 void dlm_log_enable_debug(bool enable)
 {
 	debug_log = enable;
 }
 
-void dlm_log_print(bool debug, FILE *stream, char *fmt, ...)
+static void fill_record(struct log_record *rec, enum dlm_log_level level,
+			const struct dlm_log_fields *fields, const char *fmt,
+			va_list argl)
+{
+	rec->level = level;
+	rec->lease[0] = '\0';
+	rec->client = -1;
+	rec->latency_us = -1;
+
+	if (fields) {
+		if (fields->lease)
+			snprintf(rec->lease, sizeof(rec->lease), "%s",
+				 fields->lease);
+		rec->client = fields->client;
+		rec->latency_us = fields->latency_us;
+	}
+
+	vsnprintf(rec->msg, sizeof(rec->msg), fmt, argl);
+}
+
+static void emit_stdio(const struct log_record *rec)
+{
+	FILE *stream = rec->level >= DLM_LOG_WARN ? stderr : stdout;
+	size_t len = strcspn(rec->msg, "\n");
+
+	fprintf(stream, "%s%.*s", level_prefix[rec->level], (int)len,
+		rec->msg);
+
+	if (rec->lease[0])
+		fprintf(stream, " (lease=%s", rec->lease);
+	if (rec->lease[0] && rec->client >= 0)
+		fprintf(stream, " client=%d", rec->client);
+	if (rec->lease[0] && rec->latency_us >= 0)
+		fprintf(stream, " latency=%lldus",
+			(long long)rec->latency_us);
+	if (rec->lease[0])
+		fputc(')', stream);
+
+	fputs(rec->msg + len, stream);
+}
+
+/* Append a field in journald native protocol format.
+ * Values containing newlines use the length-prefixed binary form */
+static size_t journal_field(char *buf, size_t size, size_t off,
+			    const char *key, const char *value)
+{
+	size_t key_len = strlen(key);
+	size_t len = strlen(value);
+	bool binary = strchr(value, '\n') != NULL;
+	size_t needed =
+	    key_len + 1 + (binary ? sizeof(uint64_t) : 0) + len + 1;
+
+	if (off + needed > size)
+		return off;
+
+	memcpy(buf + off, key, key_len);
+	off += key_len;
+
+	if (binary) {
+		uint64_t le_len = htole64(len);
+		buf[off++] = '\n';
+		memcpy(buf + off, &le_len, sizeof(le_len));
+		off += sizeof(le_len);
+	} else {
+		buf[off++] = '=';
+	}
+
+	memcpy(buf + off, value, len);
+	off += len;
+	buf[off++] = '\n';
+	return off;
+}
+
+static bool emit_journal(const struct log_record *rec)
+{
+	static const struct sockaddr_un addr = {
+	    .sun_family = AF_UNIX,
+	    .sun_path = JOURNAL_SOCKET,
+	};
+	char buf[512];
+	char value[32];
+	size_t off = 0;
+
+	snprintf(value, sizeof(value), "%d", level_priority[rec->level]);
+	off = journal_field(buf, sizeof(buf), off, "PRIORITY", value);
+	off = journal_field(buf, sizeof(buf), off, "SYSLOG_IDENTIFIER",
+			    program_invocation_short_name);
+
+	if (rec->lease[0]) {
+		off = journal_field(buf, sizeof(buf), off, "DLM_LEASE",
+				    rec->lease);
+	}
+	if (rec->lease[0] && rec->client >= 0) {
+		snprintf(value, sizeof(value), "%d", rec->client);
+		off = journal_field(buf, sizeof(buf), off, "DLM_CLIENT",
+				    value);
+	}
+	if (rec->lease[0] && rec->latency_us >= 0) {
+		snprintf(value, sizeof(value), "%lld",
+			 (long long)rec->latency_us);
+		off = journal_field(buf, sizeof(buf), off,
+				    "DLM_LATENCY_USEC", value);
+	}
+
+	/* Drop the trailing newline, journald records are single entries */
+	char msg[LOG_MSG_MAX];
+	size_t len = strlen(rec->msg);
+	if (len > 0 && rec->msg[len - 1] == '\n')
+		len--;
+	memcpy(msg, rec->msg, len);
+	msg[len] = '\0';
+	off = journal_field(buf, sizeof(buf), off, "MESSAGE", msg);
+
+	return sendto(ring.journal_fd, buf, off, MSG_NOSIGNAL,
+		      (const struct sockaddr *)&addr, sizeof(addr)) >= 0;
+}
+
+static void emit_record(const struct log_record *rec)
 {
-	if (debug && !debug_log)
+	if (ring.sink == DLM_LOG_SINK_JOURNAL && emit_journal(rec))
+		return;
+	emit_stdio(rec);
+}
+
+static bool ring_push(enum dlm_log_level level,
+		      const struct dlm_log_fields *fields, const char *fmt,
+		      va_list argl)
+{
+	struct log_record *rec;
+	uint_fast64_t pos = atomic_load_explicit(&ring.head,
+						 memory_order_relaxed);
+	for (;;) {
+		rec = &ring.records[pos & (LOG_RING_SIZE - 1)];
+		uint_fast64_t seq =
+		    atomic_load_explicit(&rec->seq, memory_order_acquire);
+		int64_t diff = (int64_t)(seq - pos);
+
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(
+				&ring.head, &pos, pos + 1,
+				memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			atomic_fetch_add_explicit(&ring.dropped, 1,
+						  memory_order_relaxed);
+			return false;
+		} else {
+			pos = atomic_load_explicit(&ring.head,
+						   memory_order_relaxed);
+		}
+	}
+
+	fill_record(rec, level, fields, fmt, argl);
+	atomic_store_explicit(&rec->seq, pos + 1, memory_order_release);
+
+	/* Only wake the drain thread if it is about to sleep */
+	if (atomic_exchange(&ring.drain_waiting, false))
+		eventfd_write(ring.wake_fd, 1);
+	return true;
+}
+
+static struct log_record *ring_peek(void)
+{
+	struct log_record *rec =
+	    &ring.records[ring.tail & (LOG_RING_SIZE - 1)];
+	uint_fast64_t seq =
+	    atomic_load_explicit(&rec->seq, memory_order_acquire);
+
+	return seq == ring.tail + 1 ? rec : NULL;
+}
+
+static void ring_drain(void)
+{
+	struct log_record *rec;
+	while ((rec = ring_peek())) {
+		emit_record(rec);
+		atomic_store_explicit(&rec->seq, ring.tail + LOG_RING_SIZE,
+				      memory_order_release);
+		ring.tail++;
+	}
+
+	unsigned int dropped = atomic_exchange(&ring.dropped, 0);
+	if (dropped > 0) {
+		struct log_record overflow = {.level = DLM_LOG_WARN,
+					      .client = -1,
+					      .latency_us = -1};
+		snprintf(overflow.msg, sizeof(overflow.msg),
+			 "Log buffer full, %u messages dropped\n", dropped);
+		emit_record(&overflow);
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+}
+
+static void *drain_thread(void *arg)
+{
+	(void)arg;
+
+	while (atomic_load(&ring.running)) {
+		ring_drain();
+
+		atomic_store(&ring.drain_waiting, true);
+		if (ring_peek() || !atomic_load(&ring.running)) {
+			atomic_store(&ring.drain_waiting, false);
+			continue;
+		}
+
+		struct pollfd pfd = {.fd = ring.wake_fd, .events = POLLIN};
+		if (poll(&pfd, 1, -1) > 0) {
+			eventfd_t count;
+			eventfd_read(ring.wake_fd, &count);
+		}
+	}
+
+	ring_drain();
+	return NULL;
+}
+
+static bool stderr_is_journal(void)
+{
+	const char *stream = getenv("JOURNAL_STREAM");
+	unsigned long long dev, ino;
+	struct stat st;
+
+	if (!stream || sscanf(stream, "%llu:%llu", &dev, &ino) != 2)
+		return false;
+
+	if (fstat(STDERR_FILENO, &st) < 0)
+		return false;
+
+	return st.st_dev == dev && st.st_ino == ino;
+}
+
+bool dlm_log_start_async(enum dlm_log_sink sink)
+{
+	if (atomic_load(&ring.running))
+		return true;
+
+	if (sink == DLM_LOG_SINK_AUTO)
+		sink = stderr_is_journal() ? DLM_LOG_SINK_JOURNAL
+					   : DLM_LOG_SINK_STDIO;
+
+	if (sink == DLM_LOG_SINK_JOURNAL) {
+		ring.journal_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+		if (ring.journal_fd < 0)
+			sink = DLM_LOG_SINK_STDIO;
+	}
+	ring.sink = sink;
+
+	ring.wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (ring.wake_fd < 0)
+		goto err;
+
+	for (int i = 0; i < LOG_RING_SIZE; i++)
+		atomic_init(&ring.records[i].seq, i);
+	atomic_init(&ring.head, 0);
+	ring.tail = 0;
+	atomic_init(&ring.dropped, 0);
+	atomic_init(&ring.drain_waiting, false);
+	atomic_store(&ring.running, true);
+
+	if (pthread_create(&ring.thread, NULL, drain_thread, NULL) != 0) {
+		atomic_store(&ring.running, false);
+		goto err;
+	}
+	return true;
+err:
+	if (ring.wake_fd >= 0)
+		close(ring.wake_fd);
+	if (ring.journal_fd >= 0)
+		close(ring.journal_fd);
+	ring.wake_fd = -1;
+	ring.journal_fd = -1;
+	ring.sink = DLM_LOG_SINK_STDIO;
+	return false;
+}
+
+/* Must only be called once other threads have stopped logging */
+void dlm_log_stop_async(void)
+{
+	if (!atomic_exchange(&ring.running, false))
+		return;
+
+	eventfd_write(ring.wake_fd, 1);
+	pthread_join(ring.thread, NULL);
+
+	close(ring.wake_fd);
+	if (ring.journal_fd >= 0)
+		close(ring.journal_fd);
+	ring.wake_fd = -1;
+	ring.journal_fd = -1;
+	ring.sink = DLM_LOG_SINK_STDIO;
+}
+
+void dlm_log_print(enum dlm_log_level level,
+		   const struct dlm_log_fields *fields, const char *fmt, ...)
+{
+	if (level == DLM_LOG_DEBUG && !debug_log)
 		return;
 
 	va_list argl;
 	va_start(argl, fmt);
-	vfprintf(stream, fmt, argl);
+
+	if (atomic_load_explicit(&ring.running, memory_order_acquire)) {
+		ring_push(level, fields, fmt, argl);
+	} else {
+		struct log_record rec;
+		fill_record(&rec, level, fields, fmt, argl);
+		emit_stdio(&rec);
+	}
+
 	va_end(argl);
 }
+
+static int64_t now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+bool dlm_log_ratelimit(struct dlm_log_ratelimit *rl, const char *func)
+{
+	int64_t now = now_ms();
+	int_fast64_t start = atomic_load_explicit(&rl->interval_start_ms,
+						  memory_order_relaxed);
+
+	if (start == 0 || now - start >= RATELIMIT_INTERVAL_MS) {
+		/* Only one caller starts the new interval */
+		if (atomic_compare_exchange_strong(&rl->interval_start_ms,
+						   &start, now)) {
+			unsigned int missed = atomic_exchange(&rl->missed, 0);
+			atomic_store(&rl->printed, 0);
+			if (missed > 0)
+				dlm_log_print(DLM_LOG_WARN, NULL,
+					      "%s: %u messages suppressed\n",
+					      func, missed);
+		}
+	}
+
+	if (atomic_fetch_add(&rl->printed, 1) < RATELIMIT_BURST)
+		return true;
+
+	atomic_fetch_add(&rl->missed, 1);
+	return false;
+}
@@ -16,19 +16,78 @@
 #ifndef LOG_H
 #define LOG_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
-#define DEBUG_LOG(FMT, ...)                                               \
-	dlm_log_print(true, stdout, "DEBUG: %s: line %d: " FMT, __func__, \
+enum dlm_log_level {
+	DLM_LOG_DEBUG,
+	DLM_LOG_INFO,
+	DLM_LOG_WARN,
+	DLM_LOG_ERROR,
+};
+
+/* Destination of asynchronously logged messages.
+ * DLM_LOG_SINK_AUTO selects the journal if stderr is connected to it */
+enum dlm_log_sink {
+	DLM_LOG_SINK_AUTO,
+	DLM_LOG_SINK_STDIO,
+	DLM_LOG_SINK_JOURNAL,
+};
+
+/* Optional structured fields attached to a message.
+ * lease may be NULL; client and latency_us are ignored if negative */
+struct dlm_log_fields {
+	const char *lease;
+	int client;
+	int64_t latency_us;
+};
+
+struct dlm_log_ratelimit {
+	atomic_int_fast64_t interval_start_ms;
+	atomic_uint printed;
+	atomic_uint missed;
+};
+
+#define DEBUG_LOG(FMT, ...)                                                \
+	dlm_log_print(DLM_LOG_DEBUG, NULL, "%s: line %d: " FMT, __func__, \
 		      __LINE__, ##__VA_ARGS__)
 #define INFO_LOG(FMT, ...) \
-	dlm_log_print(false, stdout, "INFO: " FMT, ##__VA_ARGS__)
+	dlm_log_print(DLM_LOG_INFO, NULL, FMT, ##__VA_ARGS__)
+#define INFO_LOG_FIELDS(FIELDS, FMT, ...) \
+	dlm_log_print(DLM_LOG_INFO, FIELDS, FMT, ##__VA_ARGS__)
+
 #define WARN_LOG(FMT, ...) \
-	dlm_log_print(false, stderr, "WARNING: " FMT, ##__VA_ARGS__)
+	dlm_log_print(DLM_LOG_WARN, NULL, FMT, ##__VA_ARGS__)
 #define ERROR_LOG(FMT, ...) \
-	dlm_log_print(false, stderr, "ERROR: " FMT, ##__VA_ARGS__)
+	dlm_log_print(DLM_LOG_ERROR, NULL, FMT, ##__VA_ARGS__)
+
+/* Rate limited per call site, for messages that clients can trigger
+ * at will or that repeat while a fault persists, so that they cannot
+ * flood the log */
+#define DLM_LOG_RATELIMITED(LEVEL, FMT, ...)                              \
+	do {                                                              \
+		static struct dlm_log_ratelimit dlm_log_rl_;              \
+		if (dlm_log_ratelimit(&dlm_log_rl_, __func__))            \
+			dlm_log_print(LEVEL, NULL, FMT, ##__VA_ARGS__);   \
+	} while (0)
+
+#define WARN_LOG_RATELIMITED(FMT, ...) \
+	DLM_LOG_RATELIMITED(DLM_LOG_WARN, FMT, ##__VA_ARGS__)
+#define ERROR_LOG_RATELIMITED(FMT, ...) \
+	DLM_LOG_RATELIMITED(DLM_LOG_ERROR, FMT, ##__VA_ARGS__)
 
 void dlm_log_enable_debug(bool enable);
-void dlm_log_print(bool debug, FILE *stream, char *fmt, ...);
+void dlm_log_print(enum dlm_log_level level,
+		   const struct dlm_log_fields *fields, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+bool dlm_log_ratelimit(struct dlm_log_ratelimit *rl, const char *func);
+
+/* Move message output off the calling thread.
+ * Messages are formatted into a lock-free ring buffer and written
+ * to the sink by a drain thread.  Without this, messages are written
+ * synchronously. */
+bool dlm_log_start_async(enum dlm_log_sink sink);
+void dlm_log_stop_async(void);
 #endif
@@ -18,20 +18,29 @@
 #include "log.h"
 
 #include <errno.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define RUNTIME_PATH DLM_DEFAULT_RUNTIME_PATH
+#define SHM_PATH "/dev/shm"
 
 bool sockaddr_set_lease_server_path(struct sockaddr_un *sa,
 				    const char *lease_name)
 {
 	int maxlen = sizeof(sa->sun_path);
 	char *socket_dir = getenv("DLM_RUNTIME_PATH") ?: RUNTIME_PATH;
+	char *path = sa->sun_path;
 
-	int len =
-	    snprintf(sa->sun_path, maxlen, "%s/%s", socket_dir, lease_name);
+	/* Abstract socket names start with a NUL byte */
+	if (socket_dir[0] == DLM_ABSTRACT_PATH_PREFIX) {
+		*path++ = '\0';
+		maxlen--;
+		socket_dir++;
+	}
+
+	int len = snprintf(path, maxlen, "%s/%s", socket_dir, lease_name);
 
 	if (len < 0) {
 		DEBUG_LOG("Socket path creation failed: %s\n", strerror(errno));
@@ -46,3 +55,55 @@ bool sockaddr_set_lease_server_path(struct sockaddr_un *sa,
 	}
 	return true;
 }
+
+bool runtime_file_path(char *path, size_t size, const char *name)
+{
+	char *runtime_dir = getenv("DLM_RUNTIME_PATH") ?: RUNTIME_PATH;
+	bool is_abstract = runtime_dir[0] == DLM_ABSTRACT_PATH_PREFIX;
+	int len;
+
+	if (is_abstract)
+		len = snprintf(path, size, SHM_PATH "/%s-%s", runtime_dir + 1,
+			       name);
+	else
+		len = snprintf(path, size, "%s/%s", runtime_dir, name);
+
+	if (len < 0 || (size_t)len >= size) {
+		errno = ENAMETOOLONG;
+		DEBUG_LOG("Runtime file path too long: %s\n", name);
+		return false;
+	}
+
+	/* Flatten the abstract name into a single file name */
+	if (is_abstract) {
+		for (char *p = path + strlen(SHM_PATH "/"); *p; p++) {
+			if (*p == '/')
+				*p = '-';
+		}
+	}
+	return true;
+}
+
+bool sockaddr_is_abstract(const struct sockaddr_un *sa)
+{
+	return sa->sun_path[0] == '\0' && sa->sun_path[1] != '\0';
+}
+
+/* Abstract socket names are not NUL terminated, so only the bytes of the
+ * name are part of the address. */
+socklen_t sockaddr_len(const struct sockaddr_un *sa)
+{
+	if (!sockaddr_is_abstract(sa))
+		return sizeof(*sa);
+
+	return offsetof(struct sockaddr_un, sun_path) + 1 +
+	       strlen(&sa->sun_path[1]);
+}
+
+/* Printable name of the socket, for log messages */
+const char *sockaddr_name(const struct sockaddr_un *sa)
+{
+	if (sockaddr_is_abstract(sa))
+		return &sa->sun_path[1];
+	return sa->sun_path;
+}
@@ -17,10 +17,29 @@
 #define SOCKET_PATH_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <sys/socket.h>
 #include <sys/un.h>
 
+/* Socket that accepts requests for any lease, named in the request */
+#define DLM_CONTROL_SOCKET_NAME "drm-lease-manager.control"
+
+/* If the runtime path starts with '@' (e.g. "@drm-lease-manager"), sockets
+ * are created in the Linux abstract socket namespace instead of the
+ * filesystem. */
+#define DLM_ABSTRACT_PATH_PREFIX '@'
+
 bool sockaddr_set_lease_server_path(struct sockaddr_un *dest,
 				    const char *lease_name);
 
+/* Path of a non-socket file shared between the lease manager and clients.
+ * When using abstract sockets, there is no runtime directory, so the file is
+ * created under /dev/shm instead. */
+bool runtime_file_path(char *path, size_t size, const char *name);
+
+bool sockaddr_is_abstract(const struct sockaddr_un *sa);
+socklen_t sockaddr_len(const struct sockaddr_un *sa);
+const char *sockaddr_name(const struct sockaddr_un *sa);
+
 #endif
@@ -0,0 +1,185 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "log.h"
+
+#define LOG_BUFFER_SIZE 16384
+
+static char log_output[LOG_BUFFER_SIZE];
+
+static FILE *capture_file;
+static int saved_fd;
+
+/* Redirect `stream` to a temporary file, so that the logged
+ * messages can be checked */
+static void start_capture(FILE *stream)
+{
+	capture_file = tmpfile();
+	ck_assert_ptr_ne(capture_file, NULL);
+
+	fflush(stream);
+	saved_fd = dup(fileno(stream));
+	ck_assert_int_ge(saved_fd, 0);
+	ck_assert_int_ge(dup2(fileno(capture_file), fileno(stream)), 0);
+}
+
+static const char *end_capture(FILE *stream)
+{
+	fflush(stream);
+	dup2(saved_fd, fileno(stream));
+	close(saved_fd);
+
+	rewind(capture_file);
+	size_t len = fread(log_output, 1, sizeof(log_output) - 1, capture_file);
+	log_output[len] = '\0';
+	fclose(capture_file);
+	return log_output;
+}
+
+static int count_lines(const char *str)
+{
+	int lines = 0;
+	for (; *str; str++)
+		if (*str == '\n')
+			lines++;
+	return lines;
+}
+
+/* async_log_ordering
+ *
+ * Test details: Log a series of messages through the async logger
+ * Expected results: All messages are written, in order, once the
+ *                   logger is stopped.
+ */
+START_TEST(async_log_ordering)
+{
+	const int nmessages = 100;
+
+	start_capture(stdout);
+	ck_assert(dlm_log_start_async(DLM_LOG_SINK_STDIO));
+
+	for (int i = 0; i < nmessages; i++)
+		INFO_LOG("message %d\n", i);
+
+	dlm_log_stop_async();
+	const char *output = end_capture(stdout);
+
+	ck_assert_int_eq(count_lines(output), nmessages);
+
+	char expected[32];
+	for (int i = 0; i < nmessages; i++) {
+		snprintf(expected, sizeof(expected), "INFO: message %d\n", i);
+		ck_assert_int_eq(strncmp(output, expected, strlen(expected)),
+				 0);
+		output += strlen(expected);
+	}
+}
+END_TEST
+
+/* log_structured_fields
+ *
+ * Test details: Log a message with lease, client and latency fields
+ * Expected results: The fields are appended to the message.
+ */
+START_TEST(log_structured_fields)
+{
+	struct dlm_log_fields fields = {
+	    .lease = "card0-HDMI-A-1",
+	    .client = 5,
+	    .latency_us = 42,
+	};
+
+	start_capture(stdout);
+	INFO_LOG_FIELDS(&fields, "Lease request granted\n");
+	const char *output = end_capture(stdout);
+
+	ck_assert_str_eq(output, "INFO: Lease request granted "
+				 "(lease=card0-HDMI-A-1 client=5 "
+				 "latency=42us)\n");
+}
+END_TEST
+
+/* repeated_errors_are_rate_limited
+ *
+ * Test details: Log the same rate limited error many times in quick
+ *               succession
+ * Expected results: Only the first few messages are written.
+ */
+START_TEST(repeated_errors_are_rate_limited)
+{
+	const int nmessages = 50;
+
+	start_capture(stderr);
+	for (int i = 0; i < nmessages; i++)
+		ERROR_LOG_RATELIMITED("repeated error %d\n", i);
+	const char *output = end_capture(stderr);
+
+	ck_assert_int_gt(count_lines(output), 0);
+	ck_assert_int_lt(count_lines(output), nmessages);
+	ck_assert_int_eq(strncmp(output, "ERROR: repeated error 0\n", 24), 0);
+}
+END_TEST
+
+/* errors_are_not_rate_limited
+ *
+ * Test details: Log the same error many times in quick succession
+ * Expected results: All messages are written.
+ */
+START_TEST(errors_are_not_rate_limited)
+{
+	const int nmessages = 50;
+
+	start_capture(stderr);
+	for (int i = 0; i < nmessages; i++)
+		ERROR_LOG("repeated error %d\n", i);
+	const char *output = end_capture(stderr);
+
+	ck_assert_int_eq(count_lines(output), nmessages);
+}
+END_TEST
+
+static void add_log_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Logging tests");
+
+	tcase_add_test(tc, async_log_ordering);
+	tcase_add_test(tc, log_structured_fields);
+	tcase_add_test(tc, repeated_errors_are_rate_limited);
+	tcase_add_test(tc, errors_are_not_rate_limited);
+	suite_add_tcase(s, tc);
+}
+
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = suite_create("DLM common library tests");
+
+	add_log_tests(s);
+
+	sr = srunner_create(s);
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -13,10 +13,13 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE
 #include "test-helpers.h"
 #include <check.h>
 
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -25,6 +28,17 @@ int get_dummy_fd(void)
 	return dup(STDIN_FILENO);
 }
 
+int get_sealed_memfd(const void *data, size_t size)
+{
+	int fd = memfd_create("test-memfd", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	ck_assert_int_ge(fd, 0);
+	ck_assert_int_eq(write(fd, data, size), size);
+	ck_assert_int_eq(fcntl(fd, F_ADD_SEALS,
+			       F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE),
+			 0);
+	return fd;
+}
+
 void check_fd_equality(int fd1, int fd2)
 {
 	struct stat s1, s2;
@@ -16,6 +16,7 @@
 #ifndef TEST_HELPERS_H
 #define TEST_HELPERS_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define UNUSED(x) (void)(x)
@@ -26,6 +27,9 @@
  * than comparing the fd value or the referenced file description. */
 int get_dummy_fd(void);
 
+/* Create a sealed memfd containing a copy of `data` */
+int get_sealed_memfd(const void *data, size_t size);
+
 void check_fd_equality(int fd1, int fd2);
 void check_fd_is_open(int fd);
 void check_fd_is_closed(int fd);
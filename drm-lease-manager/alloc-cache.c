@@ -0,0 +1,218 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include "alloc-cache.h"
+
+#include "log.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Upper limits, so that a corrupted file can't cause huge allocations */
+#define AC_MAX_OBJECTS 1024
+#define AC_MAX_TOPOLOGY_SIZE (1024 * 1024)
+
+uint64_t ac_hash(uint64_t hash, const void *data, size_t size)
+{
+	const unsigned char *p = data;
+
+	for (size_t i = 0; i < size; i++) {
+		hash ^= p[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static void *read_array(FILE *fp, size_t nmemb, size_t size)
+{
+	/* calloc(0) may return NULL, so always allocate something */
+	void *data = calloc(nmemb ? nmemb : 1, size);
+	if (!data) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	if (fread(data, size, nmemb, fp) != nmemb) {
+		free(data);
+		return NULL;
+	}
+	return data;
+}
+
+static bool read_lease(FILE *fp, struct ac_lease *lease)
+{
+	struct ac_lease_record *record = &lease->record;
+
+	if (fread(record, sizeof(*record), 1, fp) != 1)
+		return false;
+
+	if (record->nobject_ids > AC_MAX_OBJECTS ||
+	    record->topology_size > AC_MAX_TOPOLOGY_SIZE)
+		return false;
+
+	lease->object_ids =
+	    read_array(fp, record->nobject_ids, sizeof(uint32_t));
+	if (!lease->object_ids)
+		return false;
+
+	lease->topology = read_array(fp, record->topology_size, 1);
+	return lease->topology != NULL;
+}
+
+struct ac *ac_load(const char *path, uint64_t key)
+{
+	assert(path);
+
+	FILE *fp = fopen(path, "rb");
+	if (!fp) {
+		if (errno != ENOENT)
+			WARN_LOG("Cannot open allocation cache %s: %s\n", path,
+				 strerror(errno));
+		return NULL;
+	}
+
+	struct ac *ac = NULL;
+	struct ac_file_header hdr;
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    hdr.magic != AC_FILE_MAGIC || hdr.version != AC_FILE_VERSION) {
+		WARN_LOG("Ignoring invalid allocation cache %s\n", path);
+		goto out;
+	}
+
+	if (hdr.key != key) {
+		INFO_LOG("Allocation cache %s is out of date\n", path);
+		goto out;
+	}
+
+	if (hdr.nconnectors > AC_MAX_OBJECTS || hdr.nleases > AC_MAX_OBJECTS) {
+		WARN_LOG("Ignoring invalid allocation cache %s\n", path);
+		goto out;
+	}
+
+	ac = calloc(1, sizeof(struct ac));
+	if (!ac) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		goto out;
+	}
+	ac->key = hdr.key;
+
+	ac->connectors =
+	    read_array(fp, hdr.nconnectors, sizeof(struct ac_connector));
+	ac->leases = calloc(hdr.nleases ? hdr.nleases : 1,
+			    sizeof(struct ac_lease));
+	if (!ac->connectors || !ac->leases)
+		goto err;
+	ac->nconnectors = hdr.nconnectors;
+
+	for (; ac->nleases < (int)hdr.nleases; ac->nleases++) {
+		if (!read_lease(fp, &ac->leases[ac->nleases])) {
+			/* Free what has been read of the failed lease too */
+			ac->nleases++;
+			goto err;
+		}
+	}
+
+	for (int i = 0; i < ac->nconnectors; i++)
+		ac->connectors[i].name[AC_NAME_LEN - 1] = '\0';
+out:
+	fclose(fp);
+	return ac;
+err:
+	WARN_LOG("Ignoring invalid allocation cache %s\n", path);
+	ac_free(ac);
+	ac = NULL;
+	goto out;
+}
+
+static bool write_cache(FILE *fp, const struct ac *ac)
+{
+	struct ac_file_header hdr = {
+	    .magic = AC_FILE_MAGIC,
+	    .version = AC_FILE_VERSION,
+	    .key = ac->key,
+	    .nconnectors = ac->nconnectors,
+	    .nleases = ac->nleases,
+	};
+
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+		return false;
+
+	if (fwrite(ac->connectors, sizeof(struct ac_connector),
+		   ac->nconnectors, fp) != (size_t)ac->nconnectors)
+		return false;
+
+	for (int i = 0; i < ac->nleases; i++) {
+		const struct ac_lease *lease = &ac->leases[i];
+		const struct ac_lease_record *record = &lease->record;
+
+		if (fwrite(record, sizeof(*record), 1, fp) != 1 ||
+		    fwrite(lease->object_ids, sizeof(uint32_t),
+			   record->nobject_ids,
+			   fp) != record->nobject_ids ||
+		    fwrite(lease->topology, 1, record->topology_size, fp) !=
+			record->topology_size)
+			return false;
+	}
+	return true;
+}
+
+/* The cache is written to a temporary file first and renamed, so that a
+ * crash while saving can't leave a partial cache behind. */
+bool ac_save(const char *path, const struct ac *ac)
+{
+	assert(path);
+	assert(ac);
+
+	char *tmp_path;
+	if (asprintf(&tmp_path, "%s.tmp", path) < 0) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		return false;
+	}
+
+	bool ok = false;
+	FILE *fp = fopen(tmp_path, "wbe");
+	if (fp) {
+		ok = write_cache(fp, ac);
+		ok = (fclose(fp) == 0) && ok;
+		ok = ok && rename(tmp_path, path) == 0;
+		if (!ok)
+			unlink(tmp_path);
+	}
+
+	if (!ok)
+		WARN_LOG("Cannot save allocation cache %s: %s\n", path,
+			 strerror(errno));
+	free(tmp_path);
+	return ok;
+}
+
+void ac_free(struct ac *ac)
+{
+	if (!ac)
+		return;
+
+	for (int i = 0; i < ac->nleases; i++) {
+		free(ac->leases[i].object_ids);
+		free(ac->leases[i].topology);
+	}
+	free(ac->leases);
+	free(ac->connectors);
+	free(ac);
+}
@@ -0,0 +1,91 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ALLOC_CACHE_H
+#define ALLOC_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Allocation cache
+ * The result of enumerating a DRM device and assigning its objects to
+ * leases, saved so that the next start on the same device, with the same
+ * configuration, can skip both.
+ *
+ * The key identifies the device and the configuration the cache was
+ * created for.  A cache with a different key is ignored.
+ *
+ * File layout:
+ *   struct ac_file_header
+ *   struct ac_connector[nconnectors], in DRM resource order
+ *   nleases times:
+ *     struct ac_lease_record
+ *     uint32_t object_ids[nobject_ids]
+ *     the lease topology, topology_size bytes */
+
+#define AC_FILE_MAGIC 0x43414c44 /* "DLAC" */
+#define AC_FILE_VERSION 1
+#define AC_NAME_LEN 32
+
+#define AC_HASH_INIT 0xcbf29ce484222325ULL
+
+struct ac_file_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint32_t nconnectors;
+	uint32_t nleases;
+};
+
+struct ac_connector {
+	char name[AC_NAME_LEN];
+};
+
+struct ac_lease_record {
+	uint32_t config_index; /* lease configuration the lease was made for */
+	uint32_t crtc_id;
+	uint32_t connector_id;
+	uint32_t nobject_ids;
+	uint32_t topology_size;
+	uint32_t reserved;
+};
+
+struct ac_lease {
+	struct ac_lease_record record;
+	uint32_t *object_ids;
+	void *topology;
+};
+
+struct ac {
+	uint64_t key;
+
+	struct ac_connector *connectors;
+	int nconnectors;
+
+	struct ac_lease *leases;
+	int nleases;
+};
+
+/* Extend a cache key with data (64-bit FNV-1a) */
+uint64_t ac_hash(uint64_t hash, const void *data, size_t size);
+
+/* Returns NULL if there is no usable cache for the key */
+struct ac *ac_load(const char *path, uint64_t key);
+bool ac_save(const char *path, const struct ac *ac);
+
+/* Frees the cache and the object ids and topologies it points to */
+void ac_free(struct ac *ac);
+#endif
@@ -0,0 +1,394 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config-blob.h"
+
+#include "alloc-cache.h"
+#include "log.h"
+
+#include <endian.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The layout must be the same on every machine */
+_Static_assert(sizeof(struct cb_device) == 16, "cb_device is padded");
+_Static_assert(sizeof(struct cb_header) == 56, "cb_header is padded");
+_Static_assert(sizeof(struct cb_lease) == 24, "cb_lease is padded");
+_Static_assert(sizeof(struct cb_connector) == 16, "cb_connector is padded");
+
+struct cb_layout {
+	size_t leases;
+	size_t connectors;
+	size_t planes;
+	size_t strings;
+	size_t size;
+};
+
+static uint64_t cb_hash(const void *data, size_t size)
+{
+	return ac_hash(AC_HASH_INIT, data, size);
+}
+
+/* Convert between the little-endian blob and the host byte order.  The
+ * conversion is the same in both directions. */
+static void cb_swap_header(struct cb_header *hdr)
+{
+	hdr->magic = htole32(hdr->magic);
+	hdr->version = htole32(hdr->version);
+	hdr->size = htole32(hdr->size);
+	hdr->source_size = htole32(hdr->source_size);
+	hdr->source_hash = htole64(hdr->source_hash);
+	hdr->nleases = htole32(hdr->nleases);
+	hdr->nconnectors = htole32(hdr->nconnectors);
+	hdr->nplanes = htole32(hdr->nplanes);
+	hdr->strings_size = htole32(hdr->strings_size);
+	hdr->device.bus_id = htole32(hdr->device.bus_id);
+	hdr->device.driver = htole32(hdr->device.driver);
+	hdr->device.sysfs_path = htole32(hdr->device.sysfs_path);
+	hdr->device.wait_ms = htole32(hdr->device.wait_ms);
+}
+
+static void cb_swap_lease(struct cb_lease *lease)
+{
+	lease->name = htole32(lease->name);
+	lease->first_connector = htole32(lease->first_connector);
+	lease->nconnectors = htole32(lease->nconnectors);
+	lease->watchdog_timeout_ms = htole32(lease->watchdog_timeout_ms);
+	lease->watchdog_action = htole32(lease->watchdog_action);
+	lease->clone = htole32(lease->clone);
+}
+
+static void cb_swap_connector(struct cb_connector *con)
+{
+	con->name = htole32(con->name);
+	con->optional = htole32(con->optional);
+	con->first_plane = htole32(con->first_plane);
+	con->nplanes = htole32(con->nplanes);
+}
+
+static void cb_read_header(const void *blob, struct cb_header *hdr)
+{
+	memcpy(hdr, blob, sizeof(*hdr));
+	cb_swap_header(hdr);
+}
+
+static void cb_read_lease(const struct cb_lease *src, struct cb_lease *lease)
+{
+	*lease = *src;
+	cb_swap_lease(lease);
+}
+
+static void cb_read_connector(const struct cb_connector *src,
+			      struct cb_connector *con)
+{
+	*con = *src;
+	cb_swap_connector(con);
+}
+
+static void cb_get_layout(const struct cb_header *hdr,
+			  struct cb_layout *layout)
+{
+	layout->leases = sizeof(*hdr);
+	layout->connectors =
+	    layout->leases + (size_t)hdr->nleases * sizeof(struct cb_lease);
+	layout->planes = layout->connectors +
+			 (size_t)hdr->nconnectors * sizeof(struct cb_connector);
+	layout->strings =
+	    layout->planes + (size_t)hdr->nplanes * sizeof(uint32_t);
+	layout->size = layout->strings + hdr->strings_size;
+}
+
+/**************  Creating a blob  *************/
+
+struct cb_strings {
+	char *base;
+	uint32_t offset; /* of base in the blob */
+	uint32_t used;
+};
+
+static uint32_t cb_add_string(struct cb_strings *strings, const char *str)
+{
+	if (!str)
+		return 0;
+
+	uint32_t offset = strings->offset + strings->used;
+	size_t len = strlen(str) + 1;
+	memcpy(strings->base + strings->used, str, len);
+	strings->used += len;
+	return offset;
+}
+
+static size_t string_size(const char *str)
+{
+	return str ? strlen(str) + 1 : 0;
+}
+
+void *cb_create(const void *source, size_t source_size, int nleases,
+		const struct lease_config *configs,
+		const struct device_config *device, size_t *size)
+{
+	struct cb_header hdr = {
+	    .magic = CB_MAGIC,
+	    .version = CB_VERSION,
+	    .source_size = source_size,
+	    .source_hash = cb_hash(source, source_size),
+	    .nleases = nleases,
+	};
+
+	/* The string table always ends with a NUL, even when empty */
+	size_t strings_size = 1;
+	for (int i = 0; i < nleases; i++) {
+		const struct lease_config *config = &configs[i];
+
+		strings_size += string_size(config->lease_name);
+		hdr.nconnectors += config->nconnectors;
+		for (int j = 0; j < config->nconnectors; j++) {
+			struct connector_config *con = &config->connectors[j];
+			strings_size += string_size(con->name);
+			hdr.nplanes += con->nplanes;
+		}
+	}
+	if (device) {
+		strings_size += string_size(device->bus_id) +
+				string_size(device->driver) +
+				string_size(device->sysfs_path);
+	}
+	hdr.strings_size = strings_size;
+
+	struct cb_layout layout;
+	cb_get_layout(&hdr, &layout);
+	if (layout.size > UINT32_MAX) {
+		ERROR_LOG("Configuration too large\n");
+		return NULL;
+	}
+	hdr.size = layout.size;
+
+	char *blob = calloc(1, layout.size);
+	if (!blob) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	struct cb_lease *leases = (void *)(blob + layout.leases);
+	struct cb_connector *connectors = (void *)(blob + layout.connectors);
+	uint32_t *planes = (void *)(blob + layout.planes);
+	struct cb_strings strings = {
+	    .base = blob + layout.strings,
+	    .offset = layout.strings,
+	};
+
+	uint32_t nconnectors = 0, nplanes = 0;
+	for (int i = 0; i < nleases; i++) {
+		const struct lease_config *config = &configs[i];
+
+		leases[i] = (struct cb_lease){
+		    .name = cb_add_string(&strings, config->lease_name),
+		    .first_connector = nconnectors,
+		    .nconnectors = config->nconnectors,
+		    .watchdog_timeout_ms = config->watchdog.timeout_ms,
+		    .watchdog_action = config->watchdog.action,
+		    .clone = config->clone,
+		};
+		cb_swap_lease(&leases[i]);
+
+		for (int j = 0; j < config->nconnectors; j++) {
+			struct connector_config *con = &config->connectors[j];
+
+			connectors[nconnectors++] = (struct cb_connector){
+			    .name = cb_add_string(&strings, con->name),
+			    .optional = con->optional,
+			    .first_plane = nplanes,
+			    .nplanes = con->nplanes,
+			};
+			cb_swap_connector(&connectors[nconnectors - 1]);
+
+			for (int k = 0; k < con->nplanes; k++)
+				planes[nplanes++] = htole32(con->planes[k]);
+		}
+	}
+
+	if (device) {
+		hdr.device = (struct cb_device){
+		    .bus_id = cb_add_string(&strings, device->bus_id),
+		    .driver = cb_add_string(&strings, device->driver),
+		    .sysfs_path = cb_add_string(&strings, device->sysfs_path),
+		    .wait_ms = device->wait_ms,
+		};
+	}
+
+	cb_swap_header(&hdr);
+	memcpy(blob, &hdr, sizeof(hdr));
+	*size = layout.size;
+	return blob;
+}
+
+/**************  Using a blob  *************/
+
+static bool cb_string_valid(const struct cb_layout *layout, uint32_t offset)
+{
+	return offset == 0 ||
+	       (offset >= layout->strings && offset < layout->size);
+}
+
+bool cb_validate(const void *blob, size_t size, const void *source,
+		 size_t source_size)
+{
+	struct cb_header hdr;
+
+	if (size < sizeof(hdr))
+		return false;
+
+	cb_read_header(blob, &hdr);
+	if (hdr.magic != CB_MAGIC || hdr.version != CB_VERSION ||
+	    hdr.size != size)
+		return false;
+
+	if (source && (hdr.source_size != source_size ||
+		       hdr.source_hash != cb_hash(source, source_size)))
+		return false;
+
+	struct cb_layout layout;
+	cb_get_layout(&hdr, &layout);
+
+	/* A NUL at the end of the string table terminates all strings */
+	const char *bytes = blob;
+	if (layout.size != size || hdr.strings_size == 0 ||
+	    bytes[size - 1] != '\0')
+		return false;
+
+	const struct cb_lease *leases = (const void *)(bytes + layout.leases);
+	for (uint32_t i = 0; i < hdr.nleases; i++) {
+		struct cb_lease lease;
+		cb_read_lease(&leases[i], &lease);
+		if (lease.name == 0 || !cb_string_valid(&layout, lease.name) ||
+		    lease.first_connector > hdr.nconnectors ||
+		    lease.nconnectors >
+			hdr.nconnectors - lease.first_connector ||
+		    lease.watchdog_action > LEASE_WATCHDOG_FALLBACK)
+			return false;
+	}
+
+	const struct cb_connector *connectors =
+	    (const void *)(bytes + layout.connectors);
+	for (uint32_t i = 0; i < hdr.nconnectors; i++) {
+		struct cb_connector con;
+		cb_read_connector(&connectors[i], &con);
+		if (con.name == 0 || !cb_string_valid(&layout, con.name) ||
+		    con.first_plane > hdr.nplanes ||
+		    con.nplanes > hdr.nplanes - con.first_plane)
+			return false;
+	}
+
+	return cb_string_valid(&layout, hdr.device.bus_id) &&
+	       cb_string_valid(&layout, hdr.device.driver) &&
+	       cb_string_valid(&layout, hdr.device.sysfs_path);
+}
+
+static char *cb_string(const void *blob, uint32_t offset)
+{
+	return offset ? (char *)blob + offset : NULL;
+}
+
+void cb_get_counts(const void *blob, uint32_t *nleases, uint32_t *nconnectors,
+		   uint32_t *nplanes)
+{
+	struct cb_header hdr;
+	cb_read_header(blob, &hdr);
+
+	*nleases = hdr.nleases;
+	*nconnectors = hdr.nconnectors;
+	*nplanes = hdr.nplanes;
+}
+
+int cb_get_leases(const void *blob, struct lease_config *configs,
+		  struct connector_config *connectors, uint32_t *planes)
+{
+	struct cb_header hdr;
+	cb_read_header(blob, &hdr);
+
+	struct cb_layout layout;
+	cb_get_layout(&hdr, &layout);
+
+	const char *bytes = blob;
+	const struct cb_lease *leases = (const void *)(bytes + layout.leases);
+	const struct cb_connector *cb_connectors =
+	    (const void *)(bytes + layout.connectors);
+	const uint32_t *cb_planes = (const void *)(bytes + layout.planes);
+
+	for (uint32_t i = 0; i < hdr.nplanes; i++)
+		planes[i] = le32toh(cb_planes[i]);
+
+	for (uint32_t i = 0; i < hdr.nconnectors; i++) {
+		struct cb_connector con;
+		cb_read_connector(&cb_connectors[i], &con);
+		connectors[i] = (struct connector_config){
+		    .name = cb_string(blob, con.name),
+		    .optional = con.optional,
+		    .nplanes = con.nplanes,
+		    .planes = con.nplanes ? &planes[con.first_plane] : NULL,
+		};
+	}
+
+	for (uint32_t i = 0; i < hdr.nleases; i++) {
+		struct cb_lease lease;
+		cb_read_lease(&leases[i], &lease);
+		configs[i] = (struct lease_config){
+		    .lease_name = cb_string(blob, lease.name),
+		    .nconnectors = lease.nconnectors,
+		    .connectors = &connectors[lease.first_connector],
+		    .watchdog =
+			{
+			    .timeout_ms = lease.watchdog_timeout_ms,
+			    .action = lease.watchdog_action,
+			},
+		    .clone = lease.clone,
+		};
+	}
+	return hdr.nleases;
+}
+
+static bool cb_copy_string(const void *blob, uint32_t offset, char **str)
+{
+	*str = NULL;
+	if (!offset)
+		return true;
+
+	*str = strdup(cb_string(blob, offset));
+	return *str != NULL;
+}
+
+bool cb_get_device(const void *blob, struct device_config *config)
+{
+	struct cb_header hdr;
+	cb_read_header(blob, &hdr);
+
+	*config = (struct device_config){
+	    .wait_ms = hdr.device.wait_ms,
+	};
+
+	if (cb_copy_string(blob, hdr.device.bus_id, &config->bus_id) &&
+	    cb_copy_string(blob, hdr.device.driver, &config->driver) &&
+	    cb_copy_string(blob, hdr.device.sysfs_path,
+			   &config->sysfs_path))
+		return true;
+
+	DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+	free(config->bus_id);
+	free(config->driver);
+	free(config->sysfs_path);
+	*config = (struct device_config){0};
+	return false;
+}
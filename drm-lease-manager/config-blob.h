@@ -0,0 +1,110 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CONFIG_BLOB_H
+#define CONFIG_BLOB_H
+
+#include "drm-lease.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Binary configuration
+ * The lease configuration compiled from a TOML configuration file by
+ * dlm-config-compile, so that it can be loaded without parsing.  It
+ * records the size and hash of the file it was compiled from, so that it
+ * is only used while the file is unchanged.
+ *
+ * Lease and connector names are used in place, so the blob has to stay
+ * mapped while the configuration is in use.
+ *
+ * All fields are little-endian, and the structures below have no padding,
+ * so that a blob doesn't depend on the machine it was compiled on.
+ *
+ * Layout:
+ *   struct cb_header
+ *   struct cb_lease[nleases]
+ *   struct cb_connector[nconnectors]
+ *   uint32_t planes[nplanes]
+ *   NUL terminated strings, strings_size bytes
+ * Strings are referenced by their offset from the start of the blob, with
+ * offset 0 standing for no string. */
+
+#define CB_MAGIC 0x42434c44 /* "DLCB" */
+#define CB_VERSION 3
+
+struct cb_device {
+	uint32_t bus_id;
+	uint32_t driver;
+	uint32_t sysfs_path;
+	uint32_t wait_ms;
+};
+
+struct cb_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size; /* of the whole blob */
+	uint32_t source_size;
+	uint64_t source_hash;
+
+	uint32_t nleases;
+	uint32_t nconnectors;
+	uint32_t nplanes;
+	uint32_t strings_size;
+
+	struct cb_device device;
+};
+
+struct cb_lease {
+	uint32_t name;
+	uint32_t first_connector;
+	uint32_t nconnectors;
+	uint32_t watchdog_timeout_ms;
+	uint32_t watchdog_action;
+	uint32_t clone;
+};
+
+struct cb_connector {
+	uint32_t name;
+	uint32_t optional;
+	uint32_t first_plane;
+	uint32_t nplanes;
+};
+
+/* Build a blob from a parsed configuration.  device may be NULL.
+ * Returns the blob, to be freed with free(), or NULL on error. */
+void *cb_create(const void *source, size_t source_size, int nleases,
+		const struct lease_config *configs,
+		const struct device_config *device, size_t *size);
+
+/* Check that a blob is well formed, and was compiled from source.
+ * If source is NULL, only the blob itself is checked. */
+bool cb_validate(const void *blob, size_t size, const void *source,
+		 size_t source_size);
+
+/* Number of leases, connectors and planes in a valid blob */
+void cb_get_counts(const void *blob, uint32_t *nleases, uint32_t *nconnectors,
+		   uint32_t *nplanes);
+
+/* Fill in configs, connectors and planes, with as many entries as the blob
+ * has leases, connectors and planes.  Names point into the blob.  Returns
+ * the number of leases. */
+int cb_get_leases(const void *blob, struct lease_config *configs,
+		  struct connector_config *connectors, uint32_t *planes);
+
+/* Fill in a copy of the device configuration, empty if there is none */
+bool cb_get_device(const void *blob, struct device_config *config);
+#endif
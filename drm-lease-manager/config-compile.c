@@ -0,0 +1,150 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Compile a drm-lease-manager configuration file into the binary format
+ * that drm-lease-manager loads without parsing. */
+
+#define _GNU_SOURCE
+#include "lease-config.h"
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BYTES_PER_LINE 12
+
+static void usage(const char *progname)
+{
+	printf("Usage: %s [OPTIONS] <config file> [<output>]\n\n"
+	       "Options:\n"
+	       "-h, --help \tPrint this help\n"
+	       "-c, --c-source \t write C source defining the configuration, "
+	       "to be built into drm-lease-manager\n\n"
+	       "The output defaults to <config file>.bin, which "
+	       "drm-lease-manager uses in place of <config file> while "
+	       "<config file> is unchanged\n",
+	       progname);
+}
+
+static bool write_binary(FILE *fp, const unsigned char *blob, size_t size)
+{
+	return fwrite(blob, 1, size, fp) == size;
+}
+
+static bool write_c_source(FILE *fp, const unsigned char *blob, size_t size)
+{
+	fprintf(fp, "/* Generated by dlm-config-compile. Do not edit. */\n\n"
+		    "#include <stddef.h>\n\n"
+		    "const unsigned char dlm_embedded_config[] "
+		    "__attribute__((aligned(8))) = {");
+
+	for (size_t i = 0; i < size; i++) {
+		if (i % BYTES_PER_LINE == 0)
+			fprintf(fp, "\n   ");
+		fprintf(fp, " 0x%02x,", blob[i]);
+	}
+
+	fprintf(fp, "\n};\n\nconst size_t dlm_embedded_config_size = %zu;\n",
+		size);
+	return !ferror(fp);
+}
+
+const char *opts = "hc";
+const struct option options[] = {
+    {"help", no_argument, NULL, 'h'},
+    {"c-source", no_argument, NULL, 'c'},
+    {NULL, 0, NULL, 0},
+};
+
+int main(int argc, char **argv)
+{
+	bool c_source = false;
+
+	int c;
+	while ((c = getopt_long(argc, argv, opts, options, NULL)) != -1) {
+		int ret = EXIT_FAILURE;
+		switch (c) {
+		case 'c':
+			c_source = true;
+			break;
+		case 'h':
+			ret = EXIT_SUCCESS;
+			/* fall through */
+		default:
+			usage(argv[0]);
+			return ret;
+		}
+	}
+
+	if (optind >= argc) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const char *config_file = argv[optind];
+	char *output = NULL;
+	if (optind + 1 < argc)
+		output = strdup(argv[optind + 1]);
+	else if (asprintf(&output, "%s.bin", config_file) < 0)
+		output = NULL;
+
+	if (!output) {
+		perror("output file name");
+		return EXIT_FAILURE;
+	}
+
+	size_t size;
+	unsigned char *blob = compile_config(config_file, &size);
+	if (!blob) {
+		fprintf(stderr, "%s: cannot compile configuration\n",
+			config_file);
+		free(output);
+		return EXIT_FAILURE;
+	}
+
+	/* The lease manager may be loading the output while it is written,
+	 * so replace it in one step */
+	int ret = EXIT_FAILURE;
+	char *tmp_output = NULL;
+	if (asprintf(&tmp_output, "%s.tmp", output) < 0) {
+		tmp_output = NULL;
+		perror("output file name");
+		goto out;
+	}
+
+	FILE *fp = fopen(tmp_output, "w");
+	if (!fp) {
+		perror(tmp_output);
+		goto out;
+	}
+
+	bool ok = c_source ? write_c_source(fp, blob, size)
+			   : write_binary(fp, blob, size);
+	ok = (fclose(fp) == 0) && ok;
+	if (ok && rename(tmp_output, output) == 0) {
+		ret = EXIT_SUCCESS;
+	} else {
+		fprintf(stderr, "%s: write failed\n", output);
+		unlink(tmp_output);
+	}
+out:
+	free(tmp_output);
+	free(blob);
+	free(output);
+	return ret;
+}
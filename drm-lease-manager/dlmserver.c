@@ -0,0 +1,541 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dlmserver.h"
+#include "flight-recorder.h"
+#include "frame-monitor.h"
+#include "lease-config.h"
+#include "lease-manager.h"
+#include "lease-server.h"
+#include "log.h"
+#include "request-trace.h"
+#include "status-page.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/* The lease manager and lease server are not thread safe, so every entry
+ * point takes the server lock.  It is recursive, so that the event handler
+ * can call back into the server. */
+struct dlm_server {
+	pthread_mutex_t lock;
+	int stop_fd;
+
+	uint32_t flags;
+	dlm_server_event_handler event_handler;
+	void *event_data;
+
+	int num_configs;
+	struct lease_config *lease_configs;
+	struct device_config device_config;
+
+	struct lease_handle **lease_handles;
+	int nleases;
+
+	struct lm *lm;
+	struct ls *ls;
+	struct sp *sp;
+	struct fm *fm;
+	struct tr *tr;
+};
+
+/* Events are delivered once a request has been handled completely, so that
+ * the handler sees a consistent state.  A request changes the owner of at
+ * most one lease, revoking it from one client and granting it to another. */
+struct request_events {
+	struct dlm_server_event events[2];
+	int count;
+};
+
+static void add_event(struct request_events *re,
+		      enum dlm_server_event_type type,
+		      struct lease_handle *lease_handle, uint32_t lessee_id,
+		      pid_t client_pid)
+{
+	/* Nothing happened if the lease wasn't granted */
+	if (!lessee_id)
+		return;
+
+	assert(re->count < (int)(sizeof(re->events) / sizeof(re->events[0])));
+	re->events[re->count++] = (struct dlm_server_event){
+	    .type = type,
+	    .lease_name = lease_handle->name,
+	    .lessee_id = lessee_id,
+	    .client_pid = client_pid,
+	};
+}
+
+static void emit_events(struct dlm_server *server, struct request_events *re)
+{
+	if (!server->event_handler)
+		return;
+
+	for (int i = 0; i < re->count; i++)
+		server->event_handler(server, &re->events[i],
+				      server->event_data);
+}
+
+static pid_t owner_pid(struct lease_handle *lease_handle)
+{
+	struct ls_client *owner = lease_handle->user_data;
+	return owner ? ls_client_pid(owner) : 0;
+}
+
+static void publish_status(struct dlm_server *server,
+			   struct lease_handle *lease_handle)
+{
+	uint32_t lessee_id = lm_lease_lessee_id(lease_handle);
+
+	if (server->fm)
+		fm_update(server->fm, lease_handle, lessee_id);
+
+	if (server->sp)
+		sp_update(server->sp, lease_handle, lessee_id,
+			  owner_pid(lease_handle));
+}
+
+static bool has_watchdog(struct lease_handle **lease_handles, int count)
+{
+	for (int i = 0; i < count; i++) {
+		if (lm_lease_watchdog(lease_handles[i])->timeout_ms)
+			return true;
+	}
+	return false;
+}
+
+/* Take a lease away from its owner on behalf of the lease manager.
+ * The action decides what happens to the screen content and to clients
+ * that have yielded the lease. */
+static void revoke_owner(struct dlm_server *server,
+			 struct lease_handle *lease_handle,
+			 enum lease_watchdog_action action,
+			 struct request_events *re)
+{
+	struct ls_client *owner = lease_handle->user_data;
+
+	add_event(re, DLM_SERVER_LEASE_REVOKED, lease_handle,
+		  lm_lease_lessee_id(lease_handle), owner_pid(lease_handle));
+
+	if (server->tr)
+		tr_begin(server->tr, LS_REQ_EVENT, lease_handle,
+			 owner ? ls_client_id(owner) : 0);
+	if (owner)
+		ls_revoke_client(server->ls, owner);
+	lease_handle->user_data = NULL;
+	lm_lease_revoke(server->lm, lease_handle);
+
+	/* The fallback framebuffer has to be on screen before the
+	 * client's framebuffers are released by closing the lease */
+	if (action == LEASE_WATCHDOG_FALLBACK)
+		lm_lease_show_fallback(server->lm, lease_handle);
+	lm_lease_close(lease_handle);
+
+	if (action == LEASE_WATCHDOG_STANDBY)
+		ls_offer_lease(server->ls, lease_handle);
+
+	if (server->tr)
+		tr_end(server->tr, TR_RESULT_REVOKED);
+
+	publish_status(server, lease_handle);
+}
+
+/* Remove lease owners that have stopped presenting frames, and apply the
+ * lease's watchdog policy. */
+static void handle_stalled_leases(struct dlm_server *server)
+{
+	struct lease_handle *lease_handle;
+	uint32_t lessee_id;
+
+	while ((lease_handle = fm_get_stalled_lease(server->fm, &lessee_id))) {
+		/* The lease may have changed hands since it was reported */
+		if (lm_lease_lessee_id(lease_handle) != lessee_id)
+			continue;
+
+		const struct lease_watchdog *watchdog =
+		    lm_lease_watchdog(lease_handle);
+		TRACE_EVENT(watchdog, FR_EVENT_WATCHDOG, lease_handle->name,
+			    watchdog->action);
+		ERROR_LOG_RATELIMITED(
+		    "Client stopped presenting frames: lease=%s\n",
+		    lease_handle->name);
+
+		struct request_events re = {0};
+		revoke_owner(server, lease_handle, watchdog->action, &re);
+		emit_events(server, &re);
+	}
+}
+
+static enum tr_result handle_get_lease(struct dlm_server *server,
+				       struct ls_req *req,
+				       struct request_events *re)
+{
+	struct ls *ls = server->ls;
+	struct lm *lm = server->lm;
+	uint32_t previous_lessee_id = lm_lease_lessee_id(req->lease_handle);
+	enum tr_result result = TR_RESULT_GRANTED;
+
+	int fd = lm_lease_grant(lm, req->lease_handle);
+
+	if (fd < 0 && (server->flags & DLM_SERVER_LEASE_TRANSFER)) {
+		fd = lm_lease_transfer(lm, req->lease_handle);
+		result = TR_RESULT_TRANSFERRED;
+	}
+
+	if (fd < 0) {
+		ERROR_LOG_RATELIMITED("Can't fulfill lease request: lease=%s\n",
+				      req->lease_handle->name);
+		ls_disconnect_client(ls, req->client);
+		return TR_RESULT_FAILED;
+	}
+
+	struct ls_client *active_client = req->lease_handle->user_data;
+	if (active_client && active_client != req->client) {
+		add_event(re, DLM_SERVER_LEASE_REVOKED, req->lease_handle,
+			  previous_lessee_id, ls_client_pid(active_client));
+		ls_revoke_client(ls, active_client);
+	}
+
+	req->lease_handle->user_data = req->client;
+
+	int topology_fd = lm_lease_topology_fd(req->lease_handle);
+	if (!ls_send_fd(ls, req->client, fd, topology_fd)) {
+		ERROR_LOG_RATELIMITED("Client communication error: lease=%s\n",
+				      req->lease_handle->name);
+		ls_disconnect_client(ls, req->client);
+		/* The client slot can be reused by any new connection */
+		req->lease_handle->user_data = NULL;
+		lm_lease_revoke(lm, req->lease_handle);
+		return TR_RESULT_UNDELIVERED;
+	}
+
+	add_event(re, DLM_SERVER_LEASE_GRANTED, req->lease_handle,
+		  lm_lease_lessee_id(req->lease_handle),
+		  ls_client_pid(req->client));
+	return result;
+}
+
+static bool handle_request(struct dlm_server *server, struct ls_req *req)
+{
+	struct lease_handle *lease_handle = req->lease_handle;
+	struct request_events re = {0};
+	enum tr_result result = TR_RESULT_NONE;
+
+	if (req->type == LS_REQ_EVENT) {
+		/* Recorded and published for each stalled lease */
+		handle_stalled_leases(server);
+		return true;
+	}
+
+	if (server->tr)
+		tr_begin(server->tr, req->type, lease_handle,
+			 ls_client_id(req->client));
+
+	switch (req->type) {
+	case LS_REQ_GET_LEASE:
+		result = handle_get_lease(server, req, &re);
+		break;
+	case LS_REQ_YIELD_LEASE:
+		/* The client keeps its connection, so that it can
+		 * request the lease again without reconnecting */
+		if (lease_handle->user_data != req->client) {
+			result = TR_RESULT_IGNORED;
+			break;
+		}
+
+		add_event(&re, DLM_SERVER_LEASE_REVOKED, lease_handle,
+			  lm_lease_lessee_id(lease_handle),
+			  ls_client_pid(req->client));
+		lease_handle->user_data = NULL;
+		lm_lease_revoke(server->lm, lease_handle);
+		lm_lease_close(lease_handle);
+		result = TR_RESULT_REVOKED;
+		break;
+	case LS_REQ_RELEASE_LEASE:
+	case LS_REQ_CLIENT_DISCONNECT:
+		add_event(&re, DLM_SERVER_LEASE_REVOKED, lease_handle,
+			  lm_lease_lessee_id(lease_handle),
+			  ls_client_pid(req->client));
+		ls_disconnect_client(server->ls, req->client);
+		lease_handle->user_data = NULL;
+		lm_lease_revoke(server->lm, lease_handle);
+
+		if (!(server->flags & DLM_SERVER_KEEP_ON_CRASH) ||
+		    req->type == LS_REQ_RELEASE_LEASE)
+			lm_lease_close(lease_handle);
+
+		result = TR_RESULT_REVOKED;
+		break;
+	default:
+		ERROR_LOG("Internal error: Invalid lease request\n");
+		return false;
+	}
+
+	if (server->tr)
+		tr_end(server->tr, result);
+	publish_status(server, lease_handle);
+	emit_events(server, &re);
+	return true;
+}
+
+static bool init_lock(pthread_mutex_t *lock)
+{
+	pthread_mutexattr_t attr;
+
+	if (pthread_mutexattr_init(&attr))
+		return false;
+
+	bool ok = !pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) &&
+		  !pthread_mutex_init(lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	return ok;
+}
+
+struct dlm_server *dlm_server_create(const struct dlm_server_options *options)
+{
+	assert(options);
+
+	struct dlm_server *server = calloc(1, sizeof(struct dlm_server));
+	if (!server) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	if (!init_lock(&server->lock)) {
+		DEBUG_LOG("Mutex initialization failed\n");
+		free(server);
+		return NULL;
+	}
+
+	server->flags = options->flags;
+	server->event_handler = options->event_handler;
+	server->event_data = options->event_data;
+
+	server->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (server->stop_fd < 0) {
+		DEBUG_LOG("eventfd failed: %s\n", strerror(errno));
+		goto err;
+	}
+
+	if (options->config_file) {
+		if (!parse_device_config(options->config_file,
+					 &server->device_config))
+			goto err;
+		server->num_configs = parse_config(options->config_file,
+						   &server->lease_configs);
+	}
+
+	server->lm = lm_create_with_device_config(
+	    options->device, &server->device_config, options->cache_file,
+	    server->num_configs, server->lease_configs);
+	if (!server->lm) {
+		ERROR_LOG("DRM Lease initialization failed\n");
+		goto err;
+	}
+
+	server->nleases = lm_get_lease_handles(server->lm,
+					       &server->lease_handles);
+	assert(server->nleases > 0);
+
+	server->ls = ls_create_with_flags(
+	    server->lease_handles, server->nleases,
+	    (server->flags & DLM_SERVER_CONTROL_ONLY) ? LS_CONTROL_ONLY : 0);
+	if (!server->ls) {
+		ERROR_LOG("Client socket initialization failed\n");
+		goto err;
+	}
+
+	if (!ls_allow_peers(server->ls, options->allowed_uids,
+			    options->nallowed_uids, options->allowed_gids,
+			    options->nallowed_gids))
+		goto err;
+
+	/* Monitoring is optional, leases can still be handed out without it */
+	server->sp = sp_create(server->lease_handles, server->nleases);
+	if (!server->sp)
+		WARN_LOG("Lease status page unavailable\n");
+
+	/* The frame monitor also runs the lease watchdogs */
+	if ((server->flags & DLM_SERVER_FRAME_MONITOR) ||
+	    has_watchdog(server->lease_handles, server->nleases)) {
+		server->fm = fm_create(server->lm, server->lease_handles,
+				       server->nleases, server->sp);
+		if (!server->fm)
+			WARN_LOG("Frame monitor unavailable\n");
+	}
+
+	if (server->fm &&
+	    !ls_add_event_fd(server->ls, fm_get_event_fd(server->fm)))
+		WARN_LOG("Lease watchdogs unavailable\n");
+
+	if (options->trace_file) {
+		uint32_t flags = 0;
+		if (server->flags & DLM_SERVER_LEASE_TRANSFER)
+			flags |= TR_FLAG_LEASE_TRANSFER;
+		if (server->flags & DLM_SERVER_KEEP_ON_CRASH)
+			flags |= TR_FLAG_KEEP_ON_CRASH;
+
+		server->tr = tr_create(options->trace_file, flags);
+		if (!server->tr)
+			WARN_LOG("Request trace unavailable\n");
+	}
+
+	return server;
+err:
+	dlm_server_destroy(server);
+	return NULL;
+}
+
+void dlm_server_destroy(struct dlm_server *server)
+{
+	if (!server)
+		return;
+
+	if (server->tr)
+		tr_destroy(server->tr);
+	if (server->fm)
+		fm_destroy(server->fm);
+	if (server->sp)
+		sp_destroy(server->sp);
+	if (server->ls)
+		ls_destroy(server->ls);
+	if (server->lm)
+		lm_destroy(server->lm);
+	release_config(server->num_configs, server->lease_configs);
+	release_device_config(&server->device_config);
+
+	if (server->stop_fd >= 0)
+		close(server->stop_fd);
+	pthread_mutex_destroy(&server->lock);
+	free(server);
+}
+
+int dlm_server_event_fd(struct dlm_server *server)
+{
+	assert(server);
+	return ls_get_fd(server->ls);
+}
+
+int dlm_server_dispatch(struct dlm_server *server)
+{
+	assert(server);
+
+	struct ls_req req;
+	int ret;
+
+	pthread_mutex_lock(&server->lock);
+	while ((ret = ls_wait_request(server->ls, &req, 0)) > 0) {
+		if (!handle_request(server, &req)) {
+			errno = EPROTO;
+			ret = -1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&server->lock);
+	return ret;
+}
+
+int dlm_server_run(struct dlm_server *server)
+{
+	assert(server);
+
+	struct pollfd fds[] = {
+	    {.fd = dlm_server_event_fd(server), .events = POLLIN},
+	    {.fd = server->stop_fd, .events = POLLIN},
+	};
+
+	for (;;) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			DEBUG_LOG("poll failed: %s\n", strerror(errno));
+			return -1;
+		}
+
+		if (fds[1].revents & POLLIN) {
+			eventfd_t count;
+			eventfd_read(server->stop_fd, &count);
+			return 0;
+		}
+
+		if (dlm_server_dispatch(server) < 0)
+			return -1;
+	}
+}
+
+void dlm_server_stop(struct dlm_server *server)
+{
+	assert(server);
+	eventfd_write(server->stop_fd, 1);
+}
+
+int dlm_server_drm_fd(struct dlm_server *server)
+{
+	assert(server);
+	return lm_get_drm_fd(server->lm);
+}
+
+int dlm_server_lease_count(struct dlm_server *server)
+{
+	assert(server);
+	return server->nleases;
+}
+
+const char *dlm_server_lease_name(struct dlm_server *server, int index)
+{
+	assert(server);
+
+	if (index < 0 || index >= server->nleases)
+		return NULL;
+	return server->lease_handles[index]->name;
+}
+
+int dlm_server_revoke_lease(struct dlm_server *server, const char *name)
+{
+	assert(server);
+	assert(name);
+
+	struct lease_handle *lease_handle = NULL;
+	for (int i = 0; i < server->nleases; i++) {
+		if (!strcmp(server->lease_handles[i]->name, name))
+			lease_handle = server->lease_handles[i];
+	}
+
+	if (!lease_handle) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	pthread_mutex_lock(&server->lock);
+
+	int ret = 0;
+	if (!lm_lease_lessee_id(lease_handle)) {
+		errno = EINVAL;
+		ret = -1;
+	} else {
+		struct request_events re = {0};
+		INFO_LOG("Revoking lease %s\n", lease_handle->name);
+		revoke_owner(server, lease_handle, LEASE_WATCHDOG_REVOKE, &re);
+		emit_events(server, &re);
+	}
+
+	pthread_mutex_unlock(&server->lock);
+	return ret;
+}
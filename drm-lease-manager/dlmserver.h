@@ -0,0 +1,231 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file dlmserver.h
+ */
+#ifndef DLM_SERVER_H
+#define DLM_SERVER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* The library is built with hidden symbol visibility, so only the functions
+ * declared here are exported */
+#define DLM_SERVER_EXPORT __attribute__((visibility("default")))
+
+/**
+ * @brief lease manager handle
+ *
+ * @details A lease manager running inside the calling process, serving the
+ *          same clients as the drm-lease-manager daemon.
+ *
+ *          All functions taking a server handle may be called from any
+ *          thread, including from the event handler.  Requests are handled
+ *          by whichever thread calls dlm_server_dispatch() or
+ *          dlm_server_run().
+ */
+struct dlm_server;
+
+/**
+ * @brief Hand a lease that is in use over to a new client (server flag)
+ */
+#define DLM_SERVER_LEASE_TRANSFER (1 << 0)
+
+/**
+ * @brief Don't close a lease when its client crashes (server flag)
+ */
+#define DLM_SERVER_KEEP_ON_CRASH (1 << 1)
+
+/**
+ * @brief Collect frame pacing statistics of leased outputs (server flag)
+ *
+ * @details See dlm_server_drm_fd() for the restrictions on the DRM fd while
+ *          frames are monitored.
+ */
+#define DLM_SERVER_FRAME_MONITOR (1 << 2)
+
+/**
+ * @brief Only accept lease requests on the control socket (server flag)
+ *
+ * @details No per-lease sockets or lock files are created, which saves two
+ *          file descriptors per lease.  Clients using libdlmclient fall back
+ *          to the control socket on their own.
+ */
+#define DLM_SERVER_CONTROL_ONLY (1 << 3)
+
+/**
+ * @brief Type of a lease event
+ */
+enum dlm_server_event_type {
+	DLM_SERVER_LEASE_GRANTED, /**< a client has been given the lease */
+	DLM_SERVER_LEASE_REVOKED, /**< the lease has been taken back */
+};
+
+/**
+ * @brief Lease event
+ */
+struct dlm_server_event {
+	enum dlm_server_event_type type; /**< event type */
+	const char *lease_name;		 /**< lease name */
+	uint32_t lessee_id;		 /**< DRM lessee id of the lease */
+	pid_t client_pid; /**< pid of the lease owner, or 0 if unknown */
+};
+
+/**
+ * @brief Lease event callback
+ *
+ * @details Called with the server locked, from the thread handling the
+ *          request.  Other threads calling into the server wait until the
+ *          callback returns.
+ */
+typedef void (*dlm_server_event_handler)(struct dlm_server *server,
+					 const struct dlm_server_event *event,
+					 void *data);
+
+/**
+ * @brief Lease manager settings
+ */
+struct dlm_server_options {
+	const char *device;	 /**< DRM device, or NULL for the default */
+	const char *config_file; /**< lease configuration, or NULL for one
+				      lease per connector */
+	const char *trace_file;	 /**< request trace output, or NULL */
+	const char *cache_file;	 /**< lease allocation cache, or NULL */
+	uint32_t flags;		 /**< DLM_SERVER_* flags */
+	const uid_t *allowed_uids; /**< users that may connect to abstract
+					sockets, besides root and the user
+					running the server */
+	int nallowed_uids;	   /**< number of allowed_uids */
+	const gid_t *allowed_gids; /**< primary groups of clients that may
+					connect to abstract sockets */
+	int nallowed_gids;	   /**< number of allowed_gids */
+	dlm_server_event_handler event_handler; /**< event callback, or NULL */
+	void *event_data; /**< passed to the event callback */
+};
+
+/**
+ * @brief Start a lease manager
+ *
+ * @details Opens the DRM device, sets up the leases and starts listening for
+ *          lease requests.  Only one lease manager can use a DRM device and
+ *          runtime directory at a time.
+ * @param[in] options lease manager settings
+ * @return A pointer to a server handle on success, or NULL on error.
+ *         The cause of the error is logged.
+ */
+DLM_SERVER_EXPORT struct dlm_server *
+dlm_server_create(const struct dlm_server_options *options);
+
+/**
+ * @brief Stop a lease manager
+ *
+ * @details All leases are revoked and all clients are disconnected.
+ *          No other thread may use the handle during or after this call.
+ * @param[in] server pointer to server handle
+ */
+DLM_SERVER_EXPORT void dlm_server_destroy(struct dlm_server *server);
+
+/**
+ * @brief Get a pollable fd for lease requests
+ *
+ * @details The fd becomes readable when there are requests to handle with
+ *          dlm_server_dispatch().
+ * @param[in] server pointer to server handle
+ * @return fd to poll for POLLIN.
+ */
+DLM_SERVER_EXPORT int dlm_server_event_fd(struct dlm_server *server);
+
+/**
+ * @brief Handle pending lease requests
+ *
+ * @details Does not block waiting for new requests.
+ * @param[in] server pointer to server handle
+ * @return 0 on success, or -1 on error, with errno set.
+ */
+DLM_SERVER_EXPORT int dlm_server_dispatch(struct dlm_server *server);
+
+/**
+ * @brief Handle lease requests until dlm_server_stop() is called
+ *
+ * @param[in] server pointer to server handle
+ * @return 0 when stopped, or -1 on error, with errno set.
+ */
+DLM_SERVER_EXPORT int dlm_server_run(struct dlm_server *server);
+
+/**
+ * @brief Make dlm_server_run() return
+ *
+ * @param[in] server pointer to server handle
+ */
+DLM_SERVER_EXPORT void dlm_server_stop(struct dlm_server *server);
+
+/**
+ * @brief Get the DRM master fd of the lease manager
+ *
+ * @details The fd can be used to drive the outputs that are not leased.
+ *          It is owned by the server and must not be closed.
+ *
+ *          While the frame monitor is running (with DLM_SERVER_FRAME_MONITOR,
+ *          or a lease watchdog in the configuration), the monitor thread
+ *          reads the DRM events on this fd.  Only use requests that don't
+ *          deliver events, such as drmModeSetCrtc(), not page flips or
+ *          vblank events.
+ * @param[in] server pointer to server handle
+ * @return DRM master fd.
+ */
+DLM_SERVER_EXPORT int dlm_server_drm_fd(struct dlm_server *server);
+
+/**
+ * @brief Get the number of leases
+ *
+ * @param[in] server pointer to server handle
+ * @return Number of leases.
+ */
+DLM_SERVER_EXPORT int dlm_server_lease_count(struct dlm_server *server);
+
+/**
+ * @brief Get the name of a lease
+ *
+ * @details The name is valid for the lifetime of the server.
+ * @param[in] server pointer to server handle
+ * @param[in] index lease index, from 0 to dlm_server_lease_count() - 1
+ * @return Lease name, or NULL if the index is out of range.
+ */
+DLM_SERVER_EXPORT const char *dlm_server_lease_name(struct dlm_server *server,
+						    int index);
+
+/**
+ * @brief Take a lease back from its client
+ *
+ * @details The client is notified that the lease has been revoked.
+ * @param[in] server pointer to server handle
+ * @param[in] name lease name
+ * @return 0 on success, or -1 on error, with errno set.
+ *         ENOENT means there is no such lease, EINVAL that the lease is not
+ *         granted.
+ */
+DLM_SERVER_EXPORT int dlm_server_revoke_lease(struct dlm_server *server,
+					      const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
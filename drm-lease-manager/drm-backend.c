@@ -0,0 +1,84 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "drm-backend.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int libdrm_open(const char *device)
+{
+	return open(device, O_RDWR);
+}
+
+static void libdrm_close(int fd)
+{
+	close(fd);
+}
+
+static bool libdrm_get_device_id(int fd, dev_t *id)
+{
+	struct stat st;
+	if (fstat(fd, &st) < 0 || !S_ISCHR(st.st_mode))
+		return false;
+
+	*id = st.st_rdev;
+	return true;
+}
+
+const struct drm_backend drm_backend_libdrm = {
+    .name = "libdrm",
+    .open = libdrm_open,
+    .close = libdrm_close,
+    .get_device_id = libdrm_get_device_id,
+    .set_client_cap = drmSetClientCap,
+    .get_resources = drmModeGetResources,
+    .free_resources = drmModeFreeResources,
+    .get_plane_resources = drmModeGetPlaneResources,
+    .free_plane_resources = drmModeFreePlaneResources,
+    .get_connector = drmModeGetConnector,
+    .free_connector = drmModeFreeConnector,
+    .get_encoder = drmModeGetEncoder,
+    .free_encoder = drmModeFreeEncoder,
+    .get_plane = drmModeGetPlane,
+    .free_plane = drmModeFreePlane,
+    .get_crtc = drmModeGetCrtc,
+    .free_crtc = drmModeFreeCrtc,
+    .object_get_properties = drmModeObjectGetProperties,
+    .free_object_properties = drmModeFreeObjectProperties,
+    .get_property = drmModeGetProperty,
+    .free_property = drmModeFreeProperty,
+    .create_lease = drmModeCreateLease,
+    .revoke_lease = drmModeRevokeLease,
+    .ioctl = drmIoctl,
+    .add_fb = drmModeAddFB,
+    .rm_fb = drmModeRmFB,
+    .set_crtc = drmModeSetCrtc,
+    .crtc_queue_sequence = drmCrtcQueueSequence,
+    .handle_event = drmHandleEvent,
+};
+
+const struct drm_backend *drm_backend_for_device(const char *device)
+{
+	size_t len = strlen(DRM_BACKEND_VIRTUAL_PREFIX);
+
+	if (device && !strncmp(device, DRM_BACKEND_VIRTUAL_PREFIX, len) &&
+	    (device[len] == '\0' || device[len] == ':'))
+		return &drm_backend_virtual;
+
+	return &drm_backend_libdrm;
+}
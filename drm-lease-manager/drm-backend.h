@@ -0,0 +1,94 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DRM_BACKEND_H
+#define DRM_BACKEND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+/* DRM backend
+ * The DRM device operations used by the lease manager.  Apart from open(),
+ * close() and get_device_id(), each one has the same arguments and return
+ * value as the libdrm function of the same name, so that the libdrm
+ * backend is a plain table of libdrm functions.
+ *
+ * Objects returned by a backend must be freed by the same backend. */
+struct drm_backend {
+	const char *name;
+
+	int (*open)(const char *device);
+	void (*close)(int fd);
+	/* Device number, used to name the default leases */
+	bool (*get_device_id)(int fd, dev_t *id);
+
+	int (*set_client_cap)(int fd, uint64_t capability, uint64_t value);
+
+	drmModeResPtr (*get_resources)(int fd);
+	void (*free_resources)(drmModeResPtr res);
+	drmModePlaneResPtr (*get_plane_resources)(int fd);
+	void (*free_plane_resources)(drmModePlaneResPtr res);
+
+	drmModeConnectorPtr (*get_connector)(int fd, uint32_t id);
+	void (*free_connector)(drmModeConnectorPtr connector);
+	drmModeEncoderPtr (*get_encoder)(int fd, uint32_t id);
+	void (*free_encoder)(drmModeEncoderPtr encoder);
+	drmModePlanePtr (*get_plane)(int fd, uint32_t id);
+	void (*free_plane)(drmModePlanePtr plane);
+	drmModeCrtcPtr (*get_crtc)(int fd, uint32_t id);
+	void (*free_crtc)(drmModeCrtcPtr crtc);
+
+	drmModeObjectPropertiesPtr (*object_get_properties)(int fd,
+							    uint32_t id,
+							    uint32_t type);
+	void (*free_object_properties)(drmModeObjectPropertiesPtr props);
+	drmModePropertyPtr (*get_property)(int fd, uint32_t id);
+	void (*free_property)(drmModePropertyPtr prop);
+
+	int (*create_lease)(int fd, const uint32_t *objects, int num_objects,
+			    int flags, uint32_t *lessee_id);
+	int (*revoke_lease)(int fd, uint32_t lessee_id);
+
+	int (*ioctl)(int fd, unsigned long request, void *arg);
+	int (*add_fb)(int fd, uint32_t width, uint32_t height, uint8_t depth,
+		      uint8_t bpp, uint32_t pitch, uint32_t bo_handle,
+		      uint32_t *buf_id);
+	int (*rm_fb)(int fd, uint32_t buffer_id);
+	int (*set_crtc)(int fd, uint32_t crtc_id, uint32_t buffer_id,
+			uint32_t x, uint32_t y, uint32_t *connectors,
+			int count, drmModeModeInfoPtr mode);
+
+	int (*crtc_queue_sequence)(int fd, uint32_t crtc_id, uint32_t flags,
+				   uint64_t sequence, uint64_t *sequence_queued,
+				   uint64_t user_data);
+	int (*handle_event)(int fd, drmEventContextPtr evctx);
+};
+
+extern const struct drm_backend drm_backend_libdrm;
+
+/* In-process virtual display device, for testing and benchmarking without
+ * a GPU.  Selected with a device name of the form
+ *   virtual[:<outputs>|:<topology file>]
+ * The topology file format is the one written by dlm-topology-dump. */
+extern const struct drm_backend drm_backend_virtual;
+
+#define DRM_BACKEND_VIRTUAL_PREFIX "virtual"
+
+/* Backend that handles the given device name */
+const struct drm_backend *drm_backend_for_device(const char *device);
+#endif
@@ -30,6 +30,28 @@ struct connector_config {
 	uint32_t *planes;
 };
 
+/* Action taken when the owner of a lease stops presenting new frames */
+enum lease_watchdog_action {
+	LEASE_WATCHDOG_REVOKE,   /* Revoke the lease */
+	LEASE_WATCHDOG_STANDBY,  /* Revoke, and offer it to a standby client */
+	LEASE_WATCHDOG_FALLBACK, /* Revoke, and show a fallback framebuffer */
+};
+
+struct lease_watchdog {
+	uint32_t timeout_ms; /* 0 disables the watchdog */
+	enum lease_watchdog_action action;
+};
+
+/* Selects the DRM device to use when none is given explicitly.
+ * Devices are matched on the information available without opening them,
+ * and NULL fields match any device. */
+struct device_config {
+	char *bus_id;	  /* e.g. "pci:0000:00:02.0" */
+	char *driver;	  /* kernel driver name, e.g. "i915" */
+	char *sysfs_path; /* device directory in sysfs */
+	uint32_t wait_ms; /* time to wait for a matching device to appear */
+};
+
 struct lease_config {
 	char *lease_name;
 
@@ -38,6 +60,11 @@ struct lease_config {
 
 	int nconnectors;
 	struct connector_config *connectors;
+
+	struct lease_watchdog watchdog;
+
+	/* Drive the connectors from one CRTC where the encoders allow it */
+	bool clone;
 };
 
 #endif
@@ -0,0 +1,70 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Print a flight recorder dump written by drm-lease-manager */
+
+#include "flight-recorder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+int main(int argc, char **argv)
+{
+	if (argc != 2) {
+		printf("Usage: %s <flight recorder dump>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	FILE *f = fopen(argv[1], "rb");
+	if (!f) {
+		perror(argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	struct fr_dump_header hdr;
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    hdr.magic != FR_DUMP_MAGIC || hdr.version != FR_DUMP_VERSION ||
+	    hdr.nevents > FR_MAX_EVENTS) {
+		fprintf(stderr, "%s: not a flight recorder dump\n", argv[1]);
+		fclose(f);
+		return EXIT_FAILURE;
+	}
+
+	int64_t offset_ns = hdr.realtime_ns - hdr.monotonic_ns;
+
+	struct fr_event_record rec;
+	for (uint32_t i = 0; i < hdr.nevents; i++) {
+		if (fread(&rec, sizeof(rec), 1, f) != 1) {
+			fprintf(stderr, "%s: truncated dump\n", argv[1]);
+			break;
+		}
+
+		uint64_t ns = rec.timestamp_ns + offset_ns;
+		time_t sec = ns / 1000000000;
+		struct tm tm;
+		char date[32];
+		strftime(date, sizeof(date), "%F %T", localtime_r(&sec, &tm));
+
+		rec.lease[sizeof(rec.lease) - 1] = '\0';
+		printf("%s.%06llu %-18s %-24s %d\n", date,
+		       (unsigned long long)(ns % 1000000000) / 1000,
+		       fr_event_name(rec.event), rec.lease[0] ? rec.lease : "-",
+		       rec.arg);
+	}
+
+	fclose(f);
+	return EXIT_SUCCESS;
+}
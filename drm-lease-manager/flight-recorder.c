@@ -0,0 +1,189 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "flight-recorder.h"
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Events are written by the main loop and by lease transition threads.
+ * Each writer claims a slot with a single atomic increment, so recording
+ * never blocks.  A dump taken while an event is being written may contain
+ * one partially written record. */
+static struct {
+	struct fr_event_record events[FR_MAX_EVENTS];
+	atomic_uint_fast64_t count;
+} recorder;
+
+static char dump_path[PATH_MAX];
+
+static const int crash_signals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE,
+				    SIGABRT};
+
+static uint64_t clock_ns(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void fr_record(enum fr_event event, const char *lease, int32_t arg)
+{
+	uint_fast64_t n = atomic_fetch_add_explicit(&recorder.count, 1,
+						    memory_order_relaxed);
+	struct fr_event_record *rec = &recorder.events[n % FR_MAX_EVENTS];
+
+	rec->timestamp_ns = clock_ns(CLOCK_MONOTONIC);
+	rec->event = event;
+	rec->arg = arg;
+
+	/* strncpy would pad the whole name on every event */
+	size_t i = 0;
+	if (lease) {
+		for (; i < sizeof(rec->lease) - 1 && lease[i]; i++)
+			rec->lease[i] = lease[i];
+	}
+	rec->lease[i] = '\0';
+}
+
+static bool write_all(int fd, const void *data, size_t size)
+{
+	const char *p = data;
+	while (size > 0) {
+		ssize_t ret = write(fd, p, size);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		p += ret;
+		size -= ret;
+	}
+	return true;
+}
+
+/* Only uses async-signal-safe functions, so that it can be called
+ * from a signal handler */
+bool fr_dump(int fd)
+{
+	uint_fast64_t count = atomic_load(&recorder.count);
+	uint32_t nevents = count < FR_MAX_EVENTS ? count : FR_MAX_EVENTS;
+	uint32_t oldest = count < FR_MAX_EVENTS ? 0 : count % FR_MAX_EVENTS;
+
+	struct fr_dump_header hdr = {
+	    .magic = FR_DUMP_MAGIC,
+	    .version = FR_DUMP_VERSION,
+	    .nevents = nevents,
+	    .monotonic_ns = clock_ns(CLOCK_MONOTONIC),
+	    .realtime_ns = clock_ns(CLOCK_REALTIME),
+	};
+
+	if (!write_all(fd, &hdr, sizeof(hdr)))
+		return false;
+
+	const size_t size = sizeof(struct fr_event_record);
+	if (nevents < FR_MAX_EVENTS)
+		return write_all(fd, recorder.events, nevents * size);
+
+	return write_all(fd, &recorder.events[oldest],
+			 (FR_MAX_EVENTS - oldest) * size) &&
+	       write_all(fd, recorder.events, oldest * size);
+}
+
+static void dump_to_file(void)
+{
+	int fd = open(dump_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC |
+				     O_NOFOLLOW,
+		      0600);
+	if (fd < 0)
+		return;
+
+	fr_dump(fd);
+	close(fd);
+}
+
+static void dump_signal_handler(int sig)
+{
+	int saved_errno = errno;
+	(void)sig;
+	dump_to_file();
+	errno = saved_errno;
+}
+
+static void crash_signal_handler(int sig)
+{
+	dump_to_file();
+	/* The handler was reset to the default on entry */
+	raise(sig);
+}
+
+bool fr_install_dump_handlers(const char *path)
+{
+	if (strlen(path) >= sizeof(dump_path)) {
+		ERROR_LOG("Flight recorder path too long: %s\n", path);
+		return false;
+	}
+	strcpy(dump_path, path);
+
+	struct sigaction sa = {
+	    .sa_handler = dump_signal_handler,
+	    .sa_flags = SA_RESTART,
+	};
+	sigemptyset(&sa.sa_mask);
+
+	if (sigaction(SIGUSR1, &sa, NULL) < 0) {
+		ERROR_LOG("Cannot install flight recorder handler: %s\n",
+			  strerror(errno));
+		return false;
+	}
+
+	sa.sa_handler = crash_signal_handler;
+	sa.sa_flags = SA_RESETHAND | SA_NODEFER;
+	for (unsigned int i = 0;
+	     i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++) {
+		if (sigaction(crash_signals[i], &sa, NULL) < 0) {
+			ERROR_LOG("Cannot install crash handler: %s\n",
+				  strerror(errno));
+			return false;
+		}
+	}
+	return true;
+}
+
+const char *fr_event_name(enum fr_event event)
+{
+	static const char *const names[] = {
+	    [FR_EVENT_ACCEPT] = "accept",
+	    [FR_EVENT_REQUEST] = "request",
+	    [FR_EVENT_LEASE_CREATE] = "lease_create",
+	    [FR_EVENT_LEASE_REVOKE] = "lease_revoke",
+	    [FR_EVENT_TRANSITION_START] = "transition_start",
+	    [FR_EVENT_TRANSITION_FINISH] = "transition_finish",
+	    [FR_EVENT_CLIENT_REVOKE] = "client_revoke",
+	    [FR_EVENT_DISCONNECT] = "disconnect",
+	    [FR_EVENT_WATCHDOG] = "watchdog",
+	};
+
+	if ((unsigned int)event >= sizeof(names) / sizeof(names[0]))
+		return "unknown";
+	return names[event];
+}
@@ -0,0 +1,93 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#endif
+
+/* Flight recorder
+ * An always-on, fixed-size record of the most recent lease events.
+ * Recording an event only stores it in memory; the record is written out
+ * in binary form on request (SIGUSR1) or when the process crashes.
+ *
+ * Dump layout:
+ *   struct fr_dump_header
+ *   struct fr_event_record[header.nevents], oldest first */
+
+#define FR_DUMP_MAGIC 0x52464c44 /* "DLFR" */
+#define FR_DUMP_VERSION 1
+#define FR_MAX_EVENTS 256
+#define FR_LEASE_NAME_LEN 32
+
+enum fr_event {
+	FR_EVENT_ACCEPT,
+	FR_EVENT_REQUEST,
+	FR_EVENT_LEASE_CREATE,
+	FR_EVENT_LEASE_REVOKE,
+	FR_EVENT_TRANSITION_START,
+	FR_EVENT_TRANSITION_FINISH,
+	FR_EVENT_CLIENT_REVOKE,
+	FR_EVENT_DISCONNECT,
+	FR_EVENT_WATCHDOG,
+};
+
+struct fr_dump_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nevents;
+	uint32_t reserved;
+	/* Clock values at dump time, to convert event timestamps
+	 * to wall clock time */
+	uint64_t monotonic_ns;
+	uint64_t realtime_ns;
+};
+
+struct fr_event_record {
+	uint64_t timestamp_ns; /* CLOCK_MONOTONIC */
+	uint32_t event;
+	int32_t arg;
+	char lease[FR_LEASE_NAME_LEN];
+};
+
+void fr_record(enum fr_event event, const char *lease, int32_t arg);
+bool fr_dump(int fd);
+bool fr_install_dump_handlers(const char *dump_path);
+const char *fr_event_name(enum fr_event event);
+
+/* Trace a lease event.
+ * The event is always stored in the flight recorder and, if the
+ * build supports it, also fires a drm_lease_manager:NAME USDT probe
+ * with the lease name and ARG as arguments. */
+#ifdef HAVE_SYS_SDT_H
+#define TRACE_PROBE(NAME, LEASE, ARG) \
+	DTRACE_PROBE2(drm_lease_manager, NAME, LEASE, ARG)
+#else
+#define TRACE_PROBE(NAME, LEASE, ARG)
+#endif
+
+#define TRACE_EVENT(NAME, EVENT, LEASE, ARG)       \
+	do {                                       \
+		TRACE_PROBE(NAME, LEASE, ARG);     \
+		fr_record(EVENT, LEASE, ARG);      \
+	} while (0)
+#endif
@@ -0,0 +1,388 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "frame-monitor.h"
+
+#include "clock.h"
+#include "drm-backend.h"
+#include "log.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+/* Interval to retry monitoring of CRTCs that have vblanks disabled,
+ * and to check the watchdogs of leases without vblank events */
+#define FM_REARM_INTERVAL_MS 100
+
+/* Frame pacing monitor
+ * The lease manager remains DRM master of the leased CRTCs, so it can
+ * request a vblank event for each of them on its own fd.  On every vblank,
+ * the monitor checks the framebuffer that is being scanned out.  A new
+ * framebuffer means the lessee presented a new frame; the number of vblank
+ * periods since the previous frame is added to the frame interval histogram
+ * and every period beyond the first one counts as a missed frame.
+ *
+ * Clients that render into the same framebuffer again (front buffer
+ * rendering) cannot be observed this way.
+ *
+ * Every CRTC of a lease is monitored.  The statistics of a lease with
+ * several CRTCs count the frames presented on all of them.
+ *
+ * Leases can have a watchdog, which reports the lease to the main thread if
+ * its owner has not presented a frame within the timeout.  The timeout
+ * starts when the lease is granted, so it also covers the first frame. */
+
+struct fm_crtc {
+	struct fm_lease *lease;
+	uint32_t crtc_id;
+
+	/* Only used by the monitor thread */
+	bool armed;
+	bool has_frame;
+	uint32_t last_fb;
+	uint64_t last_frame_seq;
+};
+
+struct fm_lease {
+	struct fm *fm;
+	struct lease_handle *handle;
+	struct fm_crtc *crtcs;
+	int ncrtcs;
+
+	/* Written by the main thread */
+	atomic_uint lessee_id;
+
+	/* Written by the monitor thread, cleared by the main thread */
+	atomic_uint stalled_lessee_id;
+
+	/* Only used by the monitor thread */
+	uint32_t monitored_lessee_id;
+	uint64_t last_frame_ns;
+	uint64_t watchdog_ns;
+	bool watchdog_expired;
+	struct sp_frame_stats stats;
+};
+
+struct fm {
+	const struct drm_backend *drm;
+	int drm_fd;
+	int wake_fd;
+	int event_fd;
+	atomic_bool running;
+	pthread_t thread;
+
+	struct sp *sp;
+	struct fm_lease *leases;
+	int nleases;
+	struct fm_crtc *crtcs;
+};
+
+/* Frame intervals and the watchdog are only meaningful for a single lease
+ * owner, so start over whenever the owner changes. */
+static void update_owner(struct fm_lease *lease)
+{
+	uint32_t lessee_id = atomic_load(&lease->lessee_id);
+	if (lessee_id == lease->monitored_lessee_id)
+		return;
+
+	lease->monitored_lessee_id = lessee_id;
+	for (int i = 0; i < lease->ncrtcs; i++)
+		lease->crtcs[i].has_frame = false;
+	lease->last_frame_ns = monotonic_ns();
+	lease->watchdog_expired = false;
+}
+
+static void check_watchdog(struct fm *fm, struct fm_lease *lease)
+{
+	if (!lease->watchdog_ns || !lease->monitored_lessee_id ||
+	    lease->watchdog_expired)
+		return;
+
+	if (monotonic_ns() - lease->last_frame_ns < lease->watchdog_ns)
+		return;
+
+	WARN_LOG_RATELIMITED(
+	    "No new frame on lease %s within %" PRIu64 " ms\n",
+	    lease->handle->name, lease->watchdog_ns / 1000000);
+	lease->watchdog_expired = true;
+	atomic_store(&lease->stalled_lessee_id, lease->monitored_lessee_id);
+	eventfd_write(fm->event_fd, 1);
+}
+
+static void arm_vblank_event(struct fm *fm, struct fm_crtc *crtc)
+{
+	if (fm->drm->crtc_queue_sequence(fm->drm_fd, crtc->crtc_id,
+					 DRM_CRTC_SEQUENCE_RELATIVE, 1, NULL,
+					 (uint64_t)(uintptr_t)crtc) < 0) {
+		/* The CRTC is probably off, try again later */
+		return;
+	}
+	crtc->armed = true;
+}
+
+static void record_frame(struct fm_lease *lease, uint64_t interval)
+{
+	if (interval == 0)
+		return;
+
+	int bucket = interval < DLM_STATUS_FRAME_BUCKETS
+			 ? interval - 1
+			 : DLM_STATUS_FRAME_BUCKETS - 1;
+
+	lease->stats.frame_intervals[bucket]++;
+	lease->stats.frame_count++;
+	lease->stats.missed_frames += interval - 1;
+
+	if (lease->fm->sp)
+		sp_update_frames(lease->fm->sp, lease->handle, &lease->stats);
+}
+
+static void handle_vblank(int fd, uint64_t sequence, uint64_t ns,
+			  uint64_t user_data)
+{
+	struct fm_crtc *crtc = (struct fm_crtc *)(uintptr_t)user_data;
+	struct fm_lease *lease = crtc->lease;
+	(void)ns;
+
+	crtc->armed = false;
+
+	update_owner(lease);
+	if (lease->monitored_lessee_id == 0)
+		return;
+
+	const struct drm_backend *drm = lease->fm->drm;
+	drmModeCrtcPtr mode_crtc = drm->get_crtc(fd, crtc->crtc_id);
+	if (!mode_crtc)
+		return;
+
+	uint32_t fb = mode_crtc->buffer_id;
+	drm->free_crtc(mode_crtc);
+
+	if (crtc->has_frame && fb == crtc->last_fb)
+		return;
+
+	if (crtc->has_frame)
+		record_frame(lease, sequence - crtc->last_frame_seq);
+
+	crtc->has_frame = true;
+	crtc->last_fb = fb;
+	crtc->last_frame_seq = sequence;
+
+	/* A frame on any of the CRTCs shows that the owner is alive */
+	lease->last_frame_ns = monotonic_ns();
+}
+
+static void *monitor_thread(void *arg)
+{
+	struct fm *fm = arg;
+
+	drmEventContext ctx = {
+	    .version = DRM_EVENT_CONTEXT_VERSION,
+	    .sequence_handler = handle_vblank,
+	};
+
+	struct pollfd fds[] = {
+	    {.fd = fm->drm_fd, .events = POLLIN},
+	    {.fd = fm->wake_fd, .events = POLLIN},
+	};
+
+	while (atomic_load(&fm->running)) {
+		for (int i = 0; i < fm->nleases; i++) {
+			struct fm_lease *lease = &fm->leases[i];
+			update_owner(lease);
+			check_watchdog(fm, lease);
+			if (!lease->monitored_lessee_id)
+				continue;
+
+			for (int j = 0; j < lease->ncrtcs; j++) {
+				if (!lease->crtcs[j].armed)
+					arm_vblank_event(fm, &lease->crtcs[j]);
+			}
+		}
+
+		if (poll(fds, 2, FM_REARM_INTERVAL_MS) < 0) {
+			if (errno == EINTR)
+				continue;
+			ERROR_LOG("Frame monitor poll failed: %s\n",
+				  strerror(errno));
+			break;
+		}
+
+		if (fds[1].revents & POLLIN) {
+			eventfd_t count;
+			eventfd_read(fm->wake_fd, &count);
+		}
+
+		if (fds[0].revents & POLLIN)
+			fm->drm->handle_event(fm->drm_fd, &ctx);
+	}
+	return NULL;
+}
+
+struct fm *fm_create(struct lm *lm, struct lease_handle **lease_handles,
+		     int count, struct sp *sp)
+{
+	assert(lm);
+	assert(lease_handles);
+
+	struct fm *fm = calloc(1, sizeof(struct fm));
+	if (!fm) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	fm->leases = calloc(count, sizeof(struct fm_lease));
+	if (!fm->leases) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		goto err;
+	}
+
+	fm->drm = lm_get_drm_backend(lm);
+	fm->drm_fd = lm_get_drm_fd(lm);
+	fm->sp = sp;
+	fm->nleases = count;
+
+	int ncrtcs = 0;
+	for (int i = 0; i < count; i++)
+		ncrtcs += lm_lease_crtc_ids(lm, lease_handles[i], NULL, 0);
+
+	fm->crtcs = calloc(ncrtcs ? ncrtcs : 1, sizeof(struct fm_crtc));
+	uint32_t *crtc_ids = calloc(ncrtcs ? ncrtcs : 1, sizeof(uint32_t));
+	if (!fm->crtcs || !crtc_ids) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		free(crtc_ids);
+		goto err;
+	}
+
+	int first_crtc = 0;
+	for (int i = 0; i < count; i++) {
+		struct fm_lease *lease = &fm->leases[i];
+		lease->fm = fm;
+		lease->handle = lease_handles[i];
+		lease->crtcs = &fm->crtcs[first_crtc];
+		lease->ncrtcs = lm_lease_crtc_ids(lm, lease_handles[i],
+						  &crtc_ids[first_crtc],
+						  ncrtcs - first_crtc);
+
+		for (int j = 0; j < lease->ncrtcs; j++) {
+			lease->crtcs[j].lease = lease;
+			lease->crtcs[j].crtc_id = crtc_ids[first_crtc + j];
+		}
+		first_crtc += lease->ncrtcs;
+
+		const struct lease_watchdog *watchdog =
+		    lm_lease_watchdog(lease_handles[i]);
+		lease->watchdog_ns = (uint64_t)watchdog->timeout_ms * 1000000;
+	}
+	free(crtc_ids);
+
+	fm->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (fm->wake_fd < 0) {
+		DEBUG_LOG("eventfd failed: %s\n", strerror(errno));
+		goto err;
+	}
+
+	fm->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (fm->event_fd < 0) {
+		DEBUG_LOG("eventfd failed: %s\n", strerror(errno));
+		goto err_close_wake;
+	}
+
+	atomic_store(&fm->running, true);
+	if (pthread_create(&fm->thread, NULL, monitor_thread, fm) != 0) {
+		DEBUG_LOG("Cannot start frame monitor thread\n");
+		close(fm->event_fd);
+		goto err_close_wake;
+	}
+
+	return fm;
+err_close_wake:
+	close(fm->wake_fd);
+err:
+	free(fm->crtcs);
+	free(fm->leases);
+	free(fm);
+	return NULL;
+}
+
+void fm_destroy(struct fm *fm)
+{
+	assert(fm);
+
+	atomic_store(&fm->running, false);
+	eventfd_write(fm->wake_fd, 1);
+	pthread_join(fm->thread, NULL);
+
+	close(fm->event_fd);
+	close(fm->wake_fd);
+	free(fm->crtcs);
+	free(fm->leases);
+	free(fm);
+}
+
+void fm_update(struct fm *fm, struct lease_handle *lease_handle,
+	       uint32_t lessee_id)
+{
+	assert(fm);
+	assert(lease_handle);
+
+	for (int i = 0; i < fm->nleases; i++) {
+		struct fm_lease *lease = &fm->leases[i];
+		if (lease->handle != lease_handle)
+			continue;
+
+		if (atomic_exchange(&lease->lessee_id, lessee_id) != lessee_id)
+			eventfd_write(fm->wake_fd, 1);
+		return;
+	}
+}
+
+int fm_get_event_fd(struct fm *fm)
+{
+	assert(fm);
+	return fm->event_fd;
+}
+
+struct lease_handle *fm_get_stalled_lease(struct fm *fm, uint32_t *lessee_id)
+{
+	assert(fm);
+	assert(lessee_id);
+
+	/* Reset the event before looking for stalled leases, so that a lease
+	 * that stalls while searching triggers a new event. */
+	eventfd_t count;
+	eventfd_read(fm->event_fd, &count);
+
+	for (int i = 0; i < fm->nleases; i++) {
+		struct fm_lease *lease = &fm->leases[i];
+		uint32_t id = atomic_exchange(&lease->stalled_lessee_id, 0);
+		if (id) {
+			*lessee_id = id;
+			return lease->handle;
+		}
+	}
+	return NULL;
+}
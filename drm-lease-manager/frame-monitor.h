@@ -0,0 +1,44 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAME_MONITOR_H
+#define FRAME_MONITOR_H
+
+#include "drm-lease.h"
+#include "lease-manager.h"
+#include "status-page.h"
+
+#include <stdint.h>
+
+struct fm;
+
+/* sp may be NULL if frame statistics don't need to be published */
+struct fm *fm_create(struct lm *lm, struct lease_handle **lease_handles,
+		     int count, struct sp *sp);
+void fm_destroy(struct fm *fm);
+
+/* Tell the monitor about a new lease owner.
+ * lessee_id is 0 if the lease is not granted. */
+void fm_update(struct fm *fm, struct lease_handle *lease_handle,
+	       uint32_t lessee_id);
+
+/* Lease watchdog
+ * The event fd becomes readable when the owner of a lease with a watchdog
+ * has not presented a new frame within the timeout.
+ * fm_get_stalled_lease() returns each such lease once, along with the
+ * lessee id of the stalled owner, and NULL once there are none left. */
+int fm_get_event_fd(struct fm *fm);
+struct lease_handle *fm_get_stalled_lease(struct fm *fm, uint32_t *lessee_id);
+#endif
@@ -14,15 +14,43 @@
  */
 
 #include "lease-config.h"
+#include "config-blob.h"
 #include "log.h"
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <toml.h>
+#include <unistd.h>
 
 #define CONFIG_ERROR(x, ...) ERROR_LOG("%s: " x, filename, ##__VA_ARGS__)
 
+/* Configuration compiled into the binary with the embedded_config build
+ * option, if any */
+extern const unsigned char dlm_embedded_config[] __attribute__((weak));
+extern const size_t dlm_embedded_config_size __attribute__((weak));
+
+/* Every array of lease configurations returned by parse_config is
+ * preceded by this header, so that release_config knows whether the
+ * configurations point into a binary configuration or were allocated
+ * field by field. */
+struct config_alloc {
+	const void *blob;
+	size_t map_size; /* 0 if the blob is not mapped */
+	struct lease_config configs[];
+};
+
+struct config_blob {
+	const void *data;
+	size_t size;
+	size_t map_size;
+};
+
 static bool populate_connector_planes(struct connector_config *config,
 				      toml_array_t *planes)
 {
@@ -87,10 +115,51 @@ static bool populate_connector_config(struct lease_config *config,
 	return true;
 }
 
-int parse_config(char *filename, struct lease_config **parsed_config)
+static bool populate_watchdog_config(struct lease_config *config,
+				     toml_table_t *lease)
+{
+	static const char *const actions[] = {
+	    [LEASE_WATCHDOG_REVOKE] = "revoke",
+	    [LEASE_WATCHDOG_STANDBY] = "standby",
+	    [LEASE_WATCHDOG_FALLBACK] = "fallback",
+	};
+
+	toml_datum_t timeout = toml_int_in(lease, "watchdog_timeout_ms");
+	if (timeout.ok) {
+		if (timeout.u.i < 0 || timeout.u.i > UINT32_MAX) {
+			ERROR_LOG("Invalid watchdog timeout in lease %s\n",
+				  config->lease_name);
+			return false;
+		}
+		config->watchdog.timeout_ms = timeout.u.i;
+	}
+
+	toml_datum_t action = toml_string_in(lease, "watchdog_action");
+	if (!action.ok)
+		return true;
+
+	bool found = false;
+	for (size_t i = 0; i < sizeof(actions) / sizeof(actions[0]); i++) {
+		if (!strcmp(action.u.s, actions[i])) {
+			config->watchdog.action = i;
+			found = true;
+			break;
+		}
+	}
+
+	if (!found)
+		ERROR_LOG("Unknown watchdog action in lease %s: %s\n",
+			  config->lease_name, action.u.s);
+	free(action.u.s);
+	return found;
+}
+
+static int parse_toml_config(const char *filename,
+			     struct lease_config **parsed_config)
 {
+	struct config_alloc *alloc = NULL;
 	struct lease_config *config = NULL;
-	int nconfigs, i, ret = 0;
+	int nconfigs, i, ret = -1;
 	char parse_error[160];
 
 	FILE *fp = fopen(filename, "r");
@@ -103,22 +172,28 @@ int parse_config(char *filename, struct lease_config **parsed_config)
 		CONFIG_ERROR("configuration file parse error: %s\n",
 			     parse_error);
 		fclose(fp);
-		return 0;
+		return -1;
 	}
 
 	toml_array_t *leases = toml_array_in(t_config, "lease");
+	/* A config that only selects the device uses the default leases */
+	if (!leases && toml_table_in(t_config, "device")) {
+		ret = 0;
+		goto err;
+	}
 	if (!leases) {
 		CONFIG_ERROR(
 		    "Invalid config - cannot find any 'lease' configs");
 		goto err;
 	}
 	nconfigs = toml_array_nelem(leases);
-	config = calloc(nconfigs, sizeof *config);
+	alloc = calloc(1, sizeof(*alloc) + nconfigs * sizeof(*config));
 
-	if (!config) {
+	if (!alloc) {
 		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
 		goto err;
 	}
+	config = alloc->configs;
 
 	for (i = 0; i < toml_array_nelem(leases); i++) {
 		toml_table_t *lease = toml_table_at(leases, i);
@@ -138,6 +213,16 @@ int parse_config(char *filename, struct lease_config **parsed_config)
 				     config[i].lease_name);
 			goto err_free_config;
 		}
+
+		toml_datum_t clone = toml_bool_in(lease, "clone");
+		if (clone.ok)
+			config[i].clone = clone.u.b;
+
+		if (!populate_watchdog_config(&config[i], lease)) {
+			CONFIG_ERROR("Error configuring lease: %s\n",
+				     config[i].lease_name);
+			goto err_free_config;
+		}
 	}
 
 	*parsed_config = config;
@@ -151,8 +236,216 @@ err_free_config:
 	goto err;
 }
 
+static bool populate_device_string(const char *filename, toml_table_t *device,
+				   const char *key, char **value)
+{
+	if (!toml_key_exists(device, key))
+		return true;
+
+	toml_datum_t str = toml_string_in(device, key);
+	if (!str.ok) {
+		CONFIG_ERROR("Invalid device %s\n", key);
+		return false;
+	}
+	*value = str.u.s;
+	return true;
+}
+
+static bool parse_toml_device_config(const char *filename,
+				     struct device_config *config)
+{
+	char parse_error[160];
+	bool ret = true;
+
+	FILE *fp = fopen(filename, "r");
+	if (!fp)
+		return true;
+
+	toml_table_t *t_config =
+	    toml_parse_file(fp, parse_error, sizeof parse_error);
+	fclose(fp);
+	if (!t_config) {
+		CONFIG_ERROR("configuration file parse error: %s\n",
+			     parse_error);
+		return false;
+	}
+
+	toml_table_t *device = toml_table_in(t_config, "device");
+	if (!device)
+		goto out;
+
+	ret = populate_device_string(filename, device, "bus_id",
+				     &config->bus_id) &&
+	      populate_device_string(filename, device, "driver",
+				     &config->driver) &&
+	      populate_device_string(filename, device, "sysfs_path",
+				     &config->sysfs_path);
+
+	if (ret && toml_key_exists(device, "wait_ms")) {
+		toml_datum_t wait = toml_int_in(device, "wait_ms");
+		if (!wait.ok || wait.u.i < 0 || wait.u.i > UINT32_MAX) {
+			CONFIG_ERROR("Invalid device wait_ms\n");
+			ret = false;
+		} else {
+			config->wait_ms = wait.u.i;
+		}
+	}
+
+	if (!ret)
+		release_device_config(config);
+out:
+	toml_free(t_config);
+	return ret;
+}
+
+/**************  Binary configuration  *************/
+
+static bool map_file(const char *filename, const void **data, size_t *size)
+{
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	bool ret = false;
+	if (fstat(fd, &st) < 0)
+		goto out;
+
+	/* mmap can't map an empty file, but an empty file is still valid */
+	*size = st.st_size;
+	*data = "";
+	if (*size > 0) {
+		void *map = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			DEBUG_LOG("mmap of %s failed: %s\n", filename,
+				  strerror(errno));
+			goto out;
+		}
+		*data = map;
+	}
+	ret = true;
+out:
+	close(fd);
+	return ret;
+}
+
+static void unmap_file(const void *data, size_t size)
+{
+	if (size > 0)
+		munmap((void *)data, size);
+}
+
+static bool use_blob(const char *name, const void *blob, size_t size,
+		     const void *source, size_t source_size)
+{
+	if (!cb_validate(blob, size, NULL, 0)) {
+		WARN_LOG("Ignoring invalid binary configuration %s\n", name);
+		return false;
+	}
+	if (source && !cb_validate(blob, size, source, source_size)) {
+		INFO_LOG("Binary configuration %s is out of date\n", name);
+		return false;
+	}
+	return true;
+}
+
+/* Look for a binary configuration compiled from filename: first
+ * <filename>.bin, then one embedded at build time.  A binary
+ * configuration is only used while filename is unchanged, or if filename
+ * doesn't exist. */
+static bool find_binary_config(const char *filename, struct config_blob *blob)
+{
+	const void *source = NULL;
+	size_t source_size = 0;
+	bool found = false;
+
+	if (!map_file(filename, &source, &source_size))
+		source = NULL;
+
+	char bin_name[PATH_MAX];
+	if (snprintf(bin_name, sizeof(bin_name), "%s.bin", filename) <
+		(int)sizeof(bin_name) &&
+	    map_file(bin_name, &blob->data, &blob->size)) {
+		blob->map_size = blob->size;
+		found = use_blob(bin_name, blob->data, blob->size, source,
+				 source_size);
+		if (!found)
+			unmap_file(blob->data, blob->map_size);
+	}
+
+	if (!found && dlm_embedded_config && &dlm_embedded_config_size) {
+		*blob = (struct config_blob){
+		    .data = dlm_embedded_config,
+		    .size = dlm_embedded_config_size,
+		};
+		found = use_blob("(embedded)", blob->data, blob->size, source,
+				 source_size);
+	}
+
+	if (source)
+		unmap_file(source, source_size);
+	return found;
+}
+
+static int load_binary_config(const struct config_blob *blob,
+			      struct lease_config **parsed_config)
+{
+	uint32_t nleases, nconnectors, nplanes;
+	cb_get_counts(blob->data, &nleases, &nconnectors, &nplanes);
+
+	if (nleases == 0) {
+		unmap_file(blob->data, blob->map_size);
+		return 0;
+	}
+
+	/* One allocation holds all of the lease and connector configs and
+	 * plane lists.  Names are used in place. */
+	struct config_alloc *alloc =
+	    calloc(1, sizeof(*alloc) + nleases * sizeof(struct lease_config) +
+			  nconnectors * sizeof(struct connector_config) +
+			  nplanes * sizeof(uint32_t));
+	if (!alloc) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		unmap_file(blob->data, blob->map_size);
+		return 0;
+	}
+
+	struct connector_config *connectors =
+	    (void *)&alloc->configs[nleases];
+	uint32_t *planes = (void *)&connectors[nconnectors];
+
+	alloc->blob = blob->data;
+	alloc->map_size = blob->map_size;
+	*parsed_config = alloc->configs;
+	return cb_get_leases(blob->data, alloc->configs, connectors, planes);
+}
+
+int parse_config(const char *filename, struct lease_config **parsed_config)
+{
+	struct config_blob blob;
+
+	if (find_binary_config(filename, &blob))
+		return load_binary_config(&blob, parsed_config);
+
+	/* Invalid configurations fall back to the default leases */
+	int ret = parse_toml_config(filename, parsed_config);
+	return ret < 0 ? 0 : ret;
+}
+
 void release_config(int num_leases, struct lease_config *config)
 {
+	if (!config)
+		return;
+
+	struct config_alloc *alloc =
+	    (void *)((char *)config - offsetof(struct config_alloc, configs));
+
+	if (alloc->blob) {
+		unmap_file(alloc->blob, alloc->map_size);
+		free(alloc);
+		return;
+	}
+
 	for (int i = 0; i < num_leases; i++) {
 		struct lease_config *c = &config[i];
 		free(c->lease_name);
@@ -162,5 +455,56 @@ void release_config(int num_leases, struct lease_config *config)
 		}
 		free(c->connectors);
 	}
-	free(config);
+	free(alloc);
+}
+
+bool parse_device_config(const char *filename, struct device_config *config)
+{
+	struct config_blob blob;
+
+	*config = (struct device_config){0};
+
+	if (find_binary_config(filename, &blob)) {
+		bool ret = cb_get_device(blob.data, config);
+		unmap_file(blob.data, blob.map_size);
+		return ret;
+	}
+
+	return parse_toml_device_config(filename, config);
+}
+
+void release_device_config(struct device_config *config)
+{
+	free(config->bus_id);
+	free(config->driver);
+	free(config->sysfs_path);
+	*config = (struct device_config){0};
+}
+
+void *compile_config(const char *filename, size_t *size)
+{
+	struct lease_config *configs = NULL;
+	struct device_config device = {0};
+	const void *source;
+	size_t source_size;
+	void *blob = NULL;
+
+	if (!map_file(filename, &source, &source_size)) {
+		ERROR_LOG("Cannot open %s: %s\n", filename, strerror(errno));
+		return NULL;
+	}
+
+	if (!parse_toml_device_config(filename, &device))
+		goto out;
+
+	int nconfigs = parse_toml_config(filename, &configs);
+	if (nconfigs >= 0) {
+		blob = cb_create(source, source_size, nconfigs, configs,
+				 &device, size);
+		release_config(nconfigs, configs);
+	}
+	release_device_config(&device);
+out:
+	unmap_file(source, source_size);
+	return blob;
 }
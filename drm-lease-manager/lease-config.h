@@ -15,5 +15,17 @@
 
 #include "drm-lease.h"
 
-int parse_config(char *filename, struct lease_config **parsed_config);
+#include <stddef.h>
+
+int parse_config(const char *filename, struct lease_config **parsed_config);
 void release_config(int num_leasess, struct lease_config *config);
+
+/* Parse the [device] table of the configuration file.
+ * Leaves config empty, and returns true, if there is none. */
+bool parse_device_config(const char *filename, struct device_config *config);
+void release_device_config(struct device_config *config);
+
+/* Compile a configuration file into a binary configuration (see
+ * config-blob.h).  Returns the blob, to be freed with free(), or NULL if
+ * the file is invalid. */
+void *compile_config(const char *filename, size_t *size);
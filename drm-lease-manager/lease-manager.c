@@ -16,20 +16,28 @@
 #define _GNU_SOURCE
 #include "lease-manager.h"
 
+#include "alloc-cache.h"
+#include "dlm-topology.h"
+#include "drm-backend.h"
 #include "drm-lease.h"
+#include "flight-recorder.h"
 #include "log.h"
 
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <poll.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
@@ -40,8 +48,17 @@
 
 #define ARRAY_LENGTH(x) (sizeof(x) / sizeof(x[0]))
 
+struct lease;
+
+struct transition_ctx {
+	struct lease *lease;
+	int close_fd;
+	uint32_t old_fb;
+};
+
 struct lease {
 	struct lease_handle base;
+	const struct drm_backend *drm;
 
 	bool is_granted;
 	uint32_t lessee_id;
@@ -50,13 +67,28 @@ struct lease {
 	uint32_t *object_ids;
 	int nobject_ids;
 
+	/* index of the lease configuration, for the allocation cache */
+	int config_index;
+
+	/* sealed memfd describing the leased objects */
+	int topology_fd;
+
 	/* for lease transfer completion */
 	uint32_t crtc_id;
 	pthread_t transition_tid;
 	bool transition_running;
+	struct transition_ctx transition;
+
+	struct lease_watchdog watchdog;
+
+	/* for showing the fallback framebuffer */
+	uint32_t connector_id;
+	uint32_t fallback_fb_id;
+	uint32_t fallback_bo_handle;
 };
 
 struct lm {
+	const struct drm_backend *drm;
 	int drm_fd;
 	dev_t dev_id;
 
@@ -145,12 +177,12 @@ static int drm_get_active_crtc_index(struct lm *lm,
 				     drmModeConnectorPtr connector)
 {
 	drmModeEncoder *encoder =
-	    drmModeGetEncoder(lm->drm_fd, connector->encoder_id);
+	    lm->drm->get_encoder(lm->drm_fd, connector->encoder_id);
 	if (!encoder)
 		return -1;
 
 	int crtc_idx = drm_get_encoder_crtc_index(lm, encoder);
-	drmModeFreeEncoder(encoder);
+	lm->drm->free_encoder(encoder);
 	return crtc_idx;
 }
 
@@ -165,14 +197,14 @@ static int drm_get_crtc_index(struct lm *lm, drmModeConnectorPtr connector)
 	// If not try the first available CRTC on the connector/encoder
 	for (int i = 0; i < connector->count_encoders; i++) {
 		drmModeEncoder *encoder =
-		    drmModeGetEncoder(lm->drm_fd, connector->encoders[i]);
+		    lm->drm->get_encoder(lm->drm_fd, connector->encoders[i]);
 
 		assert(encoder);
 
 		uint32_t usable_crtcs =
 		    lm->available_crtcs & encoder->possible_crtcs;
 		int crtc = ffs(usable_crtcs);
-		drmModeFreeEncoder(encoder);
+		lm->drm->free_encoder(encoder);
 		if (crtc == 0)
 			continue;
 		crtc_index = crtc - 1;
@@ -182,6 +214,63 @@ static int drm_get_crtc_index(struct lm *lm, drmModeConnectorPtr connector)
 	return crtc_index;
 }
 
+/* Clone mode
+ * In a lease configured with clone = true, connectors share the CRTC of
+ * the first connector when one of their encoders can drive that CRTC, and
+ * every encoder on the CRTC is in the possible_clones of all the others. */
+struct clone_state {
+	int crtc_index;		  /* -1 until the first connector has a CRTC */
+	uint32_t encoders;	  /* indices of the encoders on the CRTC */
+	uint32_t possible_clones; /* encoders all of them can be cloned with */
+	int next_object;	  /* object_ids index for the next clone */
+};
+
+static int drm_get_encoder_index(struct lm *lm, uint32_t encoder_id)
+{
+	for (int i = 0; i < lm->drm_resource->count_encoders && i < 32; i++) {
+		if (lm->drm_resource->encoders[i] == encoder_id)
+			return i;
+	}
+	return -1;
+}
+
+static bool drm_add_clone_encoder(struct lm *lm, drmModeConnectorPtr connector,
+				  struct clone_state *clone)
+{
+	uint32_t crtc_mask = 1 << clone->crtc_index;
+
+	for (int i = 0; i < connector->count_encoders; i++) {
+		drmModeEncoder *encoder =
+		    lm->drm->get_encoder(lm->drm_fd, connector->encoders[i]);
+		if (!encoder)
+			continue;
+
+		int index = drm_get_encoder_index(lm, encoder->encoder_id);
+		bool usable =
+		    index >= 0 && (encoder->possible_crtcs & crtc_mask) &&
+		    (clone->possible_clones & (1 << index)) &&
+		    (encoder->possible_clones & clone->encoders) ==
+			clone->encoders;
+		if (usable) {
+			clone->encoders |= 1 << index;
+			clone->possible_clones &= encoder->possible_clones;
+		}
+		lm->drm->free_encoder(encoder);
+		if (usable)
+			return true;
+	}
+	return false;
+}
+
+static bool id_in_list(uint32_t id, const uint32_t *ids, int count)
+{
+	for (int i = 0; i < count; i++) {
+		if (ids[i] == id)
+			return true;
+	}
+	return false;
+}
+
 static void drm_find_available_crtcs(struct lm *lm)
 {
 	// Assume all CRTCS are available by default,
@@ -190,7 +279,8 @@ static void drm_find_available_crtcs(struct lm *lm)
 	// then remove any that are in use. */
 	for (int i = 0; i < lm->drm_resource->count_encoders; i++) {
 		int enc_id = lm->drm_resource->encoders[i];
-		drmModeEncoderPtr enc = drmModeGetEncoder(lm->drm_fd, enc_id);
+		drmModeEncoderPtr enc =
+		    lm->drm->get_encoder(lm->drm_fd, enc_id);
 		if (!enc)
 			continue;
 
@@ -198,7 +288,7 @@ static void drm_find_available_crtcs(struct lm *lm)
 		if (crtc_idx >= 0)
 			lm->available_crtcs &= ~(1 << crtc_idx);
 
-		drmModeFreeEncoder(enc);
+		lm->drm->free_encoder(enc);
 	}
 }
 
@@ -244,7 +334,8 @@ static bool lease_add_planes(struct lm *lm, struct lease *lease,
 
 	for (int i = 0; i < nplanes; i++) {
 		uint32_t plane_id = planes[i];
-		drmModePlanePtr plane = drmModeGetPlane(lm->drm_fd, plane_id);
+		drmModePlanePtr plane =
+		    lm->drm->get_plane(lm->drm_fd, plane_id);
 
 		if (!plane) {
 			ERROR_LOG(
@@ -253,13 +344,17 @@ static bool lease_add_planes(struct lm *lm, struct lease *lease,
 			return false;
 		}
 
-		if (plane->possible_crtcs & crtc_mask) {
+		/* Connectors sharing a CRTC can list the same planes */
+		bool added = id_in_list(plane_id, lease->object_ids,
+					lease->nobject_ids);
+
+		if (!added && plane->possible_crtcs & crtc_mask) {
 			bool shared_plane = plane->possible_crtcs != crtc_mask;
 			if (allow_shared || !shared_plane)
 				lease->object_ids[lease->nobject_ids++] =
 				    plane_id;
 		}
-		drmModeFreePlane(plane);
+		lm->drm->free_plane(plane);
 	}
 	return true;
 }
@@ -286,23 +381,18 @@ static void wait_for_fb_update(struct lease *lease, uint32_t old_fb)
 			break;
 		}
 
-		crtc = drmModeGetCrtc(lease->lease_fd, lease->crtc_id);
+		crtc = lease->drm->get_crtc(lease->lease_fd, lease->crtc_id);
 		current_fb = crtc->buffer_id;
-		drmModeFreeCrtc(crtc);
+		lease->drm->free_crtc(crtc);
 	}
 }
 
-struct transition_ctx {
-	struct lease *lease;
-	int close_fd;
-	uint32_t old_fb;
-};
-
 static void transition_done(void *arg)
 {
 	struct transition_ctx *ctx = arg;
+	TRACE_EVENT(transition_finish, FR_EVENT_TRANSITION_FINISH,
+		    ctx->lease->base.name, ctx->close_fd);
 	close(ctx->close_fd);
-	free(ctx);
 }
 
 static void *finish_transition_task(void *arg)
@@ -316,17 +406,21 @@ static void *finish_transition_task(void *arg)
 
 static void close_after_lease_transition(struct lease *lease, int close_fd)
 {
-	struct transition_ctx *ctx = calloc(1, sizeof(*ctx));
+	/* A lease is revoked, which joins the previous transition thread,
+	 * before it can be granted again, so one context per lease is enough */
+	struct transition_ctx *ctx = &lease->transition;
 
-	assert(ctx);
+	drmModeCrtcPtr crtc =
+	    lease->drm->get_crtc(lease->lease_fd, lease->crtc_id);
 
-	drmModeCrtcPtr crtc = drmModeGetCrtc(lease->lease_fd, lease->crtc_id);
+	TRACE_EVENT(transition_start, FR_EVENT_TRANSITION_START,
+		    lease->base.name, close_fd);
 
 	ctx->lease = lease;
 	ctx->close_fd = close_fd;
 	ctx->old_fb = crtc->buffer_id;
 
-	drmModeFreeCrtc(crtc);
+	lease->drm->free_crtc(crtc);
 
 	int ret = pthread_create(&lease->transition_tid, NULL,
 				 finish_transition_task, ctx);
@@ -345,15 +439,208 @@ static void cancel_lease_transition_thread(struct lease *lease)
 	lease->transition_running = false;
 }
 
+/* Lease topology
+ * Describe the objects in a lease, along with the ids of their properties,
+ * so that clients don't need to enumerate them again after receiving the
+ * lease fd. */
+static uint32_t drm_get_topology_object(struct lm *lm,
+					struct dlm_topology_object *obj,
+					uint32_t *drm_type)
+{
+	drmModeResPtr res = lm->drm_resource;
+
+	for (int i = 0; i < res->count_crtcs; i++) {
+		if (res->crtcs[i] == obj->id) {
+			*drm_type = DRM_MODE_OBJECT_CRTC;
+			return DLM_TOPOLOGY_CRTC;
+		}
+	}
+
+	for (int i = 0; i < res->count_connectors; i++) {
+		if (res->connectors[i] == obj->id) {
+			snprintf(obj->name, sizeof(obj->name), "%s",
+				 lm->connector_names[i]);
+			*drm_type = DRM_MODE_OBJECT_CONNECTOR;
+			return DLM_TOPOLOGY_CONNECTOR;
+		}
+	}
+
+	*drm_type = DRM_MODE_OBJECT_PLANE;
+	return DLM_TOPOLOGY_PLANE;
+}
+
+static bool topology_add_properties(struct lm *lm,
+				    struct dlm_topology_object *obj,
+				    uint32_t drm_type,
+				    struct dlm_topology_prop **props,
+				    uint32_t *nprops)
+{
+	obj->first_prop = *nprops;
+
+	drmModeObjectPropertiesPtr obj_props =
+	    lm->drm->object_get_properties(lm->drm_fd, obj->id, drm_type);
+	if (!obj_props)
+		return true;
+
+	bool ret = true;
+	if (obj_props->count_props == 0)
+		goto done;
+
+	struct dlm_topology_prop *new_props =
+	    realloc(*props, (*nprops + obj_props->count_props) *
+				sizeof(struct dlm_topology_prop));
+	if (!new_props) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		ret = false;
+		goto done;
+	}
+	*props = new_props;
+
+	for (uint32_t i = 0; i < obj_props->count_props; i++) {
+		drmModePropertyPtr prop =
+		    lm->drm->get_property(lm->drm_fd, obj_props->props[i]);
+		if (!prop)
+			continue;
+
+		struct dlm_topology_prop *tprop = &new_props[(*nprops)++];
+		tprop->id = prop->prop_id;
+		snprintf(tprop->name, sizeof(tprop->name), "%s", prop->name);
+		lm->drm->free_property(prop);
+	}
+	obj->nprops = *nprops - obj->first_prop;
+done:
+	lm->drm->free_object_properties(obj_props);
+	return ret;
+}
+
+static int lease_seal_topology(struct lease *lease, const struct iovec *iov,
+			       int iovcnt, size_t size)
+{
+	int fd = memfd_create("dlm-topology", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) {
+		DEBUG_LOG("memfd_create failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	int seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL;
+	if (writev(fd, iov, iovcnt) != (ssize_t)size ||
+	    fcntl(fd, F_ADD_SEALS, seals)) {
+		DEBUG_LOG("Can't create topology for lease %s: %s\n",
+			  lease->base.name, strerror(errno));
+		close(fd);
+		fd = -1;
+	}
+	return fd;
+}
+
+static int lease_create_topology(struct lm *lm, struct lease *lease)
+{
+	int fd = -1;
+	uint32_t nprops = 0;
+	struct dlm_topology_prop *props = NULL;
+	struct dlm_topology_object *objects =
+	    calloc(lease->nobject_ids, sizeof(struct dlm_topology_object));
+	if (!objects) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	for (int i = 0; i < lease->nobject_ids; i++) {
+		struct dlm_topology_object *obj = &objects[i];
+		uint32_t drm_type;
+
+		obj->id = lease->object_ids[i];
+		obj->type = drm_get_topology_object(lm, obj, &drm_type);
+		if (!topology_add_properties(lm, obj, drm_type, &props,
+					     &nprops))
+			goto out;
+	}
+
+	struct dlm_topology_header header = {
+	    .magic = DLM_TOPOLOGY_MAGIC,
+	    .version = DLM_TOPOLOGY_VERSION,
+	    .nobjects = lease->nobject_ids,
+	    .nprops = nprops,
+	};
+
+	size_t objects_size = header.nobjects * sizeof(*objects);
+	size_t props_size = header.nprops * sizeof(*props);
+	header.size = sizeof(header) + objects_size + props_size;
+
+	struct iovec iov[] = {
+	    {.iov_base = &header, .iov_len = sizeof(header)},
+	    {.iov_base = objects, .iov_len = objects_size},
+	    {.iov_base = props, .iov_len = props_size},
+	};
+	fd = lease_seal_topology(lease, iov, ARRAY_LENGTH(iov), header.size);
+out:
+	free(objects);
+	free(props);
+	return fd;
+}
+
+/* Fallback framebuffer
+ * A black framebuffer owned by the lease manager, used to replace the
+ * content of a lease whose client has stopped updating the display.
+ * It is created on first use and kept until the lease manager exits. */
+static bool lease_create_fallback_fb(struct lm *lm, struct lease *lease,
+				     const drmModeModeInfo *mode)
+{
+	/* Dumb buffers are zero filled on creation, so no need to draw */
+	struct drm_mode_create_dumb create = {
+	    .width = mode->hdisplay,
+	    .height = mode->vdisplay,
+	    .bpp = 32,
+	};
+	if (lm->drm->ioctl(lm->drm_fd, DRM_IOCTL_MODE_CREATE_DUMB, &create) <
+	    0) {
+		DEBUG_LOG("Can't create fallback buffer for lease %s: %s\n",
+			  lease->base.name, strerror(errno));
+		return false;
+	}
+
+	if (lm->drm->add_fb(lm->drm_fd, create.width, create.height, 24, 32,
+			    create.pitch, create.handle,
+			    &lease->fallback_fb_id) < 0) {
+		DEBUG_LOG("Can't create fallback framebuffer for lease %s: "
+			  "%s\n",
+			  lease->base.name, strerror(errno));
+		struct drm_mode_destroy_dumb destroy = {
+		    .handle = create.handle,
+		};
+		lm->drm->ioctl(lm->drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB,
+			       &destroy);
+		return false;
+	}
+
+	lease->fallback_bo_handle = create.handle;
+	return true;
+}
+
+static void lease_destroy_fallback_fb(struct lm *lm, struct lease *lease)
+{
+	if (!lease->fallback_fb_id)
+		return;
+
+	lm->drm->rm_fb(lm->drm_fd, lease->fallback_fb_id);
+	struct drm_mode_destroy_dumb destroy = {
+	    .handle = lease->fallback_bo_handle,
+	};
+	lm->drm->ioctl(lm->drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+	lease->fallback_fb_id = 0;
+}
+
 static void lease_free(struct lease *lease)
 {
+	if (lease->topology_fd >= 0)
+		close(lease->topology_fd);
 	free(lease->base.name);
 	free(lease->object_ids);
 	free(lease);
 }
 
-static struct lease *lease_create(struct lm *lm,
-				  const struct lease_config *config)
+static struct lease *lease_alloc(struct lm *lm,
+				 const struct lease_config *config)
 {
 	struct lease *lease;
 
@@ -367,13 +654,74 @@ static struct lease *lease_create(struct lm *lm,
 		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
 		return NULL;
 	}
+	lease->topology_fd = -1;
+	lease->lease_fd = -1;
+	lease->drm = lm->drm;
+	lease->watchdog = config->watchdog;
 
 	lease->base.name = strdup(config->lease_name);
 	if (!lease->base.name) {
 		DEBUG_LOG("Can't create lease name: %s\n", strerror(errno));
-		goto err;
+		lease_free(lease);
+		return NULL;
+	}
+	return lease;
+}
+
+/* Connectors sharing the CRTC directly follow it in object_ids, so that
+ * lease_get_crtc_connectors() can find them, also in leases restored from
+ * the allocation cache. */
+static bool lease_add_clone(struct lm *lm, struct lease *lease,
+			    struct clone_state *clone, uint32_t cid,
+			    const struct connector_config *con_config)
+{
+	int pos = clone->next_object++;
+
+	memmove(&lease->object_ids[pos + 1], &lease->object_ids[pos],
+		(lease->nobject_ids - pos) * sizeof(uint32_t));
+	lease->object_ids[pos] = cid;
+	lease->nobject_ids++;
+
+	/* The planes of the CRTC are already in the lease, unless the
+	 * connector has its own list. */
+	if (con_config && con_config->planes)
+		return lease_add_planes(lm, lease, clone->crtc_index,
+					con_config);
+	return true;
+}
+
+static int lease_get_crtc_connectors(struct lm *lm, struct lease *lease,
+				     uint32_t **connector_ids)
+{
+	drmModeResPtr res = lm->drm_resource;
+
+	for (int i = 0; i < lease->nobject_ids; i++) {
+		if (lease->object_ids[i] != lease->crtc_id)
+			continue;
+
+		int count = 0;
+		while (i + 1 + count < lease->nobject_ids &&
+		       id_in_list(lease->object_ids[i + 1 + count],
+				  res->connectors, res->count_connectors))
+			count++;
+		if (count == 0)
+			break;
+
+		*connector_ids = &lease->object_ids[i + 1];
+		return count;
 	}
 
+	*connector_ids = &lease->connector_id;
+	return 1;
+}
+
+static struct lease *lease_create(struct lm *lm,
+				  const struct lease_config *config)
+{
+	struct lease *lease = lease_alloc(lm, config);
+	if (!lease)
+		return NULL;
+
 	int nconnectors =
 	    config->nconnectors > 0 ? config->nconnectors : config->ncids;
 	int nobjects = lm->drm_plane_resource->count_planes +
@@ -385,6 +733,11 @@ static struct lease *lease_create(struct lm *lm,
 		goto err;
 	}
 
+	struct clone_state clone = {
+	    .crtc_index = -1,
+	    .possible_clones = ~0U,
+	};
+
 	for (int i = 0; i < nconnectors; i++) {
 		uint32_t cid;
 		struct connector_config *con_config = NULL;
@@ -418,16 +771,35 @@ static struct lease *lease_create(struct lm *lm,
 		}
 
 		drmModeConnectorPtr connector =
-		    drmModeGetConnector(lm->drm_fd, cid);
+		    lm->drm->get_connector(lm->drm_fd, cid);
 
 		if (connector == NULL) {
 			ERROR_LOG("Can't find connector id: %d\n", cid);
 			goto err;
 		}
 
+		if (clone.crtc_index >= 0 &&
+		    drm_add_clone_encoder(lm, connector, &clone)) {
+			lm->drm->free_connector(connector);
+			if (!lease_add_clone(lm, lease, &clone, cid,
+					     con_config))
+				goto err;
+			continue;
+		}
+
+		if (clone.crtc_index >= 0)
+			WARN_LOG("Lease: %s, connector %d can't share a CRTC\n",
+				 lease->base.name, cid);
+
 		int crtc_index = drm_get_crtc_index(lm, connector);
 
-		drmModeFreeConnector(connector);
+		if (crtc_index >= 0 && config->clone && clone.crtc_index < 0) {
+			clone.crtc_index = crtc_index;
+			if (!drm_add_clone_encoder(lm, connector, &clone))
+				clone.possible_clones = 0;
+		}
+
+		lm->drm->free_connector(connector);
 
 		if (crtc_index < 0) {
 			DEBUG_LOG("No crtc found for connector: %d, lease %s\n",
@@ -439,12 +811,16 @@ static struct lease *lease_create(struct lm *lm,
 			goto err;
 
 		uint32_t crtc_id = lm->drm_resource->crtcs[crtc_index];
-		lease->crtc_id = crtc_id;
+		if (crtc_index == clone.crtc_index || !config->clone) {
+			lease->crtc_id = crtc_id;
+			lease->connector_id = cid;
+		}
 		lease->object_ids[lease->nobject_ids++] = crtc_id;
 		lease->object_ids[lease->nobject_ids++] = cid;
+		if (crtc_index == clone.crtc_index)
+			clone.next_object = lease->nobject_ids;
 	}
-	lease->is_granted = false;
-	lease->lease_fd = -1;
+	lease->topology_fd = lease_create_topology(lm, lease);
 
 	return lease;
 
@@ -511,7 +887,8 @@ static struct lm *drm_device_get_resources(const char *device)
 		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
 		return NULL;
 	}
-	lm->drm_fd = open(device, O_RDWR);
+	lm->drm = drm_backend_for_device(device);
+	lm->drm_fd = lm->drm->open(device);
 	if (lm->drm_fd < 0) {
 		ERROR_LOG("Cannot open DRM device (%s): %s\n", device,
 			  strerror(errno));
@@ -520,12 +897,19 @@ static struct lm *drm_device_get_resources(const char *device)
 
 	/* Enable universal planes so that ALL planes, even primary and cursor
 	 * planes can be assigned from lease configurations. */
-	if (drmSetClientCap(lm->drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1)) {
+	if (lm->drm->set_client_cap(lm->drm_fd,
+				    DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1)) {
 		DEBUG_LOG("drmSetClientCap failed\n");
 		goto err;
 	}
 
-	lm->drm_resource = drmModeGetResources(lm->drm_fd);
+	/* Atomic properties (CRTC_ID, FB_ID, MODE_ID, ...) are only visible
+	 * to atomic clients. They are needed for the lease topology, but
+	 * leases still work without them. */
+	if (lm->drm->set_client_cap(lm->drm_fd, DRM_CLIENT_CAP_ATOMIC, 1))
+		DEBUG_LOG("Atomic properties not available\n");
+
+	lm->drm_resource = lm->drm->get_resources(lm->drm_fd);
 	if (!lm->drm_resource) {
 		ERROR_LOG("Invalid DRM device(%s)\n", device);
 		DEBUG_LOG("drmModeGetResources failed: %s\n", strerror(errno));
@@ -539,63 +923,196 @@ static struct lm *drm_device_get_resources(const char *device)
 		goto err;
 	}
 
-	lm->drm_plane_resource = drmModeGetPlaneResources(lm->drm_fd);
+	lm->drm_plane_resource = lm->drm->get_plane_resources(lm->drm_fd);
 	if (!lm->drm_plane_resource) {
 		DEBUG_LOG("drmModeGetPlaneResources failed: %s\n",
 			  strerror(errno));
 		goto err;
 	}
 
-	struct stat st;
-	if (fstat(lm->drm_fd, &st) < 0 || !S_ISCHR(st.st_mode)) {
+	if (!lm->drm->get_device_id(lm->drm_fd, &lm->dev_id)) {
 		DEBUG_LOG("%s is not a valid device file\n", device);
 		goto err;
 	}
+	return lm;
+err:
+	lm_destroy(lm);
+	return NULL;
+}
 
-	lm->dev_id = st.st_rdev;
+/* Getting a connector can make the driver probe it, which is slow for some
+ * outputs, so connector names are only looked up when not cached */
+static bool drm_get_connector_names(struct lm *lm)
+{
+	int nconnectors = lm->drm_resource->count_connectors;
 
-	lm->nconnectors = lm->drm_resource->count_connectors;
-	lm->connector_names = calloc(lm->nconnectors, sizeof(char *));
+	lm->connector_names = calloc(nconnectors, sizeof(char *));
+	if (!lm->connector_names) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		return false;
+	}
+	lm->nconnectors = nconnectors;
 
 	for (int i = 0; i < lm->nconnectors; i++) {
 		drmModeConnectorPtr connector;
 		uint32_t cid = lm->drm_resource->connectors[i];
 
-		connector = drmModeGetConnector(lm->drm_fd, cid);
+		connector = lm->drm->get_connector(lm->drm_fd, cid);
 		lm->connector_names[i] = drm_create_connector_name(connector);
-		drmModeFreeConnector(connector);
+		lm->drm->free_connector(connector);
 
 		if (!lm->connector_names[i]) {
 			DEBUG_LOG("Can't create name for connector %d: %s\n",
 				  cid, strerror(errno));
-			goto err;
+			return false;
 		}
 	}
-	return lm;
-err:
-	lm_destroy(lm);
-	return NULL;
+	return true;
+}
+
+/* Poll interval while waiting for a configured device to appear */
+#define DEVICE_WAIT_INTERVAL_MS 100
+
+static bool drm_device_bus_id(drmDevicePtr dev, char *buf, size_t size)
+{
+	int n = -1;
+
+	switch (dev->bustype) {
+	case DRM_BUS_PCI:
+		n = snprintf(buf, size, "pci:%04x:%02x:%02x.%u",
+			     dev->businfo.pci->domain, dev->businfo.pci->bus,
+			     dev->businfo.pci->dev, dev->businfo.pci->func);
+		break;
+	case DRM_BUS_USB:
+		n = snprintf(buf, size, "usb:%03u:%03u", dev->businfo.usb->bus,
+			     dev->businfo.usb->dev);
+		break;
+	case DRM_BUS_PLATFORM:
+		n = snprintf(buf, size, "platform:%s",
+			     dev->businfo.platform->fullname);
+		break;
+	case DRM_BUS_HOST1X:
+		n = snprintf(buf, size, "host1x:%s",
+			     dev->businfo.host1x->fullname);
+		break;
+	}
+	return n >= 0 && (size_t)n < size;
 }
 
-static struct lm *drm_find_drm_device(const char *device)
+/* Resolve the sysfs device directory of a DRM node without opening it */
+static bool drm_device_sysfs_path(const char *node, char *buf)
+{
+	struct stat st;
+	char path[64];
+
+	if (stat(node, &st) < 0 || !S_ISCHR(st.st_mode))
+		return false;
+
+	snprintf(path, sizeof(path), "/sys/dev/char/%u:%u/device",
+		 major(st.st_rdev), minor(st.st_rdev));
+	return realpath(path, buf) != NULL;
+}
+
+static bool drm_device_matches(drmDevicePtr dev,
+			       const struct device_config *config)
+{
+	char buf[PATH_MAX];
+	const char *node = dev->nodes[DRM_NODE_PRIMARY];
+
+	if (config->bus_id && (!drm_device_bus_id(dev, buf, sizeof(buf)) ||
+			       strcmp(buf, config->bus_id)))
+		return false;
+
+	if (!config->sysfs_path && !config->driver)
+		return true;
+
+	if (!drm_device_sysfs_path(node, buf)) {
+		DEBUG_LOG("No sysfs device for %s\n", node);
+		return false;
+	}
+
+	if (config->sysfs_path && strcmp(buf, config->sysfs_path))
+		return false;
+
+	if (config->driver) {
+		char driver[PATH_MAX];
+		size_t len = strlen(buf);
+		if (len + sizeof("/driver") > sizeof(buf))
+			return false;
+		strcpy(buf + len, "/driver");
+
+		ssize_t n = readlink(buf, driver, sizeof(driver) - 1);
+		if (n < 0)
+			return false;
+		driver[n] = '\0';
+
+		char *name = strrchr(driver, '/');
+		if (strcmp(name ? name + 1 : driver, config->driver))
+			return false;
+	}
+	return true;
+}
+
+/* Open the first matching device that can be used.  Devices that don't
+ * match the config are not opened. */
+static struct lm *drm_open_matching_device(const struct device_config *config,
+					   bool *found)
 {
-	drmDevicePtr devices[64];
-	int ndevs;
 	struct lm *lm = NULL;
 
-	if (device)
-		return drm_device_get_resources(device);
+	*found = false;
+
+	int ndevs = drmGetDevices2(0, NULL, 0);
+	if (ndevs <= 0)
+		return NULL;
+
+	drmDevicePtr *devices = calloc(ndevs, sizeof(*devices));
+	if (!devices) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	ndevs = drmGetDevices2(0, devices, ndevs);
 
-	ndevs = drmGetDevices2(0, devices, 64);
+	for (int i = 0; i < ndevs && !lm; i++) {
+		if (!(devices[i]->available_nodes & (1 << DRM_NODE_PRIMARY)))
+			continue;
+		if (config && !drm_device_matches(devices[i], config))
+			continue;
 
-	for (int i = 0; i < ndevs; i++) {
+		*found = true;
 		lm = drm_device_get_resources(
 		    devices[i]->nodes[DRM_NODE_PRIMARY]);
-		if (lm)
-			break;
 	}
 
-	drmFreeDevices(devices, ndevs);
+	if (ndevs > 0)
+		drmFreeDevices(devices, ndevs);
+	free(devices);
+
+	return lm;
+}
+
+static struct lm *drm_find_drm_device(const char *device,
+				      const struct device_config *config)
+{
+	struct lm *lm;
+	bool found;
+
+	if (device)
+		return drm_device_get_resources(device);
+
+	uint32_t waited_ms = 0;
+	while (!(lm = drm_open_matching_device(config, &found))) {
+		if (found || !config || waited_ms >= config->wait_ms)
+			break;
+
+		if (waited_ms == 0)
+			INFO_LOG("Waiting up to %u ms for a matching DRM "
+				 "device\n",
+				 config->wait_ms);
+		usleep(DEVICE_WAIT_INTERVAL_MS * 1000);
+		waited_ms += DEVICE_WAIT_INTERVAL_MS;
+	}
 
 	return lm;
 }
@@ -616,6 +1133,7 @@ static int lm_create_leases(struct lm *lm, int num_leases,
 		if (!lease)
 			continue;
 
+		lease->config_index = i;
 		lm->leases[lm->nleases] = lease;
 		lm->nleases++;
 	}
@@ -625,20 +1143,276 @@ static int lm_create_leases(struct lm *lm, int num_leases,
 	return 0;
 }
 
-struct lm *lm_create_with_config(const char *device, int num_leases,
-				 struct lease_config *configs)
+/* Allocation cache
+ * The cache key covers everything the allocation depends on that can be
+ * checked without getting connectors: the device, the ids of its objects
+ * and the lease configuration.  Watchdog settings are always taken from
+ * the configuration, so they are left out. */
+static uint64_t hash_u32(uint64_t hash, uint32_t value)
+{
+	return ac_hash(hash, &value, sizeof(value));
+}
+
+static uint64_t hash_ids(uint64_t hash, const uint32_t *ids, int count)
+{
+	hash = hash_u32(hash, count);
+	return ac_hash(hash, ids, count * sizeof(uint32_t));
+}
+
+static uint64_t hash_str(uint64_t hash, const char *str)
+{
+	return str ? ac_hash(hash, str, strlen(str) + 1) : hash_u32(hash, 0);
+}
+
+static uint64_t lm_cache_key(struct lm *lm, int num_leases,
+			     const struct lease_config *configs)
+{
+	drmModeResPtr res = lm->drm_resource;
+	drmModePlaneResPtr plane_res = lm->drm_plane_resource;
+	uint64_t key = AC_HASH_INIT;
+
+	key = hash_str(key, lm->drm->name);
+	key = ac_hash(key, &lm->dev_id, sizeof(lm->dev_id));
+	key = hash_ids(key, res->crtcs, res->count_crtcs);
+	key = hash_ids(key, res->connectors, res->count_connectors);
+	key = hash_ids(key, res->encoders, res->count_encoders);
+	key = hash_ids(key, plane_res->planes, plane_res->count_planes);
+
+	if (!configs)
+		num_leases = 0;
+	key = hash_u32(key, num_leases);
+	for (int i = 0; i < num_leases; i++) {
+		const struct lease_config *config = &configs[i];
+
+		key = hash_str(key, config->lease_name);
+		key = hash_u32(key, config->nconnectors);
+		for (int j = 0; j < config->nconnectors; j++) {
+			struct connector_config *con = &config->connectors[j];
+			key = hash_str(key, con->name);
+			key = hash_u32(key, con->optional);
+			key = hash_ids(key, con->planes, con->nplanes);
+		}
+		key = hash_ids(key, config->connector_ids, config->ncids);
+		key = hash_u32(key, config->clone);
+	}
+	return key;
+}
+
+static void lm_free_leases(struct lm *lm)
+{
+	for (int i = 0; i < lm->nleases; i++)
+		lease_free(lm->leases[i]);
+	free(lm->leases);
+	lm->leases = NULL;
+	lm->nleases = 0;
+}
+
+static void lm_free_connector_names(struct lm *lm)
+{
+	for (int i = 0; i < lm->nconnectors; i++)
+		free(lm->connector_names[i]);
+	free(lm->connector_names);
+	lm->connector_names = NULL;
+	lm->nconnectors = 0;
+}
+
+static bool lm_restore_connector_names(struct lm *lm, const struct ac *ac)
+{
+	if (ac->nconnectors != lm->drm_resource->count_connectors)
+		return false;
+
+	lm->connector_names = calloc(ac->nconnectors, sizeof(char *));
+	if (!lm->connector_names) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		return false;
+	}
+	lm->nconnectors = ac->nconnectors;
+
+	for (int i = 0; i < lm->nconnectors; i++) {
+		lm->connector_names[i] = strdup(ac->connectors[i].name);
+		if (!lm->connector_names[i]) {
+			DEBUG_LOG("Memory allocation failed: %s\n",
+				  strerror(errno));
+			lm_free_connector_names(lm);
+			return false;
+		}
+	}
+	return true;
+}
+
+static struct lease *lease_restore(struct lm *lm,
+				   const struct lease_config *config,
+				   const struct ac_lease *cached)
+{
+	const struct ac_lease_record *record = &cached->record;
+
+	/* Cheap checks, in case the key matched by accident */
+	if (!id_in_list(record->crtc_id, lm->drm_resource->crtcs,
+			lm->drm_resource->count_crtcs) ||
+	    !id_in_list(record->connector_id, lm->drm_resource->connectors,
+			lm->drm_resource->count_connectors))
+		return NULL;
+
+	struct lease *lease = lease_alloc(lm, config);
+	if (!lease)
+		return NULL;
+
+	lease->object_ids =
+	    calloc(record->nobject_ids ? record->nobject_ids : 1,
+		   sizeof(uint32_t));
+	if (!lease->object_ids) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		lease_free(lease);
+		return NULL;
+	}
+	memcpy(lease->object_ids, cached->object_ids,
+	       record->nobject_ids * sizeof(uint32_t));
+	lease->nobject_ids = record->nobject_ids;
+	lease->crtc_id = record->crtc_id;
+	lease->connector_id = record->connector_id;
+
+	if (record->topology_size > 0) {
+		struct iovec iov = {
+		    .iov_base = cached->topology,
+		    .iov_len = record->topology_size,
+		};
+		lease->topology_fd =
+		    lease_seal_topology(lease, &iov, 1, record->topology_size);
+	}
+	return lease;
+}
+
+static bool lm_restore_leases(struct lm *lm, const struct ac *ac,
+			      int num_leases,
+			      const struct lease_config *configs)
+{
+	if (ac->nleases == 0)
+		return false;
+
+	lm->leases = calloc(ac->nleases, sizeof(struct lease *));
+	if (!lm->leases) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		return false;
+	}
+
+	for (int i = 0; i < ac->nleases; i++) {
+		const struct ac_lease *cached = &ac->leases[i];
+		uint32_t index = cached->record.config_index;
+		struct lease *lease = NULL;
+
+		if (index < (uint32_t)num_leases)
+			lease = lease_restore(lm, &configs[index], cached);
+		if (!lease) {
+			lm_free_leases(lm);
+			return false;
+		}
+
+		lease->config_index = index;
+		lm->leases[lm->nleases++] = lease;
+	}
+	return true;
+}
+
+static void *lease_read_topology(struct lease *lease, uint32_t *size)
+{
+	struct stat st;
+
+	*size = 0;
+	if (lease->topology_fd < 0 || fstat(lease->topology_fd, &st) < 0)
+		return NULL;
+
+	void *topology = malloc(st.st_size);
+	if (!topology)
+		return NULL;
+
+	if (pread(lease->topology_fd, topology, st.st_size, 0) !=
+	    st.st_size) {
+		free(topology);
+		return NULL;
+	}
+	*size = st.st_size;
+	return topology;
+}
+
+static void lm_save_cache(struct lm *lm, const char *cache_file,
+			  uint64_t key)
+{
+	struct ac ac = {
+	    .key = key,
+	    .connectors = calloc(lm->nconnectors, sizeof(struct ac_connector)),
+	    .nconnectors = lm->nconnectors,
+	    .leases = calloc(lm->nleases, sizeof(struct ac_lease)),
+	    .nleases = lm->nleases,
+	};
+
+	if (!ac.connectors || !ac.leases) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		goto out;
+	}
+
+	for (int i = 0; i < lm->nconnectors; i++) {
+		if (strlen(lm->connector_names[i]) >= AC_NAME_LEN) {
+			DEBUG_LOG("Connector name too long to cache: %s\n",
+				  lm->connector_names[i]);
+			goto out;
+		}
+		strcpy(ac.connectors[i].name, lm->connector_names[i]);
+	}
+
+	for (int i = 0; i < lm->nleases; i++) {
+		struct lease *lease = lm->leases[i];
+		struct ac_lease *cached = &ac.leases[i];
+
+		cached->record = (struct ac_lease_record){
+		    .config_index = lease->config_index,
+		    .crtc_id = lease->crtc_id,
+		    .connector_id = lease->connector_id,
+		    .nobject_ids = lease->nobject_ids,
+		};
+		cached->object_ids = lease->object_ids;
+		cached->topology =
+		    lease_read_topology(lease, &cached->record.topology_size);
+	}
+
+	ac_save(cache_file, &ac);
+out:
+	for (int i = 0; ac.leases && i < ac.nleases; i++)
+		free(ac.leases[i].topology);
+	free(ac.leases);
+	free(ac.connectors);
+}
+
+struct lm *lm_create_with_device_config(
+    const char *device, const struct device_config *device_config,
+    const char *cache_file, int num_leases, struct lease_config *configs)
 {
 	struct lease_config *default_configs = NULL;
-	struct lm *lm = drm_find_drm_device(device);
+	struct lm *lm = drm_find_drm_device(device, device_config);
 
 	if (!lm) {
 		ERROR_LOG("No available DRM device found\n");
 		return NULL;
 	}
 
+	uint64_t cache_key = 0;
+	struct ac *ac = NULL;
+	if (cache_file) {
+		cache_key = lm_cache_key(lm, num_leases, configs);
+		ac = ac_load(cache_file, cache_key);
+	}
+
+	if (!(ac && lm_restore_connector_names(lm, ac)) &&
+	    !drm_get_connector_names(lm)) {
+		ac_free(ac);
+		lm_destroy(lm);
+		ERROR_LOG("DRM connector enumeration failed\n");
+		return NULL;
+	}
+
 	if (configs == NULL || num_leases == 0) {
 		num_leases = create_default_lease_configs(lm, &default_configs);
 		if (num_leases < 0) {
+			ac_free(ac);
 			lm_destroy(lm);
 			ERROR_LOG("DRM connector enumeration failed\n");
 			return NULL;
@@ -646,16 +1420,29 @@ struct lm *lm_create_with_config(const char *device, int num_leases,
 		configs = default_configs;
 	}
 
-	if (lm_create_leases(lm, num_leases, configs) < 0) {
+	if (ac && lm_restore_leases(lm, ac, num_leases, configs)) {
+		INFO_LOG("Using cached lease allocation from %s\n",
+			 cache_file);
+	} else if (lm_create_leases(lm, num_leases, configs) < 0) {
 		lm_destroy(lm);
 		lm = NULL;
+	} else if (cache_file) {
+		lm_save_cache(lm, cache_file, cache_key);
 	}
 
+	ac_free(ac);
 	if (default_configs)
 		destroy_default_lease_configs(num_leases, default_configs);
 	return lm;
 }
 
+struct lm *lm_create_with_config(const char *device, int num_leases,
+				 struct lease_config *configs)
+{
+	return lm_create_with_device_config(device, NULL, NULL, num_leases,
+					    configs);
+}
+
 struct lm *lm_create(const char *device)
 {
 	return lm_create_with_config(device, 0, NULL);
@@ -669,18 +1456,17 @@ void lm_destroy(struct lm *lm)
 		struct lease_handle *lease_handle = &lm->leases[i]->base;
 		lm_lease_revoke(lm, lease_handle);
 		lm_lease_close(lease_handle);
+		lease_destroy_fallback_fb(lm, lm->leases[i]);
 		lease_free(lm->leases[i]);
 	}
 
 	free(lm->leases);
 
-	for (int i = 0; i < lm->nconnectors; i++)
-		free(lm->connector_names[i]);
-	free(lm->connector_names);
+	lm_free_connector_names(lm);
 
-	drmModeFreeResources(lm->drm_resource);
-	drmModeFreePlaneResources(lm->drm_plane_resource);
-	close(lm->drm_fd);
+	lm->drm->free_resources(lm->drm_resource);
+	lm->drm->free_plane_resources(lm->drm_plane_resource);
+	lm->drm->close(lm->drm_fd);
 	free(lm);
 }
 
@@ -705,11 +1491,14 @@ int lm_lease_grant(struct lm *lm, struct lease_handle *handle)
 	}
 
 	int lease_fd =
-	    drmModeCreateLease(lm->drm_fd, lease->object_ids,
-			       lease->nobject_ids, 0, &lease->lessee_id);
+	    lm->drm->create_lease(lm->drm_fd, lease->object_ids,
+				  lease->nobject_ids, 0, &lease->lessee_id);
+	TRACE_EVENT(lease_create, FR_EVENT_LEASE_CREATE, lease->base.name,
+		    lease_fd < 0 ? -errno : (int32_t)lease->lessee_id);
 	if (lease_fd < 0) {
-		ERROR_LOG("drmModeCreateLease failed on lease %s: %s\n",
-			  lease->base.name, strerror(errno));
+		ERROR_LOG_RATELIMITED(
+		    "drmModeCreateLease failed on lease %s: %s\n",
+		    lease->base.name, strerror(errno));
 		return -1;
 	}
 
@@ -752,11 +1541,119 @@ void lm_lease_revoke(struct lm *lm, struct lease_handle *handle)
 	if (!lease->is_granted)
 		return;
 
-	drmModeRevokeLease(lm->drm_fd, lease->lessee_id);
+	TRACE_EVENT(lease_revoke, FR_EVENT_LEASE_REVOKE, lease->base.name,
+		    (int32_t)lease->lessee_id);
+	lm->drm->revoke_lease(lm->drm_fd, lease->lessee_id);
 	cancel_lease_transition_thread(lease);
 	lease->is_granted = false;
 }
 
+int lm_lease_topology_fd(struct lease_handle *handle)
+{
+	assert(handle);
+
+	struct lease *lease = (struct lease *)handle;
+	return lease->topology_fd;
+}
+
+bool lm_lease_show_fallback(struct lm *lm, struct lease_handle *handle)
+{
+	assert(lm);
+	assert(handle);
+
+	struct lease *lease = (struct lease *)handle;
+	if (lease->is_granted)
+		return false;
+
+	drmModeCrtcPtr crtc = lm->drm->get_crtc(lm->drm_fd, lease->crtc_id);
+	if (!crtc)
+		return false;
+
+	bool ok = false;
+	if (!crtc->mode_valid) {
+		DEBUG_LOG("No active mode on lease %s\n", lease->base.name);
+		goto out;
+	}
+
+	if (!lease->fallback_fb_id &&
+	    !lease_create_fallback_fb(lm, lease, &crtc->mode))
+		goto out;
+
+	uint32_t *connector_ids;
+	int nconnectors = lease_get_crtc_connectors(lm, lease, &connector_ids);
+
+	if (lm->drm->set_crtc(lm->drm_fd, lease->crtc_id,
+			      lease->fallback_fb_id, 0, 0, connector_ids,
+			      nconnectors, &crtc->mode) < 0) {
+		ERROR_LOG_RATELIMITED(
+		    "Can't show fallback framebuffer on lease %s: %s\n",
+		    lease->base.name, strerror(errno));
+		goto out;
+	}
+	ok = true;
+out:
+	lm->drm->free_crtc(crtc);
+	return ok;
+}
+
+const struct lease_watchdog *lm_lease_watchdog(struct lease_handle *handle)
+{
+	assert(handle);
+
+	struct lease *lease = (struct lease *)handle;
+	return &lease->watchdog;
+}
+
+uint32_t lm_lease_lessee_id(struct lease_handle *handle)
+{
+	assert(handle);
+
+	struct lease *lease = (struct lease *)handle;
+	return lease->is_granted ? lease->lessee_id : 0;
+}
+
+int lm_get_drm_fd(struct lm *lm)
+{
+	assert(lm);
+	return lm->drm_fd;
+}
+
+const struct drm_backend *lm_get_drm_backend(struct lm *lm)
+{
+	assert(lm);
+	return lm->drm;
+}
+
+uint32_t lm_lease_crtc_id(struct lease_handle *handle)
+{
+	assert(handle);
+
+	struct lease *lease = (struct lease *)handle;
+	return lease->crtc_id;
+}
+
+int lm_lease_crtc_ids(struct lm *lm, struct lease_handle *handle,
+		      uint32_t *crtc_ids, int max)
+{
+	assert(lm);
+	assert(handle);
+
+	struct lease *lease = (struct lease *)handle;
+	int count = 0;
+
+	for (int i = 0; i < lease->nobject_ids; i++) {
+		uint32_t id = lease->object_ids[i];
+		if (!id_in_list(id, lm->drm_resource->crtcs,
+				lm->drm_resource->count_crtcs))
+			continue;
+
+		if (count < max)
+			crtc_ids[count] = id;
+		count++;
+	}
+	return count;
+}
+
 void lm_lease_close(struct lease_handle *handle)
 {
 	assert(handle);
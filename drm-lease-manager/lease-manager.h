@@ -17,11 +17,21 @@
 #define LEASE_MANAGER_H
 #include "drm-lease.h"
 
+#include <stdint.h>
+
+struct drm_backend;
 struct lm;
 
 struct lm *lm_create(const char *path);
 struct lm *lm_create_with_config(const char *path, int leases,
 				 struct lease_config *configs);
+/* Like lm_create_with_config(), selecting the device with device_config
+ * when no path is given.  If cache_file is set, the lease allocation is
+ * read from it when it matches the device and configuration, and written
+ * to it otherwise. */
+struct lm *lm_create_with_device_config(
+    const char *path, const struct device_config *device_config,
+    const char *cache_file, int leases, struct lease_config *configs);
 
 void lm_destroy(struct lm *lm);
 
@@ -31,4 +41,23 @@ int lm_lease_grant(struct lm *lm, struct lease_handle *lease_handle);
 int lm_lease_transfer(struct lm *lm, struct lease_handle *lease_handle);
 void lm_lease_revoke(struct lm *lm, struct lease_handle *lease_handle);
 void lm_lease_close(struct lease_handle *lease_handle);
+int lm_lease_topology_fd(struct lease_handle *lease_handle);
+
+/* Replace the content of a revoked lease with a black framebuffer */
+bool lm_lease_show_fallback(struct lm *lm, struct lease_handle *lease_handle);
+
+/* DRM lessee id of a granted lease, or 0 if the lease is not granted */
+uint32_t lm_lease_lessee_id(struct lease_handle *lease_handle);
+
+/* For monitoring leased outputs through the DRM master fd */
+int lm_get_drm_fd(struct lm *lm);
+const struct drm_backend *lm_get_drm_backend(struct lm *lm);
+uint32_t lm_lease_crtc_id(struct lease_handle *lease_handle);
+
+/* Fill in up to max of the CRTCs in the lease, and return how many there
+ * are.  Leases with several connectors can have more than one. */
+int lm_lease_crtc_ids(struct lm *lm, struct lease_handle *lease_handle,
+		      uint32_t *crtc_ids, int max);
+const struct lease_watchdog *
+lm_lease_watchdog(struct lease_handle *lease_handle);
 #endif
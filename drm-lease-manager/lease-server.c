@@ -13,9 +13,11 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE
 #include "lease-server.h"
 
 #include "dlm-protocol.h"
+#include "flight-recorder.h"
 #include "log.h"
 #include "socket-path.h"
 
@@ -23,42 +25,74 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/epoll.h>
 #include <sys/file.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
 #define SOCK_LOCK_SUFFIX ".lock"
 
 /* ACTIVE_CLIENTS
  * An 'active' client is one that either
- *  - owns a lease, or
+ *  - owns a lease,
  *  - is requesting ownership of a lease (which will
- *    disconnect the current owner if granted)
+ *    disconnect the current owner if granted), or
+ *  - has yielded the lease, but kept the connection open
+ *    so that it can quickly reacquire it (a 'parked' client)
  *
  * There can only be at most one of each kind of client at the same
  * time. Any other client connections are queued in the
- * listen() backlog, waiting to be accept()'ed.
+ * listen() backlog, waiting to be accept()'ed.  If all slots are in
+ * use, a parked client is disconnected to make room for the new
+ * connection.  It will have to reconnect to reacquire the lease.
  */
-#define ACTIVE_CLIENTS 2
+#define ACTIVE_CLIENTS 3
+
+/* CONTROL_CLIENTS
+ * Number of simultaneous connections on the control socket, on top of
+ * ACTIVE_CLIENTS for every lease.
+ * Control socket clients name the lease in their request, so they aren't
+ * tied to a particular lease until the first request is received.
+ */
+#define CONTROL_CLIENTS 32
+
+enum ls_socket_type {
+	LS_SOCKET_SERVER,
+	LS_SOCKET_CONTROL,
+	LS_SOCKET_CLIENT,
+	LS_SOCKET_PROCESS, /* pidfd of a client process */
+	LS_SOCKET_EVENT,
+};
 
 struct ls_socket {
 	int fd;
-	bool is_server;
+	enum ls_socket_type type;
 	union {
 		struct ls_server *server;
+		struct ls_control *control;
 		struct ls_client *client;
 	};
 };
 
 struct ls_client {
 	struct ls_socket socket;
+	struct ls_socket process;
 	struct ls_server *serv;
 	bool is_connected;
+	bool is_parked;
+	bool is_control;
+	bool wants_topology;
+	struct timespec request_time;
+	pid_t pid;
+	uint32_t id;
 };
 
 struct ls_server {
@@ -70,36 +104,223 @@ struct ls_server {
 	struct ls_client clients[ACTIVE_CLIENTS];
 };
 
+struct ls_control {
+	struct sockaddr_un address;
+	int socket_lock;
+
+	struct ls_socket listen;
+	int nclients;
+	struct ls_client clients[];
+};
+
 struct ls {
 	int epoll_fd;
 
 	struct ls_server *servers;
 	int nservers;
+
+	/* Open addressing hash table of servers, indexed by lease name */
+	struct ls_server **index;
+	uint32_t index_mask;
+
+	struct ls_control *control;
+
+	struct ls_socket event;
+
+	uint32_t next_client_id;
+
+	/* Users and groups allowed on abstract sockets */
+	uid_t *allowed_uids;
+	int nallowed_uids;
+	gid_t *allowed_gids;
+	int nallowed_gids;
 };
 
-static void client_connect(struct ls *ls, struct ls_server *serv)
+/* FNV-1a */
+static uint32_t lease_name_hash(const char *name)
 {
-	int cfd = accept(serv->listen.fd, NULL, NULL);
-	if (cfd < 0) {
-		DEBUG_LOG("accept failed on %s: %s\n", serv->address.sun_path,
-			  strerror(errno));
-		return;
+	uint32_t hash = 2166136261u;
+
+	while (*name) {
+		hash ^= (uint8_t)*name++;
+		hash *= 16777619u;
 	}
+	return hash;
+}
 
-	struct ls_client *client = NULL;
+static bool build_lease_index(struct ls *ls)
+{
+	uint32_t size = 1;
+	while (size < 2 * (uint32_t)ls->nservers)
+		size <<= 1;
 
-	for (int i = 0; i < ACTIVE_CLIENTS; i++) {
-		if (!serv->clients[i].is_connected) {
-			client = &serv->clients[i];
-			break;
+	ls->index = calloc(size, sizeof(*ls->index));
+	if (!ls->index) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		return false;
+	}
+	ls->index_mask = size - 1;
+
+	for (int i = 0; i < ls->nservers; i++) {
+		struct ls_server *serv = &ls->servers[i];
+		const char *name = serv->lease_handle->name;
+		uint32_t slot = lease_name_hash(name);
+
+		struct ls_server *other;
+		while ((other = ls->index[slot & ls->index_mask])) {
+			/* Normally caught by the socket lock, but there are
+			 * no per-lease sockets in control-only mode */
+			if (!strcmp(other->lease_handle->name, name)) {
+				ERROR_LOG("Duplicate lease name %s\n", name);
+				return false;
+			}
+			slot++;
 		}
+		ls->index[slot & ls->index_mask] = serv;
+	}
+	return true;
+}
+
+static struct ls_server *find_server(struct ls *ls, const char *name)
+{
+	uint32_t slot = lease_name_hash(name);
+	struct ls_server *serv;
+
+	while ((serv = ls->index[slot & ls->index_mask])) {
+		if (!strcmp(serv->lease_handle->name, name))
+			return serv;
+		slot++;
+	}
+	return NULL;
+}
+
+static const char *client_lease_name(struct ls_client *client)
+{
+	return client->serv ? client->serv->lease_handle->name : NULL;
+}
+
+static struct ls_client *find_free_client(struct ls *ls,
+					   struct ls_client *clients, int count)
+{
+	for (int i = 0; i < count; i++) {
+		if (!clients[i].is_connected)
+			return &clients[i];
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (clients[i].is_parked) {
+			DEBUG_LOG("Dropping parked client on %s\n",
+				  sockaddr_name(&clients[i].serv->address));
+			ls_disconnect_client(ls, &clients[i]);
+			return &clients[i];
+		}
+	}
+	return NULL;
+}
+
+/* Watch the client process, so that its exit is noticed even if the socket
+ * is kept open by child processes that have inherited it. */
+static void watch_client_process(struct ls *ls, struct ls_client *client)
+{
+	client->process.fd = -1;
+	if (client->pid <= 0)
+		return;
+
+#ifdef SYS_pidfd_open
+	int pidfd = syscall(SYS_pidfd_open, client->pid, 0);
+#else
+	int pidfd = -1;
+	errno = ENOSYS;
+#endif
+	if (pidfd < 0) {
+		DEBUG_LOG("pidfd_open failed: %s\n", strerror(errno));
+		return;
+	}
+
+	client->process.type = LS_SOCKET_PROCESS;
+	client->process.client = client;
+
+	struct epoll_event ev = {
+	    .events = POLLIN,
+	    .data.ptr = &client->process,
+	};
+	if (epoll_ctl(ls->epoll_fd, EPOLL_CTL_ADD, pidfd, &ev)) {
+		DEBUG_LOG("epoll_ctl add failed: %s\n", strerror(errno));
+		close(pidfd);
+		return;
+	}
+	client->process.fd = pidfd;
+}
+
+static bool client_has_pending_request(struct ls_client *client)
+{
+	struct pollfd pfd = {
+	    .fd = client->socket.fd,
+	    .events = POLLIN,
+	};
+	return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+
+/* Abstract sockets have no filesystem permissions to restrict access, so
+ * check the peer credentials instead */
+static bool is_peer_allowed(struct ls *ls, const struct ucred *cred)
+{
+	if (cred->uid == 0 || cred->uid == geteuid())
+		return true;
+
+	for (int i = 0; i < ls->nallowed_uids; i++) {
+		if (cred->uid == ls->allowed_uids[i])
+			return true;
+	}
+
+	for (int i = 0; i < ls->nallowed_gids; i++) {
+		if (cred->gid == ls->allowed_gids[i])
+			return true;
 	}
+	return false;
+}
+
+static void client_connect(struct ls *ls, struct ls_socket *listen,
+			   struct ls_client *clients, int count)
+{
+	int cfd = accept(listen->fd, NULL, NULL);
+	if (cfd < 0) {
+		DEBUG_LOG("accept failed: %s\n", strerror(errno));
+		return;
+	}
+
+	const struct sockaddr_un *address = listen->type == LS_SOCKET_CONTROL
+						? &listen->control->address
+						: &listen->server->address;
+
+	struct ucred cred;
+	socklen_t cred_len = sizeof(cred);
+	bool has_cred =
+	    getsockopt(cfd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == 0;
+	if (!has_cred)
+		cred.pid = 0;
+
+	if (sockaddr_is_abstract(address) &&
+	    !(has_cred && is_peer_allowed(ls, &cred))) {
+		ERROR_LOG_RATELIMITED("Connection from uid %d rejected on %s\n",
+				      has_cred ? (int)cred.uid : -1,
+				      sockaddr_name(address));
+		close(cfd);
+		return;
+	}
+
+	struct ls_client *client = find_free_client(ls, clients, count);
 	if (!client) {
+		ERROR_LOG_RATELIMITED(
+		    "Too many clients on %s, connection rejected\n",
+		    sockaddr_name(address));
 		close(cfd);
 		return;
 	}
 
 	client->socket.fd = cfd;
+	client->id = ++ls->next_client_id;
+	client->pid = cred.pid;
 
 	struct epoll_event ev = {
 	    .events = POLLIN,
@@ -112,24 +333,61 @@ static void client_connect(struct ls *ls, struct ls_server *serv)
 	}
 
 	client->is_connected = true;
+	watch_client_process(ls, client);
+	TRACE_EVENT(accept, FR_EVENT_ACCEPT, client_lease_name(client), cfd);
+}
+
+/* Control socket clients are attached to a lease by their first request */
+static bool bind_control_client(struct ls *ls, struct ls_client *client,
+				struct dlm_client_request *hdr)
+{
+	if (hdr->opcode != DLM_GET_LEASE) {
+		DEBUG_LOG("Control socket client must request a lease first\n");
+		return false;
+	}
+
+	hdr->lease_name[sizeof(hdr->lease_name) - 1] = '\0';
+
+	struct ls_server *serv = find_server(ls, hdr->lease_name);
+	if (!serv) {
+		ERROR_LOG_RATELIMITED("Request for unknown lease: %s\n",
+				      hdr->lease_name);
+		return false;
+	}
+
+	client->serv = serv;
+	return true;
 }
 
-static int parse_client_request(struct ls_socket *client)
+static int parse_client_request(struct ls *ls, struct ls_client *client)
 {
 	int ret = -1;
 	struct dlm_client_request hdr;
-	if (!receive_dlm_client_request(client->fd, &hdr))
+	if (!receive_dlm_client_request(client->socket.fd, &hdr))
 		return ret;
 
+	if (!client->serv && !bind_control_client(ls, client, &hdr)) {
+		ls_disconnect_client(ls, client);
+		return ret;
+	}
+
+	TRACE_EVENT(request, FR_EVENT_REQUEST, client_lease_name(client),
+		    hdr.opcode);
+
 	switch (hdr.opcode) {
 	case DLM_GET_LEASE:
 		ret = LS_REQ_GET_LEASE;
+		client->wants_topology = hdr.flags & DLM_REQUEST_TOPOLOGY;
+		clock_gettime(CLOCK_MONOTONIC, &client->request_time);
 		break;
 	case DLM_RELEASE_LEASE:
 		ret = LS_REQ_RELEASE_LEASE;
 		break;
+	case DLM_YIELD_LEASE:
+		ret = LS_REQ_YIELD_LEASE;
+		break;
 	default:
-		ERROR_LOG("Unexpected client request received\n");
+		ERROR_LOG_RATELIMITED("Unexpected client request received\n");
 		break;
 	};
 
@@ -170,21 +428,34 @@ static int create_socket_lock(struct sockaddr_un *addr)
 	return lock_fd;
 }
 
-static bool server_setup(struct ls *ls, struct ls_server *serv,
-			 struct lease_handle *lease_handle)
+/* Abstract sockets don't have a filesystem path, and bind() fails if the
+ * name is already in use, so they don't need a lock file. */
+static int socket_lock(struct sockaddr_un *addr)
 {
-	struct sockaddr_un *address = &serv->address;
+	if (sockaddr_is_abstract(addr))
+		return -1;
 
-	if (!sockaddr_set_lease_server_path(address, lease_handle->name))
-		return false;
+	return create_socket_lock(addr);
+}
 
-	int socket_lock = create_socket_lock(address);
-	if (socket_lock < 0)
-		return false;
+static void socket_unlink(struct sockaddr_un *addr)
+{
+	if (sockaddr_is_abstract(addr))
+		return;
 
+	if (unlink(addr->sun_path)) {
+		WARN_LOG("Server socket %s delete failed: %s\n", addr->sun_path,
+			 strerror(errno));
+	}
+}
+
+static bool socket_listen(struct ls *ls, struct sockaddr_un *address,
+			  struct ls_socket *listen_sock)
+{
 	/* The socket address is now owned by this instance, so any existing
 	 * sockets can safely be removed */
-	unlink(address->sun_path);
+	if (!sockaddr_is_abstract(address))
+		unlink(address->sun_path);
 
 	address->sun_family = AF_UNIX;
 
@@ -194,68 +465,169 @@ static bool server_setup(struct ls *ls, struct ls_server *serv,
 		return false;
 	}
 
-	if (bind(server_socket, (struct sockaddr *)address, sizeof(*address))) {
+	if (bind(server_socket, (struct sockaddr *)address,
+		 sockaddr_len(address))) {
 		ERROR_LOG("Failed to create named socket at %s: %s\n",
-			  address->sun_path, strerror(errno));
+			  sockaddr_name(address), strerror(errno));
 		close(server_socket);
 		return false;
 	}
 
 	if (listen(server_socket, 0)) {
-		DEBUG_LOG("listen failed on %s: %s\n", address->sun_path,
+		DEBUG_LOG("listen failed on %s: %s\n", sockaddr_name(address),
 			  strerror(errno));
-		close(server_socket);
+		goto err;
+	}
+
+	listen_sock->fd = server_socket;
+
+	struct epoll_event ev = {
+	    .events = POLLIN,
+	    .data.ptr = listen_sock,
+	};
+
+	if (epoll_ctl(ls->epoll_fd, EPOLL_CTL_ADD, server_socket, &ev)) {
+		DEBUG_LOG("epoll_ctl add failed: %s\n", strerror(errno));
+		goto err;
+	}
+	return true;
+err:
+	close(server_socket);
+	if (!sockaddr_is_abstract(address))
 		unlink(address->sun_path);
+	return false;
+}
+
+static bool server_setup(struct ls *ls, struct ls_server *serv,
+			 struct lease_handle *lease_handle, uint32_t flags)
+{
+	struct sockaddr_un *address = &serv->address;
+
+	/* Also used to name the lease in log messages */
+	if (!sockaddr_set_lease_server_path(address, lease_handle->name))
 		return false;
-	}
 
 	for (int i = 0; i < ACTIVE_CLIENTS; i++) {
 		struct ls_client *client = &serv->clients[i];
 		client->serv = serv;
 		client->socket.client = client;
+		client->socket.type = LS_SOCKET_CLIENT;
 	}
 
 	serv->lease_handle = lease_handle;
-	serv->server_socket_lock = socket_lock;
 
-	serv->listen.fd = server_socket;
-	serv->listen.server = serv;
-	serv->listen.is_server = true;
+	if (flags & LS_CONTROL_ONLY) {
+		serv->listen.fd = -1;
+		serv->server_socket_lock = -1;
+		return true;
+	}
 
-	struct epoll_event ev = {
-	    .events = POLLIN,
-	    .data.ptr = &serv->listen,
-	};
+	int lock = socket_lock(address);
+	if (lock < 0 && !sockaddr_is_abstract(address))
+		return false;
 
-	if (epoll_ctl(ls->epoll_fd, EPOLL_CTL_ADD, server_socket, &ev)) {
-		DEBUG_LOG("epoll_ctl add failed: %s\n", strerror(errno));
-		close(server_socket);
-		unlink(address->sun_path);
+	serv->listen.server = serv;
+	serv->listen.type = LS_SOCKET_SERVER;
+
+	if (!socket_listen(ls, address, &serv->listen)) {
+		if (lock >= 0)
+			close(lock);
 		return false;
 	}
 
+	serv->server_socket_lock = lock;
+
 	INFO_LOG("Lease server (%s) initialized at %s\n", lease_handle->name,
-		 address->sun_path);
+		 sockaddr_name(address));
 	return true;
 }
 
 static void server_shutdown(struct ls *ls, struct ls_server *serv)
 {
-	if (unlink(serv->address.sun_path)) {
-		WARN_LOG("Server socket %s delete failed: %s\n",
-			 serv->address.sun_path, strerror(errno));
-	}
+	if (serv->listen.fd >= 0) {
+		socket_unlink(&serv->address);
 
-	epoll_ctl(ls->epoll_fd, EPOLL_CTL_DEL, serv->listen.fd, NULL);
-	close(serv->listen.fd);
+		epoll_ctl(ls->epoll_fd, EPOLL_CTL_DEL, serv->listen.fd, NULL);
+		close(serv->listen.fd);
+	}
 
 	for (int i = 0; i < ACTIVE_CLIENTS; i++)
 		ls_disconnect_client(ls, &serv->clients[i]);
 
-	close(serv->server_socket_lock);
+	if (serv->server_socket_lock >= 0)
+		close(serv->server_socket_lock);
+}
+
+/* Control socket
+ * A single socket that can be used to request any lease by name, so that
+ * clients don't need to know the per-lease socket path. */
+static bool control_setup(struct ls *ls)
+{
+	/* Every lease can be held through the control socket */
+	int nclients = ls->nservers * ACTIVE_CLIENTS + CONTROL_CLIENTS;
+
+	struct ls_control *control =
+	    calloc(1, sizeof(*control) + nclients * sizeof(struct ls_client));
+	if (!control) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		return false;
+	}
+
+	struct sockaddr_un *address = &control->address;
+	if (!sockaddr_set_lease_server_path(address, DLM_CONTROL_SOCKET_NAME))
+		goto err;
+
+	control->socket_lock = socket_lock(address);
+	if (control->socket_lock < 0 && !sockaddr_is_abstract(address))
+		goto err;
+
+	control->listen.control = control;
+	control->listen.type = LS_SOCKET_CONTROL;
+
+	if (!socket_listen(ls, address, &control->listen)) {
+		if (control->socket_lock >= 0)
+			close(control->socket_lock);
+		goto err;
+	}
+
+	control->nclients = nclients;
+	for (int i = 0; i < nclients; i++) {
+		struct ls_client *client = &control->clients[i];
+		client->is_control = true;
+		client->socket.client = client;
+		client->socket.type = LS_SOCKET_CLIENT;
+	}
+
+	ls->control = control;
+	INFO_LOG("Control socket initialized at %s\n", sockaddr_name(address));
+	return true;
+err:
+	free(control);
+	return false;
+}
+
+static void control_shutdown(struct ls *ls, struct ls_control *control)
+{
+	socket_unlink(&control->address);
+
+	epoll_ctl(ls->epoll_fd, EPOLL_CTL_DEL, control->listen.fd, NULL);
+	close(control->listen.fd);
+
+	for (int i = 0; i < control->nclients; i++)
+		ls_disconnect_client(ls, &control->clients[i]);
+
+	if (control->socket_lock >= 0)
+		close(control->socket_lock);
+	free(control);
 }
 
 struct ls *ls_create(struct lease_handle **lease_handles, int count)
+{
+	return ls_create_with_flags(lease_handles, count, 0);
+}
+
+struct ls *ls_create_with_flags(struct lease_handle **lease_handles,
+				int count, uint32_t flags)
 {
 	assert(lease_handles);
 	assert(count > 0);
@@ -280,10 +652,18 @@ struct ls *ls_create(struct lease_handle **lease_handles, int count)
 	}
 
 	for (int i = 0; i < count; i++) {
-		if (!server_setup(ls, &ls->servers[i], lease_handles[i]))
+		if (!server_setup(ls, &ls->servers[i], lease_handles[i],
+				  flags))
 			goto err;
 		ls->nservers++;
 	}
+
+	if (!build_lease_index(ls))
+		goto err;
+
+	if (!control_setup(ls))
+		goto err;
+
 	return ls;
 err:
 	ls_destroy(ls);
@@ -294,15 +674,98 @@ void ls_destroy(struct ls *ls)
 {
 	assert(ls);
 
+	if (ls->control)
+		control_shutdown(ls, ls->control);
+
 	for (int i = 0; i < ls->nservers; i++)
 		server_shutdown(ls, &ls->servers[i]);
 
 	close(ls->epoll_fd);
+	free(ls->allowed_uids);
+	free(ls->allowed_gids);
+	free(ls->index);
 	free(ls->servers);
 	free(ls);
 }
 
+/* A parked client doesn't hold the lease, so its requests only need to be
+ * passed on when it wants the lease back. */
+static int parked_client_request(struct ls *ls, struct ls_client *client,
+				 int request)
+{
+	switch (request) {
+	case LS_REQ_GET_LEASE:
+		client->is_parked = false;
+		return request;
+	case LS_REQ_RELEASE_LEASE:
+	case LS_REQ_CLIENT_DISCONNECT:
+		ls_disconnect_client(ls, client);
+		return -1;
+	default:
+		return -1;
+	}
+}
+
+bool ls_allow_peers(struct ls *ls, const uid_t *uids, int nuids,
+		    const gid_t *gids, int ngids)
+{
+	assert(ls);
+	assert(nuids >= 0 && ngids >= 0);
+
+	/* Never empty, so that allocation failures are unambiguous */
+	uid_t *allowed_uids = calloc(nuids + 1, sizeof(uid_t));
+	gid_t *allowed_gids = calloc(ngids + 1, sizeof(gid_t));
+	if (!allowed_uids || !allowed_gids) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		free(allowed_uids);
+		free(allowed_gids);
+		return false;
+	}
+
+	for (int i = 0; i < nuids; i++)
+		allowed_uids[i] = uids[i];
+	for (int i = 0; i < ngids; i++)
+		allowed_gids[i] = gids[i];
+
+	free(ls->allowed_uids);
+	free(ls->allowed_gids);
+	ls->allowed_uids = allowed_uids;
+	ls->nallowed_uids = nuids;
+	ls->allowed_gids = allowed_gids;
+	ls->nallowed_gids = ngids;
+	return true;
+}
+
+bool ls_add_event_fd(struct ls *ls, int fd)
+{
+	assert(ls);
+
+	ls->event.fd = fd;
+	ls->event.type = LS_SOCKET_EVENT;
+
+	struct epoll_event ev = {
+	    .events = POLLIN,
+	    .data.ptr = &ls->event,
+	};
+	if (epoll_ctl(ls->epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+		DEBUG_LOG("epoll_ctl add failed: %s\n", strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+int ls_get_fd(struct ls *ls)
+{
+	assert(ls);
+	return ls->epoll_fd;
+}
+
 bool ls_get_request(struct ls *ls, struct ls_req *req)
+{
+	return ls_wait_request(ls, req, -1) > 0;
+}
+
+int ls_wait_request(struct ls *ls, struct ls_req *req, int timeout_ms)
 {
 	assert(ls);
 	assert(req);
@@ -310,39 +773,85 @@ bool ls_get_request(struct ls *ls, struct ls_req *req)
 	int request = -1;
 	while (request < 0) {
 		struct epoll_event ev;
-		if (epoll_wait(ls->epoll_fd, &ev, 1, -1) < 0) {
+		int nevents = epoll_wait(ls->epoll_fd, &ev, 1, timeout_ms);
+		if (nevents < 0) {
 			if (errno == EINTR)
 				continue;
 			DEBUG_LOG("epoll_wait failed: %s\n", strerror(errno));
-			return false;
+			return -1;
 		}
+		if (nevents == 0)
+			return 0;
 
 		struct ls_socket *sock = ev.data.ptr;
 		assert(sock);
 
-		if (sock->is_server) {
+		if (sock->type == LS_SOCKET_SERVER) {
 			if (ev.events & POLLIN)
-				client_connect(ls, sock->server);
+				client_connect(ls, sock, sock->server->clients,
+					       ACTIVE_CLIENTS);
 			continue;
 		}
 
-		if (ev.events & POLLIN)
-			request = parse_client_request(sock);
+		if (sock->type == LS_SOCKET_CONTROL) {
+			if (ev.events & POLLIN)
+				client_connect(ls, sock, sock->control->clients,
+					       sock->control->nclients);
+			continue;
+		}
+
+		if (sock->type == LS_SOCKET_EVENT) {
+			req->lease_handle = NULL;
+			req->client = NULL;
+			req->type = LS_REQ_EVENT;
+			return 1;
+		}
+
+		struct ls_client *client = sock->client;
+
+		if (sock->type == LS_SOCKET_PROCESS) {
+			/* Handle requests sent before the exit first */
+			if (client_has_pending_request(client))
+				continue;
+			request = LS_REQ_CLIENT_DISCONNECT;
+		} else if (ev.events & POLLIN) {
+			request = parse_client_request(ls, client);
+		}
+
+		if (!client->is_connected)
+			continue;
 
 		if (request < 0 && (ev.events & POLLHUP))
 			request = LS_REQ_CLIENT_DISCONNECT;
 
-		struct ls_client *client = sock->client;
-		struct ls_server *server = client->serv;
+		/* Control socket client left before naming a lease */
+		if (!client->serv) {
+			ls_disconnect_client(ls, client);
+			continue;
+		}
+
+		if (client->is_parked)
+			request = parked_client_request(ls, client, request);
+		else if (request == LS_REQ_YIELD_LEASE)
+			client->is_parked = true;
 
-		req->lease_handle = server->lease_handle;
+		req->lease_handle = client->serv->lease_handle;
 		req->client = client;
 		req->type = request;
 	}
-	return true;
+	return 1;
+}
+
+static int64_t elapsed_us(const struct timespec *since)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)(now.tv_sec - since->tv_sec) * 1000000 +
+	       (now.tv_nsec - since->tv_nsec) / 1000;
 }
 
-bool ls_send_fd(struct ls *ls, struct ls_client *client, int fd)
+bool ls_send_fd(struct ls *ls, struct ls_client *client, int fd,
+		int topology_fd)
 {
 	assert(ls);
 	assert(client);
@@ -352,19 +861,40 @@ bool ls_send_fd(struct ls *ls, struct ls_client *client, int fd)
 	if (fd < 0)
 		return false;
 
-	if (!send_lease_fd(client->socket.fd, fd)) {
-		DEBUG_LOG("sendmsg failed on %s: %s\n", serv->address.sun_path,
-			  strerror(errno));
+	if (!client->wants_topology)
+		topology_fd = -1;
+
+	if (!send_lease_fd(client->socket.fd, fd, topology_fd)) {
+		DEBUG_LOG("sendmsg failed on %s: %s\n",
+			  sockaddr_name(&serv->address), strerror(errno));
 		return false;
 	}
 
-	if (fd > 0)
-		INFO_LOG("Lease request granted on %s\n",
-			 serv->address.sun_path);
+	if (fd > 0) {
+		struct dlm_log_fields fields = {
+		    .lease = serv->lease_handle->name,
+		    .client = ls_client_id(client),
+		    .latency_us = elapsed_us(&client->request_time),
+		};
+		INFO_LOG_FIELDS(&fields, "Lease request granted on %s\n",
+				sockaddr_name(&serv->address));
+	}
 
 	return true;
 }
 
+pid_t ls_client_pid(struct ls_client *client)
+{
+	assert(client);
+	return client->pid;
+}
+
+uint32_t ls_client_id(struct ls_client *client)
+{
+	assert(client);
+	return client->id;
+}
+
 void ls_disconnect_client(struct ls *ls, struct ls_client *client)
 {
 	assert(ls);
@@ -373,7 +903,68 @@ void ls_disconnect_client(struct ls *ls, struct ls_client *client)
 	if (!client->is_connected)
 		return;
 
+	TRACE_EVENT(disconnect, FR_EVENT_DISCONNECT, client_lease_name(client),
+		    client->socket.fd);
+
 	epoll_ctl(ls->epoll_fd, EPOLL_CTL_DEL, client->socket.fd, NULL);
 	close(client->socket.fd);
+	if (client->process.fd >= 0) {
+		epoll_ctl(ls->epoll_fd, EPOLL_CTL_DEL, client->process.fd,
+			  NULL);
+		close(client->process.fd);
+		client->process.fd = -1;
+	}
 	client->is_connected = false;
+	client->is_parked = false;
+
+	if (client->is_control)
+		client->serv = NULL;
+}
+
+/* Notify a lease owner that its lease has been revoked, then disconnect it.
+ * The event is queued on the socket, so it can still be read by the client
+ * after the connection is closed. */
+void ls_revoke_client(struct ls *ls, struct ls_client *client)
+{
+	assert(ls);
+	assert(client);
+
+	if (!client->is_connected)
+		return;
+
+	TRACE_EVENT(client_revoke, FR_EVENT_CLIENT_REVOKE,
+		    client_lease_name(client), client->socket.fd);
+
+	if (!send_dlm_event(client->socket.fd, DLM_EVENT_LEASE_REVOKED)) {
+		DEBUG_LOG("Revoke notification failed on %s: %s\n",
+			  sockaddr_name(&client->serv->address),
+			  strerror(errno));
+	}
+
+	ls_disconnect_client(ls, client);
+}
+
+static void notify_parked_clients(struct ls_client *clients, int count,
+				  struct ls_server *serv)
+{
+	for (int i = 0; i < count; i++) {
+		struct ls_client *client = &clients[i];
+		if (client->is_parked && client->serv == serv)
+			send_dlm_event(client->socket.fd,
+				       DLM_EVENT_LEASE_AVAILABLE);
+	}
+}
+
+void ls_offer_lease(struct ls *ls, struct lease_handle *lease_handle)
+{
+	assert(ls);
+	assert(lease_handle);
+
+	struct ls_server *serv = find_server(ls, lease_handle->name);
+	if (!serv)
+		return;
+
+	notify_parked_clients(serv->clients, ACTIVE_CLIENTS, serv);
+	notify_parked_clients(ls->control->clients, ls->control->nclients,
+			      serv);
 }
@@ -16,6 +16,8 @@
 #ifndef LEASE_SERVER_H
 #define LEASE_SERVER_H
 #include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
 
 #include "drm-lease.h"
 
@@ -25,6 +27,8 @@ enum ls_req_type {
 	LS_REQ_GET_LEASE,
 	LS_REQ_RELEASE_LEASE,
 	LS_REQ_CLIENT_DISCONNECT,
+	LS_REQ_YIELD_LEASE,
+	LS_REQ_EVENT, /* The fd passed to ls_add_event_fd() is readable */
 };
 
 struct ls_req {
@@ -34,10 +38,46 @@ struct ls_req {
 };
 
 struct ls *ls_create(struct lease_handle **lease_handles, int count);
+
+/* Don't create per-lease sockets and lock files, leases can then only be
+ * requested through the control socket */
+#define LS_CONTROL_ONLY (1 << 0)
+
+struct ls *ls_create_with_flags(struct lease_handle **lease_handles,
+				int count, uint32_t flags);
 void ls_destroy(struct ls *ls);
 
+/* Abstract sockets have no filesystem permissions, so connections to them
+ * are only accepted from root, the user running the lease server, and the
+ * users and primary groups allowed here. */
+bool ls_allow_peers(struct ls *ls, const uid_t *uids, int nuids,
+		    const gid_t *gids, int ngids);
+
+/* Wait for fd, as well as for client requests, in ls_get_request().
+ * The caller is responsible for clearing the fd's readiness. */
+bool ls_add_event_fd(struct ls *ls, int fd);
+
 bool ls_get_request(struct ls *ls, struct ls_req *req);
-bool ls_send_fd(struct ls *ls, struct ls_client *client, int fd);
+
+/* Like ls_get_request(), but wait at most timeout_ms for each event, as in
+ * epoll_wait().  Returns 1 if a request was received, 0 if there was none
+ * within the timeout, and -1 on error. */
+int ls_wait_request(struct ls *ls, struct ls_req *req, int timeout_ms);
+
+/* Becomes readable when ls_wait_request() has something to process */
+int ls_get_fd(struct ls *ls);
+bool ls_send_fd(struct ls *ls, struct ls_client *client, int fd,
+		int topology_fd);
+
+/* Process id of the client, or 0 if it is unknown */
+pid_t ls_client_pid(struct ls_client *client);
+
+/* Id of the client connection, unique for the lifetime of the server */
+uint32_t ls_client_id(struct ls_client *client);
 
 void ls_disconnect_client(struct ls *ls, struct ls_client *client);
+void ls_revoke_client(struct ls *ls, struct ls_client *client);
+
+/* Notify clients that have yielded the lease that it is free again */
+void ls_offer_lease(struct ls *ls, struct lease_handle *lease_handle);
 #endif
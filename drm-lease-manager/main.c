@@ -13,14 +13,20 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE
 #include "config.h"
+#include "dlmserver.h"
+#include "flight-recorder.h"
 #include "lease-config.h"
 #include "lease-manager.h"
-#include "lease-server.h"
 #include "log.h"
+#include "realtime.h"
 
-#include <assert.h>
+#include <errno.h>
 #include <getopt.h>
+#include <grp.h>
+#include <pwd.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
@@ -37,17 +43,127 @@ static void usage(const char *progname)
 	       "/etc/drm-lease-manager.toml)\n"
 	       "-v, --verbose \tEnable verbose debug messages\n"
 	       "-t, --lease-transfer \tAllow lease transfter to new clients\n"
-	       "-k, --keep-on-crash \tDon't close lease on client crash\n",
+	       "-k, --keep-on-crash \tDon't close lease on client crash\n"
+	       "-m, --frame-monitor \tCollect frame pacing statistics of "
+	       "leased outputs\n"
+	       "-o, --control-only \tOnly accept requests on the control "
+	       "socket, without per-lease sockets\n"
+	       "-r, --flight-recorder \t file to write recent lease events "
+	       "to on SIGUSR1 or crash (default " DLM_DEFAULT_FLIGHT_RECORDER
+	       ")\n"
+	       "-R, --realtime \t<policy>[:<priority>] Lock memory and run "
+	       "lease handover with the scheduling policy other, fifo or rr\n"
+	       "-a, --cpu-affinity \t<cpus> Run lease handover on the "
+	       "listed CPUs, e.g. 0-1,3\n"
+	       "-S, --rt-selftest \t<iterations> Report lease grant "
+	       "latency and exit\n"
+	       "-T, --trace \t<file> Record lease requests for replay "
+	       "with dlm-replay\n"
+	       "-C, --cache \t<file> Reuse the lease allocation saved in "
+	       "the file, while the device and configuration don't change\n"
+	       "-u, --allow-user \t<user> Accept clients of this user on "
+	       "abstract sockets (can be repeated)\n"
+	       "-g, --allow-group \t<group> Accept clients with this primary "
+	       "group on abstract sockets (can be repeated)\n",
 	       progname);
 }
 
-const char *opts = "vtkhc:";
+/* Users and groups allowed on abstract sockets, by name or number */
+#define MAX_ALLOWED_IDS 16
+
+static bool parse_id(const char *str, unsigned long *id)
+{
+	char *end;
+	errno = 0;
+	*id = strtoul(str, &end, 10);
+	return *str && !*end && !errno;
+}
+
+static bool add_allowed_user(const char *name, uid_t *uids, int *nuids)
+{
+	unsigned long id;
+	if (!parse_id(name, &id)) {
+		struct passwd *pw = getpwnam(name);
+		if (!pw) {
+			fprintf(stderr, "Unknown user: %s\n", name);
+			return false;
+		}
+		id = pw->pw_uid;
+	}
+
+	if (*nuids == MAX_ALLOWED_IDS) {
+		fprintf(stderr, "Too many allowed users\n");
+		return false;
+	}
+	uids[(*nuids)++] = id;
+	return true;
+}
+
+static bool add_allowed_group(const char *name, gid_t *gids, int *ngids)
+{
+	unsigned long id;
+	if (!parse_id(name, &id)) {
+		struct group *gr = getgrnam(name);
+		if (!gr) {
+			fprintf(stderr, "Unknown group: %s\n", name);
+			return false;
+		}
+		id = gr->gr_gid;
+	}
+
+	if (*ngids == MAX_ALLOWED_IDS) {
+		fprintf(stderr, "Too many allowed groups\n");
+		return false;
+	}
+	gids[(*ngids)++] = id;
+	return true;
+}
+
+/* Measure lease grant latency with the lease manager alone, without
+ * serving any clients */
+static bool run_selftest(const char *device, const char *config_file,
+			 int iterations)
+{
+	struct device_config device_config;
+	if (!parse_device_config(config_file, &device_config))
+		return false;
+
+	struct lease_config *lease_configs = NULL;
+	int num_configs = parse_config(config_file, &lease_configs);
+
+	struct lm *lm = lm_create_with_device_config(
+	    device, &device_config, NULL, num_configs, lease_configs);
+
+	bool ok = false;
+	if (lm) {
+		ok = rt_grant_selftest(lm, iterations);
+		lm_destroy(lm);
+	} else {
+		ERROR_LOG("DRM Lease initialization failed\n");
+	}
+
+	release_config(num_configs, lease_configs);
+	release_device_config(&device_config);
+	return ok;
+}
+
+const char *opts = "vtkmohc:r:R:a:S:T:C:u:g:";
 const struct option options[] = {
     {"help", no_argument, NULL, 'h'},
     {"verbose", no_argument, NULL, 'v'},
     {"lease-transfer", no_argument, NULL, 't'},
     {"keep-on-crash", no_argument, NULL, 'k'},
+    {"frame-monitor", no_argument, NULL, 'm'},
+    {"control-only", no_argument, NULL, 'o'},
     {"config", required_argument, NULL, 'c'},
+    {"flight-recorder", required_argument, NULL, 'r'},
+    {"realtime", required_argument, NULL, 'R'},
+    {"cpu-affinity", required_argument, NULL, 'a'},
+    {"rt-selftest", required_argument, NULL, 'S'},
+    {"trace", required_argument, NULL, 'T'},
+    {"cache", required_argument, NULL, 'C'},
+    {"allow-user", required_argument, NULL, 'u'},
+    {"allow-group", required_argument, NULL, 'g'},
     {NULL, 0, NULL, 0},
 };
 
@@ -55,10 +171,22 @@ int main(int argc, char **argv)
 {
 	char *device = NULL;
 	char *config_file = "/etc/drm-lease-manager.toml";
+	char *flight_recorder = DLM_DEFAULT_FLIGHT_RECORDER;
+	char *trace_file = NULL;
+	char *cache_file = NULL;
 
 	bool debug_log = false;
 	bool can_transfer_leases = false;
 	bool keep_on_crash = false;
+	bool frame_monitor = false;
+	bool control_only = false;
+	bool realtime = false;
+	int selftest_iterations = 0;
+	struct rt_config rt_config = {.policy = SCHED_OTHER};
+	uid_t allowed_uids[MAX_ALLOWED_IDS];
+	int nallowed_uids = 0;
+	gid_t allowed_gids[MAX_ALLOWED_IDS];
+	int nallowed_gids = 0;
 
 	int c;
 	while ((c = getopt_long(argc, argv, opts, options, NULL)) != -1) {
@@ -73,9 +201,51 @@ int main(int argc, char **argv)
 		case 'k':
 			keep_on_crash = true;
 			break;
+		case 'm':
+			frame_monitor = true;
+			break;
+		case 'o':
+			control_only = true;
+			break;
 		case 'c':
 			config_file = optarg;
 			break;
+		case 'r':
+			flight_recorder = optarg;
+			break;
+		case 'R':
+			if (!rt_parse_sched(optarg, &rt_config))
+				return EXIT_FAILURE;
+			realtime = true;
+			break;
+		case 'a':
+			if (!rt_parse_cpus(optarg, &rt_config))
+				return EXIT_FAILURE;
+			realtime = true;
+			break;
+		case 'T':
+			trace_file = optarg;
+			break;
+		case 'C':
+			cache_file = optarg;
+			break;
+		case 'u':
+			if (!add_allowed_user(optarg, allowed_uids,
+					      &nallowed_uids))
+				return EXIT_FAILURE;
+			break;
+		case 'g':
+			if (!add_allowed_group(optarg, allowed_gids,
+					       &nallowed_gids))
+				return EXIT_FAILURE;
+			break;
+		case 'S':
+			selftest_iterations = atoi(optarg);
+			if (selftest_iterations <= 0) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
 		case 'h':
 			ret = EXIT_SUCCESS;
 			/* fall through */
@@ -89,26 +259,48 @@ int main(int argc, char **argv)
 		device = argv[optind];
 
 	dlm_log_enable_debug(debug_log);
+	if (!dlm_log_start_async(DLM_LOG_SINK_AUTO))
+		WARN_LOG("Asynchronous logging unavailable\n");
 
-	struct lease_config *lease_configs = NULL;
-	int num_configs = parse_config(config_file, &lease_configs);
-
-	struct lm *lm =
-	    lm_create_with_config(device, num_configs, lease_configs);
+	fr_install_dump_handlers(flight_recorder);
 
-	if (!lm) {
-		ERROR_LOG("DRM Lease initialization failed\n");
+	/* Enabled before the lease manager is started, so that the frame
+	 * monitor inherits the scheduling settings, as do lease transition
+	 * threads.  The logging thread keeps the default policy. */
+	if (realtime && !rt_enable(&rt_config)) {
+		dlm_log_stop_async();
 		return EXIT_FAILURE;
 	}
 
-	struct lease_handle **lease_handles = NULL;
-	int count_ids = lm_get_lease_handles(lm, &lease_handles);
-	assert(count_ids > 0);
+	if (selftest_iterations > 0) {
+		bool ok =
+		    run_selftest(device, config_file, selftest_iterations);
+		dlm_log_stop_async();
+		return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
 
-	struct ls *ls = ls_create(lease_handles, count_ids);
-	if (!ls) {
-		lm_destroy(lm);
-		ERROR_LOG("Client socket initialization failed\n");
+	struct dlm_server_options server_options = {
+	    .device = device,
+	    .config_file = config_file,
+	    .trace_file = trace_file,
+	    .cache_file = cache_file,
+	    .allowed_uids = allowed_uids,
+	    .nallowed_uids = nallowed_uids,
+	    .allowed_gids = allowed_gids,
+	    .nallowed_gids = nallowed_gids,
+	};
+	if (can_transfer_leases)
+		server_options.flags |= DLM_SERVER_LEASE_TRANSFER;
+	if (keep_on_crash)
+		server_options.flags |= DLM_SERVER_KEEP_ON_CRASH;
+	if (frame_monitor)
+		server_options.flags |= DLM_SERVER_FRAME_MONITOR;
+	if (control_only)
+		server_options.flags |= DLM_SERVER_CONTROL_ONLY;
+
+	struct dlm_server *server = dlm_server_create(&server_options);
+	if (!server) {
+		dlm_log_stop_async();
 		return EXIT_FAILURE;
 	}
 
@@ -116,57 +308,10 @@ int main(int argc, char **argv)
 	sd_notify(1, "READY=1");
 #endif
 
-	struct ls_req req;
-	while (ls_get_request(ls, &req)) {
-		switch (req.type) {
-		case LS_REQ_GET_LEASE: {
-			int fd = lm_lease_grant(lm, req.lease_handle);
-
-			if (fd < 0 && can_transfer_leases)
-				fd = lm_lease_transfer(lm, req.lease_handle);
-
-			if (fd < 0) {
-				ERROR_LOG(
-				    "Can't fulfill lease request: lease=%s\n",
-				    req.lease_handle->name);
-				ls_disconnect_client(ls, req.client);
-				break;
-			}
-
-			struct ls_client *active_client =
-			    req.lease_handle->user_data;
-			if (active_client)
-				ls_disconnect_client(ls, active_client);
+	/* Only returns on error */
+	dlm_server_run(server);
 
-			req.lease_handle->user_data = req.client;
-
-			if (!ls_send_fd(ls, req.client, fd)) {
-				ERROR_LOG(
-				    "Client communication error: lease=%s\n",
-				    req.lease_handle->name);
-				ls_disconnect_client(ls, req.client);
-				lm_lease_revoke(lm, req.lease_handle);
-			}
-			break;
-		}
-		case LS_REQ_RELEASE_LEASE:
-		case LS_REQ_CLIENT_DISCONNECT:
-			ls_disconnect_client(ls, req.client);
-			req.lease_handle->user_data = NULL;
-			lm_lease_revoke(lm, req.lease_handle);
-
-			if (!keep_on_crash || req.type == LS_REQ_RELEASE_LEASE)
-				lm_lease_close(req.lease_handle);
-
-			break;
-		default:
-			ERROR_LOG("Internal error: Invalid lease request\n");
-			goto done;
-		}
-	}
-done:
-	ls_destroy(ls);
-	lm_destroy(lm);
-	release_config(num_configs, lease_configs);
+	dlm_server_destroy(server);
+	dlm_log_stop_async();
 	return EXIT_FAILURE;
 }
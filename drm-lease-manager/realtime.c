@@ -0,0 +1,270 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include "realtime.h"
+
+#include "clock.h"
+#include "latency-stats.h"
+#include "lease-manager.h"
+#include "log.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Stack of the main thread that is faulted in up front */
+#define RT_STACK_PREFAULT_SIZE (256 * 1024)
+
+/* Heap that is faulted in up front, and kept by malloc once it is freed */
+#define RT_HEAP_PREFAULT_SIZE (1024 * 1024)
+
+/* Stack size of threads created in real-time mode.
+ * Locked memory is faulted in as soon as it is mapped, so the default
+ * thread stack size of several MiB would delay every lease transition. */
+#define RT_THREAD_STACK_SIZE (256 * 1024)
+
+#define ARRAY_LENGTH(x) (sizeof(x) / sizeof(x[0]))
+
+static const struct {
+	const char *name;
+	int policy;
+} sched_policies[] = {
+    {"other", SCHED_OTHER},
+    {"fifo", SCHED_FIFO},
+    {"rr", SCHED_RR},
+};
+
+bool rt_parse_sched(const char *arg, struct rt_config *config)
+{
+	assert(arg);
+	assert(config);
+
+	const char *sep = strchr(arg, ':');
+	size_t len = sep ? (size_t)(sep - arg) : strlen(arg);
+
+	int policy = -1;
+	for (size_t i = 0; i < ARRAY_LENGTH(sched_policies); i++) {
+		if (strlen(sched_policies[i].name) == len &&
+		    !strncmp(arg, sched_policies[i].name, len))
+			policy = sched_policies[i].policy;
+	}
+	if (policy < 0) {
+		ERROR_LOG("Unknown scheduling policy: %s\n", arg);
+		return false;
+	}
+
+	int min = sched_get_priority_min(policy);
+	int max = sched_get_priority_max(policy);
+	long priority = min;
+
+	if (sep) {
+		char *end;
+		errno = 0;
+		priority = strtol(sep + 1, &end, 10);
+		if (errno || end == sep + 1 || *end != '\0' ||
+		    priority < min || priority > max) {
+			ERROR_LOG("Invalid priority %s, must be %d-%d\n",
+				  sep + 1, min, max);
+			return false;
+		}
+	}
+
+	config->policy = policy;
+	config->priority = priority;
+	return true;
+}
+
+bool rt_parse_cpus(const char *arg, struct rt_config *config)
+{
+	assert(arg);
+	assert(config);
+
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+
+	const char *p = arg;
+	do {
+		char *end;
+		unsigned long first = strtoul(p, &end, 10);
+		if (end == p)
+			goto err;
+
+		unsigned long last = first;
+		if (*end == '-') {
+			p = end + 1;
+			last = strtoul(p, &end, 10);
+			if (end == p)
+				goto err;
+		}
+
+		if (last < first || last >= CPU_SETSIZE)
+			goto err;
+
+		for (unsigned long cpu = first; cpu <= last; cpu++)
+			CPU_SET(cpu, &cpus);
+		p = end;
+	} while (*p++ == ',');
+
+	if (p[-1] != '\0')
+		goto err;
+
+	config->cpus = cpus;
+	config->set_affinity = true;
+	return true;
+err:
+	ERROR_LOG("Invalid CPU list: %s\n", arg);
+	return false;
+}
+
+static void prefault_stack(void)
+{
+	volatile char stack[RT_STACK_PREFAULT_SIZE];
+	long page_size = sysconf(_SC_PAGESIZE);
+
+	for (size_t i = 0; i < sizeof(stack); i += page_size)
+		stack[i] = 0;
+}
+
+static bool prefault_heap(void)
+{
+	volatile char *heap = malloc(RT_HEAP_PREFAULT_SIZE);
+	if (!heap) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		return false;
+	}
+
+	long page_size = sysconf(_SC_PAGESIZE);
+	for (size_t i = 0; i < RT_HEAP_PREFAULT_SIZE; i += page_size)
+		heap[i] = 0;
+
+	free((void *)heap);
+	return true;
+}
+
+static bool set_thread_stack_size(void)
+{
+	pthread_attr_t attr;
+	if (pthread_getattr_default_np(&attr) != 0)
+		return false;
+
+	bool ok = pthread_attr_setstacksize(&attr, RT_THREAD_STACK_SIZE) == 0 &&
+		  pthread_setattr_default_np(&attr) == 0;
+
+	pthread_attr_destroy(&attr);
+	return ok;
+}
+
+bool rt_enable(const struct rt_config *config)
+{
+	assert(config);
+
+	/* Keep freed memory in the (locked) heap, rather than returning it
+	 * to the system and faulting it in again on the next allocation */
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+
+	if (!set_thread_stack_size())
+		WARN_LOG("Cannot set the default thread stack size\n");
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+		ERROR_LOG("Cannot lock memory: %s\n", strerror(errno));
+		return false;
+	}
+
+	prefault_stack();
+	if (!prefault_heap())
+		return false;
+
+	if (config->policy != SCHED_OTHER) {
+		struct sched_param param = {.sched_priority = config->priority};
+		int ret = pthread_setschedparam(pthread_self(), config->policy,
+						&param);
+		if (ret != 0) {
+			ERROR_LOG("Cannot set scheduling policy: %s\n",
+				  strerror(ret));
+			return false;
+		}
+	}
+
+	if (config->set_affinity) {
+		int ret = pthread_setaffinity_np(pthread_self(),
+						 sizeof(config->cpus),
+						 &config->cpus);
+		if (ret != 0) {
+			ERROR_LOG("Cannot set CPU affinity: %s\n",
+				  strerror(ret));
+			return false;
+		}
+	}
+
+	INFO_LOG("Real-time mode enabled\n");
+	return true;
+}
+
+bool rt_grant_selftest(struct lm *lm, int iterations)
+{
+	assert(lm);
+	assert(iterations > 0);
+
+	struct lease_handle **lease_handles = NULL;
+	int count = lm_get_lease_handles(lm, &lease_handles);
+
+	size_t nsamples = (size_t)iterations * count;
+	uint64_t *samples = calloc(nsamples, sizeof(uint64_t));
+	if (!samples) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		return false;
+	}
+
+	size_t n = 0;
+	for (int i = 0; i < iterations; i++) {
+		for (int j = 0; j < count; j++) {
+			uint64_t start = monotonic_ns();
+			int fd = lm_lease_grant(lm, lease_handles[j]);
+			uint64_t end = monotonic_ns();
+
+			if (fd < 0) {
+				ERROR_LOG("Self-test cannot grant lease %s\n",
+					  lease_handles[j]->name);
+				free(samples);
+				return false;
+			}
+			samples[n++] = end - start;
+
+			lm_lease_revoke(lm, lease_handles[j]);
+			lm_lease_close(lease_handles[j]);
+		}
+	}
+
+	struct latency_stats stats;
+	latency_stats_compute(samples, nsamples, &stats);
+
+	printf("Lease grant latency over %zu grants (us): min %.1f, "
+	       "median %.1f, 99%% %.1f, max %.1f\n",
+	       nsamples, stats.min_us, stats.p50_us, stats.p99_us,
+	       stats.max_us);
+
+	free(samples);
+	return true;
+}
@@ -0,0 +1,49 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+/* cpu_set_t is only available with _GNU_SOURCE, which must be defined
+ * before the first system header is included. */
+#include <sched.h>
+#include <stdbool.h>
+
+struct lm;
+
+struct rt_config {
+	int policy; /* SCHED_OTHER, SCHED_FIFO or SCHED_RR */
+	int priority;
+	bool set_affinity;
+	cpu_set_t cpus;
+};
+
+/* Parse a scheduling policy of the form "<policy>[:<priority>]",
+ * where policy is one of "other", "fifo" or "rr". */
+bool rt_parse_sched(const char *arg, struct rt_config *config);
+
+/* Parse a CPU list, such as "0-1,3" */
+bool rt_parse_cpus(const char *arg, struct rt_config *config);
+
+/* Switch the calling thread to real-time mode.
+ * Locks all current and future memory, so that page faults cannot delay
+ * the lease handover, and applies the scheduling policy and CPU affinity.
+ * Threads created afterwards inherit both. */
+bool rt_enable(const struct rt_config *config);
+
+/* Measure the time to grant each lease over a number of iterations, and
+ * print the latency distribution to stdout. */
+bool rt_grant_selftest(struct lm *lm, int iterations);
+#endif
@@ -0,0 +1,299 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Replay a request trace written by drm-lease-manager -T
+ * Each request is handled the same way as by the daemon, but without
+ * clients, and the outcome is compared with the recorded one. */
+
+#include "clock.h"
+#include "lease-config.h"
+#include "lease-manager.h"
+#include "request-trace.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_REQUEST_TYPES (LS_REQ_EVENT + 1)
+
+struct replay_stats {
+	uint32_t count;
+	uint64_t recorded_ns;
+	uint64_t recorded_max_ns;
+	uint64_t replayed_ns;
+	uint64_t replayed_max_ns;
+};
+
+static void usage(const char *progname)
+{
+	printf("Usage: %s [OPTIONS] <trace> [<DRM device>]\n\n"
+	       "Options:\n"
+	       "-h, --help \tPrint this help\n"
+	       "-c, --config \t path to configuration file (default "
+	       "/etc/drm-lease-manager.toml)\n"
+	       "-s, --speed \t replay speed relative to the recording, "
+	       "0 to replay without delays (default 1)\n",
+	       progname);
+}
+
+static void wait_until(uint64_t deadline_ns)
+{
+	struct timespec ts = {
+	    .tv_sec = deadline_ns / 1000000000,
+	    .tv_nsec = deadline_ns % 1000000000,
+	};
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR)
+		;
+}
+
+static struct lease_handle *find_lease(struct lease_handle **lease_handles,
+				       int count, const char *name)
+{
+	for (int i = 0; i < count; i++) {
+		if (!strcmp(lease_handles[i]->name, name))
+			return lease_handles[i];
+	}
+	return NULL;
+}
+
+/* Handle a request like drm-lease-manager does.
+ * The lease owner is tracked by client id in user_data. */
+static enum tr_result replay_request(struct lm *lm, uint32_t flags,
+				     const struct tr_record *rec,
+				     struct lease_handle *lease)
+{
+	uint32_t owner = (uint32_t)(uintptr_t)lease->user_data;
+
+	switch (rec->type) {
+	case LS_REQ_GET_LEASE: {
+		enum tr_result result = TR_RESULT_GRANTED;
+		int fd = lm_lease_grant(lm, lease);
+
+		if (fd < 0 && (flags & TR_FLAG_LEASE_TRANSFER)) {
+			fd = lm_lease_transfer(lm, lease);
+			result = TR_RESULT_TRANSFERRED;
+		}
+
+		if (fd < 0)
+			return TR_RESULT_FAILED;
+
+		lease->user_data = (void *)(uintptr_t)rec->client_id;
+
+		/* The recorded client went away before it got the lease */
+		if (rec->result == TR_RESULT_UNDELIVERED) {
+			lm_lease_revoke(lm, lease);
+			return TR_RESULT_UNDELIVERED;
+		}
+		return result;
+	}
+	case LS_REQ_YIELD_LEASE:
+		if (owner != rec->client_id)
+			return TR_RESULT_IGNORED;
+
+		lease->user_data = NULL;
+		lm_lease_revoke(lm, lease);
+		lm_lease_close(lease);
+		return TR_RESULT_REVOKED;
+	case LS_REQ_RELEASE_LEASE:
+	case LS_REQ_CLIENT_DISCONNECT:
+		lease->user_data = NULL;
+		lm_lease_revoke(lm, lease);
+
+		if (!(flags & TR_FLAG_KEEP_ON_CRASH) ||
+		    rec->type == LS_REQ_RELEASE_LEASE)
+			lm_lease_close(lease);
+		return TR_RESULT_REVOKED;
+	case LS_REQ_EVENT:
+		/* Revoked by the lease manager, the watchdog action only
+		 * affects the screen content and parked clients */
+		lease->user_data = NULL;
+		lm_lease_revoke(lm, lease);
+		lm_lease_close(lease);
+		return TR_RESULT_REVOKED;
+	}
+	return TR_RESULT_NONE;
+}
+
+static void update_stats(struct replay_stats *stats,
+			 const struct tr_record *rec, uint64_t replayed_ns)
+{
+	stats->count++;
+	stats->recorded_ns += rec->latency_ns;
+	if (rec->latency_ns > stats->recorded_max_ns)
+		stats->recorded_max_ns = rec->latency_ns;
+	stats->replayed_ns += replayed_ns;
+	if (replayed_ns > stats->replayed_max_ns)
+		stats->replayed_max_ns = replayed_ns;
+}
+
+static void print_stats(const struct replay_stats *stats)
+{
+	printf("\n%-10s %8s %12s %12s %12s %12s\n", "request", "count",
+	       "rec avg us", "rec max us", "avg us", "max us");
+
+	for (int i = 0; i < NUM_REQUEST_TYPES; i++) {
+		const struct replay_stats *s = &stats[i];
+		if (!s->count)
+			continue;
+
+		printf("%-10s %8u %12.1f %12.1f %12.1f %12.1f\n",
+		       tr_request_name(i), s->count,
+		       s->recorded_ns / 1000.0 / s->count,
+		       s->recorded_max_ns / 1000.0,
+		       s->replayed_ns / 1000.0 / s->count,
+		       s->replayed_max_ns / 1000.0);
+	}
+}
+
+const char *opts = "hc:s:";
+const struct option options[] = {
+    {"help", no_argument, NULL, 'h'},
+    {"config", required_argument, NULL, 'c'},
+    {"speed", required_argument, NULL, 's'},
+    {NULL, 0, NULL, 0},
+};
+
+int main(int argc, char **argv)
+{
+	char *config_file = "/etc/drm-lease-manager.toml";
+	double speed = 1.0;
+
+	int c;
+	while ((c = getopt_long(argc, argv, opts, options, NULL)) != -1) {
+		int ret = EXIT_FAILURE;
+		switch (c) {
+		case 'c':
+			config_file = optarg;
+			break;
+		case 's':
+			speed = atof(optarg);
+			if (speed < 0) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'h':
+			ret = EXIT_SUCCESS;
+			/* fall through */
+		default:
+			usage(argv[0]);
+			return ret;
+		}
+	}
+
+	if (optind >= argc) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const char *trace_file = argv[optind];
+	const char *device = optind + 1 < argc ? argv[optind + 1] : NULL;
+
+	FILE *f = fopen(trace_file, "rb");
+	if (!f) {
+		perror(trace_file);
+		return EXIT_FAILURE;
+	}
+
+	struct tr_file_header hdr;
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != TR_FILE_MAGIC ||
+	    hdr.version != TR_FILE_VERSION) {
+		fprintf(stderr, "%s: not a request trace\n", trace_file);
+		fclose(f);
+		return EXIT_FAILURE;
+	}
+
+	struct device_config device_config;
+	if (!parse_device_config(config_file, &device_config)) {
+		fclose(f);
+		return EXIT_FAILURE;
+	}
+
+	struct lease_config *lease_configs = NULL;
+	int num_configs = parse_config(config_file, &lease_configs);
+
+	struct lm *lm = lm_create_with_device_config(
+	    device, &device_config, NULL, num_configs, lease_configs);
+	if (!lm) {
+		fprintf(stderr, "DRM Lease initialization failed\n");
+		release_config(num_configs, lease_configs);
+		release_device_config(&device_config);
+		fclose(f);
+		return EXIT_FAILURE;
+	}
+
+	struct lease_handle **lease_handles = NULL;
+	int count = lm_get_lease_handles(lm, &lease_handles);
+
+	struct replay_stats stats[NUM_REQUEST_TYPES] = {0};
+	int nrequests = 0, mismatches = 0;
+	uint64_t first_ns = 0, start_ns = monotonic_ns();
+
+	printf("%10s %-10s %-24s %6s %-11s %-11s %10s %10s\n", "time ms",
+	       "request", "lease", "client", "recorded", "replayed",
+	       "rec us", "us");
+
+	struct tr_record rec;
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		rec.lease[sizeof(rec.lease) - 1] = '\0';
+		if (nrequests++ == 0)
+			first_ns = rec.timestamp_ns;
+
+		uint64_t offset_ns = rec.timestamp_ns - first_ns;
+		if (speed > 0)
+			wait_until(start_ns + offset_ns / speed);
+
+		struct lease_handle *lease =
+		    find_lease(lease_handles, count, rec.lease);
+		if (!lease || rec.type >= NUM_REQUEST_TYPES) {
+			fprintf(stderr, "Request %d: invalid request on %s\n",
+				nrequests, rec.lease);
+			mismatches++;
+			continue;
+		}
+
+		uint64_t begin_ns = monotonic_ns();
+		enum tr_result result =
+		    replay_request(lm, hdr.flags, &rec, lease);
+		uint64_t latency_ns = monotonic_ns() - begin_ns;
+
+		bool mismatch = result != rec.result;
+		if (mismatch)
+			mismatches++;
+
+		update_stats(&stats[rec.type], &rec, latency_ns);
+
+		printf("%10.3f %-10s %-24s %6u %-11s %-11s %10.1f %10.1f%s\n",
+		       offset_ns / 1000000.0, tr_request_name(rec.type),
+		       rec.lease, rec.client_id, tr_result_name(rec.result),
+		       tr_result_name(result), rec.latency_ns / 1000.0,
+		       latency_ns / 1000.0, mismatch ? " *" : "");
+	}
+
+	print_stats(stats);
+	printf("\n%d requests replayed, %d with a different outcome\n",
+	       nrequests, mismatches);
+
+	lm_destroy(lm);
+	release_config(num_configs, lease_configs);
+	release_device_config(&device_config);
+	fclose(f);
+	return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "request-trace.h"
+
+#include "clock.h"
+#include "log.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct tr {
+	int fd;
+	struct tr_record record;
+};
+
+/* Each record is written as soon as the request has been handled, so a
+ * trace that is cut short by a crash still has all earlier requests. */
+static bool write_all(int fd, const void *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t ret = write(fd, buf, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		buf = (const char *)buf + ret;
+		len -= ret;
+	}
+	return true;
+}
+
+struct tr *tr_create(const char *path, uint32_t flags)
+{
+	assert(path);
+
+	struct tr *tr = calloc(1, sizeof(struct tr));
+	if (!tr) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	tr->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (tr->fd < 0) {
+		ERROR_LOG("Cannot create request trace %s: %s\n", path,
+			  strerror(errno));
+		free(tr);
+		return NULL;
+	}
+
+	struct tr_file_header hdr = {
+	    .magic = TR_FILE_MAGIC,
+	    .version = TR_FILE_VERSION,
+	    .flags = flags,
+	};
+	if (!write_all(tr->fd, &hdr, sizeof(hdr))) {
+		ERROR_LOG("Cannot write request trace %s: %s\n", path,
+			  strerror(errno));
+		close(tr->fd);
+		free(tr);
+		return NULL;
+	}
+
+	return tr;
+}
+
+void tr_destroy(struct tr *tr)
+{
+	assert(tr);
+
+	close(tr->fd);
+	free(tr);
+}
+
+void tr_begin(struct tr *tr, enum ls_req_type type,
+	      struct lease_handle *lease_handle, uint32_t client_id)
+{
+	assert(tr);
+	assert(lease_handle);
+
+	tr->record = (struct tr_record){
+	    .type = type,
+	    .client_id = client_id,
+	};
+	snprintf(tr->record.lease, sizeof(tr->record.lease), "%s",
+		 lease_handle->name);
+	tr->record.timestamp_ns = monotonic_ns();
+}
+
+void tr_end(struct tr *tr, enum tr_result result)
+{
+	assert(tr);
+
+	uint64_t latency_ns = monotonic_ns() - tr->record.timestamp_ns;
+	tr->record.latency_ns =
+	    latency_ns > UINT32_MAX ? UINT32_MAX : latency_ns;
+	tr->record.result = result;
+
+	if (!write_all(tr->fd, &tr->record, sizeof(tr->record)))
+		DEBUG_LOG("Request trace write failed: %s\n", strerror(errno));
+}
+
+const char *tr_request_name(enum ls_req_type type)
+{
+	static const char *const names[] = {
+	    [LS_REQ_GET_LEASE] = "get",
+	    [LS_REQ_RELEASE_LEASE] = "release",
+	    [LS_REQ_CLIENT_DISCONNECT] = "disconnect",
+	    [LS_REQ_YIELD_LEASE] = "yield",
+	    [LS_REQ_EVENT] = "watchdog",
+	};
+
+	if ((unsigned int)type >= sizeof(names) / sizeof(names[0]))
+		return "unknown";
+	return names[type];
+}
+
+const char *tr_result_name(enum tr_result result)
+{
+	static const char *const names[] = {
+	    [TR_RESULT_NONE] = "-",
+	    [TR_RESULT_GRANTED] = "granted",
+	    [TR_RESULT_TRANSFERRED] = "transferred",
+	    [TR_RESULT_FAILED] = "failed",
+	    [TR_RESULT_IGNORED] = "ignored",
+	    [TR_RESULT_REVOKED] = "revoked",
+	    [TR_RESULT_UNDELIVERED] = "undelivered",
+	};
+
+	if ((unsigned int)result >= sizeof(names) / sizeof(names[0]))
+		return "unknown";
+	return names[result];
+}
@@ -0,0 +1,88 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef REQUEST_TRACE_H
+#define REQUEST_TRACE_H
+
+#include "dlm-protocol.h"
+#include "drm-lease.h"
+#include "lease-server.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Request trace
+ * A record of every request handled by the daemon, and of how the lease
+ * manager responded to it, written as it happens.  dlm-replay feeds a
+ * trace through the lease manager again to reproduce problems and to
+ * measure request latency.
+ *
+ * File layout:
+ *   struct tr_file_header
+ *   struct tr_record[], in the order the requests were handled */
+
+#define TR_FILE_MAGIC 0x52544c44 /* "DLTR" */
+#define TR_FILE_VERSION 2
+/* Long enough for any lease name a client can request */
+#define TR_LEASE_NAME_LEN DLM_LEASE_NAME_MAX
+
+/* Daemon options that change how requests are handled */
+#define TR_FLAG_LEASE_TRANSFER (1 << 0)
+#define TR_FLAG_KEEP_ON_CRASH (1 << 1)
+
+enum tr_result {
+	TR_RESULT_NONE,
+	TR_RESULT_GRANTED,
+	TR_RESULT_TRANSFERRED,
+	TR_RESULT_FAILED,
+	TR_RESULT_IGNORED,
+	TR_RESULT_REVOKED,
+	/* Granted, but revoked again because the fd could not be sent */
+	TR_RESULT_UNDELIVERED,
+};
+
+struct tr_file_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+struct tr_record {
+	uint64_t timestamp_ns; /* CLOCK_MONOTONIC, when handling started */
+	uint32_t latency_ns;   /* time taken to handle the request */
+	uint32_t type;	       /* enum ls_req_type */
+	uint32_t client_id;
+	uint32_t result; /* enum tr_result */
+	char lease[TR_LEASE_NAME_LEN];
+};
+
+struct tr;
+
+struct tr *tr_create(const char *path, uint32_t flags);
+void tr_destroy(struct tr *tr);
+
+/* Record a request.  Call tr_begin() before handling it, and tr_end()
+ * with the outcome once it has been handled.
+ * Leases revoked by the lease manager itself, because they stalled or
+ * through dlm_server_revoke_lease(), are recorded as LS_REQ_EVENT requests
+ * of their owner. */
+void tr_begin(struct tr *tr, enum ls_req_type type,
+	      struct lease_handle *lease_handle, uint32_t client_id);
+void tr_end(struct tr *tr, enum tr_result result);
+
+const char *tr_request_name(enum ls_req_type type);
+const char *tr_result_name(enum tr_result result);
+#endif
@@ -0,0 +1,206 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "status-page.h"
+
+#include "clock.h"
+#include "dlm-status.h"
+#include "log.h"
+#include "socket-path.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+struct sp {
+	char path[PATH_MAX];
+	struct dlm_status_header *hdr;
+	struct dlm_status_entry *entries;
+	size_t size;
+
+	struct lease_handle **lease_handles;
+	int nleases;
+};
+
+/* The page is filled in under a temporary name and then renamed,
+ * so readers never see a partially initialized page. */
+static bool create_page(struct sp *sp)
+{
+	char tmp_path[PATH_MAX + 4];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", sp->path);
+
+	int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		DEBUG_LOG("Cannot create %s: %s\n", tmp_path, strerror(errno));
+		return false;
+	}
+
+	if (ftruncate(fd, sp->size) < 0) {
+		DEBUG_LOG("ftruncate failed: %s\n", strerror(errno));
+		goto err;
+	}
+
+	void *page =
+	    mmap(NULL, sp->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (page == MAP_FAILED) {
+		DEBUG_LOG("mmap failed: %s\n", strerror(errno));
+		goto err;
+	}
+
+	sp->hdr = page;
+	sp->entries = (struct dlm_status_entry *)(sp->hdr + 1);
+
+	sp->hdr->magic = DLM_STATUS_MAGIC;
+	sp->hdr->version = DLM_STATUS_VERSION;
+	sp->hdr->nleases = sp->nleases;
+	sp->hdr->entry_size = sizeof(struct dlm_status_entry);
+
+	for (int i = 0; i < sp->nleases; i++) {
+		struct dlm_status_entry *entry = &sp->entries[i];
+		snprintf(entry->name, sizeof(entry->name), "%s",
+			 sp->lease_handles[i]->name);
+	}
+	atomic_store(&sp->hdr->active, 1);
+
+	if (rename(tmp_path, sp->path) < 0) {
+		DEBUG_LOG("Cannot publish %s: %s\n", sp->path, strerror(errno));
+		munmap(page, sp->size);
+		sp->hdr = NULL;
+		goto err;
+	}
+
+	close(fd);
+	return true;
+err:
+	close(fd);
+	unlink(tmp_path);
+	return false;
+}
+
+struct sp *sp_create(struct lease_handle **lease_handles, int count)
+{
+	assert(lease_handles);
+	assert(count > 0);
+
+	struct sp *sp = calloc(1, sizeof(struct sp));
+	if (!sp) {
+		DEBUG_LOG("Memory allocation failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	sp->lease_handles = lease_handles;
+	sp->nleases = count;
+	sp->size = sizeof(struct dlm_status_header) +
+		   count * sizeof(struct dlm_status_entry);
+
+	if (!runtime_file_path(sp->path, sizeof(sp->path),
+			       DLM_STATUS_FILE_NAME))
+		goto err;
+
+	if (!create_page(sp))
+		goto err;
+
+	return sp;
+err:
+	free(sp);
+	return NULL;
+}
+
+void sp_destroy(struct sp *sp)
+{
+	assert(sp);
+
+	atomic_store(&sp->hdr->active, 0);
+	munmap(sp->hdr, sp->size);
+	unlink(sp->path);
+	free(sp);
+}
+
+static struct dlm_status_entry *find_entry(struct sp *sp,
+					   struct lease_handle *lease_handle)
+{
+	for (int i = 0; i < sp->nleases; i++) {
+		if (sp->lease_handles[i] == lease_handle)
+			return &sp->entries[i];
+	}
+	return NULL;
+}
+
+/* Sequence lock writer side.
+ * Each lock has a single writer, so no atomic read-modify-write is needed */
+static unsigned int seq_write_begin(atomic_uint *seq)
+{
+	unsigned int start = atomic_load_explicit(seq, memory_order_relaxed);
+	atomic_store_explicit(seq, start + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	return start;
+}
+
+static void seq_write_end(atomic_uint *seq, unsigned int start)
+{
+	atomic_store_explicit(seq, start + 2, memory_order_release);
+}
+
+void sp_update(struct sp *sp, struct lease_handle *lease_handle,
+	       uint32_t lessee_id, pid_t client_pid)
+{
+	assert(sp);
+	assert(lease_handle);
+
+	struct dlm_status_entry *entry = find_entry(sp, lease_handle);
+	assert(entry);
+
+	if (entry->lessee_id == lessee_id &&
+	    entry->client_pid == (int32_t)client_pid)
+		return;
+
+	unsigned int seq = seq_write_begin(&entry->seq);
+
+	if (entry->lessee_id != lessee_id) {
+		if (lessee_id != 0)
+			entry->grant_count++;
+		entry->last_transition_ns = monotonic_ns();
+	}
+	entry->granted = lessee_id != 0;
+	entry->lessee_id = lessee_id;
+	entry->client_pid = client_pid;
+
+	seq_write_end(&entry->seq, seq);
+}
+
+void sp_update_frames(struct sp *sp, struct lease_handle *lease_handle,
+		      const struct sp_frame_stats *stats)
+{
+	assert(sp);
+	assert(lease_handle);
+	assert(stats);
+
+	struct dlm_status_entry *entry = find_entry(sp, lease_handle);
+	assert(entry);
+
+	unsigned int seq = seq_write_begin(&entry->frame_seq);
+	entry->frame_count = stats->frame_count;
+	entry->missed_frames = stats->missed_frames;
+	memcpy(entry->frame_intervals, stats->frame_intervals,
+	       sizeof(entry->frame_intervals));
+	seq_write_end(&entry->frame_seq, seq);
+}
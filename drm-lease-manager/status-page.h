@@ -0,0 +1,46 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef STATUS_PAGE_H
+#define STATUS_PAGE_H
+
+#include "dlm-status.h"
+#include "drm-lease.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
+struct sp;
+
+struct sp *sp_create(struct lease_handle **lease_handles, int count);
+void sp_destroy(struct sp *sp);
+
+/* Publish the current owner of a lease.
+ * lessee_id is 0 if the lease is not granted. */
+void sp_update(struct sp *sp, struct lease_handle *lease_handle,
+	       uint32_t lessee_id, pid_t client_pid);
+
+struct sp_frame_stats {
+	uint64_t frame_count;
+	uint64_t missed_frames;
+	uint64_t frame_intervals[DLM_STATUS_FRAME_BUCKETS];
+};
+
+/* Publish frame pacing statistics of a lease.
+ * May be called from a different thread than sp_update(), but only from
+ * a single thread. */
+void sp_update_frames(struct sp *sp, struct lease_handle *lease_handle,
+		      const struct sp_frame_stats *stats);
+#endif
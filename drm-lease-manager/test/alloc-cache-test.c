@@ -0,0 +1,167 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <check.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-cache.h"
+
+#define CACHE_FILE "/tmp/dlm-alloc-cache-test.cache"
+#define TEST_KEY 0x1234
+
+static uint32_t test_object_ids[] = {31, 41, 59};
+static char test_topology[] = "topology";
+
+static struct ac_connector test_connectors[] = {
+    {.name = "HDMI-A-1"},
+    {.name = "eDP-1"},
+};
+
+static struct ac_lease test_leases[] = {
+    {
+	.record =
+	    {
+		.config_index = 1,
+		.crtc_id = 41,
+		.connector_id = 59,
+		.nobject_ids = 3,
+		.topology_size = sizeof(test_topology),
+	    },
+	.object_ids = test_object_ids,
+	.topology = test_topology,
+    },
+};
+
+static struct ac test_cache = {
+    .key = TEST_KEY,
+    .connectors = test_connectors,
+    .nconnectors = 2,
+    .leases = test_leases,
+    .nleases = 1,
+};
+
+static void test_shutdown(void)
+{
+	unlink(CACHE_FILE);
+}
+
+/* cache_round_trip
+ *
+ * Test details: Save a cache and load it with the same key.
+ * Expected results: The loaded cache has the saved connectors and leases,
+ *                   and no temporary file is left behind.
+ */
+START_TEST(cache_round_trip)
+{
+	ck_assert_int_eq(ac_save(CACHE_FILE, &test_cache), true);
+	ck_assert_int_ne(access(CACHE_FILE ".tmp", F_OK), 0);
+
+	struct ac *ac = ac_load(CACHE_FILE, TEST_KEY);
+	ck_assert_ptr_ne(ac, NULL);
+
+	ck_assert_int_eq(ac->nconnectors, 2);
+	ck_assert_str_eq(ac->connectors[0].name, "HDMI-A-1");
+	ck_assert_str_eq(ac->connectors[1].name, "eDP-1");
+
+	ck_assert_int_eq(ac->nleases, 1);
+	struct ac_lease *lease = &ac->leases[0];
+	ck_assert_uint_eq(lease->record.config_index, 1);
+	ck_assert_uint_eq(lease->record.crtc_id, 41);
+	ck_assert_uint_eq(lease->record.connector_id, 59);
+	ck_assert_uint_eq(lease->record.nobject_ids, 3);
+	for (int i = 0; i < 3; i++)
+		ck_assert_uint_eq(lease->object_ids[i], test_object_ids[i]);
+	ck_assert_uint_eq(lease->record.topology_size, sizeof(test_topology));
+	ck_assert_str_eq(lease->topology, test_topology);
+
+	ac_free(ac);
+}
+END_TEST
+
+/* cache_key_mismatch
+ *
+ * Test details: Save a cache and load it with a different key.
+ * Expected results: The cache is not used.
+ */
+START_TEST(cache_key_mismatch)
+{
+	ck_assert_int_eq(ac_save(CACHE_FILE, &test_cache), true);
+	ck_assert_ptr_eq(ac_load(CACHE_FILE, TEST_KEY + 1), NULL);
+}
+END_TEST
+
+/* truncated_cache
+ *
+ * Test details: Save a cache, cut off its last byte, and load it.
+ * Expected results: The cache is not used.
+ */
+START_TEST(truncated_cache)
+{
+	ck_assert_int_eq(ac_save(CACHE_FILE, &test_cache), true);
+
+	struct stat st;
+	ck_assert_int_eq(stat(CACHE_FILE, &st), 0);
+	ck_assert_int_eq(truncate(CACHE_FILE, st.st_size - 1), 0);
+
+	ck_assert_ptr_eq(ac_load(CACHE_FILE, TEST_KEY), NULL);
+}
+END_TEST
+
+/* missing_cache
+ *
+ * Test details: Load a cache that doesn't exist.
+ * Expected results: No cache is returned.
+ */
+START_TEST(missing_cache)
+{
+	unlink(CACHE_FILE);
+	ck_assert_ptr_eq(ac_load(CACHE_FILE, TEST_KEY), NULL);
+}
+END_TEST
+
+static void add_alloc_cache_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Allocation cache tests");
+
+	tcase_add_checked_fixture(tc, NULL, test_shutdown);
+
+	tcase_add_test(tc, cache_round_trip);
+	tcase_add_test(tc, cache_key_mismatch);
+	tcase_add_test(tc, truncated_cache);
+	tcase_add_test(tc, missing_cache);
+	suite_add_tcase(s, tc);
+}
+
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = suite_create("DLM allocation cache tests");
+
+	add_alloc_cache_tests(s);
+
+	sr = srunner_create(s);
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
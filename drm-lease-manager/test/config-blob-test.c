@@ -0,0 +1,234 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <check.h>
+
+#include <endian.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config-blob.h"
+
+static const char test_source[] = "configuration file contents";
+
+static uint32_t test_planes[] = {1, 4, 3};
+
+static struct connector_config test_connectors[] = {
+    {.name = "HDMI-A-1"},
+    {.name = "eDP-1", .optional = true, .nplanes = 3, .planes = test_planes},
+    {.name = "DP-1"},
+};
+
+static struct lease_config test_configs[] = {
+    {
+	.lease_name = "lease 1",
+	.nconnectors = 2,
+	.connectors = &test_connectors[0],
+	.watchdog = {.timeout_ms = 500, .action = LEASE_WATCHDOG_FALLBACK},
+    },
+    {
+	.lease_name = "lease 2",
+	.nconnectors = 1,
+	.connectors = &test_connectors[2],
+	.clone = true,
+    },
+};
+
+static struct device_config test_device = {
+    .driver = "i915",
+    .wait_ms = 5000,
+};
+
+static void *create_test_blob(size_t *size)
+{
+	void *blob = cb_create(test_source, sizeof(test_source), 2,
+			       test_configs, &test_device, size);
+	ck_assert_ptr_ne(blob, NULL);
+	return blob;
+}
+
+/* blob_round_trip
+ *
+ * Test details: Create a blob from a configuration and read it back.
+ * Expected results: The same lease and device configuration, with names
+ *                   pointing into the blob.
+ */
+START_TEST(blob_round_trip)
+{
+	size_t size;
+	char *blob = create_test_blob(&size);
+
+	ck_assert(cb_validate(blob, size, test_source, sizeof(test_source)));
+
+	struct lease_config configs[2];
+	struct connector_config connectors[3];
+	uint32_t planes[3];
+	ck_assert_int_eq(cb_get_leases(blob, configs, connectors, planes), 2);
+
+	ck_assert_str_eq(configs[0].lease_name, "lease 1");
+	ck_assert(configs[0].lease_name > blob &&
+		  configs[0].lease_name < blob + size);
+	ck_assert_int_eq(configs[0].nconnectors, 2);
+	ck_assert_str_eq(configs[0].connectors[0].name, "HDMI-A-1");
+	ck_assert(!configs[0].connectors[0].optional);
+	ck_assert_int_eq(configs[0].connectors[0].nplanes, 0);
+	ck_assert_str_eq(configs[0].connectors[1].name, "eDP-1");
+	ck_assert(configs[0].connectors[1].optional);
+	ck_assert_int_eq(configs[0].connectors[1].nplanes, 3);
+	for (int i = 0; i < 3; i++)
+		ck_assert_uint_eq(configs[0].connectors[1].planes[i],
+				  test_planes[i]);
+	ck_assert_uint_eq(configs[0].watchdog.timeout_ms, 500);
+	ck_assert_int_eq(configs[0].watchdog.action, LEASE_WATCHDOG_FALLBACK);
+	ck_assert(!configs[0].clone);
+
+	ck_assert_str_eq(configs[1].lease_name, "lease 2");
+	ck_assert_int_eq(configs[1].nconnectors, 1);
+	ck_assert_str_eq(configs[1].connectors[0].name, "DP-1");
+	ck_assert_int_eq(configs[1].watchdog.action, LEASE_WATCHDOG_REVOKE);
+	ck_assert(configs[1].clone);
+
+	struct device_config device;
+	ck_assert(cb_get_device(blob, &device));
+	ck_assert_ptr_eq(device.bus_id, NULL);
+	ck_assert_str_eq(device.driver, "i915");
+	ck_assert_ptr_eq(device.sysfs_path, NULL);
+	ck_assert_uint_eq(device.wait_ms, 5000);
+	free(device.driver);
+
+	free(blob);
+}
+END_TEST
+
+/* stale_blob
+ *
+ * Test details: Validate a blob against a changed source.
+ * Expected results: The blob is only valid without a source to check.
+ */
+START_TEST(stale_blob)
+{
+	size_t size;
+	void *blob = create_test_blob(&size);
+
+	char changed[] = "configuration file contents";
+	changed[0] = 'C';
+
+	ck_assert(!cb_validate(blob, size, changed, sizeof(changed)));
+	ck_assert(!cb_validate(blob, size, test_source,
+			       sizeof(test_source) - 1));
+	ck_assert(cb_validate(blob, size, NULL, 0));
+
+	free(blob);
+}
+END_TEST
+
+/* corrupted_blob
+ *
+ * Test details: Validate truncated blobs and blobs with out of range
+ *               offsets and counts.
+ * Expected results: None of them are valid.
+ */
+START_TEST(corrupted_blob)
+{
+	size_t size;
+	char *blob = create_test_blob(&size);
+	struct cb_header *hdr = (struct cb_header *)blob;
+	struct cb_lease *leases = (struct cb_lease *)(hdr + 1);
+
+	ck_assert(!cb_validate(blob, size - 1, NULL, 0));
+	ck_assert(!cb_validate(blob, sizeof(*hdr) - 1, NULL, 0));
+
+	hdr->version++;
+	ck_assert(!cb_validate(blob, size, NULL, 0));
+	hdr->version--;
+
+	uint32_t name = leases[1].name;
+	leases[1].name = htole32(size);
+	ck_assert(!cb_validate(blob, size, NULL, 0));
+	leases[1].name = name;
+
+	leases[1].nconnectors = htole32(2);
+	ck_assert(!cb_validate(blob, size, NULL, 0));
+	leases[1].nconnectors = htole32(1);
+
+	blob[size - 1] = 'x';
+	ck_assert(!cb_validate(blob, size, NULL, 0));
+	blob[size - 1] = '\0';
+
+	ck_assert(cb_validate(blob, size, NULL, 0));
+	free(blob);
+}
+END_TEST
+
+/* blob_is_little_endian
+ *
+ * Test details: Check the encoding of the header and plane list of a blob.
+ * Expected results: All fields are little-endian, whatever the byte order
+ *                   of the machine that created the blob.
+ */
+START_TEST(blob_is_little_endian)
+{
+	size_t size;
+	unsigned char *blob = create_test_blob(&size);
+
+	static const unsigned char header[] = {
+	    'D', 'L', 'C', 'B', CB_VERSION, 0, 0, 0,
+	};
+	ck_assert_int_eq(memcmp(blob, header, sizeof(header)), 0);
+	ck_assert_uint_eq(blob[8] | blob[9] << 8 | blob[10] << 16 |
+			      (uint32_t)blob[11] << 24,
+			  size);
+
+	/* The planes follow 2 leases and 3 connectors */
+	const unsigned char *planes = blob + sizeof(struct cb_header) +
+				      2 * sizeof(struct cb_lease) +
+				      3 * sizeof(struct cb_connector);
+	static const unsigned char expected_planes[] = {
+	    1, 0, 0, 0, 4, 0, 0, 0, 3, 0, 0, 0,
+	};
+	ck_assert_int_eq(
+	    memcmp(planes, expected_planes, sizeof(expected_planes)), 0);
+
+	free(blob);
+}
+END_TEST
+
+static void add_config_blob_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Binary configuration tests");
+
+	tcase_add_test(tc, blob_round_trip);
+	tcase_add_test(tc, stale_blob);
+	tcase_add_test(tc, corrupted_blob);
+	tcase_add_test(tc, blob_is_little_endian);
+	suite_add_tcase(s, tc);
+}
+
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = suite_create("DLM binary configuration tests");
+
+	add_config_blob_tests(s);
+
+	sr = srunner_create(s);
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,304 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <check.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "dlmserver.h"
+#include "log.h"
+#include "test-helpers.h"
+#include "test-socket-client.h"
+
+#define SOCKETDIR "/tmp"
+
+/* Long enough for the server to hand out and revoke the lease */
+#define CLIENT_TIMEOUT_MS 2000
+
+#define MAX_EVENTS 8
+
+/************** Test fixture functions *************************/
+
+static pthread_mutex_t event_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct dlm_server_event events[MAX_EVENTS];
+static int nevents;
+
+static void record_event(struct dlm_server *server,
+			 const struct dlm_server_event *event, void *data)
+{
+	UNUSED(server);
+	UNUSED(data);
+
+	pthread_mutex_lock(&event_lock);
+	if (nevents < MAX_EVENTS)
+		events[nevents++] = *event;
+	pthread_mutex_unlock(&event_lock);
+}
+
+static int event_count(void)
+{
+	pthread_mutex_lock(&event_lock);
+	int count = nevents;
+	pthread_mutex_unlock(&event_lock);
+	return count;
+}
+
+static void wait_for_events(int count)
+{
+	for (int i = 0; i < CLIENT_TIMEOUT_MS && event_count() < count; i++)
+		usleep(1000);
+	ck_assert_int_ge(event_count(), count);
+}
+
+static struct dlm_server_options server_options = {
+    .device = "virtual",
+    .event_handler = record_event,
+};
+
+static struct lease_handle test_lease;
+
+static void test_setup(void)
+{
+	dlm_log_enable_debug(true);
+	setenv("DLM_RUNTIME_PATH", SOCKETDIR, 1);
+	nevents = 0;
+}
+
+static void *server_thread(void *arg)
+{
+	struct dlm_server *server = arg;
+	return (void *)(intptr_t)dlm_server_run(server);
+}
+
+/************** Lease manager library tests *************/
+
+/* lease_names
+ *
+ * Test details: Create a lease manager on a virtual device.
+ * Expected results: One lease per output of the device.
+ */
+START_TEST(lease_names)
+{
+	struct dlm_server *server = dlm_server_create(&server_options);
+	ck_assert_ptr_ne(server, NULL);
+
+	ck_assert_int_eq(dlm_server_lease_count(server), 2);
+	ck_assert_str_eq(dlm_server_lease_name(server, 0), "card0-Virtual-1");
+	ck_assert_str_eq(dlm_server_lease_name(server, 1), "card0-Virtual-2");
+	ck_assert_ptr_eq(dlm_server_lease_name(server, 2), NULL);
+	ck_assert_int_ge(dlm_server_drm_fd(server), 0);
+
+	ck_assert_int_eq(dlm_server_revoke_lease(server, "no-such-lease"), -1);
+	ck_assert_int_eq(errno, ENOENT);
+	ck_assert_int_eq(dlm_server_revoke_lease(server, "card0-Virtual-1"),
+			 -1);
+	ck_assert_int_eq(errno, EINVAL);
+
+	dlm_server_destroy(server);
+}
+END_TEST
+
+/* dispatch_grant
+ *
+ * Test details: Poll the event fd and dispatch requests on the calling
+ *               thread, while a client requests a lease.
+ * Expected results: The client gets the lease, and the grant is reported
+ *                   to the event handler.
+ */
+START_TEST(dispatch_grant)
+{
+	struct dlm_server *server = dlm_server_create(&server_options);
+	ck_assert_ptr_ne(server, NULL);
+
+	test_lease.name = (char *)dlm_server_lease_name(server, 0);
+	struct test_config config = {
+	    .lease = &test_lease,
+	    .recv_timeout = CLIENT_TIMEOUT_MS,
+	};
+	struct client_state *cstate = test_client_start(&config);
+
+	struct pollfd pfd = {
+	    .fd = dlm_server_event_fd(server),
+	    .events = POLLIN,
+	};
+	while (event_count() < 1) {
+		ck_assert_int_eq(poll(&pfd, 1, CLIENT_TIMEOUT_MS), 1);
+		ck_assert_int_eq(dlm_server_dispatch(server), 0);
+	}
+
+	test_client_stop(cstate);
+	ck_assert_int_eq(config.has_data, true);
+	ck_assert_int_ge(config.received_fd, 0);
+
+	ck_assert_int_eq(events[0].type, DLM_SERVER_LEASE_GRANTED);
+	ck_assert_str_eq(events[0].lease_name, test_lease.name);
+	ck_assert_uint_ne(events[0].lessee_id, 0);
+	ck_assert_int_eq(events[0].client_pid, getpid());
+
+	test_config_cleanup(&config);
+	dlm_server_destroy(server);
+}
+END_TEST
+
+/* revoke_from_other_thread
+ *
+ * Test details: Run the lease manager on its own thread, and revoke a
+ *               granted lease from the test thread.
+ * Expected results: The client is notified of the revocation, the grant
+ *                   and revocation are reported to the event handler, and
+ *                   dlm_server_run() returns after dlm_server_stop().
+ */
+START_TEST(revoke_from_other_thread)
+{
+	struct dlm_server *server = dlm_server_create(&server_options);
+	ck_assert_ptr_ne(server, NULL);
+
+	pthread_t tid;
+	ck_assert_int_eq(pthread_create(&tid, NULL, server_thread, server), 0);
+
+	test_lease.name = (char *)dlm_server_lease_name(server, 1);
+	struct test_config config = {
+	    .lease = &test_lease,
+	    .recv_timeout = CLIENT_TIMEOUT_MS,
+	    .wait_for_event = true,
+	};
+	struct client_state *cstate = test_client_start(&config);
+
+	wait_for_events(1);
+	ck_assert_int_eq(dlm_server_revoke_lease(server, test_lease.name), 0);
+	wait_for_events(2);
+
+	test_client_stop(cstate);
+	ck_assert_int_ge(config.received_fd, 0);
+	ck_assert_int_eq(config.received_event, DLM_EVENT_LEASE_REVOKED);
+
+	ck_assert_int_eq(events[0].type, DLM_SERVER_LEASE_GRANTED);
+	ck_assert_int_eq(events[1].type, DLM_SERVER_LEASE_REVOKED);
+	ck_assert_uint_eq(events[1].lessee_id, events[0].lessee_id);
+
+	dlm_server_stop(server);
+	void *ret;
+	pthread_join(tid, &ret);
+	ck_assert_int_eq((intptr_t)ret, 0);
+
+	test_config_cleanup(&config);
+	dlm_server_destroy(server);
+}
+END_TEST
+
+/* Handle requests until there are none left */
+static void dispatch_pending(struct dlm_server *server)
+{
+	struct pollfd pfd = {
+	    .fd = dlm_server_event_fd(server),
+	    .events = POLLIN,
+	};
+	while (poll(&pfd, 1, 100) > 0)
+		ck_assert_int_eq(dlm_server_dispatch(server), 0);
+}
+
+/* undelivered_lease_has_no_owner
+ *
+ * Test details: A control socket client requests a lease and disconnects
+ *               before it is sent.  Another client reuses its connection
+ *               slot for a different lease, then a third client requests
+ *               the first lease.
+ * Expected results: The first lease is granted to the third client without
+ *                   revoking the lease of the second one.
+ */
+START_TEST(undelivered_lease_has_no_owner)
+{
+	struct dlm_server *server = dlm_server_create(&server_options);
+	ck_assert_ptr_ne(server, NULL);
+
+	struct lease_handle leases[] = {
+	    {.name = (char *)dlm_server_lease_name(server, 0)},
+	    {.name = (char *)dlm_server_lease_name(server, 1)},
+	};
+	struct test_config config = {
+	    .use_control_socket = true,
+	};
+
+	config.lease = &leases[0];
+	close(test_client_connect(&config));
+	dispatch_pending(server);
+	ck_assert_int_eq(event_count(), 0);
+
+	config.lease = &leases[1];
+	int owner = test_client_connect(&config);
+	ck_assert_int_ge(owner, 0);
+	dispatch_pending(server);
+	int owner_fd = receive_lease_fd(owner, NULL);
+	ck_assert_int_ge(owner_fd, 0);
+
+	config.lease = &leases[0];
+	int client = test_client_connect(&config);
+	ck_assert_int_ge(client, 0);
+	dispatch_pending(server);
+	int client_fd = receive_lease_fd(client, NULL);
+	ck_assert_int_ge(client_fd, 0);
+
+	/* No revocation was sent to the owner of the other lease */
+	struct pollfd pfd = {.fd = owner, .events = POLLIN};
+	ck_assert_int_eq(poll(&pfd, 1, 0), 0);
+
+	ck_assert_int_eq(event_count(), 2);
+	ck_assert_int_eq(events[0].type, DLM_SERVER_LEASE_GRANTED);
+	ck_assert_str_eq(events[0].lease_name, leases[1].name);
+	ck_assert_int_eq(events[1].type, DLM_SERVER_LEASE_GRANTED);
+	ck_assert_str_eq(events[1].lease_name, leases[0].name);
+
+	close(client_fd);
+	close(client);
+	close(owner_fd);
+	close(owner);
+	dlm_server_destroy(server);
+}
+END_TEST
+
+static void add_server_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Lease manager library");
+
+	tcase_add_checked_fixture(tc, test_setup, NULL);
+
+	tcase_add_test(tc, lease_names);
+	tcase_add_test(tc, dispatch_grant);
+	tcase_add_test(tc, revoke_from_other_thread);
+	tcase_add_test(tc, undelivered_lease_has_no_owner);
+	suite_add_tcase(s, tc);
+}
+
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = suite_create("DLM lease manager library tests");
+
+	add_server_tests(s);
+
+	sr = srunner_create(s);
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
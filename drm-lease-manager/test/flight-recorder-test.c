@@ -0,0 +1,148 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <check.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "flight-recorder.h"
+
+struct dump {
+	struct fr_dump_header hdr;
+	struct fr_event_record events[FR_MAX_EVENTS];
+};
+
+static void read_dump(struct dump *dump)
+{
+	int fd = memfd_create("flight-recorder", MFD_CLOEXEC);
+	ck_assert_int_ge(fd, 0);
+
+	ck_assert(fr_dump(fd));
+
+	memset(dump, 0, sizeof(*dump));
+	ssize_t size = pread(fd, dump, sizeof(*dump), 0);
+	close(fd);
+
+	ck_assert_int_ge(size, sizeof(dump->hdr));
+	ck_assert_int_eq(dump->hdr.magic, FR_DUMP_MAGIC);
+	ck_assert_int_eq(dump->hdr.version, FR_DUMP_VERSION);
+	ck_assert_int_eq(size, sizeof(dump->hdr) + dump->hdr.nevents *
+						       sizeof(dump->events[0]));
+}
+
+/* record_events
+ *
+ * Test details: Record a sequence of lease events and dump them.
+ * Expected results: The dump ends with the recorded events, in order.
+ */
+START_TEST(record_events)
+{
+	fr_record(FR_EVENT_ACCEPT, "lease-a", 10);
+	fr_record(FR_EVENT_REQUEST, "lease-a", 1);
+	fr_record(FR_EVENT_LEASE_CREATE, "lease-a", 42);
+
+	struct dump dump;
+	read_dump(&dump);
+
+	ck_assert_int_ge(dump.hdr.nevents, 3);
+	struct fr_event_record *ev = &dump.events[dump.hdr.nevents - 3];
+
+	ck_assert_int_eq(ev[0].event, FR_EVENT_ACCEPT);
+	ck_assert_int_eq(ev[0].arg, 10);
+	ck_assert_int_eq(ev[1].event, FR_EVENT_REQUEST);
+	ck_assert_int_eq(ev[2].event, FR_EVENT_LEASE_CREATE);
+	ck_assert_int_eq(ev[2].arg, 42);
+	ck_assert_str_eq(ev[2].lease, "lease-a");
+
+	ck_assert_uint_le(ev[0].timestamp_ns, ev[1].timestamp_ns);
+	ck_assert_uint_le(ev[1].timestamp_ns, ev[2].timestamp_ns);
+	ck_assert_uint_le(ev[2].timestamp_ns, dump.hdr.monotonic_ns);
+}
+END_TEST
+
+/* oldest_events_are_overwritten
+ *
+ * Test details: Record more events than the flight recorder can hold.
+ * Expected results: The dump contains the most recent events, oldest first.
+ */
+START_TEST(oldest_events_are_overwritten)
+{
+	const int nevents = FR_MAX_EVENTS + 10;
+	for (int i = 0; i < nevents; i++)
+		fr_record(FR_EVENT_DISCONNECT, NULL, i);
+
+	struct dump dump;
+	read_dump(&dump);
+
+	ck_assert_int_eq(dump.hdr.nevents, FR_MAX_EVENTS);
+	for (int i = 0; i < FR_MAX_EVENTS; i++) {
+		ck_assert_int_eq(dump.events[i].arg, i + 10);
+		ck_assert_str_eq(dump.events[i].lease, "");
+	}
+}
+END_TEST
+
+/* long_lease_names_are_truncated
+ *
+ * Test details: Record an event for a lease with a very long name.
+ * Expected results: The name is truncated and nul terminated.
+ */
+START_TEST(long_lease_names_are_truncated)
+{
+	char name[FR_LEASE_NAME_LEN * 2];
+	memset(name, 'x', sizeof(name) - 1);
+	name[sizeof(name) - 1] = '\0';
+
+	fr_record(FR_EVENT_LEASE_REVOKE, name, 0);
+
+	struct dump dump;
+	read_dump(&dump);
+
+	struct fr_event_record *ev = &dump.events[dump.hdr.nevents - 1];
+	ck_assert_int_eq(strlen(ev->lease), FR_LEASE_NAME_LEN - 1);
+	ck_assert_int_eq(strncmp(ev->lease, name, FR_LEASE_NAME_LEN - 1), 0);
+}
+END_TEST
+
+static void add_flight_recorder_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Flight recorder tests");
+
+	tcase_add_test(tc, record_events);
+	tcase_add_test(tc, oldest_events_are_overwritten);
+	tcase_add_test(tc, long_lease_names_are_truncated);
+	suite_add_tcase(s, tc);
+}
+
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = suite_create("DLM flight recorder tests");
+
+	add_flight_recorder_tests(s);
+
+	sr = srunner_create(s);
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
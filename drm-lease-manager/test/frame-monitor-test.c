@@ -0,0 +1,344 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <check.h>
+#include <fff.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "dlm-status.h"
+#include "drm-backend.h"
+#include "frame-monitor.h"
+#include "status-page.h"
+#include "test-helpers.h"
+
+#define SOCKETDIR "/tmp"
+#define STATUS_FILE SOCKETDIR "/" DLM_STATUS_FILE_NAME
+
+#define TEST_CRTC_ID 42
+#define TEST_LESSEE_ID 7
+
+/**************  Mock functions  *************/
+DEFINE_FFF_GLOBALS;
+
+FAKE_VALUE_FUNC(int, lm_get_drm_fd, struct lm *);
+FAKE_VALUE_FUNC(const struct drm_backend *, lm_get_drm_backend, struct lm *);
+FAKE_VALUE_FUNC(int, lm_lease_crtc_ids, struct lm *, struct lease_handle *,
+		uint32_t *, int);
+FAKE_VALUE_FUNC(const struct lease_watchdog *, lm_lease_watchdog,
+		struct lease_handle *);
+
+FAKE_VALUE_FUNC(int, drmCrtcQueueSequence, int, uint32_t, uint32_t, uint64_t,
+		uint64_t *, uint64_t);
+FAKE_VALUE_FUNC(int, drmHandleEvent, int, drmEventContextPtr);
+FAKE_VALUE_FUNC(drmModeCrtcPtr, drmModeGetCrtc, int, uint32_t);
+FAKE_VOID_FUNC(drmModeFreeCrtc, drmModeCrtcPtr);
+
+static const struct drm_backend test_backend = {
+    .name = "test",
+    .get_crtc = drmModeGetCrtc,
+    .free_crtc = drmModeFreeCrtc,
+    .crtc_queue_sequence = drmCrtcQueueSequence,
+    .handle_event = drmHandleEvent,
+};
+
+/* Simulated display: each byte written to the fake DRM fd is a vblank.
+ * The framebuffer on screen at the nth vblank is scanout_fbs[n]. */
+static int drm_pipe[2];
+static const uint32_t *scanout_fbs;
+static uint64_t vblank_seq;
+static uint64_t queued_user_data;
+
+static drmModeCrtc test_crtc;
+
+/* CRTCs of the test lease, and those with a vblank event queued */
+static const uint32_t *lease_crtcs;
+static int lease_ncrtcs;
+static atomic_uint queued_crtcs;
+
+static int get_lease_crtcs(struct lm *lm, struct lease_handle *handle,
+			   uint32_t *crtc_ids, int max)
+{
+	UNUSED(lm);
+	UNUSED(handle);
+
+	for (int i = 0; i < lease_ncrtcs && i < max; i++)
+		crtc_ids[i] = lease_crtcs[i];
+	return lease_ncrtcs;
+}
+
+static int queue_sequence(int fd, uint32_t crtc_id, uint32_t flags,
+			  uint64_t sequence, uint64_t *sequence_queued,
+			  uint64_t user_data)
+{
+	UNUSED(fd);
+	UNUSED(flags);
+	UNUSED(sequence);
+	UNUSED(sequence_queued);
+
+	int i = 0;
+	while (i < lease_ncrtcs && lease_crtcs[i] != crtc_id)
+		i++;
+	ck_assert_int_lt(i, lease_ncrtcs);
+
+	atomic_fetch_or(&queued_crtcs, 1u << i);
+	queued_user_data = user_data;
+	return 0;
+}
+
+static int handle_event(int fd, drmEventContextPtr ctx)
+{
+	char vblank;
+	if (read(fd, &vblank, 1) != 1)
+		return -1;
+
+	test_crtc.buffer_id = scanout_fbs[vblank_seq];
+	ctx->sequence_handler(fd, ++vblank_seq, 0, queued_user_data);
+	return 0;
+}
+
+static drmModeCrtcPtr get_crtc(int fd, uint32_t crtc_id)
+{
+	UNUSED(fd);
+	ck_assert_uint_eq(crtc_id, TEST_CRTC_ID);
+	return &test_crtc;
+}
+
+/************** Test fixture functions *************************/
+
+static struct lease_handle test_lease = {.name = "test-lease"};
+static struct lease_handle *lease_handles[] = {&test_lease};
+
+static struct sp *sp;
+static struct lease_watchdog test_watchdog;
+
+static void test_setup(void)
+{
+	RESET_FAKE(lm_get_drm_fd);
+	RESET_FAKE(lm_get_drm_backend);
+	RESET_FAKE(lm_lease_crtc_ids);
+	RESET_FAKE(lm_lease_watchdog);
+	RESET_FAKE(drmCrtcQueueSequence);
+	RESET_FAKE(drmHandleEvent);
+	RESET_FAKE(drmModeGetCrtc);
+	RESET_FAKE(drmModeFreeCrtc);
+
+	ck_assert_int_eq(pipe(drm_pipe), 0);
+	vblank_seq = 0;
+
+	lm_get_drm_fd_fake.return_val = drm_pipe[0];
+	lm_get_drm_backend_fake.return_val = &test_backend;
+	static const uint32_t test_crtc_ids[] = {TEST_CRTC_ID};
+	lease_crtcs = test_crtc_ids;
+	lease_ncrtcs = ARRAY_LEN(test_crtc_ids);
+	atomic_store(&queued_crtcs, 0);
+	lm_lease_crtc_ids_fake.custom_fake = get_lease_crtcs;
+	lm_lease_watchdog_fake.return_val = &test_watchdog;
+	test_watchdog = (struct lease_watchdog){0};
+	drmCrtcQueueSequence_fake.custom_fake = queue_sequence;
+	drmHandleEvent_fake.custom_fake = handle_event;
+	drmModeGetCrtc_fake.custom_fake = get_crtc;
+
+	setenv("DLM_RUNTIME_PATH", SOCKETDIR, 1);
+	sp = sp_create(lease_handles, 1);
+	ck_assert_ptr_ne(sp, NULL);
+}
+
+static void test_shutdown(void)
+{
+	sp_destroy(sp);
+	close(drm_pipe[0]);
+	close(drm_pipe[1]);
+}
+
+static void run_vblanks(const uint32_t *fbs, int count)
+{
+	scanout_fbs = fbs;
+
+	for (int i = 0; i < count; i++)
+		ck_assert_int_eq(write(drm_pipe[1], "v", 1), 1);
+}
+
+static struct dlm_status_entry *map_status_entry(void)
+{
+	int fd = open(STATUS_FILE, O_RDONLY);
+	ck_assert_int_ge(fd, 0);
+
+	size_t size = sizeof(struct dlm_status_header) +
+		      sizeof(struct dlm_status_entry);
+	void *page = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	ck_assert_ptr_ne(page, MAP_FAILED);
+	close(fd);
+
+	return (struct dlm_status_entry *)((struct dlm_status_header *)page +
+					   1);
+}
+
+static void wait_for_frames(struct dlm_status_entry *entry, uint64_t frames)
+{
+	struct timespec delay = {.tv_nsec = 1000000};
+	for (int i = 0; i < 1000 && entry->frame_count < frames; i++)
+		nanosleep(&delay, NULL);
+	ck_assert_uint_eq(entry->frame_count, frames);
+}
+
+/* frame_intervals_are_recorded
+ *
+ * Test details: Present frames at irregular vblank intervals on a granted
+ *               lease.
+ * Expected results: The status page shows a histogram of the intervals and
+ *                   the number of vblanks without a new frame.
+ */
+START_TEST(frame_intervals_are_recorded)
+{
+	/* New frames at vblanks 1, 3, 4 and 7 */
+	static const uint32_t fbs[] = {10, 10, 11, 12, 12, 12, 13};
+
+	struct dlm_status_entry *entry = map_status_entry();
+	struct fm *fm = fm_create((struct lm *)1, lease_handles, 1, sp);
+	ck_assert_ptr_ne(fm, NULL);
+
+	fm_update(fm, &test_lease, TEST_LESSEE_ID);
+
+	struct timespec delay = {.tv_nsec = 1000000};
+	for (int i = 0; i < 1000 && !drmCrtcQueueSequence_fake.call_count;
+	     i++)
+		nanosleep(&delay, NULL);
+	ck_assert_int_gt(drmCrtcQueueSequence_fake.call_count, 0);
+
+	run_vblanks(fbs, ARRAY_LEN(fbs));
+	wait_for_frames(entry, 3);
+
+	ck_assert_uint_eq(entry->missed_frames, 3);
+	ck_assert_uint_eq(entry->frame_intervals[0], 1);
+	ck_assert_uint_eq(entry->frame_intervals[1], 1);
+	ck_assert_uint_eq(entry->frame_intervals[2], 1);
+	ck_assert_uint_eq(entry->frame_intervals[3], 0);
+
+	fm_destroy(fm);
+}
+END_TEST
+
+/* ungranted_lease_is_not_monitored
+ *
+ * Test details: Start the monitor without granting the lease.
+ * Expected results: No vblank events are requested.
+ */
+START_TEST(ungranted_lease_is_not_monitored)
+{
+	struct fm *fm = fm_create((struct lm *)1, lease_handles, 1, sp);
+	ck_assert_ptr_ne(fm, NULL);
+
+	struct timespec delay = {.tv_nsec = 20000000};
+	nanosleep(&delay, NULL);
+
+	fm_destroy(fm);
+	ck_assert_int_eq(drmCrtcQueueSequence_fake.call_count, 0);
+}
+END_TEST
+
+/* all_lease_crtcs_are_monitored
+ *
+ * Test details: Grant a lease with several CRTCs.
+ * Expected results: Vblank events are requested for each of them.
+ */
+START_TEST(all_lease_crtcs_are_monitored)
+{
+	static const uint32_t crtc_ids[] = {TEST_CRTC_ID, TEST_CRTC_ID + 1,
+					    TEST_CRTC_ID + 2};
+	lease_crtcs = crtc_ids;
+	lease_ncrtcs = ARRAY_LEN(crtc_ids);
+	const unsigned int all_crtcs = (1u << ARRAY_LEN(crtc_ids)) - 1;
+
+	struct fm *fm = fm_create((struct lm *)1, lease_handles, 1, sp);
+	ck_assert_ptr_ne(fm, NULL);
+
+	fm_update(fm, &test_lease, TEST_LESSEE_ID);
+
+	struct timespec delay = {.tv_nsec = 1000000};
+	for (int i = 0; i < 1000 && atomic_load(&queued_crtcs) != all_crtcs;
+	     i++)
+		nanosleep(&delay, NULL);
+
+	fm_destroy(fm);
+	ck_assert_uint_eq(atomic_load(&queued_crtcs), all_crtcs);
+}
+END_TEST
+
+/* watchdog_reports_stalled_lease
+ *
+ * Test details: Grant a lease with a watchdog, but never present a frame.
+ * Expected results: The lease is reported as stalled once, with the lessee
+ *                   id of its owner.
+ */
+START_TEST(watchdog_reports_stalled_lease)
+{
+	test_watchdog.timeout_ms = 20;
+
+	struct fm *fm = fm_create((struct lm *)1, lease_handles, 1, sp);
+	ck_assert_ptr_ne(fm, NULL);
+
+	fm_update(fm, &test_lease, TEST_LESSEE_ID);
+
+	struct pollfd event = {.fd = fm_get_event_fd(fm), .events = POLLIN};
+	ck_assert_int_eq(poll(&event, 1, 1000), 1);
+
+	uint32_t lessee_id = 0;
+	ck_assert_ptr_eq(fm_get_stalled_lease(fm, &lessee_id), &test_lease);
+	ck_assert_uint_eq(lessee_id, TEST_LESSEE_ID);
+	ck_assert_ptr_eq(fm_get_stalled_lease(fm, &lessee_id), NULL);
+
+	fm_destroy(fm);
+}
+END_TEST
+
+static void add_frame_monitor_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Frame monitor tests");
+
+	tcase_add_checked_fixture(tc, test_setup, test_shutdown);
+
+	tcase_add_test(tc, frame_intervals_are_recorded);
+	tcase_add_test(tc, ungranted_lease_is_not_monitored);
+	tcase_add_test(tc, all_lease_crtcs_are_monitored);
+	tcase_add_test(tc, watchdog_reports_stalled_lease);
+	suite_add_tcase(s, tc);
+}
+
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = suite_create("DLM frame monitor tests");
+
+	add_frame_monitor_tests(s);
+
+	sr = srunner_create(s);
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
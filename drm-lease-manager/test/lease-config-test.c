@@ -14,9 +14,11 @@
  */
 
 #include "lease-config.h"
+#include "config-blob.h"
 #include <check.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #define CONFIG_FILE_TEMPLATE "/tmp/dlmconfig_tmpXXXXXX"
@@ -111,6 +113,185 @@ START_TEST(connector_config)
 	release_config(nconfigs, config);
 }
 END_TEST
+START_TEST(watchdog_config)
+{
+	ck_assert_ptr_ne(config_file, NULL);
+
+	char test_data[] = "[[lease]]\n"
+			   "name = \"lease 1\"\n"
+			   "connectors = [\"1\"]\n"
+			   "watchdog_timeout_ms = 500\n"
+			   "watchdog_action = \"fallback\"\n"
+			   "[[lease]]\n"
+			   "name = \"lease 2\"\n"
+			   "connectors = [\"2\"]\n";
+
+	write(config_fd, test_data, sizeof(test_data));
+
+	struct lease_config *config = NULL;
+	int nconfigs = parse_config(config_file, &config);
+
+	ck_assert_int_eq(nconfigs, 2);
+	ck_assert_ptr_ne(config, NULL);
+
+	ck_assert_uint_eq(config[0].watchdog.timeout_ms, 500);
+	ck_assert_int_eq(config[0].watchdog.action, LEASE_WATCHDOG_FALLBACK);
+
+	ck_assert_uint_eq(config[1].watchdog.timeout_ms, 0);
+	ck_assert_int_eq(config[1].watchdog.action, LEASE_WATCHDOG_REVOKE);
+
+	release_config(nconfigs, config);
+}
+END_TEST
+
+START_TEST(clone_config)
+{
+	ck_assert_ptr_ne(config_file, NULL);
+
+	char test_data[] = "[[lease]]\n"
+			   "name = \"lease 1\"\n"
+			   "connectors = [\"1\", \"2\"]\n"
+			   "clone = true\n"
+			   "[[lease]]\n"
+			   "name = \"lease 2\"\n"
+			   "connectors = [\"3\"]\n";
+
+	write(config_fd, test_data, sizeof(test_data));
+
+	struct lease_config *config = NULL;
+	int nconfigs = parse_config(config_file, &config);
+
+	ck_assert_int_eq(nconfigs, 2);
+	ck_assert(config[0].clone);
+	ck_assert(!config[1].clone);
+
+	release_config(nconfigs, config);
+}
+END_TEST
+
+START_TEST(invalid_watchdog_action)
+{
+	ck_assert_ptr_ne(config_file, NULL);
+
+	char test_data[] = "[[lease]]\n"
+			   "name = \"lease 1\"\n"
+			   "connectors = [\"1\"]\n"
+			   "watchdog_timeout_ms = 500\n"
+			   "watchdog_action = \"reboot\"\n";
+
+	write(config_fd, test_data, sizeof(test_data));
+
+	struct lease_config *config = NULL;
+	ck_assert_int_eq(parse_config(config_file, &config), 0);
+}
+END_TEST
+
+START_TEST(device_config)
+{
+	ck_assert_ptr_ne(config_file, NULL);
+
+	char test_data[] = "[device]\n"
+			   "bus_id = \"pci:0000:00:02.0\"\n"
+			   "driver = \"i915\"\n"
+			   "wait_ms = 5000\n";
+
+	write(config_fd, test_data, sizeof(test_data));
+
+	struct device_config config;
+	ck_assert_int_eq(parse_device_config(config_file, &config), true);
+
+	ck_assert_str_eq(config.bus_id, "pci:0000:00:02.0");
+	ck_assert_str_eq(config.driver, "i915");
+	ck_assert_ptr_eq(config.sysfs_path, NULL);
+	ck_assert_uint_eq(config.wait_ms, 5000);
+
+	/* The default leases are used when only the device is configured */
+	struct lease_config *lease_config = NULL;
+	ck_assert_int_eq(parse_config(config_file, &lease_config), 0);
+
+	release_device_config(&config);
+}
+END_TEST
+
+START_TEST(invalid_device_wait)
+{
+	ck_assert_ptr_ne(config_file, NULL);
+
+	char test_data[] = "[device]\n"
+			   "driver = \"i915\"\n"
+			   "wait_ms = -1\n";
+
+	write(config_fd, test_data, sizeof(test_data));
+
+	struct device_config config;
+	ck_assert_int_eq(parse_device_config(config_file, &config), false);
+	ck_assert_ptr_eq(config.driver, NULL);
+}
+END_TEST
+
+static void write_binary_config(const void *source, size_t source_size,
+				const char *lease_name)
+{
+	char bin_file[sizeof(config_file) + 4];
+	snprintf(bin_file, sizeof(bin_file), "%s.bin", config_file);
+
+	struct lease_config config = {.lease_name = (char *)lease_name};
+	size_t size;
+	void *blob =
+	    cb_create(source, source_size, 1, &config, NULL, &size);
+	ck_assert_ptr_ne(blob, NULL);
+
+	FILE *fp = fopen(bin_file, "w");
+	ck_assert_ptr_ne(fp, NULL);
+	ck_assert_uint_eq(fwrite(blob, 1, size, fp), size);
+	fclose(fp);
+	free(blob);
+}
+
+static void remove_binary_config(void)
+{
+	char bin_file[sizeof(config_file) + 4];
+	snprintf(bin_file, sizeof(bin_file), "%s.bin", config_file);
+	unlink(bin_file);
+}
+
+/* binary_config
+ *
+ * Test details: Compile a config file to <config>.bin, then change the
+ *               config file.
+ * Expected results: The binary configuration is used until the config file
+ *                   changes, then the config file is parsed.
+ */
+START_TEST(binary_config)
+{
+	ck_assert_ptr_ne(config_file, NULL);
+
+	char test_data[] = "[[lease]]\n"
+			   "name = \"lease 1\"\n";
+
+	write(config_fd, test_data, strlen(test_data));
+	write_binary_config(test_data, strlen(test_data), "compiled lease");
+
+	struct lease_config *config = NULL;
+	int nconfigs = parse_config(config_file, &config);
+	ck_assert_int_eq(nconfigs, 1);
+	ck_assert_str_eq(config[0].lease_name, "compiled lease");
+	release_config(nconfigs, config);
+
+	char update[] = "[[lease]]\n"
+			"name = \"lease 2\"\n";
+	write(config_fd, update, strlen(update));
+
+	config = NULL;
+	nconfigs = parse_config(config_file, &config);
+	ck_assert_int_eq(nconfigs, 2);
+	ck_assert_str_eq(config[0].lease_name, "lease 1");
+	release_config(nconfigs, config);
+
+	remove_binary_config();
+}
+END_TEST
+
 static void add_parse_tests(Suite *s)
 {
 	TCase *tc = tcase_create("Config file parsing tests");
@@ -119,6 +300,12 @@ static void add_parse_tests(Suite *s)
 
 	tcase_add_test(tc, parse_leases);
 	tcase_add_test(tc, connector_config);
+	tcase_add_test(tc, watchdog_config);
+	tcase_add_test(tc, invalid_watchdog_action);
+	tcase_add_test(tc, clone_config);
+	tcase_add_test(tc, device_config);
+	tcase_add_test(tc, invalid_device_wait);
+	tcase_add_test(tc, binary_config);
 	suite_add_tcase(s, tc);
 }
 
@@ -13,13 +13,19 @@
  * limitations under the License.
  */
 
+#define _GNU_SOURCE
 #include <check.h>
 #include <fff.h>
 
+#include <fcntl.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <xf86drm.h>
 #include <xf86drmMode.h>
 
+#include "dlm-topology.h"
 #include "lease-manager.h"
 #include "log.h"
 #include "test-drm-device.h"
@@ -57,12 +63,29 @@ FAKE_VALUE_FUNC(drmModeConnectorPtr, drmModeGetConnector, int, uint32_t);
 FAKE_VOID_FUNC(drmModeFreeConnector, drmModeConnectorPtr);
 FAKE_VALUE_FUNC(drmModeEncoderPtr, drmModeGetEncoder, int, uint32_t);
 FAKE_VOID_FUNC(drmModeFreeEncoder, drmModeEncoderPtr);
+FAKE_VALUE_FUNC(drmModeObjectPropertiesPtr, drmModeObjectGetProperties, int,
+		uint32_t, uint32_t);
+FAKE_VOID_FUNC(drmModeFreeObjectProperties, drmModeObjectPropertiesPtr);
+FAKE_VALUE_FUNC(drmModePropertyPtr, drmModeGetProperty, int, uint32_t);
+FAKE_VOID_FUNC(drmModeFreeProperty, drmModePropertyPtr);
 
 FAKE_VALUE_FUNC(int, drmModeCreateLease, int, const uint32_t *, int, int,
 		uint32_t *);
 FAKE_VALUE_FUNC(int, drmModeRevokeLease, int, uint32_t);
 FAKE_VALUE_FUNC(int, drmSetClientCap, int, uint64_t, uint64_t);
 
+FAKE_VALUE_FUNC(drmModeCrtcPtr, drmModeGetCrtc, int, uint32_t);
+FAKE_VOID_FUNC(drmModeFreeCrtc, drmModeCrtcPtr);
+FAKE_VALUE_FUNC(int, drmIoctl, int, unsigned long, void *);
+FAKE_VALUE_FUNC(int, drmModeAddFB, int, uint32_t, uint32_t, uint8_t, uint8_t,
+		uint32_t, uint32_t, uint32_t *);
+FAKE_VALUE_FUNC(int, drmModeSetCrtc, int, uint32_t, uint32_t, uint32_t,
+		uint32_t, uint32_t *, int, drmModeModeInfoPtr);
+FAKE_VALUE_FUNC(int, drmModeRmFB, int, uint32_t);
+
+FAKE_VALUE_FUNC(int, drmGetDevices2, uint32_t, drmDevicePtr *, int);
+FAKE_VOID_FUNC(drmFreeDevices, drmDevicePtr *, int);
+
 /************** Test fixutre functions *************************/
 struct lm *g_lm = NULL;
 
@@ -79,16 +102,32 @@ static void test_setup(void)
 	RESET_FAKE(drmModeFreeConnector);
 	RESET_FAKE(drmModeGetEncoder);
 	RESET_FAKE(drmModeFreeEncoder);
+	RESET_FAKE(drmModeObjectGetProperties);
+	RESET_FAKE(drmModeFreeObjectProperties);
+	RESET_FAKE(drmModeGetProperty);
+	RESET_FAKE(drmModeFreeProperty);
 
 	RESET_FAKE(drmModeCreateLease);
 	RESET_FAKE(drmModeRevokeLease);
 
+	RESET_FAKE(drmModeGetCrtc);
+	RESET_FAKE(drmModeFreeCrtc);
+	RESET_FAKE(drmIoctl);
+	RESET_FAKE(drmModeAddFB);
+	RESET_FAKE(drmModeSetCrtc);
+	RESET_FAKE(drmModeRmFB);
+
+	RESET_FAKE(drmGetDevices2);
+	RESET_FAKE(drmFreeDevices);
+
 	drmModeGetResources_fake.return_val = TEST_DEVICE_RESOURCES;
 	drmModeGetPlaneResources_fake.return_val = TEST_DEVICE_PLANE_RESOURCES;
 
 	drmModeGetPlane_fake.custom_fake = get_plane;
 	drmModeGetConnector_fake.custom_fake = get_connector;
 	drmModeGetEncoder_fake.custom_fake = get_encoder;
+	drmModeObjectGetProperties_fake.custom_fake = get_object_properties;
+	drmModeGetProperty_fake.custom_fake = get_property;
 	drmModeCreateLease_fake.custom_fake = create_lease;
 
 	drmSetClientCap_fake.return_val = 0;
@@ -100,7 +139,8 @@ static void test_setup(void)
 static void test_shutdown(void)
 {
 	reset_drm_test_device();
-	lm_destroy(g_lm);
+	if (g_lm)
+		lm_destroy(g_lm);
 	g_lm = NULL;
 }
 
@@ -320,6 +360,39 @@ START_TEST(reject_planes_shared_between_multiple_crtcs)
 }
 END_TEST
 
+/* captured_topology */
+/* Test details: Create leases on a device loaded from a topology file, with
+ *               more planes than CRTCs, some of them usable on any CRTC.
+ * Expected results: Each output gets a lease with its CRTC, its connector
+ *                   and all of the planes that can only be used on its CRTC.
+ */
+START_TEST(captured_topology)
+{
+	int out_cnt = 4, planes_per_crtc = 9;
+
+	ck_assert(setup_test_device_from_file(TEST_DATA_DIR
+					      "/sample-soc.topology"));
+	ck_assert_int_eq(test_device.resources.count_crtcs, out_cnt);
+	ck_assert_int_eq(test_device.plane_resources.count_planes, 44);
+
+	struct lease_handle **handles = create_leases(out_cnt, NULL);
+
+	for (int i = 0; i < out_cnt; i++) {
+		uint32_t objs[planes_per_crtc + 2];
+		for (int j = 0; j < planes_per_crtc; j++)
+			objs[j] = PLANE_ID(i * planes_per_crtc + j);
+		objs[planes_per_crtc] = CRTC_ID(i);
+		objs[planes_per_crtc + 1] = CONNECTOR_ID(i);
+
+		lm_lease_grant(g_lm, handles[i]);
+		ck_assert_int_eq(drmModeCreateLease_fake.arg2_val,
+				 ARRAY_LEN(objs));
+		check_uint_array_eq(drmModeCreateLease_fake.arg1_val, objs,
+				    ARRAY_LEN(objs));
+	}
+}
+END_TEST
+
 static void add_connector_enum_tests(Suite *s)
 {
 	TCase *tc = tcase_create("Resource enumeration");
@@ -332,6 +405,7 @@ static void add_connector_enum_tests(Suite *s)
 	tcase_add_test(tc, some_outputs_connected);
 	tcase_add_test(tc, separate_overlay_planes_by_crtc);
 	tcase_add_test(tc, reject_planes_shared_between_multiple_crtcs);
+	tcase_add_test(tc, captured_topology);
 	suite_add_tcase(s, tc);
 }
 
@@ -363,6 +437,61 @@ START_TEST(create_and_revoke_lease)
 }
 END_TEST
 
+#define TEST_FALLBACK_FB_ID 77
+
+static drmModeCrtc active_crtc = {
+    .mode_valid = 1,
+    .mode = {.hdisplay = 1920, .vdisplay = 1080},
+};
+
+static int add_fallback_fb(int fd, uint32_t width, uint32_t height,
+			   uint8_t depth, uint8_t bpp, uint32_t pitch,
+			   uint32_t bo_handle, uint32_t *buf_id)
+{
+	UNUSED(fd);
+	UNUSED(depth);
+	UNUSED(bpp);
+	UNUSED(pitch);
+	UNUSED(bo_handle);
+
+	ck_assert_uint_eq(width, 1920);
+	ck_assert_uint_eq(height, 1080);
+	*buf_id = TEST_FALLBACK_FB_ID;
+	return 0;
+}
+
+/* show_fallback_framebuffer */
+/* Test details: Show the fallback framebuffer on a lease, before and after
+ *               revoking it.
+ * Expected results: The fallback framebuffer is only shown on the revoked
+ *                   lease, and is created once.
+ */
+START_TEST(show_fallback_framebuffer)
+{
+	int lease_cnt = 1, plane_cnt = 0;
+
+	setup_layout_simple_test_device(lease_cnt, plane_cnt);
+
+	struct lease_handle **handles = create_leases(lease_cnt, NULL);
+
+	drmModeGetCrtc_fake.return_val = &active_crtc;
+	drmModeAddFB_fake.custom_fake = add_fallback_fb;
+
+	ck_assert_int_ge(lm_lease_grant(g_lm, handles[0]), 0);
+	ck_assert(!lm_lease_show_fallback(g_lm, handles[0]));
+
+	lm_lease_revoke(g_lm, handles[0]);
+	ck_assert(lm_lease_show_fallback(g_lm, handles[0]));
+	ck_assert(lm_lease_show_fallback(g_lm, handles[0]));
+
+	ck_assert_int_eq(drmModeAddFB_fake.call_count, 1);
+	ck_assert_int_eq(drmModeSetCrtc_fake.call_count, 2);
+	ck_assert_uint_eq(drmModeSetCrtc_fake.arg1_val, CRTC_ID(0));
+	ck_assert_uint_eq(drmModeSetCrtc_fake.arg2_val, TEST_FALLBACK_FB_ID);
+	ck_assert_int_eq(drmModeSetCrtc_fake.arg6_val, 1);
+}
+END_TEST
+
 /* Test lease names */
 /* Test details: Create some leases and verify that they have the correct names
  * Expected results: lease names should match the expected values
@@ -404,6 +533,77 @@ START_TEST(verify_lease_names)
 }
 END_TEST
 
+static void check_topology_object(struct dlm_topology_header *topology,
+				   int index, uint32_t id, uint32_t type,
+				   const char **props, int nprops)
+{
+	struct dlm_topology_object *objects = (void *)(topology + 1);
+	struct dlm_topology_prop *prop_table =
+	    (void *)(objects + topology->nobjects);
+	struct dlm_topology_object *obj = &objects[index];
+
+	ck_assert_uint_eq(obj->id, id);
+	ck_assert_uint_eq(obj->type, type);
+	ck_assert_int_eq(obj->nprops, nprops);
+	for (int i = 0; i < nprops; i++) {
+		struct dlm_topology_prop *prop =
+		    &prop_table[obj->first_prop + i];
+		ck_assert_str_eq(prop->name, props[i]);
+	}
+}
+
+/* lease_topology_description */
+/* Test details: Create a lease and read its topology descriptor
+ * Expected results: The descriptor is sealed and describes each leased object
+ *                   along with its name and properties.
+ */
+START_TEST(lease_topology_description)
+{
+	int lease_cnt = 1, plane_cnt = 1;
+
+	setup_layout_simple_test_device(lease_cnt, plane_cnt);
+
+	struct lease_handle **handles = create_leases(lease_cnt, NULL);
+
+	int topology_fd = lm_lease_topology_fd(handles[0]);
+	ck_assert_int_ge(topology_fd, 0);
+	ck_assert_int_ne(fcntl(topology_fd, F_GET_SEALS) & F_SEAL_WRITE, 0);
+
+	struct stat st;
+	ck_assert_int_eq(fstat(topology_fd, &st), 0);
+
+	struct dlm_topology_header *topology =
+	    mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, topology_fd, 0);
+	ck_assert_ptr_ne(topology, MAP_FAILED);
+
+	ck_assert_uint_eq(topology->magic, DLM_TOPOLOGY_MAGIC);
+	ck_assert_uint_eq(topology->version, DLM_TOPOLOGY_VERSION);
+	ck_assert_uint_eq(topology->size, st.st_size);
+	ck_assert_uint_eq(topology->nobjects, 3);
+	ck_assert_uint_eq(topology->nprops, 5);
+
+	const char *plane_props[] = {"FB_ID", "CRTC_ID"};
+	const char *crtc_props[] = {"MODE_ID", "ACTIVE"};
+	const char *connector_props[] = {"CRTC_ID"};
+
+	check_topology_object(topology, 0, PLANE_ID(0), DLM_TOPOLOGY_PLANE,
+			      plane_props, ARRAY_LEN(plane_props));
+	check_topology_object(topology, 1, CRTC_ID(0), DLM_TOPOLOGY_CRTC,
+			      crtc_props, ARRAY_LEN(crtc_props));
+	check_topology_object(topology, 2, CONNECTOR_ID(0),
+			      DLM_TOPOLOGY_CONNECTOR, connector_props,
+			      ARRAY_LEN(connector_props));
+
+	char connector_name[DLM_TOPOLOGY_NAME_LEN];
+	snprintf(connector_name, sizeof(connector_name), "Unknown-%u",
+		 CONNECTOR_ID(0));
+	struct dlm_topology_object *objects = (void *)(topology + 1);
+	ck_assert_str_eq(objects[2].name, connector_name);
+
+	munmap(topology, st.st_size);
+}
+END_TEST
+
 static void add_lease_management_tests(Suite *s)
 {
 	TCase *tc = tcase_create("Lease management");
@@ -412,6 +612,8 @@ static void add_lease_management_tests(Suite *s)
 
 	tcase_add_test(tc, create_and_revoke_lease);
 	tcase_add_test(tc, verify_lease_names);
+	tcase_add_test(tc, lease_topology_description);
+	tcase_add_test(tc, show_fallback_framebuffer);
 	suite_add_tcase(s, tc);
 }
 
@@ -594,6 +796,139 @@ START_TEST(config_plane_sharing)
 }
 END_TEST
 
+/* clone_connectors_share_crtc */
+/* Test details: Create a lease in clone mode, with two connectors whose
+ *               encoders can be cloned, on a device with a single CRTC.
+ * Expected results: Both connectors are in the lease, with the one CRTC and
+ *                   its plane, and the fallback framebuffer is shown on
+ *                   both connectors.
+ */
+START_TEST(clone_connectors_share_crtc)
+{
+	int out_cnt = 2, plane_cnt = 1, crtc_cnt = 1, lease_cnt = 1;
+
+	ck_assert_int_eq(
+	    setup_drm_test_device(crtc_cnt, out_cnt, out_cnt, plane_cnt),
+	    true);
+
+	drmModeConnector connectors[] = {
+	    CONNECTOR(CONNECTOR_ID(0), 0, &ENCODER_ID(0), 1),
+	    CONNECTOR(CONNECTOR_ID(1), 0, &ENCODER_ID(1), 1),
+	};
+
+	drmModeEncoder encoders[] = {
+	    ENCODER_CLONE(ENCODER_ID(0), 0, 0x1, 0x3),
+	    ENCODER_CLONE(ENCODER_ID(1), 0, 0x1, 0x3),
+	};
+
+	drmModePlane planes[] = {
+	    PLANE(PLANE_ID(0), 0x1),
+	};
+
+	setup_test_device_layout(connectors, encoders, planes);
+
+	struct lease_config lconfig = {
+	    .lease_name = "Clone Test",
+	    .ncids = 2,
+	    .connector_ids = (uint32_t[]){CONNECTOR_ID(0), CONNECTOR_ID(1)},
+	    .clone = true,
+	};
+
+	struct lease_handle **handles = create_leases(lease_cnt, &lconfig);
+
+	CHECK_LEASE_OBJECTS(handles[0], PLANE_ID(0), CRTC_ID(0),
+			    CONNECTOR_ID(0), CONNECTOR_ID(1));
+	ck_assert_uint_eq(lm_lease_crtc_id(handles[0]), CRTC_ID(0));
+	ck_assert_int_eq(lm_lease_crtc_ids(g_lm, handles[0], NULL, 0), 1);
+
+	drmModeGetCrtc_fake.return_val = &active_crtc;
+	drmModeAddFB_fake.custom_fake = add_fallback_fb;
+
+	lm_lease_revoke(g_lm, handles[0]);
+	ck_assert(lm_lease_show_fallback(g_lm, handles[0]));
+	ck_assert_int_eq(drmModeSetCrtc_fake.arg6_val, 2);
+	check_uint_array_eq(drmModeSetCrtc_fake.arg5_val,
+			    (uint32_t[]){CONNECTOR_ID(0), CONNECTOR_ID(1)}, 2);
+}
+END_TEST
+
+/* clone_incompatible_encoders */
+/* Test details: Create a lease in clone mode, where the encoder of the
+ *               second connector can't be cloned with the others.
+ * Expected results: The first and third connectors share a CRTC, and the
+ *                   second one has a CRTC of its own.
+ */
+START_TEST(clone_incompatible_encoders)
+{
+	int out_cnt = 3, plane_cnt = 0, crtc_cnt = 2, lease_cnt = 1;
+
+	ck_assert_int_eq(
+	    setup_drm_test_device(crtc_cnt, out_cnt, out_cnt, plane_cnt),
+	    true);
+
+	drmModeConnector connectors[] = {
+	    CONNECTOR(CONNECTOR_ID(0), 0, &ENCODER_ID(0), 1),
+	    CONNECTOR(CONNECTOR_ID(1), 0, &ENCODER_ID(1), 1),
+	    CONNECTOR(CONNECTOR_ID(2), 0, &ENCODER_ID(2), 1),
+	};
+
+	drmModeEncoder encoders[] = {
+	    ENCODER_CLONE(ENCODER_ID(0), 0, 0x3, 0x5),
+	    ENCODER_CLONE(ENCODER_ID(1), 0, 0x3, 0x2),
+	    ENCODER_CLONE(ENCODER_ID(2), 0, 0x3, 0x5),
+	};
+
+	setup_test_device_layout(connectors, encoders, NULL);
+
+	struct lease_config lconfig = {
+	    .lease_name = "Clone Test",
+	    .ncids = 3,
+	    .connector_ids = (uint32_t[]){CONNECTOR_ID(0), CONNECTOR_ID(1),
+					  CONNECTOR_ID(2)},
+	    .clone = true,
+	};
+
+	struct lease_handle **handles = create_leases(lease_cnt, &lconfig);
+
+	CHECK_LEASE_OBJECTS(handles[0], CRTC_ID(0), CONNECTOR_ID(0),
+			    CONNECTOR_ID(2), CRTC_ID(1), CONNECTOR_ID(1));
+	ck_assert_uint_eq(lm_lease_crtc_id(handles[0]), CRTC_ID(0));
+
+	uint32_t crtc_ids[2];
+	ck_assert_int_eq(lm_lease_crtc_ids(g_lm, handles[0], crtc_ids, 2), 2);
+	check_uint_array_eq(crtc_ids, (uint32_t[]){CRTC_ID(0), CRTC_ID(1)},
+			    2);
+}
+END_TEST
+
+/* clone_captured_topology */
+/* Test details: Create a lease in clone mode on a device loaded from a
+ *               topology file, where two of the three encoders can be
+ *               cloned and the third has no possible clones recorded.
+ * Expected results: The first two connectors share a CRTC, and the third
+ *                   one has a CRTC of its own.
+ */
+START_TEST(clone_captured_topology)
+{
+	ck_assert(setup_test_device_from_file(TEST_DATA_DIR
+					      "/clone-outputs.topology"));
+
+	struct lease_config lconfig = {
+	    .lease_name = "Clone Test",
+	    .ncids = 3,
+	    .connector_ids = (uint32_t[]){CONNECTOR_ID(0), CONNECTOR_ID(1),
+					  CONNECTOR_ID(2)},
+	    .clone = true,
+	};
+
+	struct lease_handle **handles = create_leases(1, &lconfig);
+
+	CHECK_LEASE_OBJECTS(handles[0], PLANE_ID(0), CRTC_ID(0),
+			    CONNECTOR_ID(0), CONNECTOR_ID(1), PLANE_ID(1),
+			    CRTC_ID(1), CONNECTOR_ID(2));
+}
+END_TEST
+
 static void add_lease_config_tests(Suite *s)
 {
 	TCase *tc = tcase_create("Lease configuration");
@@ -604,6 +939,249 @@ static void add_lease_config_tests(Suite *s)
 	tcase_add_test(tc, single_failed_lease);
 	tcase_add_test(tc, named_connector_config);
 	tcase_add_test(tc, config_plane_sharing);
+	tcase_add_test(tc, clone_connectors_share_crtc);
+	tcase_add_test(tc, clone_incompatible_encoders);
+	tcase_add_test(tc, clone_captured_topology);
+	suite_add_tcase(s, tc);
+}
+
+/************** Device selection tests *************/
+
+/* Two PCI devices, with character device nodes that always exist */
+static char *test_device_nodes[][DRM_NODE_MAX] = {
+    {[DRM_NODE_PRIMARY] = "/dev/null"},
+    {[DRM_NODE_PRIMARY] = "/dev/zero"},
+};
+
+static drmPciBusInfo test_device_pci[] = {
+    {.domain = 0, .bus = 0, .dev = 2, .func = 0},
+    {.domain = 0, .bus = 1, .dev = 0, .func = 0},
+};
+
+static drmDevice test_devices[] = {
+    {
+	.nodes = test_device_nodes[0],
+	.available_nodes = 1 << DRM_NODE_PRIMARY,
+	.bustype = DRM_BUS_PCI,
+	.businfo.pci = &test_device_pci[0],
+    },
+    {
+	.nodes = test_device_nodes[1],
+	.available_nodes = 1 << DRM_NODE_PRIMARY,
+	.bustype = DRM_BUS_PCI,
+	.businfo.pci = &test_device_pci[1],
+    },
+};
+
+static int get_test_devices(uint32_t flags, drmDevicePtr *devices, int max)
+{
+	UNUSED(flags);
+
+	int ndevs = ARRAY_LEN(test_devices);
+	if (!devices)
+		return ndevs;
+
+	for (int i = 0; i < ndevs && i < max; i++)
+		devices[i] = &test_devices[i];
+	return ndevs < max ? ndevs : max;
+}
+
+/* select_device_by_bus_id */
+/* Test details: Create a lease manager without a device path, selecting the
+ *               second of two devices by its bus id.
+ * Expected results: The leases are created on the selected device.
+ */
+START_TEST(select_device_by_bus_id)
+{
+	ck_assert_int_eq(setup_drm_test_device(1, 1, 1, 0), true);
+
+	drmModeConnector connectors[] = {
+	    CONNECTOR_FULL(CONNECTOR_ID(0), ENCODER_ID(0), &ENCODER_ID(0), 1,
+			   DRM_MODE_CONNECTOR_HDMIA, 1),
+	};
+	drmModeEncoder encoders[] = {
+	    ENCODER(ENCODER_ID(0), CRTC_ID(0), 0x1),
+	};
+	setup_test_device_layout(connectors, encoders, NULL);
+
+	drmGetDevices2_fake.custom_fake = get_test_devices;
+
+	struct device_config config = {
+	    .bus_id = "pci:0000:01:00.0",
+	};
+	g_lm = lm_create_with_device_config(NULL, &config, NULL, 0, NULL);
+	ck_assert_ptr_ne(g_lm, NULL);
+
+	struct lease_handle **handles;
+	ck_assert_int_eq(lm_get_lease_handles(g_lm, &handles), 1);
+	ck_assert_str_eq(handles[0]->name, "card5-HDMI-A-1");
+
+	/* Only the selected device is opened */
+	ck_assert_int_eq(drmModeGetResources_fake.call_count, 1);
+}
+END_TEST
+
+/* wait_for_missing_device */
+/* Test details: Select a device that doesn't exist, with a wait time.
+ * Expected results: The device list is read again until the wait time
+ *                   expires, lease manager creation fails, and none of the
+ *                   devices that don't match are opened.
+ */
+START_TEST(wait_for_missing_device)
+{
+	ck_assert_int_eq(setup_drm_test_device(1, 1, 1, 0), true);
+
+	drmGetDevices2_fake.custom_fake = get_test_devices;
+
+	struct device_config config = {
+	    .bus_id = "pci:0000:09:00.0",
+	    .wait_ms = 200,
+	};
+	g_lm = lm_create_with_device_config(NULL, &config, NULL, 0, NULL);
+	ck_assert_ptr_eq(g_lm, NULL);
+
+	/* Each scan counts the devices, then lists them */
+	ck_assert_int_gt(drmGetDevices2_fake.call_count, 2);
+	ck_assert_int_eq(drmModeGetResources_fake.call_count, 0);
+}
+END_TEST
+
+static void add_device_selection_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Device selection");
+
+	tcase_add_checked_fixture(tc, test_setup, test_shutdown);
+
+	tcase_add_test(tc, select_device_by_bus_id);
+	tcase_add_test(tc, wait_for_missing_device);
+	suite_add_tcase(s, tc);
+}
+
+/************** Allocation cache tests *************/
+
+#define CACHE_FILE_TEMPLATE "/tmp/dlm-alloc-cache-XXXXXX"
+static char cache_file[] = CACHE_FILE_TEMPLATE;
+
+static void cache_setup(void)
+{
+	test_setup();
+
+	strcpy(cache_file, CACHE_FILE_TEMPLATE);
+	int fd = mkstemp(cache_file);
+	ck_assert_int_ge(fd, 0);
+	close(fd);
+	unlink(cache_file);
+}
+
+static void cache_shutdown(void)
+{
+	test_shutdown();
+	unlink(cache_file);
+}
+
+/* Restart the lease manager with the allocation cache */
+static struct lease_handle **restart_with_cache(int num_leases,
+						struct lease_config *configs)
+{
+	if (g_lm)
+		lm_destroy(g_lm);
+
+	drmModeGetConnector_fake.call_count = 0;
+	drmModeGetEncoder_fake.call_count = 0;
+	drmModeGetPlane_fake.call_count = 0;
+	drmModeGetProperty_fake.call_count = 0;
+
+	g_lm = lm_create_with_device_config(TEST_DRM_DEVICE, NULL, cache_file,
+					    num_leases, configs);
+	ck_assert_ptr_ne(g_lm, NULL);
+
+	struct lease_handle **handles;
+	ck_assert_int_eq(lm_get_lease_handles(g_lm, &handles), num_leases);
+	return handles;
+}
+
+static int enumeration_calls(void)
+{
+	return drmModeGetConnector_fake.call_count +
+	       drmModeGetEncoder_fake.call_count +
+	       drmModeGetPlane_fake.call_count +
+	       drmModeGetProperty_fake.call_count;
+}
+
+/* reuse_cached_allocation */
+/* Test details: Create leases with an allocation cache, then restart the
+ *               lease manager.
+ * Expected results: After the restart, the leases have the same names,
+ *                   objects and topology, without any connector, encoder,
+ *                   plane or property being looked up.
+ */
+START_TEST(reuse_cached_allocation)
+{
+	int out_cnt = 2, plane_cnt = 2;
+
+	setup_layout_simple_test_device(out_cnt, plane_cnt);
+
+	restart_with_cache(out_cnt, NULL);
+	ck_assert_int_gt(enumeration_calls(), 0);
+
+	struct lease_handle **handles = restart_with_cache(out_cnt, NULL);
+	ck_assert_int_eq(enumeration_calls(), 0);
+
+	char name[32];
+	for (int i = 0; i < out_cnt; i++) {
+		snprintf(name, sizeof(name), "card3-Unknown-%u",
+			 CONNECTOR_ID(i));
+		ck_assert_str_eq(handles[i]->name, name);
+		ck_assert_int_ge(lm_lease_topology_fd(handles[i]), 0);
+	}
+
+	CHECK_LEASE_OBJECTS(handles[0], PLANE_ID(0), CRTC_ID(0),
+			    CONNECTOR_ID(0));
+	CHECK_LEASE_OBJECTS(handles[1], PLANE_ID(1), CRTC_ID(1),
+			    CONNECTOR_ID(1));
+}
+END_TEST
+
+/* invalidate_cache_on_config_change */
+/* Test details: Create leases with an allocation cache, and restart the
+ *               lease manager with a different lease configuration.
+ * Expected results: The cache is not used for the new configuration, and
+ *                   is replaced with one for it.
+ */
+START_TEST(invalidate_cache_on_config_change)
+{
+	int out_cnt = 2, plane_cnt = 0;
+
+	setup_layout_simple_test_device(out_cnt, plane_cnt);
+
+	restart_with_cache(out_cnt, NULL);
+
+	uint32_t connector_ids[] = {CONNECTOR_ID(1)};
+	struct lease_config lconfig = {
+	    .lease_name = "lease-a",
+	    .connector_ids = connector_ids,
+	    .ncids = 1,
+	};
+
+	struct lease_handle **handles = restart_with_cache(1, &lconfig);
+	ck_assert_int_gt(enumeration_calls(), 0);
+	ck_assert_str_eq(handles[0]->name, "lease-a");
+
+	handles = restart_with_cache(1, &lconfig);
+	ck_assert_int_eq(enumeration_calls(), 0);
+	ck_assert_str_eq(handles[0]->name, "lease-a");
+	CHECK_LEASE_OBJECTS(handles[0], CRTC_ID(1), CONNECTOR_ID(1));
+}
+END_TEST
+
+static void add_alloc_cache_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Allocation cache");
+
+	tcase_add_checked_fixture(tc, cache_setup, cache_shutdown);
+
+	tcase_add_test(tc, reuse_cached_allocation);
+	tcase_add_test(tc, invalidate_cache_on_config_change);
 	suite_add_tcase(s, tc);
 }
 
@@ -618,6 +1196,8 @@ int main(void)
 	add_connector_enum_tests(s);
 	add_lease_management_tests(s);
 	add_lease_config_tests(s);
+	add_device_selection_tests(s);
+	add_alloc_cache_tests(s);
 
 	sr = srunner_create(s);
 	srunner_run_all(sr, CK_NORMAL);
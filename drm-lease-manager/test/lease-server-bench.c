@@ -0,0 +1,424 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Lease server scalability benchmark
+ * Creates a lease server with a large number of leases, connects clients to
+ * all of them, and measures the setup time, the memory and file descriptors
+ * used per lease, and the cost of dispatching client requests.
+ *
+ * The clients are plain sockets in the benchmark process, so all file
+ * descriptors (both ends of each connection) are counted here.
+ *
+ * With -c, the leases have no sockets of their own (LS_CONTROL_ONLY), and
+ * the clients request them through the control socket. */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "dlm-protocol.h"
+#include "latency-stats.h"
+#include "lease-server.h"
+#include "log.h"
+#include "socket-path.h"
+
+/* Each lease has a lock file and a listening socket, unless only the control
+ * socket is used.  Each client connection has the client socket, the
+ * accepted socket and a pidfd. */
+#define FDS_PER_LEASE 2
+#define FDS_PER_CLIENT 3
+
+/**************  Resource usage  *************/
+
+struct usage {
+	uint64_t time_ns;
+	int64_t heap_bytes;
+	int64_t rss_bytes;
+	int fds;
+};
+
+static int64_t heap_bytes(void)
+{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+	struct mallinfo2 mi = mallinfo2();
+	return mi.uordblks + mi.hblkhd;
+#else
+	return -1;
+#endif
+}
+
+static int64_t rss_bytes(void)
+{
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if (!statm)
+		return -1;
+
+	long size, resident;
+	int n = fscanf(statm, "%ld %ld", &size, &resident);
+	fclose(statm);
+	return n == 2 ? resident * sysconf(_SC_PAGESIZE) : -1;
+}
+
+static int open_fds(void)
+{
+	DIR *dir = opendir("/proc/self/fd");
+	if (!dir)
+		return -1;
+
+	int count = 0;
+	struct dirent *entry;
+	while ((entry = readdir(dir)))
+		if (entry->d_name[0] != '.')
+			count++;
+	closedir(dir);
+
+	/* Don't count the directory itself */
+	return count - 1;
+}
+
+static void usage_sample(struct usage *u)
+{
+	u->heap_bytes = heap_bytes();
+	u->rss_bytes = rss_bytes();
+	u->fds = open_fds();
+	u->time_ns = monotonic_ns();
+}
+
+/**************  Request latency  *************/
+
+struct latency {
+	const char *name;
+	uint64_t *ns;
+	int count;
+};
+
+static void print_latency(struct latency *l)
+{
+	if (!l->count)
+		return;
+
+	struct latency_stats stats;
+	latency_stats_compute(l->ns, l->count, &stats);
+
+	printf("%-16s %8d %10.2f %10.2f %10.2f %10.2f\n", l->name, l->count,
+	       stats.mean_us, stats.p50_us, stats.p99_us, stats.max_us);
+}
+
+/* Dispatch requests until one of the given type has been received from
+ * every client */
+static bool dispatch_requests(struct ls *ls, enum ls_req_type type,
+			      int count, struct latency *l)
+{
+	while (l->count < count) {
+		struct ls_req req;
+		uint64_t start_ns = monotonic_ns();
+		if (!ls_get_request(ls, &req))
+			return false;
+		uint64_t ns = monotonic_ns() - start_ns;
+
+		if (req.type != type) {
+			fprintf(stderr, "Unexpected request type %d\n",
+				req.type);
+			return false;
+		}
+		l->ns[l->count++] = ns;
+
+		if (type == LS_REQ_RELEASE_LEASE)
+			ls_disconnect_client(ls, req.client);
+	}
+	return true;
+}
+
+/**************  Clients  *************/
+
+static int client_connect(const char *socket_name)
+{
+	struct sockaddr_un sa = {
+	    .sun_family = AF_UNIX,
+	};
+	if (!sockaddr_set_lease_server_path(&sa, socket_name))
+		return -1;
+
+	int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	if (connect(fd, (struct sockaddr *)&sa, sockaddr_len(&sa)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static bool client_send(int fd, enum dlm_opcode opcode,
+			const char *lease_name)
+{
+	struct dlm_client_request request = {.opcode = opcode};
+
+	/* Only needed on the control socket */
+	snprintf(request.lease_name, sizeof(request.lease_name), "%s",
+		 lease_name);
+	return send_dlm_client_request(fd, &request);
+}
+
+static bool clients_send(int *fds, struct lease_handle *handles, int count,
+			 enum dlm_opcode opcode)
+{
+	for (int i = 0; i < count; i++) {
+		if (!client_send(fds[i], opcode, handles[i].name))
+			return false;
+	}
+	return true;
+}
+
+/**************  Benchmark  *************/
+
+static bool raise_fd_limit(int needed)
+{
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) < 0)
+		return false;
+
+	if (limit.rlim_cur < limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	if (limit.rlim_cur < (rlim_t)needed) {
+		fprintf(stderr,
+			"%d file descriptors needed, the limit is %llu\n",
+			needed, (unsigned long long)limit.rlim_cur);
+		return false;
+	}
+	return true;
+}
+
+static void remove_runtime_dir(const char *path)
+{
+	DIR *dir = opendir(path);
+	if (dir) {
+		struct dirent *entry;
+		while ((entry = readdir(dir))) {
+			if (entry->d_name[0] != '.')
+				unlinkat(dirfd(dir), entry->d_name, 0);
+		}
+		closedir(dir);
+	}
+	rmdir(path);
+}
+
+static void print_average(const char *name, int64_t before, int64_t after,
+			  int count)
+{
+	if (before < 0 || after < 0)
+		printf("%-16s %10s\n", name, "n/a");
+	else
+		printf("%-16s %10.1f\n", name,
+		       (double)(after - before) / count);
+}
+
+static void usage(const char *progname)
+{
+	printf("Usage: %s [-c] <leases> [<clients>]\n\n"
+	       "Creates a lease server with <leases> leases, connects a client "
+	       "to the first <clients> of them (default all), and reports the "
+	       "resources used and the request dispatch time.\n\n"
+	       "-c \tOnly create the control socket, and request all leases "
+	       "through it\n",
+	       progname);
+}
+
+int main(int argc, char **argv)
+{
+	bool control_only = false;
+
+	int c;
+	while ((c = getopt(argc, argv, "c")) != -1) {
+		if (c != 'c') {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+		control_only = true;
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	int nleases = argc > 1 ? atoi(argv[1]) : 0;
+	int nclients = argc > 2 ? atoi(argv[2]) : nleases;
+
+	/* Only one client per lease can be active, others wait in the
+	 * listen backlog until the lease is released */
+	if (nleases <= 0 || nclients < 0 || nclients > nleases) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int base_fds = open_fds();
+	int fds_per_lease = control_only ? 0 : FDS_PER_LEASE;
+	if (!raise_fd_limit(base_fds + 16 + nleases * fds_per_lease +
+			    nclients * FDS_PER_CLIENT))
+		return EXIT_FAILURE;
+
+	char runtime_dir[] = "/tmp/dlm-ls-bench-XXXXXX";
+	if (!mkdtemp(runtime_dir)) {
+		perror("mkdtemp");
+		return EXIT_FAILURE;
+	}
+	setenv("DLM_RUNTIME_PATH", runtime_dir, 1);
+
+	/* Log like the lease manager does, off the dispatching thread */
+	dlm_log_start_async(DLM_LOG_SINK_STDIO);
+
+	struct lease_handle *handles = calloc(nleases, sizeof(*handles));
+	struct lease_handle **handle_ptrs =
+	    calloc(nleases, sizeof(*handle_ptrs));
+	int *client_fds = calloc(nclients ? nclients : 1, sizeof(int));
+	struct latency get = {.name = "get lease"};
+	struct latency release = {.name = "release lease"};
+	get.ns = calloc(nclients ? nclients : 1, sizeof(uint64_t));
+	release.ns = calloc(nclients ? nclients : 1, sizeof(uint64_t));
+
+	struct ls *ls = NULL;
+	int connected = 0;
+	bool ok = false;
+
+	if (!handles || !handle_ptrs || !client_fds || !get.ns || !release.ns) {
+		perror("calloc");
+		goto out;
+	}
+
+	for (int i = 0; i < nleases; i++) {
+		if (asprintf(&handles[i].name, "bench-%d", i) < 0) {
+			handles[i].name = NULL;
+			perror("asprintf");
+			goto out;
+		}
+		handle_ptrs[i] = &handles[i];
+	}
+
+	struct usage before_setup, after_setup, after_connect, after_destroy;
+	uint64_t connect_ns = 0;
+
+	usage_sample(&before_setup);
+	ls = ls_create_with_flags(handle_ptrs, nleases,
+				  control_only ? LS_CONTROL_ONLY : 0);
+	uint64_t setup_ns = monotonic_ns() - before_setup.time_ns;
+	usage_sample(&after_setup);
+
+	if (!ls) {
+		fprintf(stderr, "ls_create failed\n");
+		goto out;
+	}
+
+	for (; connected < nclients; connected++) {
+		const char *name = handles[connected].name;
+
+		uint64_t start_ns = monotonic_ns();
+		int fd = client_connect(control_only ? DLM_CONTROL_SOCKET_NAME
+						     : name);
+		connect_ns += monotonic_ns() - start_ns;
+		if (fd < 0) {
+			perror("connect");
+			goto out;
+		}
+		client_fds[connected] = fd;
+
+		/* The control socket has no listen backlog to spare, so each
+		 * connection is accepted before the next one is made */
+		if (control_only &&
+		    (!client_send(fd, DLM_GET_LEASE, name) ||
+		     !dispatch_requests(ls, LS_REQ_GET_LEASE, connected + 1,
+					&get)))
+			goto out;
+	}
+
+	/* Connections are accepted while dispatching the first requests */
+	if (!control_only &&
+	    (!clients_send(client_fds, handles, nclients, DLM_GET_LEASE) ||
+	     !dispatch_requests(ls, LS_REQ_GET_LEASE, nclients, &get)))
+		goto out;
+	usage_sample(&after_connect);
+
+	if (!clients_send(client_fds, handles, nclients, DLM_RELEASE_LEASE) ||
+	    !dispatch_requests(ls, LS_REQ_RELEASE_LEASE, nclients, &release))
+		goto out;
+
+	uint64_t start_ns = monotonic_ns();
+	ls_destroy(ls);
+	uint64_t destroy_ns = monotonic_ns() - start_ns;
+	ls = NULL;
+
+	for (; connected > 0; connected--)
+		close(client_fds[connected - 1]);
+	usage_sample(&after_destroy);
+
+	dlm_log_stop_async();
+
+	printf("\n%d leases, %d clients%s\n\n", nleases, nclients,
+	       control_only ? ", control socket only" : "");
+	printf("%-16s %10.2f ms (%.2f us per lease)\n", "setup",
+	       setup_ns / 1e6, setup_ns / 1e3 / nleases);
+	if (nclients)
+		printf("%-16s %10.2f ms (%.2f us per client)\n", "connect",
+		       connect_ns / 1e6, connect_ns / 1e3 / nclients);
+	printf("%-16s %10.2f ms\n\n", "destroy", destroy_ns / 1e6);
+
+	print_average("heap bytes/lease", before_setup.heap_bytes,
+		      after_setup.heap_bytes, nleases);
+	print_average("rss bytes/lease", before_setup.rss_bytes,
+		      after_setup.rss_bytes, nleases);
+	print_average("fds/lease", before_setup.fds, after_setup.fds, nleases);
+	if (nclients)
+		print_average("fds/client", after_setup.fds,
+			      after_connect.fds, nclients);
+	printf("%-16s %10d\n\n", "fds leaked",
+	       after_destroy.fds - before_setup.fds);
+
+	if (nclients) {
+		printf("%-16s %8s %10s %10s %10s %10s\n", "dispatch", "count",
+		       "mean us", "p50 us", "p99 us", "max us");
+		print_latency(&get);
+		print_latency(&release);
+	}
+
+	ok = after_destroy.fds == before_setup.fds;
+out:
+	dlm_log_stop_async();
+	if (ls)
+		ls_destroy(ls);
+	for (int i = 0; i < connected; i++)
+		close(client_fds[i]);
+	for (int i = 0; handles && i < nleases; i++)
+		free(handles[i].name);
+	free(handles);
+	free(handle_ptrs);
+	free(client_fds);
+	free(get.ns);
+	free(release.ns);
+	remove_runtime_dir(runtime_dir);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -17,6 +17,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include <pthread.h>
@@ -79,6 +81,20 @@ START_TEST(duplicate_server_failure)
 }
 END_TEST
 
+/* duplicate_control_only_server_failure
+ *
+ * Test details: Try to intialize the same server twice, without per-lease
+ *               sockets
+ * Expected results: ls_create_with_flags() fails.
+ */
+START_TEST(duplicate_control_only_server_failure)
+{
+	struct lease_handle *leases[] = {&test_lease, &test_lease};
+	struct ls *ls = ls_create_with_flags(leases, 2, LS_CONTROL_ONLY);
+	ck_assert_ptr_eq(ls, NULL);
+}
+END_TEST
+
 START_TEST(long_lease_name_failure)
 {
 	char long_lease_name[200];
@@ -102,6 +118,7 @@ static void add_error_tests(Suite *s)
 	tcase_add_checked_fixture(tc, test_setup, test_shutdown);
 
 	tcase_add_test(tc, duplicate_server_failure);
+	tcase_add_test(tc, duplicate_control_only_server_failure);
 	tcase_add_test(tc, long_lease_name_failure);
 	suite_add_tcase(s, tc);
 }
@@ -150,6 +167,62 @@ START_TEST(issue_lease_request_and_release)
 }
 END_TEST
 
+/* client_pid_is_reported
+ *
+ * Test details: Generate a lease request from a client.
+ * Expected results: The process id of the client is reported for the
+ *                   requesting client.
+ */
+START_TEST(client_pid_is_reported)
+{
+	struct ls *ls = create_default_server();
+
+	struct client_state *cstate = test_client_start(&default_test_config);
+
+	struct ls_req req;
+	ck_assert_int_eq(ls_get_request(ls, &req), true);
+	check_request(&req, &test_lease, LS_REQ_GET_LEASE);
+	ck_assert_int_eq(ls_client_pid(req.client), getpid());
+
+	test_client_stop(cstate);
+	get_and_check_request(ls, &test_lease, LS_REQ_RELEASE_LEASE);
+	ls_destroy(ls);
+}
+END_TEST
+
+/* client_ids_are_unique
+ *
+ * Test details: Connect a client, disconnect it and connect another one.
+ * Expected results: Each connection has a different, non-zero id, even
+ *                   though the second one reuses the same client slot.
+ */
+START_TEST(client_ids_are_unique)
+{
+	struct ls *ls = create_default_server();
+	struct ls_req req;
+
+	struct client_state *cstate = test_client_start(&default_test_config);
+	ck_assert_int_eq(ls_get_request(ls, &req), true);
+	check_request(&req, &test_lease, LS_REQ_GET_LEASE);
+	uint32_t first_id = ls_client_id(req.client);
+	ck_assert_uint_ne(first_id, 0);
+
+	test_client_stop(cstate);
+	get_and_check_request(ls, &test_lease, LS_REQ_RELEASE_LEASE);
+	ls_disconnect_client(ls, req.client);
+
+	cstate = test_client_start(&default_test_config);
+	ck_assert_int_eq(ls_get_request(ls, &req), true);
+	check_request(&req, &test_lease, LS_REQ_GET_LEASE);
+	ck_assert_uint_ne(ls_client_id(req.client), first_id);
+	ck_assert_uint_ne(ls_client_id(req.client), 0);
+
+	test_client_stop(cstate);
+	get_and_check_request(ls, &test_lease, LS_REQ_RELEASE_LEASE);
+	ls_destroy(ls);
+}
+END_TEST
+
 /* issue_lease_request_and_early_release
  *
  * Test details: Close client connection immediately after connecting (before
@@ -238,6 +311,341 @@ START_TEST(issue_multiple_lease_requests)
 }
 END_TEST
 
+/* revoke_client_lease
+ *
+ * Test details: Revoke the lease of a client after it has been granted.
+ * Expected results: The client receives a revocation event before the
+ *                   connection is closed, and no further requests are
+ *                   returned for that client.
+ */
+START_TEST(revoke_client_lease)
+{
+	struct ls *ls = create_default_server();
+
+	default_test_config.wait_for_event = true;
+	struct client_state *cstate = test_client_start(&default_test_config);
+
+	struct ls_req req;
+	ck_assert_int_eq(ls_get_request(ls, &req), true);
+	check_request(&req, &test_lease, LS_REQ_GET_LEASE);
+
+	int test_fd = get_dummy_fd();
+	ck_assert_int_eq(ls_send_fd(ls, req.client, test_fd, -1), true);
+	ls_revoke_client(ls, req.client);
+
+	test_client_stop(cstate);
+
+	ck_assert_int_eq(default_test_config.has_data, true);
+	ck_assert_int_eq(default_test_config.received_event,
+			 DLM_EVENT_LEASE_REVOKED);
+	close(test_fd);
+	ls_destroy(ls);
+}
+END_TEST
+
+/* yield_and_reacquire_lease
+ *
+ * Test details: Yield a lease and request it again over the same connection.
+ * Expected results: A yield request is returned, followed by a get lease
+ *                   request from the same client, and the new fd is received
+ *                   without reconnecting.
+ */
+START_TEST(yield_and_reacquire_lease)
+{
+	struct ls *ls = create_default_server();
+
+	default_test_config.yield_lease = true;
+	default_test_config.reacquire_lease = true;
+	struct client_state *cstate = test_client_start(&default_test_config);
+
+	struct ls_req req;
+	ck_assert_int_eq(ls_get_request(ls, &req), true);
+	check_request(&req, &test_lease, LS_REQ_GET_LEASE);
+	struct ls_client *client = req.client;
+
+	int test_fd = get_dummy_fd();
+	ck_assert_int_eq(ls_send_fd(ls, client, test_fd, -1), true);
+
+	ck_assert_int_eq(ls_get_request(ls, &req), true);
+	check_request(&req, &test_lease, LS_REQ_YIELD_LEASE);
+	ck_assert_ptr_eq(req.client, client);
+
+	ck_assert_int_eq(ls_get_request(ls, &req), true);
+	check_request(&req, &test_lease, LS_REQ_GET_LEASE);
+	ck_assert_ptr_eq(req.client, client);
+
+	int reacquired_fd = get_dummy_fd();
+	ck_assert_int_eq(ls_send_fd(ls, client, reacquired_fd, -1), true);
+
+	test_client_stop(cstate);
+	get_and_check_request(ls, &test_lease, LS_REQ_RELEASE_LEASE);
+
+	check_fd_equality(reacquired_fd, default_test_config.reacquired_fd);
+	close(test_fd);
+	close(reacquired_fd);
+	ls_destroy(ls);
+}
+END_TEST
+
+/* parked_client_release_is_not_reported
+ *
+ * Test details: Yield a lease, then release it.
+ * Expected results: Only the yield request is returned.  The release from
+ *                   a client that doesn't hold the lease is handled by the
+ *                   lease server, and the next request is from a new client.
+ */
+START_TEST(parked_client_release_is_not_reported)
+{
+	struct ls *ls = create_default_server();
+
+	struct test_config parked_config = default_test_config;
+	parked_config.yield_lease = true;
+	struct client_state *cstate = test_client_start(&parked_config);
+
+	struct ls_req req;
+	ck_assert_int_eq(ls_get_request(ls, &req), true);
+	check_request(&req, &test_lease, LS_REQ_GET_LEASE);
+	struct ls_client *parked_client = req.client;
+
+	int test_fd = get_dummy_fd();
+	ck_assert_int_eq(ls_send_fd(ls, parked_client, test_fd, -1), true);
+
+	get_and_check_request(ls, &test_lease, LS_REQ_YIELD_LEASE);
+	test_client_stop(cstate);
+
+	cstate = test_client_start(&default_test_config);
+	ck_assert_int_eq(ls_get_request(ls, &req), true);
+	check_request(&req, &test_lease, LS_REQ_GET_LEASE);
+	test_client_stop(cstate);
+
+	test_config_cleanup(&parked_config);
+	close(test_fd);
+	ls_destroy(ls);
+}
+END_TEST
+
+/* parked_client_is_offered_lease
+ *
+ * Test details: Yield a lease, then offer it to clients that have yielded it.
+ * Expected results: The parked client receives a lease available event.
+ */
+START_TEST(parked_client_is_offered_lease)
+{
+	struct ls *ls = create_default_server();
+
+	default_test_config.yield_lease = true;
+	default_test_config.wait_for_event = true;
+	default_test_config.recv_timeout = 1000;
+	struct client_state *cstate = test_client_start(&default_test_config);
+
+	struct ls_req req;
+	ck_assert_int_eq(ls_get_request(ls, &req), true);
+	check_request(&req, &test_lease, LS_REQ_GET_LEASE);
+
+	int test_fd = get_dummy_fd();
+	ck_assert_int_eq(ls_send_fd(ls, req.client, test_fd, -1), true);
+
+	get_and_check_request(ls, &test_lease, LS_REQ_YIELD_LEASE);
+	ls_offer_lease(ls, &test_lease);
+
+	test_client_stop(cstate);
+
+	ck_assert_int_eq(default_test_config.received_event,
+			 DLM_EVENT_LEASE_AVAILABLE);
+	close(test_fd);
+	ls_destroy(ls);
+}
+END_TEST
+
+/* event_fd_request
+ *
+ * Test details: Register an event fd with the lease server and make it
+ *               readable.
+ * Expected results: An event request without a lease or client is returned.
+ */
+START_TEST(event_fd_request)
+{
+	struct ls *ls = create_default_server();
+
+	int event_fd = eventfd(1, EFD_CLOEXEC);
+	ck_assert_int_ge(event_fd, 0);
+	ck_assert_int_eq(ls_add_event_fd(ls, event_fd), true);
+
+	struct ls_req req;
+	ck_assert_int_eq(ls_get_request(ls, &req), true);
+	check_request(&req, NULL, LS_REQ_EVENT);
+	ck_assert_ptr_eq(req.client, NULL);
+
+	ls_destroy(ls);
+	close(event_fd);
+}
+END_TEST
+
+/* lease_request_on_control_socket
+ *
+ * Test details: Request leases by name through the control socket, with
+ *               multiple leases configured.
+ * Expected results: The requests are returned for the named lease, and the
+ *                   fd is sent to the client.
+ */
+START_TEST(lease_request_on_control_socket)
+{
+	static struct lease_handle other_lease = {
+	    .name = "other-lease",
+	};
+	struct lease_handle *leases[] = {
+	    &test_lease,
+	    &other_lease,
+	};
+	const int nleases = ARRAY_LENGTH(leases);
+	struct ls *ls = ls_create(leases, nleases);
+	ck_assert_ptr_ne(ls, NULL);
+
+	for (int i = 0; i < nleases; i++) {
+		struct test_config config = default_test_config;
+		config.lease = leases[i];
+		config.use_control_socket = true;
+
+		struct client_state *cstate = test_client_start(&config);
+
+		struct ls_req req;
+		ck_assert_int_eq(ls_get_request(ls, &req), true);
+		check_request(&req, leases[i], LS_REQ_GET_LEASE);
+
+		int test_fd = get_dummy_fd();
+		ck_assert_int_eq(ls_send_fd(ls, req.client, test_fd, -1), true);
+
+		test_client_stop(cstate);
+		get_and_check_request(ls, leases[i], LS_REQ_RELEASE_LEASE);
+		ls_disconnect_client(ls, req.client);
+
+		check_fd_equality(test_fd, config.received_fd);
+		close(test_fd);
+		test_config_cleanup(&config);
+	}
+	ls_destroy(ls);
+}
+END_TEST
+
+/* More than the CONTROL_CLIENTS spare connections of the lease server */
+#define HELD_LEASES 40
+
+/* all_leases_held_on_control_socket
+ *
+ * Test details: Hold more leases through the control socket than there
+ *               are spare control socket connections.
+ * Expected results: A request is returned for every lease, and the fd is
+ *                   sent to every client.
+ */
+START_TEST(all_leases_held_on_control_socket)
+{
+	struct lease_handle held_leases[HELD_LEASES];
+	struct lease_handle *leases[HELD_LEASES];
+	char names[HELD_LEASES][16];
+
+	for (int i = 0; i < HELD_LEASES; i++) {
+		snprintf(names[i], sizeof(names[i]), "held-lease-%d", i);
+		held_leases[i] = (struct lease_handle){.name = names[i]};
+		leases[i] = &held_leases[i];
+	}
+	struct ls *ls = ls_create(leases, HELD_LEASES);
+	ck_assert_ptr_ne(ls, NULL);
+
+	int clients[HELD_LEASES];
+	for (int i = 0; i < HELD_LEASES; i++) {
+		struct test_config config = default_test_config;
+		config.lease = leases[i];
+		config.use_control_socket = true;
+		clients[i] = test_client_connect(&config);
+		ck_assert_int_ge(clients[i], 0);
+
+		struct ls_req req;
+		ck_assert_int_eq(ls_get_request(ls, &req), true);
+		check_request(&req, leases[i], LS_REQ_GET_LEASE);
+
+		int test_fd = get_dummy_fd();
+		ck_assert_int_eq(ls_send_fd(ls, req.client, test_fd, -1), true);
+		close(test_fd);
+	}
+
+	for (int i = 0; i < HELD_LEASES; i++) {
+		int received_fd = receive_lease_fd(clients[i], NULL);
+		ck_assert_int_ge(received_fd, 0);
+		close(received_fd);
+		close(clients[i]);
+	}
+	ls_destroy(ls);
+}
+END_TEST
+
+/* lease_request_on_control_only_server
+ *
+ * Test details: Create a server without per-lease sockets, then request the
+ *               lease on both its own socket and the control socket.
+ * Expected results: The lease socket doesn't exist.  The request on the
+ *                   control socket is returned, and the fd is sent.
+ */
+START_TEST(lease_request_on_control_only_server)
+{
+	struct lease_handle *leases[] = {
+	    &test_lease,
+	};
+	struct ls *ls = ls_create_with_flags(leases, 1, LS_CONTROL_ONLY);
+	ck_assert_ptr_ne(ls, NULL);
+
+	ck_assert_int_lt(test_client_connect(&default_test_config), 0);
+
+	struct test_config config = default_test_config;
+	config.use_control_socket = true;
+	struct client_state *cstate = test_client_start(&config);
+
+	struct ls_req req;
+	ck_assert_int_eq(ls_get_request(ls, &req), true);
+	check_request(&req, &test_lease, LS_REQ_GET_LEASE);
+
+	int test_fd = get_dummy_fd();
+	ck_assert_int_eq(ls_send_fd(ls, req.client, test_fd, -1), true);
+
+	test_client_stop(cstate);
+	get_and_check_request(ls, &test_lease, LS_REQ_RELEASE_LEASE);
+	ls_disconnect_client(ls, req.client);
+
+	check_fd_equality(test_fd, config.received_fd);
+	close(test_fd);
+	test_config_cleanup(&config);
+	ls_destroy(ls);
+}
+END_TEST
+
+/* unknown_lease_on_control_socket
+ *
+ * Test details: Request an unknown lease through the control socket,
+ *               followed by a request from a valid client.
+ * Expected results: No request is returned for the unknown lease. The next
+ *                   request is the one from the valid client.
+ */
+START_TEST(unknown_lease_on_control_socket)
+{
+	static struct lease_handle unknown_lease = {
+	    .name = "unknown-lease",
+	};
+	struct ls *ls = create_default_server();
+
+	struct test_config config = default_test_config;
+	config.lease = &unknown_lease;
+	config.use_control_socket = true;
+	struct client_state *cstate = test_client_start(&config);
+	test_client_stop(cstate);
+
+	cstate = test_client_start(&default_test_config);
+	get_and_check_request(ls, &test_lease, LS_REQ_GET_LEASE);
+	test_client_stop(cstate);
+	get_and_check_request(ls, &test_lease, LS_REQ_RELEASE_LEASE);
+
+	ls_destroy(ls);
+}
+END_TEST
+
 static void add_client_request_tests(Suite *s)
 {
 	TCase *tc = tcase_create("Client request testing");
@@ -245,8 +653,136 @@ static void add_client_request_tests(Suite *s)
 	tcase_add_checked_fixture(tc, test_setup, test_shutdown);
 
 	tcase_add_test(tc, issue_lease_request_and_release);
+	tcase_add_test(tc, client_pid_is_reported);
+	tcase_add_test(tc, client_ids_are_unique);
 	tcase_add_test(tc, issue_lease_request_and_early_release);
 	tcase_add_test(tc, issue_multiple_lease_requests);
+	tcase_add_test(tc, revoke_client_lease);
+	tcase_add_test(tc, yield_and_reacquire_lease);
+	tcase_add_test(tc, parked_client_release_is_not_reported);
+	tcase_add_test(tc, parked_client_is_offered_lease);
+	tcase_add_test(tc, event_fd_request);
+	tcase_add_test(tc, lease_request_on_control_socket);
+	tcase_add_test(tc, all_leases_held_on_control_socket);
+	tcase_add_test(tc, lease_request_on_control_only_server);
+	tcase_add_test(tc, unknown_lease_on_control_socket);
+	suite_add_tcase(s, tc);
+}
+
+/**************  Client process tracking tests ************/
+
+/* Client process exit is detected through its pidfd, even when its
+ * socket is still held open by a child process. */
+
+struct forked_client {
+	pid_t pid;
+	int exit_pipe[2]; /* The client exits when this is written to */
+	int hold_pipe[2]; /* Its child exits when this is closed */
+};
+
+static void forked_client_start(struct forked_client *fc, bool release)
+{
+	ck_assert_int_eq(pipe(fc->exit_pipe), 0);
+	ck_assert_int_eq(pipe(fc->hold_pipe), 0);
+
+	fc->pid = fork();
+	ck_assert_int_ge(fc->pid, 0);
+	if (fc->pid > 0) {
+		close(fc->exit_pipe[0]);
+		close(fc->hold_pipe[0]);
+		return;
+	}
+
+	int sock = test_client_connect(&default_test_config);
+	char c;
+	read(fc->exit_pipe[0], &c, 1);
+
+	if (release) {
+		struct dlm_client_request req = {.opcode = DLM_RELEASE_LEASE};
+		send_dlm_client_request(sock, &req);
+	}
+
+	/* Leave the socket open in a child process */
+	if (fork() == 0) {
+		close(fc->hold_pipe[1]);
+		read(fc->hold_pipe[0], &c, 1);
+	}
+	_exit(0);
+}
+
+static void forked_client_exit(struct forked_client *fc)
+{
+	write(fc->exit_pipe[1], "x", 1);
+	ck_assert_int_eq(waitpid(fc->pid, NULL, 0), fc->pid);
+}
+
+static void forked_client_cleanup(struct forked_client *fc)
+{
+	close(fc->exit_pipe[1]);
+	close(fc->hold_pipe[1]);
+}
+
+/* client_exit_with_inherited_socket
+ *
+ * Test details: A client process exits after requesting a lease, while a
+ *               child process still holds its socket open.
+ * Expected results: A client disconnect request is returned.
+ */
+START_TEST(client_exit_with_inherited_socket)
+{
+	struct ls *ls = create_default_server();
+
+	struct forked_client fc;
+	forked_client_start(&fc, false);
+
+	struct ls_req req;
+	ck_assert_int_eq(ls_get_request(ls, &req), true);
+	check_request(&req, &test_lease, LS_REQ_GET_LEASE);
+	ck_assert_int_eq(ls_client_pid(req.client), fc.pid);
+
+	forked_client_exit(&fc);
+	get_and_check_request(ls, &test_lease, LS_REQ_CLIENT_DISCONNECT);
+
+	forked_client_cleanup(&fc);
+	ls_destroy(ls);
+}
+END_TEST
+
+/* client_release_before_exit
+ *
+ * Test details: A client process releases its lease and exits, while a child
+ *               process still holds its socket open.
+ * Expected results: The release request is returned before the exit is
+ *                   reported.
+ */
+START_TEST(client_release_before_exit)
+{
+	struct ls *ls = create_default_server();
+
+	struct forked_client fc;
+	forked_client_start(&fc, true);
+
+	struct ls_req req;
+	ck_assert_int_eq(ls_get_request(ls, &req), true);
+	check_request(&req, &test_lease, LS_REQ_GET_LEASE);
+
+	forked_client_exit(&fc);
+	get_and_check_request(ls, &test_lease, LS_REQ_RELEASE_LEASE);
+	get_and_check_request(ls, &test_lease, LS_REQ_CLIENT_DISCONNECT);
+
+	forked_client_cleanup(&fc);
+	ls_destroy(ls);
+}
+END_TEST
+
+static void add_client_process_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Client process tracking");
+
+	tcase_add_checked_fixture(tc, test_setup, test_shutdown);
+
+	tcase_add_test(tc, client_exit_with_inherited_socket);
+	tcase_add_test(tc, client_release_before_exit);
 	suite_add_tcase(s, tc);
 }
 
@@ -274,7 +810,7 @@ START_TEST(send_fd_to_client)
 
 	/* send an fd to the client*/
 	int test_fd = get_dummy_fd();
-	ck_assert_int_eq(ls_send_fd(ls, req.client, test_fd), true);
+	ck_assert_int_eq(ls_send_fd(ls, req.client, test_fd, -1), true);
 
 	test_client_stop(cstate);
 	get_and_check_request(ls, &test_lease, LS_REQ_RELEASE_LEASE);
@@ -306,7 +842,7 @@ START_TEST(ls_send_fd_is_noop_when_fd_is_invalid)
 	int invalid_fd = get_dummy_fd();
 	close(invalid_fd);
 
-	ck_assert_int_eq(ls_send_fd(ls, req.client, invalid_fd), false);
+	ck_assert_int_eq(ls_send_fd(ls, req.client, invalid_fd, -1), false);
 
 	test_client_stop(cstate);
 	get_and_check_request(ls, &test_lease, LS_REQ_RELEASE_LEASE);
@@ -316,6 +852,78 @@ START_TEST(ls_send_fd_is_noop_when_fd_is_invalid)
 }
 END_TEST
 
+/* send_topology_to_client
+ *
+ * Test details: Send a lease fd and topology descriptor to a client that
+ *               requested the lease topology.
+ * Expected results: Both fds are received by the client.
+ */
+START_TEST(send_topology_to_client)
+{
+	struct ls *ls = create_default_server();
+
+	default_test_config.request_topology = true;
+	struct client_state *cstate = test_client_start(&default_test_config);
+
+	struct ls_req req;
+	ck_assert_int_eq(ls_get_request(ls, &req), true);
+	check_request(&req, &test_lease, LS_REQ_GET_LEASE);
+
+	char topology[] = "topology";
+	int test_fd = get_dummy_fd();
+	int topology_fd = get_sealed_memfd(topology, sizeof(topology));
+	ck_assert_int_eq(ls_send_fd(ls, req.client, test_fd, topology_fd),
+			 true);
+
+	test_client_stop(cstate);
+	get_and_check_request(ls, &test_lease, LS_REQ_RELEASE_LEASE);
+
+	ck_assert_int_eq(default_test_config.has_data, true);
+	check_fd_equality(test_fd, default_test_config.received_fd);
+	check_fd_equality(topology_fd,
+			  default_test_config.received_topology_fd);
+
+	close(topology_fd);
+	close(test_fd);
+	ls_destroy(ls);
+}
+END_TEST
+
+/* topology_not_sent_unless_requested
+ *
+ * Test details: Send a lease fd and topology descriptor to a client that
+ *               did not request the lease topology.
+ * Expected results: Only the lease fd is received by the client.
+ */
+START_TEST(topology_not_sent_unless_requested)
+{
+	struct ls *ls = create_default_server();
+
+	struct client_state *cstate = test_client_start(&default_test_config);
+
+	struct ls_req req;
+	ck_assert_int_eq(ls_get_request(ls, &req), true);
+	check_request(&req, &test_lease, LS_REQ_GET_LEASE);
+
+	char topology[] = "topology";
+	int test_fd = get_dummy_fd();
+	int topology_fd = get_sealed_memfd(topology, sizeof(topology));
+	ck_assert_int_eq(ls_send_fd(ls, req.client, test_fd, topology_fd),
+			 true);
+
+	test_client_stop(cstate);
+	get_and_check_request(ls, &test_lease, LS_REQ_RELEASE_LEASE);
+
+	ck_assert_int_eq(default_test_config.has_data, true);
+	check_fd_equality(test_fd, default_test_config.received_fd);
+	ck_assert_int_eq(default_test_config.received_topology_fd, -1);
+
+	close(topology_fd);
+	close(test_fd);
+	ls_destroy(ls);
+}
+END_TEST
+
 static void add_fd_send_tests(Suite *s)
 {
 	TCase *tc = tcase_create("File descriptor sending tests");
@@ -324,6 +932,148 @@ static void add_fd_send_tests(Suite *s)
 
 	tcase_add_test(tc, send_fd_to_client);
 	tcase_add_test(tc, ls_send_fd_is_noop_when_fd_is_invalid);
+	tcase_add_test(tc, send_topology_to_client);
+	tcase_add_test(tc, topology_not_sent_unless_requested);
+	suite_add_tcase(s, tc);
+}
+
+/**************  Abstract socket namespace tests ************/
+
+/* Runtime paths starting with '@' select the Linux abstract socket namespace.
+ * No files are created in the filesystem in this mode. */
+
+#define ABSTRACT_SOCKETDIR "@drm-lease-manager-test"
+
+static void abstract_test_setup(void)
+{
+	test_setup();
+	setenv("DLM_RUNTIME_PATH", ABSTRACT_SOCKETDIR, 1);
+}
+
+/* abstract_duplicate_server_failure
+ *
+ * Test details: Try to intialize the same abstract socket server twice
+ * Expected results: ls_create() fails, without the help of a lock file.
+ */
+START_TEST(abstract_duplicate_server_failure)
+{
+	struct lease_handle *leases[] = {&test_lease, &test_lease};
+	struct ls *ls = ls_create(leases, 2);
+	ck_assert_ptr_eq(ls, NULL);
+}
+END_TEST
+
+/* abstract_socket_lease_request
+ *
+ * Test details: Request a lease and send an fd on an abstract socket.
+ * Expected results: The request is received and the fd is sent to the
+ *                   client, on both the lease and control sockets.
+ */
+START_TEST(abstract_socket_lease_request)
+{
+	struct ls *ls = create_default_server();
+
+	for (int i = 0; i < 2; i++) {
+		struct test_config config = default_test_config;
+		config.use_control_socket = (i == 1);
+
+		struct client_state *cstate = test_client_start(&config);
+
+		struct ls_req req;
+		ck_assert_int_eq(ls_get_request(ls, &req), true);
+		check_request(&req, &test_lease, LS_REQ_GET_LEASE);
+
+		int test_fd = get_dummy_fd();
+		ck_assert_int_eq(ls_send_fd(ls, req.client, test_fd, -1), true);
+
+		test_client_stop(cstate);
+		get_and_check_request(ls, &test_lease, LS_REQ_RELEASE_LEASE);
+		ls_disconnect_client(ls, req.client);
+
+		check_fd_equality(test_fd, config.received_fd);
+		close(test_fd);
+		test_config_cleanup(&config);
+	}
+	ls_destroy(ls);
+}
+END_TEST
+
+#define OTHER_UID 65534
+#define OTHER_GID 65534
+
+/* Request the lease as another user, and exit with 0 if the lease fd is
+ * received, or 1 if the connection is closed instead. */
+static pid_t fork_other_user_client(void)
+{
+	pid_t pid = fork();
+	ck_assert_int_ge(pid, 0);
+	if (pid > 0)
+		return pid;
+
+	if (setgid(OTHER_GID) || setuid(OTHER_UID))
+		_exit(2);
+
+	int sock = test_client_connect(&default_test_config);
+	if (sock < 0)
+		_exit(2);
+
+	int fd = receive_lease_fd(sock, NULL);
+	_exit(fd >= 0 ? 0 : 1);
+}
+
+static int wait_for_exit_status(pid_t pid)
+{
+	int status;
+	ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+	ck_assert(WIFEXITED(status));
+	return WEXITSTATUS(status);
+}
+
+/* abstract_socket_peer_check
+ *
+ * Test details: Request a lease on an abstract socket as another user,
+ *               before and after allowing the user's group.
+ * Expected results: The connection is closed without a request while the
+ *                   group is not allowed. After that, the lease is granted.
+ *                   (Only runs as root, which can switch users)
+ */
+START_TEST(abstract_socket_peer_check)
+{
+	if (geteuid() != 0)
+		return;
+
+	struct ls *ls = create_default_server();
+	struct ls_req req;
+
+	pid_t pid = fork_other_user_client();
+	ck_assert_int_eq(ls_wait_request(ls, &req, 500), 0);
+	ck_assert_int_eq(wait_for_exit_status(pid), 1);
+
+	gid_t gid = OTHER_GID;
+	ck_assert_int_eq(ls_allow_peers(ls, NULL, 0, &gid, 1), true);
+
+	pid = fork_other_user_client();
+	ck_assert_int_eq(ls_get_request(ls, &req), true);
+	check_request(&req, &test_lease, LS_REQ_GET_LEASE);
+
+	int test_fd = get_dummy_fd();
+	ck_assert_int_eq(ls_send_fd(ls, req.client, test_fd, -1), true);
+	ck_assert_int_eq(wait_for_exit_status(pid), 0);
+	close(test_fd);
+
+	ls_destroy(ls);
+}
+END_TEST
+
+static void add_abstract_socket_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Abstract socket namespace");
+
+	tcase_add_checked_fixture(tc, abstract_test_setup, test_shutdown);
+
+	tcase_add_test(tc, abstract_duplicate_server_failure);
+	tcase_add_test(tc, abstract_socket_lease_request);
+	tcase_add_test(tc, abstract_socket_peer_check);
 	suite_add_tcase(s, tc);
 }
 
@@ -337,7 +1087,9 @@ int main(void)
 
 	add_error_tests(s);
 	add_client_request_tests(s);
+	add_client_process_tests(s);
 	add_fd_send_tests(s);
+	add_abstract_socket_tests(s);
 
 	sr = srunner_create(s);
 
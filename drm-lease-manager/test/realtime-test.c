@@ -0,0 +1,228 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <check.h>
+#include <fff.h>
+
+#include <stdlib.h>
+
+#include "lease-manager.h"
+#include "realtime.h"
+#include "test-helpers.h"
+
+#define TEST_ITERATIONS 10
+
+/**************  Mock functions  *************/
+DEFINE_FFF_GLOBALS;
+
+FAKE_VALUE_FUNC(int, lm_get_lease_handles, struct lm *,
+		struct lease_handle ***);
+FAKE_VALUE_FUNC(int, lm_lease_grant, struct lm *, struct lease_handle *);
+FAKE_VOID_FUNC(lm_lease_revoke, struct lm *, struct lease_handle *);
+FAKE_VOID_FUNC(lm_lease_close, struct lease_handle *);
+
+static struct lease_handle test_leases[] = {
+    {.name = "lease-a"},
+    {.name = "lease-b"},
+};
+
+static struct lease_handle *lease_handles[] = {
+    &test_leases[0],
+    &test_leases[1],
+};
+
+static int get_lease_handles(struct lm *lm,
+			     struct lease_handle ***handles)
+{
+	UNUSED(lm);
+	*handles = lease_handles;
+	return ARRAY_LEN(lease_handles);
+}
+
+static void test_setup(void)
+{
+	RESET_FAKE(lm_get_lease_handles);
+	RESET_FAKE(lm_lease_grant);
+	RESET_FAKE(lm_lease_revoke);
+	RESET_FAKE(lm_lease_close);
+
+	lm_get_lease_handles_fake.custom_fake = get_lease_handles;
+	lm_lease_grant_fake.return_val = 10;
+}
+
+/************** Option parsing tests *************/
+
+/* parse_sched_policy
+ *
+ * Test details: Parse scheduling policies with and without a priority.
+ * Expected results: The policy and priority are set.  Real-time policies
+ *                   without a priority use the lowest one.
+ */
+START_TEST(parse_sched_policy)
+{
+	struct rt_config config = {0};
+
+	ck_assert(rt_parse_sched("fifo:50", &config));
+	ck_assert_int_eq(config.policy, SCHED_FIFO);
+	ck_assert_int_eq(config.priority, 50);
+
+	ck_assert(rt_parse_sched("rr", &config));
+	ck_assert_int_eq(config.policy, SCHED_RR);
+	ck_assert_int_eq(config.priority, sched_get_priority_min(SCHED_RR));
+
+	ck_assert(rt_parse_sched("other", &config));
+	ck_assert_int_eq(config.policy, SCHED_OTHER);
+	ck_assert_int_eq(config.priority, 0);
+}
+END_TEST
+
+/* parse_invalid_sched_policy
+ *
+ * Test details: Parse unknown policies and invalid priorities.
+ * Expected results: Parsing fails and the configuration is unchanged.
+ */
+START_TEST(parse_invalid_sched_policy)
+{
+	struct rt_config config = {.policy = SCHED_RR, .priority = 10};
+
+	ck_assert(!rt_parse_sched("fif", &config));
+	ck_assert(!rt_parse_sched("fifo:", &config));
+	ck_assert(!rt_parse_sched("fifo:high", &config));
+	ck_assert(!rt_parse_sched("fifo:1000", &config));
+	ck_assert(!rt_parse_sched("other:1", &config));
+
+	ck_assert_int_eq(config.policy, SCHED_RR);
+	ck_assert_int_eq(config.priority, 10);
+}
+END_TEST
+
+/* parse_cpu_list
+ *
+ * Test details: Parse a list of single CPUs and CPU ranges.
+ * Expected results: Exactly the listed CPUs are in the affinity mask.
+ */
+START_TEST(parse_cpu_list)
+{
+	struct rt_config config = {0};
+
+	ck_assert(rt_parse_cpus("0-1,3,5-6", &config));
+	ck_assert(config.set_affinity);
+	ck_assert_int_eq(CPU_COUNT(&config.cpus), 5);
+	ck_assert(CPU_ISSET(0, &config.cpus));
+	ck_assert(CPU_ISSET(1, &config.cpus));
+	ck_assert(!CPU_ISSET(2, &config.cpus));
+	ck_assert(CPU_ISSET(3, &config.cpus));
+	ck_assert(CPU_ISSET(5, &config.cpus));
+	ck_assert(CPU_ISSET(6, &config.cpus));
+}
+END_TEST
+
+/* parse_invalid_cpu_list
+ *
+ * Test details: Parse malformed CPU lists.
+ * Expected results: Parsing fails and no affinity is set.
+ */
+START_TEST(parse_invalid_cpu_list)
+{
+	struct rt_config config = {0};
+
+	ck_assert(!rt_parse_cpus("", &config));
+	ck_assert(!rt_parse_cpus("1,", &config));
+	ck_assert(!rt_parse_cpus("3-1", &config));
+	ck_assert(!rt_parse_cpus("0-", &config));
+	ck_assert(!rt_parse_cpus("a", &config));
+	ck_assert(!rt_parse_cpus("100000", &config));
+
+	ck_assert(!config.set_affinity);
+}
+END_TEST
+
+static void add_option_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Real-time option parsing");
+
+	tcase_add_test(tc, parse_sched_policy);
+	tcase_add_test(tc, parse_invalid_sched_policy);
+	tcase_add_test(tc, parse_cpu_list);
+	tcase_add_test(tc, parse_invalid_cpu_list);
+	suite_add_tcase(s, tc);
+}
+
+/************** Self-test tests *************/
+
+/* selftest_grants_every_lease
+ *
+ * Test details: Run the grant latency self-test.
+ * Expected results: Each lease is granted, revoked and closed once per
+ *                   iteration.
+ */
+START_TEST(selftest_grants_every_lease)
+{
+	ck_assert(rt_grant_selftest((struct lm *)1, TEST_ITERATIONS));
+
+	int grants = TEST_ITERATIONS * ARRAY_LEN(lease_handles);
+	ck_assert_int_eq(lm_lease_grant_fake.call_count, grants);
+	ck_assert_int_eq(lm_lease_revoke_fake.call_count, grants);
+	ck_assert_int_eq(lm_lease_close_fake.call_count, grants);
+
+	ck_assert_ptr_eq(lm_lease_grant_fake.arg1_history[0], &test_leases[0]);
+	ck_assert_ptr_eq(lm_lease_grant_fake.arg1_history[1], &test_leases[1]);
+}
+END_TEST
+
+/* selftest_grant_failure
+ *
+ * Test details: Run the self-test when leases cannot be granted.
+ * Expected results: The self-test fails after the first grant.
+ */
+START_TEST(selftest_grant_failure)
+{
+	lm_lease_grant_fake.return_val = -1;
+
+	ck_assert(!rt_grant_selftest((struct lm *)1, TEST_ITERATIONS));
+	ck_assert_int_eq(lm_lease_grant_fake.call_count, 1);
+	ck_assert_int_eq(lm_lease_revoke_fake.call_count, 0);
+}
+END_TEST
+
+static void add_selftest_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Grant latency self-test");
+
+	tcase_add_checked_fixture(tc, test_setup, NULL);
+
+	tcase_add_test(tc, selftest_grants_every_lease);
+	tcase_add_test(tc, selftest_grant_failure);
+	suite_add_tcase(s, tc);
+}
+
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = suite_create("DLM real-time mode tests");
+
+	add_option_tests(s);
+	add_selftest_tests(s);
+
+	sr = srunner_create(s);
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
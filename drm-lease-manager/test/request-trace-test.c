@@ -0,0 +1,134 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <check.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "request-trace.h"
+
+#define TRACE_FILE "/tmp/dlm-request-trace-test.trace"
+
+static struct lease_handle test_lease = {.name = "test-lease"};
+
+static void test_shutdown(void)
+{
+	unlink(TRACE_FILE);
+}
+
+/* requests_are_recorded
+ *
+ * Test details: Record a granted and a revoked request.
+ * Expected results: The trace file starts with a header containing the
+ *                   flags, followed by one record per request, in order.
+ */
+START_TEST(requests_are_recorded)
+{
+	struct tr *tr = tr_create(TRACE_FILE, TR_FLAG_LEASE_TRANSFER);
+	ck_assert_ptr_ne(tr, NULL);
+
+	tr_begin(tr, LS_REQ_GET_LEASE, &test_lease, 1);
+	tr_end(tr, TR_RESULT_GRANTED);
+	tr_begin(tr, LS_REQ_CLIENT_DISCONNECT, &test_lease, 1);
+	tr_end(tr, TR_RESULT_REVOKED);
+	tr_destroy(tr);
+
+	FILE *f = fopen(TRACE_FILE, "rb");
+	ck_assert_ptr_ne(f, NULL);
+
+	struct tr_file_header hdr;
+	ck_assert_int_eq(fread(&hdr, sizeof(hdr), 1, f), 1);
+	ck_assert_uint_eq(hdr.magic, TR_FILE_MAGIC);
+	ck_assert_uint_eq(hdr.version, TR_FILE_VERSION);
+	ck_assert_uint_eq(hdr.flags, TR_FLAG_LEASE_TRANSFER);
+
+	struct tr_record rec[3];
+	ck_assert_int_eq(fread(rec, sizeof(rec[0]), 3, f), 2);
+	fclose(f);
+
+	ck_assert_uint_eq(rec[0].type, LS_REQ_GET_LEASE);
+	ck_assert_uint_eq(rec[0].result, TR_RESULT_GRANTED);
+	ck_assert_uint_eq(rec[0].client_id, 1);
+	ck_assert_str_eq(rec[0].lease, "test-lease");
+
+	ck_assert_uint_eq(rec[1].type, LS_REQ_CLIENT_DISCONNECT);
+	ck_assert_uint_eq(rec[1].result, TR_RESULT_REVOKED);
+	ck_assert_uint_ge(rec[1].timestamp_ns,
+			  rec[0].timestamp_ns + rec[0].latency_ns);
+}
+END_TEST
+
+/* long_lease_names_are_recorded
+ *
+ * Test details: Record a request for a lease with a long name, up to the
+ *               length that can be requested by a client.
+ * Expected results: The recorded name is complete.
+ */
+START_TEST(long_lease_names_are_recorded)
+{
+	char long_name[DLM_LEASE_NAME_MAX];
+	memset(long_name, 'a', sizeof(long_name) - 1);
+	long_name[sizeof(long_name) - 1] = '\0';
+
+	struct lease_handle long_lease = {.name = long_name};
+
+	struct tr *tr = tr_create(TRACE_FILE, 0);
+	ck_assert_ptr_ne(tr, NULL);
+	tr_begin(tr, LS_REQ_GET_LEASE, &long_lease, 1);
+	tr_end(tr, TR_RESULT_FAILED);
+	tr_destroy(tr);
+
+	FILE *f = fopen(TRACE_FILE, "rb");
+	ck_assert_ptr_ne(f, NULL);
+
+	struct tr_record rec;
+	ck_assert_int_eq(fseek(f, sizeof(struct tr_file_header), SEEK_SET), 0);
+	ck_assert_int_eq(fread(&rec, sizeof(rec), 1, f), 1);
+	fclose(f);
+
+	ck_assert_str_eq(rec.lease, long_name);
+}
+END_TEST
+
+static void add_request_trace_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Request trace tests");
+
+	tcase_add_checked_fixture(tc, NULL, test_shutdown);
+
+	tcase_add_test(tc, requests_are_recorded);
+	tcase_add_test(tc, long_lease_names_are_recorded);
+	suite_add_tcase(s, tc);
+}
+
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = suite_create("DLM request trace tests");
+
+	add_request_trace_tests(s);
+
+	sr = srunner_create(s);
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
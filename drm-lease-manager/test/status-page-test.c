@@ -0,0 +1,144 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <check.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dlm-status.h"
+#include "status-page.h"
+
+#define SOCKETDIR "/tmp"
+#define STATUS_FILE SOCKETDIR "/" DLM_STATUS_FILE_NAME
+
+static struct lease_handle test_leases[] = {
+    {.name = "lease-a"},
+    {.name = "lease-b"},
+};
+
+static struct lease_handle *lease_handles[] = {
+    &test_leases[0],
+    &test_leases[1],
+};
+
+static struct dlm_status_header *status_hdr;
+static size_t status_size;
+
+static void test_setup(void)
+{
+	setenv("DLM_RUNTIME_PATH", SOCKETDIR, 1);
+}
+
+static struct dlm_status_entry *map_status_page(void)
+{
+	int fd = open(STATUS_FILE, O_RDONLY);
+	ck_assert_int_ge(fd, 0);
+
+	struct stat st;
+	ck_assert_int_eq(fstat(fd, &st), 0);
+	status_size = st.st_size;
+
+	status_hdr = mmap(NULL, status_size, PROT_READ, MAP_SHARED, fd, 0);
+	ck_assert_ptr_ne(status_hdr, MAP_FAILED);
+	close(fd);
+
+	ck_assert_int_eq(status_hdr->magic, DLM_STATUS_MAGIC);
+	ck_assert_int_eq(status_hdr->nleases, 2);
+	return (struct dlm_status_entry *)(status_hdr + 1);
+}
+
+static void unmap_status_page(void)
+{
+	munmap(status_hdr, status_size);
+}
+
+/* status_page_tracks_lease_owner
+ *
+ * Test details: Grant, transfer and revoke a lease.
+ * Expected results: The status page shows the current owner and counts
+ *                   each grant.  Every update leaves an even sequence number.
+ */
+START_TEST(status_page_tracks_lease_owner)
+{
+	struct sp *sp = sp_create(lease_handles, 2);
+	ck_assert_ptr_ne(sp, NULL);
+
+	struct dlm_status_entry *entries = map_status_page();
+	ck_assert_str_eq(entries[0].name, "lease-a");
+	ck_assert_str_eq(entries[1].name, "lease-b");
+	ck_assert(!entries[1].granted);
+
+	sp_update(sp, &test_leases[1], 10, 100);
+	ck_assert(entries[1].granted);
+	ck_assert_uint_eq(entries[1].lessee_id, 10);
+	ck_assert_int_eq(entries[1].client_pid, 100);
+	ck_assert_uint_eq(entries[1].grant_count, 1);
+	ck_assert_uint_gt(entries[1].last_transition_ns, 0);
+
+	uint64_t granted_ns = entries[1].last_transition_ns;
+	sp_update(sp, &test_leases[1], 11, 101);
+	ck_assert_uint_eq(entries[1].lessee_id, 11);
+	ck_assert_uint_eq(entries[1].grant_count, 2);
+	ck_assert_uint_ge(entries[1].last_transition_ns, granted_ns);
+
+	sp_update(sp, &test_leases[1], 0, 0);
+	ck_assert(!entries[1].granted);
+	ck_assert_int_eq(entries[1].client_pid, 0);
+	ck_assert_uint_eq(entries[1].grant_count, 2);
+	ck_assert_int_eq(atomic_load(&entries[1].seq) % 2, 0);
+
+	/* The other lease is not affected */
+	ck_assert(!entries[0].granted);
+	ck_assert_uint_eq(entries[0].grant_count, 0);
+
+	ck_assert_uint_eq(atomic_load(&status_hdr->active), 1);
+	sp_destroy(sp);
+	ck_assert_uint_eq(atomic_load(&status_hdr->active), 0);
+	ck_assert_int_ne(access(STATUS_FILE, F_OK), 0);
+
+	unmap_status_page();
+}
+END_TEST
+
+static void add_status_page_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Lease status page tests");
+
+	tcase_add_checked_fixture(tc, test_setup, NULL);
+
+	tcase_add_test(tc, status_page_tracks_lease_owner);
+	suite_add_tcase(s, tc);
+}
+
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = suite_create("DLM lease status page tests");
+
+	add_status_page_tests(s);
+
+	sr = srunner_create(s);
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
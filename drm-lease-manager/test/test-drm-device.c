@@ -15,17 +15,19 @@
 
 #include <check.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <xf86drmMode.h>
 
 #include "test-drm-device.h"
+#include "topology-file.h"
 #define UNUSED(x) (void)(x)
 
 /* Set the base value for IDs of each resource type.
  * These can be adjusted if test cases need more IDs. */
-#define IDS_PER_RES_TYPE 32
+#define IDS_PER_RES_TYPE 64
 
 #define CRTC_BASE (IDS_PER_RES_TYPE)
 #define CONNECTOR_BASE (CRTC_BASE + IDS_PER_RES_TYPE)
@@ -81,6 +83,7 @@ void reset_drm_test_device(void)
 		free(test_device.layout.connectors);
 		free(test_device.layout.encoders);
 		free(test_device.layout.planes);
+		free(test_device.layout.connector_encoders);
 	}
 
 	memset(&test_device, 0, sizeof(test_device));
@@ -130,6 +133,176 @@ void setup_layout_simple_test_device(int conn_cnt, int plane_cnt)
 	test_device.layout.free_on_reset = true;
 }
 
+/* Topology files */
+
+struct topology {
+	int crtcs, connectors, encoders, planes;
+
+	/* Object ids in the file, of the objects that others refer to */
+	uint32_t *crtc_ids;
+	uint32_t *encoder_ids;
+};
+
+static bool count_topology_objects(FILE *f, struct topology *topo)
+{
+	struct tf_object obj;
+	int lineno = 0;
+	int ret;
+
+	while ((ret = tf_read_object(f, &obj, &lineno)) > 0) {
+		switch (obj.type) {
+		case TF_CRTC:
+			topo->crtcs++;
+			break;
+		case TF_CONNECTOR:
+			topo->connectors++;
+			break;
+		case TF_ENCODER:
+			topo->encoders++;
+			break;
+		case TF_PLANE:
+			topo->planes++;
+			break;
+		}
+	}
+	rewind(f);
+	return ret == 0;
+}
+
+static void read_topology_objects(FILE *f, struct topology *topo,
+				  drmModeConnector *connectors,
+				  drmModeEncoder *encoders,
+				  drmModePlane *planes)
+{
+	int crtc = 0, connector = 0, encoder = 0, plane = 0;
+	struct tf_object obj;
+	int lineno = 0;
+
+	while (tf_read_object(f, &obj, &lineno) > 0) {
+		switch (obj.type) {
+		case TF_CRTC:
+			topo->crtc_ids[crtc++] = obj.id;
+			break;
+		case TF_ENCODER:
+			topo->encoder_ids[encoder] = obj.id;
+			encoders[encoder++] = (drmModeEncoder)ENCODER_CLONE(
+			    obj.id, obj.crtc_id, obj.possible_crtcs,
+			    obj.possible_clones);
+			break;
+		case TF_CONNECTOR: {
+			uint32_t *encs = test_device.layout.connector_encoders +
+					 connector * TF_MAX_CONNECTOR_ENCODERS;
+			memcpy(encs, obj.encoders,
+			       obj.nencoders * sizeof(uint32_t));
+
+			connectors[connector++] =
+			    (drmModeConnector)CONNECTOR_FULL(
+				obj.id, obj.encoder_id, encs, obj.nencoders,
+				obj.connector_type, obj.connector_type_id);
+			break;
+		}
+		case TF_PLANE:
+			planes[plane++] =
+			    (drmModePlane)PLANE(obj.id, obj.possible_crtcs);
+			break;
+		}
+	}
+}
+
+/* Map an object id in the file to the id of the test device object */
+static uint32_t map_object_id(const uint32_t *file_ids, int count,
+			      uint32_t id, uint32_t base)
+{
+	if (id == 0)
+		return 0;
+
+	for (int i = 0; i < count; i++) {
+		if (file_ids[i] == id)
+			return base + i;
+	}
+	ck_abort_msg("Unknown object id %u in topology file", id);
+	return 0;
+}
+
+static void renumber_topology_objects(struct topology *topo,
+				      drmModeConnector *connectors,
+				      drmModeEncoder *encoders,
+				      drmModePlane *planes)
+{
+	for (int i = 0; i < topo->connectors; i++) {
+		drmModeConnector *connector = &connectors[i];
+		connector->connector_id = CONNECTOR_ID(i);
+		connector->encoder_id =
+		    map_object_id(topo->encoder_ids, topo->encoders,
+				  connector->encoder_id, ENCODER_BASE);
+		for (int j = 0; j < connector->count_encoders; j++)
+			connector->encoders[j] = map_object_id(
+			    topo->encoder_ids, topo->encoders,
+			    connector->encoders[j], ENCODER_BASE);
+	}
+
+	for (int i = 0; i < topo->encoders; i++) {
+		encoders[i].encoder_id = ENCODER_ID(i);
+		encoders[i].crtc_id =
+		    map_object_id(topo->crtc_ids, topo->crtcs,
+				  encoders[i].crtc_id, CRTC_BASE);
+	}
+
+	for (int i = 0; i < topo->planes; i++)
+		planes[i].plane_id = PLANE_ID(i);
+}
+
+bool setup_test_device_from_file(const char *path)
+{
+	struct topology topo = {0};
+	bool ok = false;
+
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return false;
+
+	if (!count_topology_objects(f, &topo))
+		goto out;
+	ck_assert_int_le(topo.crtcs, IDS_PER_RES_TYPE);
+	ck_assert_int_le(topo.connectors, IDS_PER_RES_TYPE);
+	ck_assert_int_le(topo.encoders, IDS_PER_RES_TYPE);
+	ck_assert_int_le(topo.planes, IDS_PER_RES_TYPE);
+
+	if (!setup_drm_test_device(topo.crtcs, topo.connectors, topo.encoders,
+				   topo.planes))
+		goto out;
+
+	/* calloc(0) may return NULL, so allocate at least one of each */
+	drmModeConnector *connectors =
+	    calloc(topo.connectors + 1, sizeof(drmModeConnector));
+	drmModeEncoder *encoders =
+	    calloc(topo.encoders + 1, sizeof(drmModeEncoder));
+	drmModePlane *planes = calloc(topo.planes + 1, sizeof(drmModePlane));
+	test_device.layout.connector_encoders = calloc(
+	    (topo.connectors + 1) * TF_MAX_CONNECTOR_ENCODERS,
+	    sizeof(uint32_t));
+
+	topo.crtc_ids = calloc(topo.crtcs + 1, sizeof(uint32_t));
+	topo.encoder_ids = calloc(topo.encoders + 1, sizeof(uint32_t));
+
+	setup_test_device_layout(connectors, encoders, planes);
+	test_device.layout.free_on_reset = true;
+
+	if (!connectors || !encoders || !planes ||
+	    !test_device.layout.connector_encoders || !topo.crtc_ids ||
+	    !topo.encoder_ids)
+		goto out;
+
+	read_topology_objects(f, &topo, connectors, encoders, planes);
+	renumber_topology_objects(&topo, connectors, encoders, planes);
+	ok = true;
+out:
+	free(topo.crtc_ids);
+	free(topo.encoder_ids);
+	fclose(f);
+	return ok;
+}
+
 #define GET_DRM_RESOURCE_FN(Res, res, RES, container)                       \
 	drmMode##Res##Ptr get_##res(int fd, uint32_t id)                    \
 	{                                                                   \
@@ -163,3 +336,61 @@ int create_lease(int fd, const uint32_t *objects, int num_objects, int flags,
 
 	return dup(fd);
 }
+
+static uint32_t crtc_props[] = {
+    PROP_ID(TEST_PROP_MODE_ID),
+    PROP_ID(TEST_PROP_ACTIVE),
+};
+static uint32_t connector_props[] = {
+    PROP_ID(TEST_PROP_CRTC_ID),
+};
+static uint32_t plane_props[] = {
+    PROP_ID(TEST_PROP_FB_ID),
+    PROP_ID(TEST_PROP_CRTC_ID),
+};
+
+#define OBJECT_PROPERTIES(list)                                  \
+	{                                                        \
+		.count_props = sizeof(list) / sizeof(list[0]),   \
+		.props = list,                                   \
+	}
+
+drmModeObjectPropertiesPtr get_object_properties(int fd, uint32_t id,
+						 uint32_t type)
+{
+	static drmModeObjectProperties crtc = OBJECT_PROPERTIES(crtc_props);
+	static drmModeObjectProperties connector =
+	    OBJECT_PROPERTIES(connector_props);
+	static drmModeObjectProperties plane = OBJECT_PROPERTIES(plane_props);
+
+	UNUSED(fd);
+	UNUSED(id);
+
+	switch (type) {
+	case DRM_MODE_OBJECT_CRTC:
+		return &crtc;
+	case DRM_MODE_OBJECT_CONNECTOR:
+		return &connector;
+	case DRM_MODE_OBJECT_PLANE:
+		return &plane;
+	}
+	return NULL;
+}
+
+drmModePropertyPtr get_property(int fd, uint32_t id)
+{
+	static drmModePropertyRes properties[] = {
+	    [TEST_PROP_CRTC_ID] = {.name = "CRTC_ID"},
+	    [TEST_PROP_FB_ID] = {.name = "FB_ID"},
+	    [TEST_PROP_MODE_ID] = {.name = "MODE_ID"},
+	    [TEST_PROP_ACTIVE] = {.name = "ACTIVE"},
+	};
+
+	UNUSED(fd);
+
+	uint32_t index = id - TEST_PROP_ID_BASE;
+	ck_assert_uint_lt(index, sizeof(properties) / sizeof(properties[0]));
+
+	properties[index].prop_id = id;
+	return &properties[index];
+}
@@ -30,6 +30,7 @@ struct drm_device {
 		drmModeConnector *connectors;
 		drmModeEncoder *encoders;
 		drmModePlane *planes;
+		uint32_t *connector_encoders;
 		bool free_on_reset;
 	} layout;
 
@@ -46,6 +47,11 @@ bool setup_drm_test_device(int crtcs, int connectors, int encoders, int planes);
 void setup_test_device_layout(drmModeConnector *connectors,
 			      drmModeEncoder *encoders, drmModePlane *planes);
 void setup_layout_simple_test_device(int connectors, int planes);
+
+/* Set up the device from a topology file written by dlm-topology-dump.
+ * Objects are renumbered, so that CRTC_ID(x), CONNECTOR_ID(x), etc. refer
+ * to the xth object of each type in the file. */
+bool setup_test_device_from_file(const char *path);
 void reset_drm_test_device(void);
 
 drmModeConnectorPtr get_connector(int fd, uint32_t id);
@@ -53,6 +59,9 @@ drmModeEncoderPtr get_encoder(int fd, uint32_t id);
 drmModePlanePtr get_plane(int fd, uint32_t id);
 int create_lease(int fd, const uint32_t *objects, int num_objects, int flags,
 		 uint32_t *lessee_id);
+drmModeObjectPropertiesPtr get_object_properties(int fd, uint32_t id,
+						 uint32_t type);
+drmModePropertyPtr get_property(int fd, uint32_t id);
 
 #define TEST_DEVICE_RESOURCES (&test_device.resources)
 #define TEST_DEVICE_PLANE_RESOURCES (&test_device.plane_resources)
@@ -63,6 +72,17 @@ int create_lease(int fd, const uint32_t *objects, int num_objects, int flags,
 #define PLANE_ID(x) (test_device.plane_resources.planes[x])
 #define LESSEE_ID(x) (test_device.leases.lessee_ids[x])
 
+/* Every object of a given type has the same set of properties */
+enum test_property {
+	TEST_PROP_CRTC_ID,
+	TEST_PROP_FB_ID,
+	TEST_PROP_MODE_ID,
+	TEST_PROP_ACTIVE,
+};
+
+#define TEST_PROP_ID_BASE 1024
+#define PROP_ID(x) (TEST_PROP_ID_BASE + (x))
+
 #define CONNECTOR(cid, eid, encs, enc_cnt) \
 	CONNECTOR_FULL(cid, eid, encs, enc_cnt, DRM_MODE_CONNECTOR_Unknown, cid)
 
@@ -73,10 +93,12 @@ int create_lease(int fd, const uint32_t *objects, int num_objects, int flags,
 		.connector_type = type, .connector_type_id = type_id, \
 	}
 
-#define ENCODER(eid, crtc, crtc_mask)               \
-	{                                           \
-		.encoder_id = eid, .crtc_id = crtc, \
-		.possible_crtcs = crtc_mask,        \
+#define ENCODER(eid, crtc, crtc_mask) ENCODER_CLONE(eid, crtc, crtc_mask, 0)
+
+#define ENCODER_CLONE(eid, crtc, crtc_mask, clone_mask)                    \
+	{                                                                  \
+		.encoder_id = eid, .crtc_id = crtc,                        \
+		.possible_crtcs = crtc_mask, .possible_clones = clone_mask, \
 	}
 
 #define PLANE(pid, crtc_mask)                                 \
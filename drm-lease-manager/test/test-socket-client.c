@@ -24,6 +24,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
@@ -40,11 +41,15 @@ struct client_state {
 	struct test_config *config;
 };
 
-static void send_lease_request(int socket, enum dlm_opcode opcode)
+static void send_lease_request(int socket, struct test_config *config,
+			       enum dlm_opcode opcode, uint32_t flags)
 {
 	struct dlm_client_request req = {
 	    .opcode = opcode,
+	    .flags = flags,
 	};
+	strncpy(req.lease_name, config->lease->name,
+		sizeof(req.lease_name) - 1);
 	send_dlm_client_request(socket, &req);
 }
 
@@ -66,31 +71,43 @@ static void client_gst_socket_status(int socket_fd, struct test_config *config)
 	return;
 }
 
-static void *test_client_thread(void *arg)
+int test_client_connect(struct test_config *config)
 {
-	struct client_state *cstate = arg;
-	struct test_config *config = cstate->config;
-
 	struct sockaddr_un address = {
 	    .sun_family = AF_UNIX,
 	};
 
-	ck_assert_int_eq(
-	    sockaddr_set_lease_server_path(&address, config->lease->name),
-	    true);
+	const char *socket_name = config->use_control_socket
+				      ? DLM_CONTROL_SOCKET_NAME
+				      : config->lease->name;
+	ck_assert_int_eq(sockaddr_set_lease_server_path(&address, socket_name),
+			 true);
 
 	int client = socket(PF_UNIX, SOCK_SEQPACKET, 0);
 	ck_assert_int_ge(client, 0);
 
 	int ret;
-	ret = connect(client, (struct sockaddr *)&address, sizeof(address));
+	ret = connect(client, (struct sockaddr *)&address,
+		      sockaddr_len(&address));
 	if (ret != 0) {
 		printf("Connect failed;: %s\n", strerror(errno));
 		close(client);
-		return NULL;
+		return -1;
 	}
 
-	send_lease_request(client, DLM_GET_LEASE);
+	uint32_t flags = config->request_topology ? DLM_REQUEST_TOPOLOGY : 0;
+	send_lease_request(client, config, DLM_GET_LEASE, flags);
+	return client;
+}
+
+static void *test_client_thread(void *arg)
+{
+	struct client_state *cstate = arg;
+	struct test_config *config = cstate->config;
+
+	int client = test_client_connect(config);
+	if (client < 0)
+		return NULL;
 
 	if (!config->recv_timeout)
 		config->recv_timeout = DEFAULT_RECV_TIMEOUT;
@@ -98,11 +115,29 @@ static void *test_client_thread(void *arg)
 	client_gst_socket_status(client, config);
 
 	if (config->has_data) {
-		config->received_fd = receive_lease_fd(client);
+		config->received_fd =
+		    receive_lease_fd(client, &config->received_topology_fd);
+	}
+
+	if (config->yield_lease)
+		send_lease_request(client, config, DLM_YIELD_LEASE, 0);
+
+	if (config->reacquire_lease) {
+		send_lease_request(client, config, DLM_GET_LEASE, 0);
+		struct pollfd pfd = {.fd = client, .events = POLLIN};
+		config->reacquired_fd = -1;
+		if (poll(&pfd, 1, config->recv_timeout) > 0)
+			config->reacquired_fd = receive_lease_fd(client, NULL);
+	}
+
+	if (config->wait_for_event) {
+		struct pollfd pfd = {.fd = client, .events = POLLIN};
+		if (poll(&pfd, 1, config->recv_timeout) > 0)
+			receive_dlm_event(client, &config->received_event);
 	}
 
 	cstate->socket_fd = client;
-	send_lease_request(client, DLM_RELEASE_LEASE);
+	send_lease_request(client, config, DLM_RELEASE_LEASE, 0);
 
 	return NULL;
 }
@@ -137,4 +172,8 @@ void test_config_cleanup(struct test_config *config)
 {
 	if (config->has_data && config->received_fd >= 0)
 		close(config->received_fd);
+	if (config->has_data && config->received_topology_fd >= 0)
+		close(config->received_topology_fd);
+	if (config->reacquire_lease && config->reacquired_fd >= 0)
+		close(config->reacquired_fd);
 }
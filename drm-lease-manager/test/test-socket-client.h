@@ -17,20 +17,33 @@
 #define TEST_SOCKET_CLIENT_H
 #include <stdbool.h>
 
+#include "dlm-protocol.h"
 #include "drm-lease.h"
 struct test_config {
 	// settings
 	struct lease_handle *lease;
 	int recv_timeout;
+	bool request_topology;
+	bool use_control_socket;
+	bool wait_for_event;
+	bool yield_lease;
+	bool reacquire_lease;
 
 	// outputs
 	int received_fd;
+	int received_topology_fd;
 	bool has_data;
 	bool connection_completed;
+	enum dlm_event received_event;
+	int reacquired_fd;
 };
 
 void test_config_cleanup(struct test_config *config);
 
+/* Connect to the lease server and request the lease.
+ * Returns the connected socket, or -1 on failure. */
+int test_client_connect(struct test_config *config);
+
 struct client_state;
 struct client_state *test_client_start(struct test_config *test_config);
 void test_client_stop(struct client_state *cstate);
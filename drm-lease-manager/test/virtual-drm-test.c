@@ -0,0 +1,306 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <check.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "drm-backend.h"
+#include "lease-manager.h"
+#include "test-helpers.h"
+
+static const struct drm_backend *drm = &drm_backend_virtual;
+
+/************** Virtual device tests *************/
+
+/* default_topology
+ *
+ * Test details: Open the default virtual device.
+ * Expected results: Two connected outputs, each with a CRTC, encoder,
+ *                   connector and plane.  The device can only be opened
+ *                   once at a time.
+ */
+START_TEST(default_topology)
+{
+	int fd = drm->open("virtual");
+	ck_assert_int_ge(fd, 0);
+
+	drmModeResPtr res = drm->get_resources(fd);
+	ck_assert_ptr_ne(res, NULL);
+	ck_assert_int_eq(res->count_crtcs, 2);
+	ck_assert_int_eq(res->count_encoders, 2);
+	ck_assert_int_eq(res->count_connectors, 2);
+
+	drmModeConnectorPtr connector =
+	    drm->get_connector(fd, res->connectors[1]);
+	ck_assert_ptr_ne(connector, NULL);
+	ck_assert_int_eq(connector->connection, DRM_MODE_CONNECTED);
+	ck_assert_int_eq(connector->connector_type,
+			 DRM_MODE_CONNECTOR_VIRTUAL);
+	ck_assert_int_eq(connector->count_modes, 1);
+
+	drmModeEncoderPtr encoder = drm->get_encoder(fd, connector->encoder_id);
+	ck_assert_ptr_ne(encoder, NULL);
+	ck_assert_uint_eq(encoder->crtc_id, res->crtcs[1]);
+
+	drmModePlaneResPtr plane_res = drm->get_plane_resources(fd);
+	ck_assert_ptr_ne(plane_res, NULL);
+	ck_assert_uint_eq(plane_res->count_planes, 2);
+
+	ck_assert_int_lt(drm->open("virtual"), 0);
+	ck_assert_int_eq(errno, EBUSY);
+
+	drm->free_plane_resources(plane_res);
+	drm->free_encoder(encoder);
+	drm->free_connector(connector);
+	drm->free_resources(res);
+	drm->close(fd);
+}
+END_TEST
+
+/* output_count
+ *
+ * Test details: Open a virtual device with a given number of outputs.
+ * Expected results: The device has that many CRTCs and connectors.
+ */
+START_TEST(output_count)
+{
+	int fd = drm->open("virtual:5");
+	ck_assert_int_ge(fd, 0);
+
+	drmModeResPtr res = drm->get_resources(fd);
+	ck_assert_int_eq(res->count_crtcs, 5);
+	ck_assert_int_eq(res->count_connectors, 5);
+
+	drm->free_resources(res);
+	drm->close(fd);
+}
+END_TEST
+
+/* lease_conflict
+ *
+ * Test details: Lease the same objects twice, before and after revoking
+ *               the first lease.
+ * Expected results: The second lease fails with EBUSY until the first one
+ *                   is revoked.
+ */
+START_TEST(lease_conflict)
+{
+	int fd = drm->open("virtual");
+	ck_assert_int_ge(fd, 0);
+
+	drmModeResPtr res = drm->get_resources(fd);
+	uint32_t objects[] = {res->connectors[0], res->crtcs[0]};
+	uint32_t first, second;
+
+	int lease_fd =
+	    drm->create_lease(fd, objects, ARRAY_LEN(objects), 0, &first);
+	ck_assert_int_ge(lease_fd, 0);
+
+	ck_assert_int_eq(
+	    drm->create_lease(fd, objects, ARRAY_LEN(objects), 0, &second),
+	    -EBUSY);
+
+	ck_assert_int_eq(drm->revoke_lease(fd, first), 0);
+	ck_assert_int_eq(drm->revoke_lease(fd, first), -ENOENT);
+	close(lease_fd);
+
+	lease_fd =
+	    drm->create_lease(fd, objects, ARRAY_LEN(objects), 0, &second);
+	ck_assert_int_ge(lease_fd, 0);
+	ck_assert_uint_ne(first, second);
+
+	close(lease_fd);
+	drm->free_resources(res);
+	drm->close(fd);
+}
+END_TEST
+
+static uint64_t vblank_user_data;
+static uint64_t vblank_sequence;
+
+static void handle_sequence(int fd, uint64_t sequence, uint64_t ns,
+			    uint64_t user_data)
+{
+	UNUSED(fd);
+	UNUSED(ns);
+	vblank_user_data = user_data;
+	vblank_sequence = sequence;
+}
+
+/* vblank_event
+ *
+ * Test details: Queue a vblank event and wait for it on the device fd.
+ * Expected results: The event is delivered at the queued sequence, with
+ *                   the given user data.
+ */
+START_TEST(vblank_event)
+{
+	int fd = drm->open("virtual");
+	ck_assert_int_ge(fd, 0);
+
+	drmModeResPtr res = drm->get_resources(fd);
+	drmEventContext ctx = {
+	    .version = DRM_EVENT_CONTEXT_VERSION,
+	    .sequence_handler = handle_sequence,
+	};
+	uint64_t queued;
+
+	vblank_user_data = 0;
+	ck_assert_int_eq(drm->crtc_queue_sequence(fd, res->crtcs[0],
+						  DRM_CRTC_SEQUENCE_RELATIVE,
+						  1, &queued, 1234),
+			 0);
+
+	struct pollfd pfd = {.fd = fd, .events = POLLIN};
+	for (int i = 0; i < 10 && !vblank_user_data; i++) {
+		ck_assert_int_eq(poll(&pfd, 1, 1000), 1);
+		ck_assert_int_eq(drm->handle_event(fd, &ctx), 0);
+	}
+
+	ck_assert_uint_eq(vblank_user_data, 1234);
+	ck_assert_uint_ge(vblank_sequence, queued);
+
+	drm->free_resources(res);
+	drm->close(fd);
+}
+END_TEST
+
+/* topology_file_clones
+ *
+ * Test details: Open a virtual device from a topology file with possible
+ *               clones recorded for some of its encoders.
+ * Expected results: The encoders have the possible clones of the file, or
+ *                   none if the file doesn't list them.
+ */
+START_TEST(topology_file_clones)
+{
+	int fd = drm->open("virtual:" TEST_DATA_DIR "/clone-outputs.topology");
+	ck_assert_int_ge(fd, 0);
+
+	drmModeResPtr res = drm->get_resources(fd);
+	ck_assert_ptr_ne(res, NULL);
+	ck_assert_int_eq(res->count_encoders, 3);
+
+	static const uint32_t possible_clones[] = {0x3, 0x3, 0};
+	for (int i = 0; i < 3; i++) {
+		drmModeEncoderPtr encoder =
+		    drm->get_encoder(fd, res->encoders[i]);
+		ck_assert_ptr_ne(encoder, NULL);
+		ck_assert_uint_eq(encoder->possible_clones,
+				  possible_clones[i]);
+		drm->free_encoder(encoder);
+	}
+
+	drm->free_resources(res);
+	drm->close(fd);
+}
+END_TEST
+
+static void add_device_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Virtual DRM device");
+
+	tcase_add_test(tc, default_topology);
+	tcase_add_test(tc, output_count);
+	tcase_add_test(tc, lease_conflict);
+	tcase_add_test(tc, vblank_event);
+	tcase_add_test(tc, topology_file_clones);
+	suite_add_tcase(s, tc);
+}
+
+/************** Lease manager tests *************/
+
+/* lease_manager_default_leases
+ *
+ * Test details: Create a lease manager on a virtual device and grant all
+ *               of its leases.
+ * Expected results: One lease per output, named after the connectors.
+ *                   All leases can be granted at the same time.
+ */
+START_TEST(lease_manager_default_leases)
+{
+	struct lm *lm = lm_create("virtual:3");
+	ck_assert_ptr_ne(lm, NULL);
+	ck_assert_ptr_eq(lm_get_drm_backend(lm), &drm_backend_virtual);
+
+	struct lease_handle **handles;
+	int count = lm_get_lease_handles(lm, &handles);
+	ck_assert_int_eq(count, 3);
+	ck_assert_str_eq(handles[0]->name, "card0-Virtual-1");
+
+	for (int i = 0; i < count; i++) {
+		ck_assert_int_ge(lm_lease_grant(lm, handles[i]), 0);
+		ck_assert_uint_ne(lm_lease_lessee_id(handles[i]), 0);
+	}
+
+	lm_lease_revoke(lm, handles[0]);
+	ck_assert_uint_eq(lm_lease_lessee_id(handles[0]), 0);
+	ck_assert_int_ge(lm_lease_grant(lm, handles[0]), 0);
+
+	lm_destroy(lm);
+}
+END_TEST
+
+/* lease_manager_topology_file
+ *
+ * Test details: Create a lease manager on a virtual device loaded from a
+ *               captured topology.
+ * Expected results: One lease per connector in the topology.
+ */
+START_TEST(lease_manager_topology_file)
+{
+	struct lm *lm =
+	    lm_create("virtual:" TEST_DATA_DIR "/sample-soc.topology");
+	ck_assert_ptr_ne(lm, NULL);
+
+	struct lease_handle **handles;
+	ck_assert_int_eq(lm_get_lease_handles(lm, &handles), 4);
+	ck_assert_int_ge(lm_lease_grant(lm, handles[3]), 0);
+
+	lm_destroy(lm);
+}
+END_TEST
+
+static void add_lease_manager_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Lease manager on a virtual device");
+
+	tcase_add_test(tc, lease_manager_default_leases);
+	tcase_add_test(tc, lease_manager_topology_file);
+	suite_add_tcase(s, tc);
+}
+
+int main(void)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = suite_create("DLM virtual DRM device tests");
+
+	add_device_tests(s);
+	add_lease_manager_tests(s);
+
+	sr = srunner_create(s);
+	srunner_run_all(sr, CK_NORMAL);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,132 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Write the display topology of a DRM device in the format read by the
+ * test DRM device (drm-lease-manager/test/test-drm-device.c):
+ *
+ *   crtc <id>
+ *   encoder <id> <crtc id> <possible crtcs> <possible clones>
+ *   connector <id> <type> <type id> <encoder id> <encoder ids...>
+ *   plane <id> <possible crtcs>
+ *
+ * Lines starting with '#' are comments.  An id of 0 means "none". */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+static void dump_connector(FILE *out, int fd, uint32_t id)
+{
+	drmModeConnectorPtr connector = drmModeGetConnector(fd, id);
+	if (!connector)
+		return;
+
+	fprintf(out, "connector %u %u %u %u", connector->connector_id,
+		connector->connector_type, connector->connector_type_id,
+		connector->encoder_id);
+	for (int i = 0; i < connector->count_encoders; i++)
+		fprintf(out, " %u", connector->encoders[i]);
+	fprintf(out, "\n");
+
+	drmModeFreeConnector(connector);
+}
+
+static void dump_encoder(FILE *out, int fd, uint32_t id)
+{
+	drmModeEncoderPtr encoder = drmModeGetEncoder(fd, id);
+	if (!encoder)
+		return;
+
+	fprintf(out, "encoder %u %u 0x%x 0x%x\n", encoder->encoder_id,
+		encoder->crtc_id, encoder->possible_crtcs,
+		encoder->possible_clones);
+	drmModeFreeEncoder(encoder);
+}
+
+static void dump_plane(FILE *out, int fd, uint32_t id)
+{
+	drmModePlanePtr plane = drmModeGetPlane(fd, id);
+	if (!plane)
+		return;
+
+	fprintf(out, "plane %u 0x%x\n", plane->plane_id,
+		plane->possible_crtcs);
+	drmModeFreePlane(plane);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 3 || (argc > 1 && argv[1][0] == '-')) {
+		printf("Usage: %s [<DRM device> [<output file>]]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const char *device = argc > 1 ? argv[1] : "/dev/dri/card0";
+
+	int fd = open(device, O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		perror(device);
+		return EXIT_FAILURE;
+	}
+
+	FILE *out = stdout;
+	if (argc > 2 && !(out = fopen(argv[2], "w"))) {
+		perror(argv[2]);
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	/* Include primary and cursor planes, like drm-lease-manager */
+	drmSetClientCap(fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+
+	drmModeResPtr res = drmModeGetResources(fd);
+	drmModePlaneResPtr plane_res = drmModeGetPlaneResources(fd);
+	if (!res || !plane_res) {
+		fprintf(stderr, "%s: cannot get DRM resources\n", device);
+		goto err;
+	}
+
+	fprintf(out, "# %s: %d crtcs, %d encoders, %d connectors, %u planes\n",
+		device, res->count_crtcs, res->count_encoders,
+		res->count_connectors, plane_res->count_planes);
+
+	for (int i = 0; i < res->count_crtcs; i++)
+		fprintf(out, "crtc %u\n", res->crtcs[i]);
+	for (int i = 0; i < res->count_encoders; i++)
+		dump_encoder(out, fd, res->encoders[i]);
+	for (int i = 0; i < res->count_connectors; i++)
+		dump_connector(out, fd, res->connectors[i]);
+	for (uint32_t i = 0; i < plane_res->count_planes; i++)
+		dump_plane(out, fd, plane_res->planes[i]);
+
+	drmModeFreePlaneResources(plane_res);
+	drmModeFreeResources(res);
+	if (out != stdout)
+		fclose(out);
+	close(fd);
+	return EXIT_SUCCESS;
+err:
+	if (plane_res)
+		drmModeFreePlaneResources(plane_res);
+	if (res)
+		drmModeFreeResources(res);
+	if (out != stdout)
+		fclose(out);
+	close(fd);
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,74 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "topology-file.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int parse_id_list(const char *list, uint32_t *ids, int max)
+{
+	int count = 0;
+	char *end;
+
+	for (;;) {
+		unsigned long id = strtoul(list, &end, 0);
+		if (end == list || count == max)
+			return count;
+		ids[count++] = id;
+		list = end;
+	}
+}
+
+static bool parse_object(const char *line, struct tf_object *obj)
+{
+	int len;
+
+	*obj = (struct tf_object){0};
+
+	if (sscanf(line, "crtc %u", &obj->id) == 1) {
+		obj->type = TF_CRTC;
+	} else if (sscanf(line, "encoder %u %u %x %x", &obj->id,
+			  &obj->crtc_id, &obj->possible_crtcs,
+			  &obj->possible_clones) >= 3) {
+		obj->type = TF_ENCODER;
+	} else if (sscanf(line, "connector %u %u %u %u%n", &obj->id,
+			  &obj->connector_type, &obj->connector_type_id,
+			  &obj->encoder_id, &len) == 4) {
+		obj->type = TF_CONNECTOR;
+		obj->nencoders = parse_id_list(line + len, obj->encoders,
+					       TF_MAX_CONNECTOR_ENCODERS);
+	} else if (sscanf(line, "plane %u %x", &obj->id,
+			  &obj->possible_crtcs) == 2) {
+		obj->type = TF_PLANE;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+int tf_read_object(FILE *f, struct tf_object *obj, int *lineno)
+{
+	char line[256], type[16];
+
+	while (fgets(line, sizeof(line), f)) {
+		(*lineno)++;
+		if (sscanf(line, "%15s", type) != 1 || type[0] == '#')
+			continue;
+
+		return parse_object(line, obj) ? 1 : -1;
+	}
+	return 0;
+}
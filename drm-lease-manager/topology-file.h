@@ -0,0 +1,68 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TOPOLOGY_FILE_H
+#define TOPOLOGY_FILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Topology files
+ * A text description of the display objects of a DRM device, as written
+ * by dlm-topology-dump.  Used by the virtual DRM device and the unit tests.
+ *
+ * One object per line, lines starting with '#' are comments:
+ *   crtc <id>
+ *   encoder <id> <crtc id> <possible crtcs> [<possible clones>]
+ *   connector <id> <type> <type id> <encoder id> [<encoder ids>...]
+ *   plane <id> <possible crtcs>
+ * The possible crtcs and clones masks are hexadecimal, all other values
+ * decimal.  Encoders without possible clones can't be cloned, as in files
+ * written before they were recorded. */
+
+#define TF_MAX_CONNECTOR_ENCODERS 8
+
+enum tf_object_type {
+	TF_CRTC,
+	TF_ENCODER,
+	TF_CONNECTOR,
+	TF_PLANE,
+};
+
+struct tf_object {
+	enum tf_object_type type;
+	uint32_t id;
+
+	/* Encoders */
+	uint32_t crtc_id;
+	uint32_t possible_clones;
+
+	/* Encoders and planes */
+	uint32_t possible_crtcs;
+
+	/* Connectors */
+	uint32_t connector_type;
+	uint32_t connector_type_id;
+	uint32_t encoder_id;
+	uint32_t encoders[TF_MAX_CONNECTOR_ENCODERS];
+	int nencoders;
+};
+
+/* Read the next object from f.  lineno counts the lines read so far.
+ * Returns 1 if an object was read, 0 at the end of the file and -1 if
+ * the line at lineno is invalid. */
+int tf_read_object(FILE *f, struct tf_object *obj, int *lineno);
+#endif
@@ -0,0 +1,741 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "drm-backend.h"
+
+#include "log.h"
+#include "topology-file.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Virtual DRM device
+ * A display device that only exists in the lease manager process.  All
+ * outputs are connected and show a 1920x1080@60 mode.
+ *
+ * The device fd is a timer that becomes readable at every vblank.  Vblank
+ * events requested with crtc_queue_sequence() are delivered by
+ * handle_event() once their vblank has passed.
+ *
+ * Lease fds are eventfds.  They can be passed to clients and closed like
+ * real lease fds, but do not give access to the leased objects.
+ *
+ * There is only one virtual device per process. */
+
+#define VDRM_DEFAULT_OUTPUTS 2
+#define VDRM_MAX_OBJECTS 64 /* per object type */
+#define VDRM_MAX_CRTCS 32   /* possible_crtcs is a 32 bit mask */
+#define VDRM_MAX_CONNECTOR_ENCODERS TF_MAX_CONNECTOR_ENCODERS
+#define VDRM_MAX_LEASES 32
+#define VDRM_MAX_EVENTS 64
+#define VDRM_REFRESH_HZ 60
+
+struct vdrm_lease {
+	bool active;
+	uint32_t lessee_id;
+	uint32_t *objects;
+	int nobjects;
+};
+
+struct vdrm_event {
+	uint64_t sequence;
+	uint64_t user_data;
+};
+
+struct vdrm_device {
+	int fd;
+	uint64_t vblank_seq;
+
+	uint32_t crtc_ids[VDRM_MAX_CRTCS];
+	uint32_t crtc_fbs[VDRM_MAX_CRTCS];
+	int ncrtcs;
+
+	uint32_t encoder_ids[VDRM_MAX_OBJECTS];
+	drmModeEncoder encoders[VDRM_MAX_OBJECTS];
+	int nencoders;
+
+	uint32_t connector_ids[VDRM_MAX_OBJECTS];
+	drmModeConnector connectors[VDRM_MAX_OBJECTS];
+	uint32_t connector_encoders[VDRM_MAX_OBJECTS]
+				   [VDRM_MAX_CONNECTOR_ENCODERS];
+	int nconnectors;
+
+	uint32_t plane_ids[VDRM_MAX_OBJECTS];
+	drmModePlane planes[VDRM_MAX_OBJECTS];
+	int nplanes;
+
+	struct vdrm_lease leases[VDRM_MAX_LEASES];
+	uint32_t next_lessee_id;
+	uint32_t next_fb_id;
+	uint32_t next_bo_handle;
+
+	struct vdrm_event events[VDRM_MAX_EVENTS];
+	int nevents;
+};
+
+static pthread_mutex_t vdrm_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct vdrm_device vdev = {.fd = -1};
+
+static drmModeModeInfo vdrm_mode = {
+    .clock = 148500,
+    .hdisplay = 1920,
+    .hsync_start = 2008,
+    .hsync_end = 2052,
+    .htotal = 2200,
+    .vdisplay = 1080,
+    .vsync_start = 1084,
+    .vsync_end = 1089,
+    .vtotal = 1125,
+    .vrefresh = VDRM_REFRESH_HZ,
+    .type = DRM_MODE_TYPE_PREFERRED | DRM_MODE_TYPE_DRIVER,
+    .name = "1920x1080",
+};
+
+static int fail(int err)
+{
+	errno = err;
+	return -err;
+}
+
+static int find_id(const uint32_t *ids, int count, uint32_t id)
+{
+	for (int i = 0; i < count; i++) {
+		if (ids[i] == id)
+			return i;
+	}
+	return -1;
+}
+
+/* Topology setup */
+
+static bool add_crtc(uint32_t id)
+{
+	if (vdev.ncrtcs == VDRM_MAX_CRTCS)
+		return false;
+	vdev.crtc_ids[vdev.ncrtcs++] = id;
+	return true;
+}
+
+static bool add_encoder(uint32_t id, uint32_t crtc_id, uint32_t crtc_mask,
+			uint32_t clone_mask)
+{
+	if (vdev.nencoders == VDRM_MAX_OBJECTS)
+		return false;
+	vdev.encoder_ids[vdev.nencoders] = id;
+	vdev.encoders[vdev.nencoders++] = (drmModeEncoder){
+	    .encoder_id = id,
+	    .encoder_type = DRM_MODE_ENCODER_VIRTUAL,
+	    .crtc_id = crtc_id,
+	    .possible_crtcs = crtc_mask,
+	    .possible_clones = clone_mask,
+	};
+	return true;
+}
+
+static bool add_connector(uint32_t id, uint32_t type, uint32_t type_id,
+			  uint32_t encoder_id, const uint32_t *encoders,
+			  int nencoders)
+{
+	if (vdev.nconnectors == VDRM_MAX_OBJECTS)
+		return false;
+
+	int index = vdev.nconnectors++;
+	memcpy(vdev.connector_encoders[index], encoders,
+	       nencoders * sizeof(uint32_t));
+
+	vdev.connector_ids[index] = id;
+	vdev.connectors[index] = (drmModeConnector){
+	    .connector_id = id,
+	    .encoder_id = encoder_id,
+	    .connector_type = type,
+	    .connector_type_id = type_id,
+	    .connection = DRM_MODE_CONNECTED,
+	    .count_modes = 1,
+	    .modes = &vdrm_mode,
+	    .count_encoders = nencoders,
+	    .encoders = vdev.connector_encoders[index],
+	};
+	return true;
+}
+
+static bool add_plane(uint32_t id, uint32_t crtc_mask)
+{
+	if (vdev.nplanes == VDRM_MAX_OBJECTS)
+		return false;
+	vdev.plane_ids[vdev.nplanes] = id;
+	vdev.planes[vdev.nplanes++] = (drmModePlane){
+	    .plane_id = id,
+	    .possible_crtcs = crtc_mask,
+	};
+	return true;
+}
+
+/* Each output has a CRTC, encoder, connector and primary plane.
+ * Object ids are assigned in that order, like the kernel does. */
+static bool create_default_topology(int outputs)
+{
+	if (outputs <= 0 || outputs > VDRM_MAX_CRTCS)
+		return false;
+
+	uint32_t id = 1;
+	uint32_t crtc_base = id;
+	for (int i = 0; i < outputs; i++)
+		add_crtc(id++);
+
+	uint32_t encoder_base = id;
+	for (int i = 0; i < outputs; i++)
+		add_encoder(id++, crtc_base + i, 1u << i, 0);
+
+	for (int i = 0; i < outputs; i++) {
+		uint32_t encoder_id = encoder_base + i;
+		add_connector(id++, DRM_MODE_CONNECTOR_VIRTUAL, i + 1,
+			      encoder_id, &encoder_id, 1);
+	}
+
+	for (int i = 0; i < outputs; i++)
+		add_plane(id++, 1u << i);
+
+	return true;
+}
+
+static bool add_object(const struct tf_object *obj)
+{
+	switch (obj->type) {
+	case TF_CRTC:
+		return add_crtc(obj->id);
+	case TF_ENCODER:
+		return add_encoder(obj->id, obj->crtc_id, obj->possible_crtcs,
+				   obj->possible_clones);
+	case TF_CONNECTOR:
+		return add_connector(obj->id, obj->connector_type,
+				     obj->connector_type_id, obj->encoder_id,
+				     obj->encoders, obj->nencoders);
+	case TF_PLANE:
+		return add_plane(obj->id, obj->possible_crtcs);
+	}
+	return false;
+}
+
+static bool load_topology(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		ERROR_LOG("Cannot open topology %s: %s\n", path,
+			  strerror(errno));
+		return false;
+	}
+
+	struct tf_object obj;
+	int lineno = 0;
+	int ret;
+
+	while ((ret = tf_read_object(f, &obj, &lineno)) > 0) {
+		if (!add_object(&obj)) {
+			ret = -1;
+			break;
+		}
+	}
+
+	if (ret < 0)
+		ERROR_LOG("Invalid topology %s, line %d\n", path, lineno);
+	fclose(f);
+	return ret == 0;
+}
+
+static bool create_topology(const char *spec)
+{
+	if (!spec)
+		return create_default_topology(VDRM_DEFAULT_OUTPUTS);
+
+	char *end;
+	long outputs = strtol(spec, &end, 10);
+	if (end != spec && *end == '\0')
+		return create_default_topology(outputs);
+
+	return load_topology(spec);
+}
+
+/* Backend operations */
+
+static void reset_device(void)
+{
+	for (int i = 0; i < VDRM_MAX_LEASES; i++)
+		free(vdev.leases[i].objects);
+	vdev = (struct vdrm_device){.fd = -1};
+}
+
+static int vdrm_open(const char *device)
+{
+	const char *spec = strchr(device, ':');
+	if (spec)
+		spec++;
+
+	pthread_mutex_lock(&vdrm_lock);
+	if (vdev.fd >= 0) {
+		pthread_mutex_unlock(&vdrm_lock);
+		return fail(EBUSY);
+	}
+
+	int fd = -1;
+	if (!create_topology(spec)) {
+		errno = EINVAL;
+		goto err;
+	}
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (fd < 0)
+		goto err;
+
+	struct itimerspec vblank = {
+	    .it_interval.tv_nsec = 1000000000 / VDRM_REFRESH_HZ,
+	    .it_value.tv_nsec = 1000000000 / VDRM_REFRESH_HZ,
+	};
+	if (timerfd_settime(fd, 0, &vblank, NULL) < 0)
+		goto err;
+
+	vdev.fd = fd;
+	vdev.next_fb_id = 1000;
+	pthread_mutex_unlock(&vdrm_lock);
+
+	INFO_LOG("Virtual DRM device: %d crtcs, %d connectors, %d planes\n",
+		 vdev.ncrtcs, vdev.nconnectors, vdev.nplanes);
+	return fd;
+err:;
+	int err = errno;
+	if (fd >= 0)
+		close(fd);
+	reset_device();
+	pthread_mutex_unlock(&vdrm_lock);
+	return fail(err);
+}
+
+static void vdrm_close(int fd)
+{
+	pthread_mutex_lock(&vdrm_lock);
+	if (fd == vdev.fd) {
+		close(fd);
+		reset_device();
+	}
+	pthread_mutex_unlock(&vdrm_lock);
+}
+
+static bool vdrm_get_device_id(int fd, dev_t *id)
+{
+	(void)fd;
+	*id = 0;
+	return true;
+}
+
+static int vdrm_set_client_cap(int fd, uint64_t capability, uint64_t value)
+{
+	(void)fd;
+	(void)capability;
+	(void)value;
+	return 0;
+}
+
+static drmModeResPtr vdrm_get_resources(int fd)
+{
+	(void)fd;
+
+	drmModeResPtr res = calloc(1, sizeof(*res));
+	if (!res)
+		return NULL;
+
+	res->count_crtcs = vdev.ncrtcs;
+	res->crtcs = vdev.crtc_ids;
+	res->count_encoders = vdev.nencoders;
+	res->encoders = vdev.encoder_ids;
+	res->count_connectors = vdev.nconnectors;
+	res->connectors = vdev.connector_ids;
+	res->max_width = vdrm_mode.hdisplay;
+	res->max_height = vdrm_mode.vdisplay;
+	return res;
+}
+
+static drmModePlaneResPtr vdrm_get_plane_resources(int fd)
+{
+	(void)fd;
+
+	drmModePlaneResPtr res = calloc(1, sizeof(*res));
+	if (!res)
+		return NULL;
+
+	res->count_planes = vdev.nplanes;
+	res->planes = vdev.plane_ids;
+	return res;
+}
+
+/* Objects are returned as copies, so that the caller can free them.
+ * Arrays inside the objects belong to the device. */
+static void *copy_object(const uint32_t *ids, int count, uint32_t id,
+			 const void *objects, size_t size)
+{
+	int index = find_id(ids, count, id);
+	if (index < 0) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	void *copy = malloc(size);
+	if (copy)
+		memcpy(copy, (const char *)objects + index * size, size);
+	return copy;
+}
+
+static drmModeConnectorPtr vdrm_get_connector(int fd, uint32_t id)
+{
+	(void)fd;
+	return copy_object(vdev.connector_ids, vdev.nconnectors, id,
+			   vdev.connectors, sizeof(drmModeConnector));
+}
+
+static drmModeEncoderPtr vdrm_get_encoder(int fd, uint32_t id)
+{
+	(void)fd;
+	return copy_object(vdev.encoder_ids, vdev.nencoders, id,
+			   vdev.encoders, sizeof(drmModeEncoder));
+}
+
+static drmModePlanePtr vdrm_get_plane(int fd, uint32_t id)
+{
+	(void)fd;
+	return copy_object(vdev.plane_ids, vdev.nplanes, id, vdev.planes,
+			   sizeof(drmModePlane));
+}
+
+static drmModeCrtcPtr vdrm_get_crtc(int fd, uint32_t id)
+{
+	(void)fd;
+
+	int index = find_id(vdev.crtc_ids, vdev.ncrtcs, id);
+	if (index < 0) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	drmModeCrtcPtr crtc = calloc(1, sizeof(*crtc));
+	if (!crtc)
+		return NULL;
+
+	pthread_mutex_lock(&vdrm_lock);
+	crtc->buffer_id = vdev.crtc_fbs[index];
+	pthread_mutex_unlock(&vdrm_lock);
+
+	crtc->crtc_id = id;
+	crtc->mode_valid = 1;
+	crtc->mode = vdrm_mode;
+	crtc->width = vdrm_mode.hdisplay;
+	crtc->height = vdrm_mode.vdisplay;
+	return crtc;
+}
+
+/* No properties, so the lease topology only lists the objects */
+static drmModeObjectPropertiesPtr
+vdrm_object_get_properties(int fd, uint32_t id, uint32_t type)
+{
+	(void)fd;
+	(void)id;
+	(void)type;
+	return calloc(1, sizeof(drmModeObjectProperties));
+}
+
+static drmModePropertyPtr vdrm_get_property(int fd, uint32_t id)
+{
+	(void)fd;
+	(void)id;
+	errno = ENOENT;
+	return NULL;
+}
+
+static bool object_exists(uint32_t id)
+{
+	return find_id(vdev.crtc_ids, vdev.ncrtcs, id) >= 0 ||
+	       find_id(vdev.connector_ids, vdev.nconnectors, id) >= 0 ||
+	       find_id(vdev.plane_ids, vdev.nplanes, id) >= 0;
+}
+
+static bool object_is_leased(uint32_t id)
+{
+	for (int i = 0; i < VDRM_MAX_LEASES; i++) {
+		struct vdrm_lease *lease = &vdev.leases[i];
+		if (lease->active &&
+		    find_id(lease->objects, lease->nobjects, id) >= 0)
+			return true;
+	}
+	return false;
+}
+
+static int vdrm_create_lease(int fd, const uint32_t *objects, int num_objects,
+			     int flags, uint32_t *lessee_id)
+{
+	(void)fd;
+	(void)flags;
+
+	int ret;
+	pthread_mutex_lock(&vdrm_lock);
+
+	struct vdrm_lease *lease = NULL;
+	for (int i = 0; i < VDRM_MAX_LEASES && !lease; i++) {
+		if (!vdev.leases[i].active)
+			lease = &vdev.leases[i];
+	}
+	if (!lease) {
+		ret = fail(ENOSPC);
+		goto out;
+	}
+
+	for (int i = 0; i < num_objects; i++) {
+		if (!object_exists(objects[i])) {
+			ret = fail(ENOENT);
+			goto out;
+		}
+		if (object_is_leased(objects[i])) {
+			ret = fail(EBUSY);
+			goto out;
+		}
+	}
+
+	uint32_t *copy = malloc(num_objects * sizeof(uint32_t));
+	if (!copy) {
+		ret = fail(ENOMEM);
+		goto out;
+	}
+
+	ret = eventfd(0, EFD_CLOEXEC);
+	if (ret < 0) {
+		ret = fail(errno);
+		free(copy);
+		goto out;
+	}
+
+	memcpy(copy, objects, num_objects * sizeof(uint32_t));
+	free(lease->objects);
+	lease->objects = copy;
+	lease->nobjects = num_objects;
+	lease->lessee_id = ++vdev.next_lessee_id;
+	lease->active = true;
+	*lessee_id = lease->lessee_id;
+out:
+	pthread_mutex_unlock(&vdrm_lock);
+	return ret;
+}
+
+static int vdrm_revoke_lease(int fd, uint32_t lessee_id)
+{
+	(void)fd;
+
+	int ret = fail(ENOENT);
+	pthread_mutex_lock(&vdrm_lock);
+	for (int i = 0; i < VDRM_MAX_LEASES; i++) {
+		struct vdrm_lease *lease = &vdev.leases[i];
+		if (lease->active && lease->lessee_id == lessee_id) {
+			lease->active = false;
+			ret = 0;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&vdrm_lock);
+	return ret;
+}
+
+static int vdrm_ioctl(int fd, unsigned long request, void *arg)
+{
+	(void)fd;
+
+	switch (request) {
+	case DRM_IOCTL_MODE_CREATE_DUMB: {
+		struct drm_mode_create_dumb *create = arg;
+		create->pitch = create->width * ((create->bpp + 7) / 8);
+		create->size = (uint64_t)create->pitch * create->height;
+
+		pthread_mutex_lock(&vdrm_lock);
+		create->handle = ++vdev.next_bo_handle;
+		pthread_mutex_unlock(&vdrm_lock);
+		return 0;
+	}
+	case DRM_IOCTL_MODE_DESTROY_DUMB:
+		return 0;
+	}
+
+	errno = ENOTTY;
+	return -1;
+}
+
+static int vdrm_add_fb(int fd, uint32_t width, uint32_t height, uint8_t depth,
+		       uint8_t bpp, uint32_t pitch, uint32_t bo_handle,
+		       uint32_t *buf_id)
+{
+	(void)fd;
+	(void)width;
+	(void)height;
+	(void)depth;
+	(void)bpp;
+	(void)pitch;
+	(void)bo_handle;
+
+	pthread_mutex_lock(&vdrm_lock);
+	*buf_id = ++vdev.next_fb_id;
+	pthread_mutex_unlock(&vdrm_lock);
+	return 0;
+}
+
+static int vdrm_rm_fb(int fd, uint32_t buffer_id)
+{
+	(void)fd;
+	(void)buffer_id;
+	return 0;
+}
+
+static int vdrm_set_crtc(int fd, uint32_t crtc_id, uint32_t buffer_id,
+			 uint32_t x, uint32_t y, uint32_t *connectors,
+			 int count, drmModeModeInfoPtr mode)
+{
+	(void)fd;
+	(void)x;
+	(void)y;
+	(void)connectors;
+	(void)count;
+	(void)mode;
+
+	int index = find_id(vdev.crtc_ids, vdev.ncrtcs, crtc_id);
+	if (index < 0)
+		return fail(EINVAL);
+
+	pthread_mutex_lock(&vdrm_lock);
+	vdev.crtc_fbs[index] = buffer_id;
+	pthread_mutex_unlock(&vdrm_lock);
+	return 0;
+}
+
+static int vdrm_crtc_queue_sequence(int fd, uint32_t crtc_id, uint32_t flags,
+				    uint64_t sequence,
+				    uint64_t *sequence_queued,
+				    uint64_t user_data)
+{
+	(void)fd;
+
+	if (find_id(vdev.crtc_ids, vdev.ncrtcs, crtc_id) < 0)
+		return fail(EINVAL);
+
+	int ret = 0;
+	pthread_mutex_lock(&vdrm_lock);
+	if (vdev.nevents == VDRM_MAX_EVENTS) {
+		ret = fail(EBUSY);
+		goto out;
+	}
+
+	if (flags & DRM_CRTC_SEQUENCE_RELATIVE)
+		sequence += vdev.vblank_seq;
+
+	vdev.events[vdev.nevents++] = (struct vdrm_event){
+	    .sequence = sequence,
+	    .user_data = user_data,
+	};
+	if (sequence_queued)
+		*sequence_queued = sequence;
+out:
+	pthread_mutex_unlock(&vdrm_lock);
+	return ret;
+}
+
+static int vdrm_handle_event(int fd, drmEventContextPtr evctx)
+{
+	uint64_t expirations = 0;
+	if (read(fd, &expirations, sizeof(expirations)) < 0 &&
+	    errno != EAGAIN)
+		return -1;
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	uint64_t ns = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+	struct vdrm_event due[VDRM_MAX_EVENTS];
+	int ndue = 0;
+
+	pthread_mutex_lock(&vdrm_lock);
+	vdev.vblank_seq += expirations;
+	uint64_t sequence = vdev.vblank_seq;
+
+	for (int i = 0; i < vdev.nevents;) {
+		if (vdev.events[i].sequence <= sequence) {
+			due[ndue++] = vdev.events[i];
+			vdev.events[i] = vdev.events[--vdev.nevents];
+		} else {
+			i++;
+		}
+	}
+	pthread_mutex_unlock(&vdrm_lock);
+
+	/* Handlers may call back into the device */
+	for (int i = 0; i < ndue; i++) {
+		if (evctx->version >= 4 && evctx->sequence_handler)
+			evctx->sequence_handler(fd, sequence, ns,
+						due[i].user_data);
+	}
+	return 0;
+}
+
+/* Objects are freed with free(), whatever their type */
+#define VDRM_FREE_FUNC(object, type)                                           \
+	static void vdrm_free_##object(type ptr) { free(ptr); }
+
+VDRM_FREE_FUNC(resources, drmModeResPtr)
+VDRM_FREE_FUNC(plane_resources, drmModePlaneResPtr)
+VDRM_FREE_FUNC(connector, drmModeConnectorPtr)
+VDRM_FREE_FUNC(encoder, drmModeEncoderPtr)
+VDRM_FREE_FUNC(plane, drmModePlanePtr)
+VDRM_FREE_FUNC(crtc, drmModeCrtcPtr)
+VDRM_FREE_FUNC(object_properties, drmModeObjectPropertiesPtr)
+VDRM_FREE_FUNC(property, drmModePropertyPtr)
+
+const struct drm_backend drm_backend_virtual = {
+    .name = "virtual",
+    .open = vdrm_open,
+    .close = vdrm_close,
+    .get_device_id = vdrm_get_device_id,
+    .set_client_cap = vdrm_set_client_cap,
+    .get_resources = vdrm_get_resources,
+    .free_resources = vdrm_free_resources,
+    .get_plane_resources = vdrm_get_plane_resources,
+    .free_plane_resources = vdrm_free_plane_resources,
+    .get_connector = vdrm_get_connector,
+    .free_connector = vdrm_free_connector,
+    .get_encoder = vdrm_get_encoder,
+    .free_encoder = vdrm_free_encoder,
+    .get_plane = vdrm_get_plane,
+    .free_plane = vdrm_free_plane,
+    .get_crtc = vdrm_get_crtc,
+    .free_crtc = vdrm_free_crtc,
+    .object_get_properties = vdrm_object_get_properties,
+    .free_object_properties = vdrm_free_object_properties,
+    .get_property = vdrm_get_property,
+    .free_property = vdrm_free_property,
+    .create_lease = vdrm_create_lease,
+    .revoke_lease = vdrm_revoke_lease,
+    .ioctl = vdrm_ioctl,
+    .add_fb = vdrm_add_fb,
+    .rm_fb = vdrm_rm_fb,
+    .set_crtc = vdrm_set_crtc,
+    .crtc_queue_sequence = vdrm_crtc_queue_sequence,
+    .handle_event = vdrm_handle_event,
+};
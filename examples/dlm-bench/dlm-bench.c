@@ -0,0 +1,408 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Lease request load generator
+ * Runs a number of concurrent clients, each one repeatedly acquiring and
+ * giving up one of the leases, and reports how long the acquisitions took
+ * and how the lease manager answered. */
+
+#include "clock.h"
+#include "dlmclient.h"
+#include "latency-stats.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum bench_mode {
+	BENCH_RELEASE,	/* dlm_get_lease() / dlm_release_lease() */
+	BENCH_YIELD,	/* dlm_lease_reacquire() / dlm_lease_yield() */
+	BENCH_TRANSFER, /* dlm_get_lease(), keep the lease until revoked */
+};
+
+static const char *const bench_mode_names[] = {
+    [BENCH_RELEASE] = "release",
+    [BENCH_YIELD] = "yield",
+    [BENCH_TRANSFER] = "transfer",
+};
+
+struct bench_config {
+	enum bench_mode mode;
+	int cycles;
+	int hold_us;
+};
+
+struct bench_stats {
+	uint64_t *latency_ns;
+	int acquired;
+	int denied;	 /* EACCES: lease in use */
+	int unavailable; /* ENOENT: no such lease, or no lease manager */
+	int revoked;	 /* taken over by another client */
+	int errors;	 /* anything else */
+	int last_error;
+};
+
+struct bench_client {
+	pthread_t tid;
+	const char *lease_name;
+	const struct bench_config *config;
+	struct bench_stats stats;
+};
+
+static void usage(const char *progname)
+{
+	printf("Usage: %s [OPTIONS] [<lease name>...]\n\n"
+	       "Options:\n"
+	       "-h, --help \tPrint this help\n"
+	       "-c, --clients \t<count> number of concurrent clients "
+	       "(default 4)\n"
+	       "-n, --cycles \t<count> acquisitions per client "
+	       "(default 100)\n"
+	       "-m, --mode \t<mode> release: get and release the lease, "
+	       "yield: yield and reacquire the lease, transfer: keep the "
+	       "lease until another client takes it over "
+	       "(drm-lease-manager -t) (default release)\n"
+	       "-H, --hold \t<us> time to hold each lease (default 1000)\n\n"
+	       "Clients are distributed over the listed leases, or over all "
+	       "leases of the running lease manager.\n",
+	       progname);
+}
+
+static void hold(const struct bench_config *config)
+{
+	struct timespec ts = {
+	    .tv_sec = config->hold_us / 1000000,
+	    .tv_nsec = (config->hold_us % 1000000) * 1000,
+	};
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+		;
+}
+
+static void count_failure(struct bench_stats *stats, int err)
+{
+	switch (err) {
+	case EACCES:
+		stats->denied++;
+		break;
+	case ENOENT:
+		stats->unavailable++;
+		break;
+	default:
+		stats->errors++;
+		stats->last_error = err;
+		break;
+	}
+}
+
+static void count_acquisition(struct bench_stats *stats, uint64_t start_ns)
+{
+	stats->latency_ns[stats->acquired++] = monotonic_ns() - start_ns;
+}
+
+/* Returns true if the lease has been taken over by another client */
+static bool check_revoked(struct dlm_lease *lease)
+{
+	dlm_lease_dispatch(lease);
+	return dlm_lease_is_revoked(lease);
+}
+
+static void run_get_release(struct bench_client *client)
+{
+	const struct bench_config *config = client->config;
+	struct bench_stats *stats = &client->stats;
+	struct dlm_lease *lease = NULL;
+
+	for (int i = 0; i < config->cycles; i++) {
+		uint64_t start_ns = monotonic_ns();
+		struct dlm_lease *new_lease = dlm_get_lease(client->lease_name);
+		if (!new_lease) {
+			count_failure(stats, errno);
+			hold(config);
+			continue;
+		}
+		count_acquisition(stats, start_ns);
+
+		/* In transfer mode, the previous lease is only given up
+		 * after the new one has been granted */
+		if (lease) {
+			if (check_revoked(lease))
+				stats->revoked++;
+			dlm_release_lease(lease);
+		}
+		lease = new_lease;
+
+		hold(config);
+
+		if (config->mode == BENCH_RELEASE) {
+			if (check_revoked(lease))
+				stats->revoked++;
+			dlm_release_lease(lease);
+			lease = NULL;
+		}
+	}
+
+	if (lease)
+		dlm_release_lease(lease);
+}
+
+static void run_yield_reacquire(struct bench_client *client)
+{
+	const struct bench_config *config = client->config;
+	struct bench_stats *stats = &client->stats;
+	struct dlm_lease *lease = NULL;
+
+	for (int i = 0; i < config->cycles; i++) {
+		uint64_t start_ns = monotonic_ns();
+		int ret;
+
+		if (!lease) {
+			lease = dlm_get_lease(client->lease_name);
+			ret = lease ? 0 : -1;
+		} else {
+			ret = dlm_lease_reacquire(lease);
+		}
+
+		if (ret < 0) {
+			count_failure(stats, errno);
+			hold(config);
+			continue;
+		}
+		count_acquisition(stats, start_ns);
+
+		hold(config);
+
+		if (check_revoked(lease))
+			stats->revoked++;
+		dlm_lease_yield(lease);
+	}
+
+	if (lease)
+		dlm_release_lease(lease);
+}
+
+static void *client_thread(void *arg)
+{
+	struct bench_client *client = arg;
+
+	if (client->config->mode == BENCH_YIELD)
+		run_yield_reacquire(client);
+	else
+		run_get_release(client);
+	return NULL;
+}
+
+static void print_report(struct bench_client *clients, int nclients,
+			 uint64_t elapsed_ns)
+{
+	struct bench_stats total = {0};
+	int capacity = nclients * clients[0].config->cycles;
+
+	total.latency_ns = calloc(capacity, sizeof(uint64_t));
+	if (!total.latency_ns) {
+		perror("calloc");
+		return;
+	}
+
+	for (int i = 0; i < nclients; i++) {
+		struct bench_stats *s = &clients[i].stats;
+		memcpy(&total.latency_ns[total.acquired], s->latency_ns,
+		       s->acquired * sizeof(uint64_t));
+		total.acquired += s->acquired;
+		total.denied += s->denied;
+		total.unavailable += s->unavailable;
+		total.revoked += s->revoked;
+		total.errors += s->errors;
+		if (s->errors)
+			total.last_error = s->last_error;
+	}
+
+	struct latency_stats stats;
+	latency_stats_compute(total.latency_ns, total.acquired, &stats);
+
+	printf("acquired    %8d\n", total.acquired);
+	printf("denied      %8d\n", total.denied);
+	printf("unavailable %8d\n", total.unavailable);
+	printf("revoked     %8d\n", total.revoked);
+	printf("errors      %8d", total.errors);
+	if (total.errors)
+		printf(" (last: %s)", strerror(total.last_error));
+	printf("\n\n");
+
+	printf("throughput  %10.1f acquisitions/s\n",
+	       total.acquired / (elapsed_ns / 1e9));
+	printf("latency us  p50 %.1f  p99 %.1f  max %.1f\n", stats.p50_us,
+	       stats.p99_us, stats.max_us);
+
+	free(total.latency_ns);
+}
+
+/* All leases of the running lease manager, from its status page */
+static int get_all_leases(char ***names)
+{
+	struct dlm_status *status = dlm_status_open();
+	if (!status) {
+		fprintf(stderr, "Cannot open lease manager status: %s\n",
+			strerror(errno));
+		return -1;
+	}
+
+	int count = dlm_status_lease_count(status);
+	*names = calloc(count, sizeof(char *));
+
+	for (int i = 0; *names && i < count; i++) {
+		struct dlm_lease_status lease_status;
+		if (dlm_status_read(status, i, &lease_status) < 0 ||
+		    !((*names)[i] = strdup(lease_status.name))) {
+			count = i;
+			break;
+		}
+	}
+
+	dlm_status_close(status);
+	return *names ? count : -1;
+}
+
+static bool parse_mode(const char *name, enum bench_mode *mode)
+{
+	for (int i = 0; i <= BENCH_TRANSFER; i++) {
+		if (!strcmp(name, bench_mode_names[i])) {
+			*mode = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *opts = "hc:n:m:H:";
+const struct option options[] = {
+    {"help", no_argument, NULL, 'h'},
+    {"clients", required_argument, NULL, 'c'},
+    {"cycles", required_argument, NULL, 'n'},
+    {"mode", required_argument, NULL, 'm'},
+    {"hold", required_argument, NULL, 'H'},
+    {NULL, 0, NULL, 0},
+};
+
+int main(int argc, char **argv)
+{
+	struct bench_config config = {
+	    .mode = BENCH_RELEASE,
+	    .cycles = 100,
+	    .hold_us = 1000,
+	};
+	int nclients = 4;
+
+	int c;
+	while ((c = getopt_long(argc, argv, opts, options, NULL)) != -1) {
+		int ret = EXIT_FAILURE;
+		switch (c) {
+		case 'c':
+			nclients = atoi(optarg);
+			break;
+		case 'n':
+			config.cycles = atoi(optarg);
+			break;
+		case 'm':
+			if (!parse_mode(optarg, &config.mode)) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'H':
+			config.hold_us = atoi(optarg);
+			break;
+		case 'h':
+			ret = EXIT_SUCCESS;
+			/* fall through */
+		default:
+			usage(argv[0]);
+			return ret;
+		}
+	}
+
+	if (nclients <= 0 || config.cycles <= 0 || config.hold_us < 0) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	char **lease_names = &argv[optind];
+	int nleases = argc - optind;
+	bool own_names = nleases == 0;
+
+	if (own_names) {
+		nleases = get_all_leases(&lease_names);
+		if (nleases <= 0) {
+			fprintf(stderr, "No leases to benchmark\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	struct bench_client *clients =
+	    calloc(nclients, sizeof(struct bench_client));
+	if (!clients) {
+		perror("calloc");
+		return EXIT_FAILURE;
+	}
+
+	printf("%d clients, %d leases, %s mode, %d cycles per client\n\n",
+	       nclients, nleases, bench_mode_names[config.mode],
+	       config.cycles);
+
+	int started = 0;
+	uint64_t start_ns = monotonic_ns();
+
+	for (; started < nclients; started++) {
+		struct bench_client *client = &clients[started];
+		client->config = &config;
+		client->lease_name = lease_names[started % nleases];
+		client->stats.latency_ns =
+		    calloc(config.cycles, sizeof(uint64_t));
+
+		if (!client->stats.latency_ns ||
+		    pthread_create(&client->tid, NULL, client_thread, client)) {
+			fprintf(stderr, "Cannot start client %d\n", started);
+			free(client->stats.latency_ns);
+			break;
+		}
+	}
+
+	for (int i = 0; i < started; i++)
+		pthread_join(clients[i].tid, NULL);
+
+	uint64_t elapsed_ns = monotonic_ns() - start_ns;
+
+	int errors = started < nclients;
+	if (started) {
+		print_report(clients, started, elapsed_ns);
+		for (int i = 0; i < started; i++)
+			errors += clients[i].stats.errors;
+	}
+
+	for (int i = 0; i < started; i++)
+		free(clients[i].stats.latency_ns);
+	free(clients);
+
+	if (own_names) {
+		for (int i = 0; i < nleases; i++)
+			free(lease_names[i]);
+		free(lease_names);
+	}
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,406 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Time-to-first-frame probe
+ * Requests a lease, shows a (black) frame on it with an atomic commit, and
+ * reports how long each step took until the frame was on screen:
+ *
+ *   lease request  dlm_get_lease() until the lease fd is received
+ *   client setup   finding the leased objects, creating a framebuffer
+ *   atomic commit  the commit ioctl
+ *   first flip     until the vblank at which the frame was shown
+ *   flip event     until the flip event was received by the client */
+
+#include "clock.h"
+#include "dlmclient.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+enum probe_step {
+	STEP_START,
+	STEP_LEASE_FD,
+	STEP_SETUP_DONE,
+	STEP_COMMIT_DONE,
+	STEP_FLIP,
+	STEP_FLIP_EVENT,
+	NUM_STEPS,
+};
+
+static const char *const step_names[] = {
+    [STEP_LEASE_FD] = "lease request",
+    [STEP_SETUP_DONE] = "client setup",
+    [STEP_COMMIT_DONE] = "atomic commit",
+    [STEP_FLIP] = "first flip",
+    [STEP_FLIP_EVENT] = "flip event",
+};
+
+struct probe {
+	struct dlm_lease *lease;
+	int fd;
+
+	uint32_t crtc_id;
+	uint32_t connector_id;
+	uint32_t plane_id;
+	drmModeModeInfo mode;
+
+	uint32_t bo_handle;
+	uint32_t fb_id;
+	uint32_t mode_blob_id;
+
+	bool flipped;
+	uint64_t ns[NUM_STEPS];
+};
+
+static void usage(const char *progname)
+{
+	printf("Usage: %s [OPTIONS] <lease name>\n\n"
+	       "Options:\n"
+	       "-h, --help \tPrint this help\n"
+	       "-t, --timeout \t<ms> time to wait for the first flip "
+	       "(default 1000)\n",
+	       progname);
+}
+
+/* Use the lease topology sent by the lease manager if there is one,
+ * otherwise ask the kernel */
+static uint32_t get_property_id(struct probe *p, uint32_t object_id,
+				uint32_t object_type, const char *name)
+{
+	uint32_t prop_id = dlm_lease_property_id(p->lease, object_id, name);
+	if (prop_id)
+		return prop_id;
+
+	drmModeObjectPropertiesPtr props =
+	    drmModeObjectGetProperties(p->fd, object_id, object_type);
+	if (!props)
+		return 0;
+
+	for (uint32_t i = 0; i < props->count_props && !prop_id; i++) {
+		drmModePropertyPtr prop =
+		    drmModeGetProperty(p->fd, props->props[i]);
+		if (prop && !strcmp(prop->name, name))
+			prop_id = prop->prop_id;
+		drmModeFreeProperty(prop);
+	}
+	drmModeFreeObjectProperties(props);
+	return prop_id;
+}
+
+static bool is_primary_plane(struct probe *p, uint32_t plane_id)
+{
+	drmModeObjectPropertiesPtr props =
+	    drmModeObjectGetProperties(p->fd, plane_id, DRM_MODE_OBJECT_PLANE);
+	if (!props)
+		return false;
+
+	uint32_t type_id =
+	    get_property_id(p, plane_id, DRM_MODE_OBJECT_PLANE, "type");
+	bool primary = false;
+
+	for (uint32_t i = 0; i < props->count_props; i++) {
+		if (props->props[i] == type_id)
+			primary =
+			    props->prop_values[i] == DRM_PLANE_TYPE_PRIMARY;
+	}
+	drmModeFreeObjectProperties(props);
+	return primary;
+}
+
+static bool find_objects(struct probe *p)
+{
+	drmModeResPtr res = drmModeGetResources(p->fd);
+	drmModePlaneResPtr plane_res = drmModeGetPlaneResources(p->fd);
+	bool ok = false;
+
+	if (dlm_lease_object_count(p->lease, DLM_OBJECT_CRTC) > 0) {
+		p->crtc_id = dlm_lease_object_id(p->lease, DLM_OBJECT_CRTC, 0);
+		p->connector_id =
+		    dlm_lease_object_id(p->lease, DLM_OBJECT_CONNECTOR, 0);
+	} else if (res && res->count_crtcs > 0 && res->count_connectors > 0) {
+		p->crtc_id = res->crtcs[0];
+		p->connector_id = res->connectors[0];
+	}
+
+	for (uint32_t i = 0; plane_res && i < plane_res->count_planes; i++) {
+		if (is_primary_plane(p, plane_res->planes[i])) {
+			p->plane_id = plane_res->planes[i];
+			break;
+		}
+	}
+
+	if (!p->crtc_id || !p->connector_id || !p->plane_id) {
+		fprintf(stderr, "Lease has no CRTC, connector or primary "
+				"plane\n");
+		goto out;
+	}
+
+	/* Keep the current mode, if any, to avoid a full modeset */
+	drmModeCrtcPtr crtc = drmModeGetCrtc(p->fd, p->crtc_id);
+	if (crtc && crtc->mode_valid) {
+		p->mode = crtc->mode;
+		ok = true;
+	}
+	drmModeFreeCrtc(crtc);
+
+	/* Without probing, the lease manager has already done that */
+	drmModeConnectorPtr connector =
+	    drmModeGetConnectorCurrent(p->fd, p->connector_id);
+	if (!ok && connector && connector->count_modes > 0) {
+		p->mode = connector->modes[0];
+		for (int i = 0; i < connector->count_modes; i++) {
+			drmModeModeInfo *mode = &connector->modes[i];
+			if (mode->type & DRM_MODE_TYPE_PREFERRED) {
+				p->mode = *mode;
+				break;
+			}
+		}
+		ok = true;
+	}
+	drmModeFreeConnector(connector);
+
+	if (!ok)
+		fprintf(stderr, "No mode available on connector %u\n",
+			p->connector_id);
+out:
+	drmModeFreePlaneResources(plane_res);
+	drmModeFreeResources(res);
+	return ok;
+}
+
+static bool create_framebuffer(struct probe *p)
+{
+	struct drm_mode_create_dumb create = {
+	    .width = p->mode.hdisplay,
+	    .height = p->mode.vdisplay,
+	    .bpp = 32,
+	};
+
+	if (drmIoctl(p->fd, DRM_IOCTL_MODE_CREATE_DUMB, &create) < 0) {
+		perror("DRM_IOCTL_MODE_CREATE_DUMB");
+		return false;
+	}
+	p->bo_handle = create.handle;
+
+	if (drmModeAddFB(p->fd, create.width, create.height, 24, 32,
+			 create.pitch, create.handle, &p->fb_id) < 0) {
+		perror("drmModeAddFB");
+		return false;
+	}
+
+	if (drmModeCreatePropertyBlob(p->fd, &p->mode, sizeof(p->mode),
+				      &p->mode_blob_id) < 0) {
+		perror("drmModeCreatePropertyBlob");
+		return false;
+	}
+	return true;
+}
+
+static bool add_property(struct probe *p, drmModeAtomicReqPtr req,
+			 uint32_t object_id, uint32_t object_type,
+			 const char *name, uint64_t value)
+{
+	uint32_t prop_id = get_property_id(p, object_id, object_type, name);
+	if (!prop_id) {
+		fprintf(stderr, "Object %u has no %s property\n", object_id,
+			name);
+		return false;
+	}
+	return drmModeAtomicAddProperty(req, object_id, prop_id, value) >= 0;
+}
+
+static bool commit_frame(struct probe *p)
+{
+	drmModeAtomicReqPtr req = drmModeAtomicAlloc();
+	if (!req)
+		return false;
+
+	uint64_t w = p->mode.hdisplay, h = p->mode.vdisplay;
+	uint32_t crtc = DRM_MODE_OBJECT_CRTC, plane = DRM_MODE_OBJECT_PLANE;
+	bool ok =
+	    add_property(p, req, p->connector_id, DRM_MODE_OBJECT_CONNECTOR,
+			 "CRTC_ID", p->crtc_id) &&
+	    add_property(p, req, p->crtc_id, crtc, "MODE_ID",
+			 p->mode_blob_id) &&
+	    add_property(p, req, p->crtc_id, crtc, "ACTIVE", 1) &&
+	    add_property(p, req, p->plane_id, plane, "FB_ID", p->fb_id) &&
+	    add_property(p, req, p->plane_id, plane, "CRTC_ID", p->crtc_id) &&
+	    add_property(p, req, p->plane_id, plane, "SRC_X", 0) &&
+	    add_property(p, req, p->plane_id, plane, "SRC_Y", 0) &&
+	    add_property(p, req, p->plane_id, plane, "SRC_W", w << 16) &&
+	    add_property(p, req, p->plane_id, plane, "SRC_H", h << 16) &&
+	    add_property(p, req, p->plane_id, plane, "CRTC_X", 0) &&
+	    add_property(p, req, p->plane_id, plane, "CRTC_Y", 0) &&
+	    add_property(p, req, p->plane_id, plane, "CRTC_W", w) &&
+	    add_property(p, req, p->plane_id, plane, "CRTC_H", h);
+
+	uint32_t flags = DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT |
+			 DRM_MODE_ATOMIC_ALLOW_MODESET;
+
+	if (ok && drmModeAtomicCommit(p->fd, req, flags, p) < 0) {
+		perror("drmModeAtomicCommit");
+		ok = false;
+	}
+	drmModeAtomicFree(req);
+	return ok;
+}
+
+static void handle_flip(int fd, unsigned int sequence, unsigned int tv_sec,
+			unsigned int tv_usec, unsigned int crtc_id,
+			void *user_data)
+{
+	struct probe *p = user_data;
+	(void)fd;
+	(void)sequence;
+	(void)crtc_id;
+
+	/* vblank timestamps are CLOCK_MONOTONIC */
+	p->ns[STEP_FLIP] = (uint64_t)tv_sec * 1000000000 + tv_usec * 1000;
+	p->ns[STEP_FLIP_EVENT] = monotonic_ns();
+	p->flipped = true;
+}
+
+static bool wait_for_flip(struct probe *p, int timeout_ms)
+{
+	drmEventContext ctx = {
+	    .version = DRM_EVENT_CONTEXT_VERSION,
+	    .page_flip_handler2 = handle_flip,
+	};
+	struct pollfd pfd = {.fd = p->fd, .events = POLLIN};
+
+	while (!p->flipped) {
+		int ret = poll(&pfd, 1, timeout_ms);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0) {
+			fprintf(stderr, "No flip event within %d ms\n",
+				timeout_ms);
+			return false;
+		}
+		drmHandleEvent(p->fd, &ctx);
+	}
+	return true;
+}
+
+static void print_report(const struct probe *p, const char *lease_name)
+{
+	printf("lease %s: crtc %u, connector %u, plane %u, %dx%d@%d\n\n",
+	       lease_name, p->crtc_id, p->connector_id, p->plane_id,
+	       p->mode.hdisplay, p->mode.vdisplay, p->mode.vrefresh);
+	printf("%-14s %10s %10s\n", "step", "ms", "total ms");
+
+	for (int i = STEP_LEASE_FD; i < NUM_STEPS; i++) {
+		/* Signed, in case the vblank timestamp is earlier than the
+		 * end of the commit ioctl */
+		int64_t step_ns = p->ns[i] - p->ns[i - 1];
+		int64_t total_ns = p->ns[i] - p->ns[STEP_START];
+		printf("%-14s %10.3f %10.3f\n", step_names[i], step_ns / 1e6,
+		       total_ns / 1e6);
+	}
+
+	printf("\nmanager %.3f ms, client %.3f ms, kernel %.3f ms\n",
+	       (p->ns[STEP_LEASE_FD] - p->ns[STEP_START]) / 1e6,
+	       (p->ns[STEP_SETUP_DONE] - p->ns[STEP_LEASE_FD]) / 1e6,
+	       ((int64_t)p->ns[STEP_FLIP] - (int64_t)p->ns[STEP_SETUP_DONE]) /
+		   1e6);
+}
+
+static void probe_cleanup(struct probe *p)
+{
+	if (p->mode_blob_id)
+		drmModeDestroyPropertyBlob(p->fd, p->mode_blob_id);
+	if (p->fb_id)
+		drmModeRmFB(p->fd, p->fb_id);
+	if (p->bo_handle) {
+		struct drm_mode_destroy_dumb destroy = {
+		    .handle = p->bo_handle,
+		};
+		drmIoctl(p->fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+	}
+	dlm_release_lease(p->lease);
+}
+
+const char *opts = "ht:";
+const struct option options[] = {
+    {"help", no_argument, NULL, 'h'},
+    {"timeout", required_argument, NULL, 't'},
+    {NULL, 0, NULL, 0},
+};
+
+int main(int argc, char **argv)
+{
+	int timeout_ms = 1000;
+
+	int c;
+	while ((c = getopt_long(argc, argv, opts, options, NULL)) != -1) {
+		int ret = EXIT_FAILURE;
+		switch (c) {
+		case 't':
+			timeout_ms = atoi(optarg);
+			break;
+		case 'h':
+			ret = EXIT_SUCCESS;
+			/* fall through */
+		default:
+			usage(argv[0]);
+			return ret;
+		}
+	}
+
+	if (optind >= argc) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const char *lease_name = argv[optind];
+	struct probe p = {0};
+
+	p.ns[STEP_START] = monotonic_ns();
+	p.lease = dlm_get_lease(lease_name);
+	if (!p.lease) {
+		fprintf(stderr, "dlm_get_lease: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+	p.fd = dlm_lease_fd(p.lease);
+	p.ns[STEP_LEASE_FD] = monotonic_ns();
+
+	bool ok = drmSetClientCap(p.fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) ==
+			  0 &&
+		  drmSetClientCap(p.fd, DRM_CLIENT_CAP_ATOMIC, 1) == 0;
+	if (!ok)
+		fprintf(stderr, "Atomic modesetting not supported\n");
+
+	ok = ok && find_objects(&p) && create_framebuffer(&p);
+	p.ns[STEP_SETUP_DONE] = monotonic_ns();
+
+	ok = ok && commit_frame(&p);
+	p.ns[STEP_COMMIT_DONE] = monotonic_ns();
+
+	ok = ok && wait_for_flip(&p, timeout_ms);
+	if (ok)
+		print_report(&p, lease_name);
+
+	probe_cleanup(&p);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
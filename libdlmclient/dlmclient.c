@@ -16,53 +16,117 @@
 #include "dlmclient.h"
 
 #include "dlm-protocol.h"
+#include "dlm-status.h"
+#include "dlm-topology.h"
 #include "log.h"
 #include "socket-path.h"
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
+/* Retry interval for connection attempts during recovery when the socket
+ * exists, but the lease manager is not yet accepting connections. */
+#define RECOVERY_RETRY_INTERVAL_MS 10
+
+/* Attempts to read a consistent lease status entry */
+#define STATUS_READ_RETRIES 10000
+
 void dlm_enable_debug_log(bool enable)
 {
 	dlm_log_enable_debug(enable);
 }
 
 struct dlm_lease {
+	char *name;
 	int dlm_server_sock;
 	int lease_fd;
+
+	struct dlm_topology_header *topology;
+
+	bool is_revoked;
+	dlm_revoke_handler revoke_handler;
+	void *revoke_data;
+
+	dlm_available_handler available_handler;
+	void *available_data;
+
+	int recovery_timeout_ms;
+	dlm_recovery_handler recovery_handler;
+	void *recovery_data;
 };
 
-static bool lease_connect(struct dlm_lease *lease, const char *name)
+static int socket_connect(const char *name, int sock_flags)
 {
 	struct sockaddr_un sa = {
 	    .sun_family = AF_UNIX,
 	};
 
 	if (!sockaddr_set_lease_server_path(&sa, name))
-		return false;
+		return -1;
 
-	int dlm_server_sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	int dlm_server_sock = socket(AF_UNIX, SOCK_SEQPACKET | sock_flags, 0);
 	if (dlm_server_sock < 0) {
 		DEBUG_LOG("Socket creation failed: %s\n", strerror(errno));
-		return false;
+		return -1;
 	}
 
 	while (connect(dlm_server_sock, (struct sockaddr *)&sa,
-		       sizeof(struct sockaddr_un)) == -1) {
+		       sockaddr_len(&sa)) == -1) {
 		if (errno == EINTR)
 			continue;
-		DEBUG_LOG("Cannot connect to %s: %s\n", sa.sun_path,
+		int saved_errno = errno;
+		DEBUG_LOG("Cannot connect to %s: %s\n", sockaddr_name(&sa),
 			  strerror(errno));
 		close(dlm_server_sock);
-		return false;
+
+		/* There is no socket file to be missing in the abstract
+		 * namespace, so connecting to a name that nobody is
+		 * listening on is refused instead */
+		if (saved_errno == ECONNREFUSED && sockaddr_is_abstract(&sa))
+			saved_errno = ENOENT;
+		errno = saved_errno;
+		return -1;
+	}
+
+	if (sock_flags & SOCK_NONBLOCK) {
+		int flags = fcntl(dlm_server_sock, F_GETFL);
+		fcntl(dlm_server_sock, F_SETFL, flags & ~O_NONBLOCK);
 	}
+	return dlm_server_sock;
+}
+
+static bool lease_connect(struct dlm_lease *lease, const char *name,
+			  int sock_flags)
+{
+	int dlm_server_sock = socket_connect(name, sock_flags);
+
+	/* If there is no socket for this lease, the lease manager may still
+	 * provide it through the control socket. */
+	if (dlm_server_sock < 0 && errno == ENOENT) {
+		dlm_server_sock =
+		    socket_connect(DLM_CONTROL_SOCKET_NAME, sock_flags);
+		if (dlm_server_sock < 0 && errno != ENAMETOOLONG)
+			errno = ENOENT;
+	}
+
+	if (dlm_server_sock < 0)
+		return false;
+
 	lease->dlm_server_sock = dlm_server_sock;
 	return true;
 }
@@ -73,6 +137,15 @@ static bool lease_send_request(struct dlm_lease *lease, enum dlm_opcode opcode)
 	    .opcode = opcode,
 	};
 
+	/* Only needed by the control socket, but always sent, so that the
+	 * request is the same whichever socket is used */
+	strncpy(request.lease_name, lease->name,
+		sizeof(request.lease_name) - 1);
+
+	/* The topology doesn't change, so only ask for it once */
+	if (opcode == DLM_GET_LEASE && !lease->topology)
+		request.flags |= DLM_REQUEST_TOPOLOGY;
+
 	if (!send_dlm_client_request(lease->dlm_server_sock, &request)) {
 		DEBUG_LOG("Socket data send error: %s\n", strerror(errno));
 		return false;
@@ -80,13 +153,104 @@ static bool lease_send_request(struct dlm_lease *lease, enum dlm_opcode opcode)
 	return true;
 }
 
+static struct dlm_topology_object *
+topology_objects(struct dlm_topology_header *topology)
+{
+	return (struct dlm_topology_object *)(topology + 1);
+}
+
+static struct dlm_topology_prop *
+topology_props(struct dlm_topology_header *topology)
+{
+	return (struct dlm_topology_prop *)(topology_objects(topology) +
+					    topology->nobjects);
+}
+
+static bool topology_is_valid(struct dlm_topology_header *topology,
+			      size_t size)
+{
+	if (size < sizeof(*topology) || topology->size != size ||
+	    topology->magic != DLM_TOPOLOGY_MAGIC ||
+	    topology->version != DLM_TOPOLOGY_VERSION)
+		return false;
+
+	size_t avail = size - sizeof(*topology);
+	if (topology->nobjects > avail / sizeof(struct dlm_topology_object))
+		return false;
+
+	avail -= topology->nobjects * sizeof(struct dlm_topology_object);
+	if (topology->nprops != avail / sizeof(struct dlm_topology_prop) ||
+	    avail % sizeof(struct dlm_topology_prop))
+		return false;
+
+	struct dlm_topology_object *objects = topology_objects(topology);
+	for (uint32_t i = 0; i < topology->nobjects; i++) {
+		struct dlm_topology_object *obj = &objects[i];
+		if (obj->first_prop > topology->nprops ||
+		    obj->nprops > topology->nprops - obj->first_prop)
+			return false;
+		obj->name[sizeof(obj->name) - 1] = '\0';
+	}
+
+	struct dlm_topology_prop *props = topology_props(topology);
+	for (uint32_t i = 0; i < topology->nprops; i++)
+		props[i].name[sizeof(props[i].name) - 1] = '\0';
+
+	return true;
+}
+
+static void lease_map_topology(struct dlm_lease *lease, int topology_fd)
+{
+	struct stat st;
+	if (fstat(topology_fd, &st) < 0) {
+		DEBUG_LOG("Can't read lease topology: %s\n", strerror(errno));
+		return;
+	}
+
+	/* Map privately so that the names can be safely terminated during
+	 * validation. Pages are only copied if they are modified. */
+	void *topology = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+			      MAP_PRIVATE, topology_fd, 0);
+	if (topology == MAP_FAILED) {
+		DEBUG_LOG("Can't map lease topology: %s\n", strerror(errno));
+		return;
+	}
+
+	if (!topology_is_valid(topology, st.st_size)) {
+		DEBUG_LOG("Invalid lease topology received\n");
+		munmap(topology, st.st_size);
+		return;
+	}
+	lease->topology = topology;
+}
+
+static void lease_unmap_topology(struct dlm_lease *lease)
+{
+	if (!lease->topology)
+		return;
+
+	munmap(lease->topology, lease->topology->size);
+	lease->topology = NULL;
+}
+
 static bool lease_recv_fd(struct dlm_lease *lease)
 {
-	lease->lease_fd = receive_lease_fd(lease->dlm_server_sock);
+	int topology_fd;
+	int lease_fd = receive_lease_fd(lease->dlm_server_sock, &topology_fd);
 
-	if (lease->lease_fd < 0)
+	if (lease_fd < 0)
 		goto err;
 
+	/* A revoked lease fd is kept open until it has been replaced */
+	if (lease->lease_fd >= 0)
+		close(lease->lease_fd);
+	lease->lease_fd = lease_fd;
+
+	if (topology_fd >= 0) {
+		lease_map_topology(lease, topology_fd);
+		close(topology_fd);
+	}
+
 	return true;
 
 err:
@@ -114,11 +278,17 @@ struct dlm_lease *dlm_get_lease(const char *name)
 		return NULL;
 	}
 
-	if (!lease_connect(lease, name)) {
+	lease->lease_fd = -1;
+	lease->name = strdup(name);
+	if (!lease->name) {
+		DEBUG_LOG("can't allocate memory : %s\n", strerror(errno));
 		free(lease);
 		return NULL;
 	}
 
+	if (!lease_connect(lease, name, 0))
+		goto err_connect;
+
 	if (!lease_send_request(lease, DLM_GET_LEASE))
 		goto err_request;
 
@@ -133,6 +303,8 @@ err:
 	errno = saved_errno;
 err_request:
 	close(lease->dlm_server_sock);
+err_connect:
+	free(lease->name);
 	free(lease);
 	return NULL;
 }
@@ -142,10 +314,78 @@ void dlm_release_lease(struct dlm_lease *lease)
 	if (!lease)
 		return;
 
-	lease_send_request(lease, DLM_RELEASE_LEASE);
+	/* The lease manager has already dropped the connection to a revoked
+	 * lease, so there is no one to send the release to */
+	if (!lease->is_revoked && lease->dlm_server_sock >= 0)
+		lease_send_request(lease, DLM_RELEASE_LEASE);
+	lease_unmap_topology(lease);
+	if (lease->lease_fd >= 0)
+		close(lease->lease_fd);
+	if (lease->dlm_server_sock >= 0)
+		close(lease->dlm_server_sock);
+	free(lease->name);
+	free(lease);
+}
+
+int dlm_lease_yield(struct dlm_lease *lease)
+{
+	if (!lease) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (lease->lease_fd < 0)
+		return 0;
+
+	/* Even if the request can't be sent, the lease fd is no longer
+	 * usable, so it is safe to close it in either case */
+	bool sent = lease->is_revoked ||
+		    lease_send_request(lease, DLM_YIELD_LEASE);
+
 	close(lease->lease_fd);
+	lease->lease_fd = -1;
+
+	return sent ? 0 : -1;
+}
+
+static bool lease_reconnect(struct dlm_lease *lease)
+{
 	close(lease->dlm_server_sock);
-	free(lease);
+	lease->dlm_server_sock = -1;
+
+	if (!lease_connect(lease, lease->name, 0))
+		return false;
+
+	lease->is_revoked = false;
+	return lease_send_request(lease, DLM_GET_LEASE);
+}
+
+int dlm_lease_reacquire(struct dlm_lease *lease)
+{
+	if (!lease) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!lease->is_revoked && lease->lease_fd >= 0)
+		return 0;
+
+	/* Use the existing connection if the lease manager is still holding
+	 * it open.  Otherwise, fall back to a full reconnect. */
+	bool sent = false;
+	if (!lease->is_revoked && lease->dlm_server_sock >= 0)
+		sent = lease_send_request(lease, DLM_GET_LEASE);
+
+	if (!sent && !lease_reconnect(lease))
+		return -1;
+
+	if (!lease_recv_fd(lease)) {
+		/* The lease manager closes the connection on rejection */
+		lease->is_revoked = true;
+		return -1;
+	}
+	lease->is_revoked = false;
+	return 0;
 }
 
 int dlm_lease_fd(struct dlm_lease *lease)
@@ -155,3 +395,507 @@ int dlm_lease_fd(struct dlm_lease *lease)
 
 	return lease->lease_fd;
 }
+
+int dlm_lease_event_fd(struct dlm_lease *lease)
+{
+	if (!lease)
+		return -1;
+
+	return lease->dlm_server_sock;
+}
+
+void dlm_lease_set_revoke_handler(struct dlm_lease *lease,
+				  dlm_revoke_handler handler, void *data)
+{
+	if (!lease)
+		return;
+
+	lease->revoke_handler = handler;
+	lease->revoke_data = data;
+}
+
+void dlm_lease_set_available_handler(struct dlm_lease *lease,
+				     dlm_available_handler handler, void *data)
+{
+	if (!lease)
+		return;
+
+	lease->available_handler = handler;
+	lease->available_data = data;
+}
+
+static void lease_revoked(struct dlm_lease *lease)
+{
+	if (lease->is_revoked)
+		return;
+
+	DEBUG_LOG("Lease revoked by DRM lease manager\n");
+	lease->is_revoked = true;
+
+	if (lease->revoke_handler)
+		lease->revoke_handler(lease, lease->revoke_data);
+}
+
+int dlm_lease_enable_recovery(struct dlm_lease *lease, int timeout_ms,
+			      dlm_recovery_handler handler, void *data)
+{
+	if (!lease || timeout_ms < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	lease->recovery_timeout_ms = timeout_ms;
+	lease->recovery_handler = handler;
+	lease->recovery_data = data;
+	return 0;
+}
+
+static int64_t time_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Watch the runtime directory, so that a restarted lease manager is
+ * noticed as soon as it recreates the lease socket. */
+static int watch_socket_dir(const char *name)
+{
+	struct sockaddr_un sa;
+	if (!sockaddr_set_lease_server_path(&sa, name))
+		return -1;
+
+	/* Nothing to watch in the abstract namespace */
+	if (sockaddr_is_abstract(&sa))
+		return -1;
+
+	char *sep = strrchr(sa.sun_path, '/');
+	if (!sep)
+		return -1;
+	*sep = '\0';
+
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (inotify_add_watch(fd, sa.sun_path, IN_CREATE | IN_MOVED_TO) < 0) {
+		DEBUG_LOG("Cannot watch %s: %s\n", sa.sun_path,
+			  strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static bool lease_wait_and_connect(struct dlm_lease *lease, int64_t deadline)
+{
+	int watch_fd = watch_socket_dir(lease->name);
+
+	/* Don't block on a lease manager that isn't accepting connections */
+	while (!lease_connect(lease, lease->name, SOCK_NONBLOCK)) {
+		int remaining = deadline - time_ms();
+		if (remaining <= 0) {
+			errno = ETIMEDOUT;
+			break;
+		}
+
+		/* Without a directory watch, or if the socket exists but
+		 * isn't listening yet, fall back to polling */
+		int timeout = remaining;
+		if ((watch_fd < 0 || errno != ENOENT) &&
+		    timeout > RECOVERY_RETRY_INTERVAL_MS)
+			timeout = RECOVERY_RETRY_INTERVAL_MS;
+
+		struct pollfd pfd = {.fd = watch_fd, .events = POLLIN};
+		if (poll(&pfd, 1, timeout) > 0) {
+			char buf[4096];
+			while (read(watch_fd, buf, sizeof(buf)) > 0)
+				;
+		}
+	}
+
+	int saved_errno = errno;
+	if (watch_fd >= 0)
+		close(watch_fd);
+	errno = saved_errno;
+
+	return lease->dlm_server_sock >= 0;
+}
+
+static bool lease_recv_fd_timeout(struct dlm_lease *lease, int64_t timeout_ms)
+{
+	if (timeout_ms <= 0) {
+		errno = ETIMEDOUT;
+		return false;
+	}
+
+	struct timeval tv = {
+	    .tv_sec = timeout_ms / 1000,
+	    .tv_usec = (timeout_ms % 1000) * 1000,
+	};
+	setsockopt(lease->dlm_server_sock, SOL_SOCKET, SO_RCVTIMEO, &tv,
+		   sizeof(tv));
+
+	bool ret = lease_recv_fd(lease);
+	int saved_errno = errno;
+
+	tv = (struct timeval){0};
+	setsockopt(lease->dlm_server_sock, SOL_SOCKET, SO_RCVTIMEO, &tv,
+		   sizeof(tv));
+
+	errno = saved_errno;
+	return ret;
+}
+
+/* The lease manager has gone away without revoking the lease, which means
+ * that it has crashed or been restarted.  The old lease fd is useless, so
+ * wait for the lease manager to come back, and request the lease again. */
+static bool lease_recover(struct dlm_lease *lease)
+{
+	int64_t deadline = time_ms() + lease->recovery_timeout_ms;
+
+	DEBUG_LOG("Lost connection to lease manager. Recovering lease\n");
+
+	close(lease->lease_fd);
+	lease->lease_fd = -1;
+
+	/* A new lease manager instance may have a different view of the
+	 * device, so get a fresh topology */
+	lease_unmap_topology(lease);
+
+	do {
+		close(lease->dlm_server_sock);
+		lease->dlm_server_sock = -1;
+
+		if (!lease_wait_and_connect(lease, deadline)) {
+			DEBUG_LOG("Lease manager did not restart: %s\n",
+				  strerror(errno));
+			return false;
+		}
+
+		/* The connection may have been accepted by the old instance
+		 * while it was shutting down.  If so, try again. */
+		if (!lease_send_request(lease, DLM_GET_LEASE))
+			continue;
+
+		if (lease_recv_fd_timeout(lease, deadline - time_ms())) {
+			if (lease->recovery_handler)
+				lease->recovery_handler(lease, lease->lease_fd,
+							lease->recovery_data);
+			return true;
+		}
+
+		if (errno != ECONNRESET)
+			return false;
+	} while (time_ms() < deadline);
+
+	return false;
+}
+
+int dlm_lease_dispatch(struct dlm_lease *lease)
+{
+	if (!lease) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (lease->is_revoked)
+		return 0;
+
+	enum dlm_event event;
+	do {
+		if (!receive_dlm_event(lease->dlm_server_sock, &event)) {
+			if (errno != EPIPE && errno != ECONNRESET) {
+				DEBUG_LOG("Lease manager receive data error: "
+					  "%s\n",
+					  strerror(errno));
+				return -1;
+			}
+
+			/* Losing the connection to the lease manager also
+			 * means losing the lease, unless it can be recovered */
+			if (lease->recovery_timeout_ms > 0 &&
+			    lease->lease_fd >= 0) {
+				if (lease_recover(lease))
+					return 0;
+			}
+			event = DLM_EVENT_LEASE_REVOKED;
+		}
+
+		switch (event) {
+		case DLM_EVENT_LEASE_REVOKED:
+			lease_revoked(lease);
+			return 0;
+		case DLM_EVENT_LEASE_AVAILABLE:
+			/* Only relevant while the lease is yielded */
+			if (lease->lease_fd < 0 && lease->available_handler)
+				lease->available_handler(
+				    lease, lease->available_data);
+			break;
+		case DLM_EVENT_NONE:
+			break;
+		default:
+			DEBUG_LOG("Ignoring unknown lease manager event: %d\n",
+				  event);
+			break;
+		}
+	} while (event != DLM_EVENT_NONE);
+
+	return 0;
+}
+
+bool dlm_lease_is_revoked(struct dlm_lease *lease)
+{
+	if (!lease)
+		return true;
+
+	return lease->is_revoked;
+}
+
+static bool object_has_type(struct dlm_topology_object *obj,
+			    enum dlm_object_type type)
+{
+	switch (type) {
+	case DLM_OBJECT_CRTC:
+		return obj->type == DLM_TOPOLOGY_CRTC;
+	case DLM_OBJECT_CONNECTOR:
+		return obj->type == DLM_TOPOLOGY_CONNECTOR;
+	case DLM_OBJECT_PLANE:
+		return obj->type == DLM_TOPOLOGY_PLANE;
+	}
+	return false;
+}
+
+static struct dlm_topology_object *find_object(struct dlm_lease *lease,
+					       uint32_t object_id)
+{
+	if (!lease || !lease->topology)
+		return NULL;
+
+	struct dlm_topology_object *objects = topology_objects(lease->topology);
+	for (uint32_t i = 0; i < lease->topology->nobjects; i++) {
+		if (objects[i].id == object_id)
+			return &objects[i];
+	}
+	return NULL;
+}
+
+int dlm_lease_object_count(struct dlm_lease *lease, enum dlm_object_type type)
+{
+	if (!lease || !lease->topology)
+		return -1;
+
+	int count = 0;
+	struct dlm_topology_object *objects = topology_objects(lease->topology);
+	for (uint32_t i = 0; i < lease->topology->nobjects; i++) {
+		if (object_has_type(&objects[i], type))
+			count++;
+	}
+	return count;
+}
+
+uint32_t dlm_lease_object_id(struct dlm_lease *lease, enum dlm_object_type type,
+			     int index)
+{
+	if (!lease || !lease->topology || index < 0)
+		return 0;
+
+	struct dlm_topology_object *objects = topology_objects(lease->topology);
+	for (uint32_t i = 0; i < lease->topology->nobjects; i++) {
+		if (!object_has_type(&objects[i], type))
+			continue;
+		if (index-- == 0)
+			return objects[i].id;
+	}
+	return 0;
+}
+
+const char *dlm_lease_connector_name(struct dlm_lease *lease,
+				     uint32_t connector_id)
+{
+	struct dlm_topology_object *obj = find_object(lease, connector_id);
+	if (!obj || obj->type != DLM_TOPOLOGY_CONNECTOR)
+		return NULL;
+
+	return obj->name;
+}
+
+uint32_t dlm_lease_property_id(struct dlm_lease *lease, uint32_t object_id,
+			       const char *name)
+{
+	struct dlm_topology_object *obj = find_object(lease, object_id);
+	if (!obj || !name)
+		return 0;
+
+	struct dlm_topology_prop *props = topology_props(lease->topology);
+	for (uint32_t i = 0; i < obj->nprops; i++) {
+		struct dlm_topology_prop *prop = &props[obj->first_prop + i];
+		if (!strcmp(prop->name, name))
+			return prop->id;
+	}
+	return 0;
+}
+
+/* Lease status page */
+
+_Static_assert(DLM_FRAME_INTERVAL_BUCKETS == DLM_STATUS_FRAME_BUCKETS,
+	       "Frame interval histogram size mismatch");
+
+struct dlm_status {
+	struct dlm_status_header *hdr;
+	struct dlm_status_entry *entries;
+	size_t size;
+};
+
+struct dlm_status *dlm_status_open(void)
+{
+	char path[PATH_MAX];
+	if (!runtime_file_path(path, sizeof(path), DLM_STATUS_FILE_NAME))
+		return NULL;
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		DEBUG_LOG("Cannot open %s: %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	struct dlm_status *status = calloc(1, sizeof(struct dlm_status));
+	if (!status) {
+		DEBUG_LOG("can't allocate memory for status handle\n");
+		close(fd);
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+		goto err;
+
+	if ((size_t)st.st_size < sizeof(struct dlm_status_header)) {
+		errno = EPROTO;
+		goto err;
+	}
+
+	status->size = st.st_size;
+	status->hdr = mmap(NULL, status->size, PROT_READ, MAP_SHARED, fd, 0);
+	if (status->hdr == MAP_FAILED) {
+		status->hdr = NULL;
+		goto err;
+	}
+
+	struct dlm_status_header *hdr = status->hdr;
+	if (hdr->magic != DLM_STATUS_MAGIC ||
+	    hdr->version != DLM_STATUS_VERSION ||
+	    hdr->entry_size != sizeof(struct dlm_status_entry) ||
+	    status->size <
+		sizeof(*hdr) + hdr->nleases * sizeof(struct dlm_status_entry)) {
+		DEBUG_LOG("Invalid lease status page\n");
+		errno = EPROTO;
+		goto err;
+	}
+
+	status->entries = (struct dlm_status_entry *)(hdr + 1);
+	close(fd);
+	return status;
+err:
+	DEBUG_LOG("Cannot map %s: %s\n", path, strerror(errno));
+	dlm_status_close(status);
+	close(fd);
+	return NULL;
+}
+
+void dlm_status_close(struct dlm_status *status)
+{
+	assert(status);
+
+	int saved_errno = errno;
+	if (status->hdr)
+		munmap(status->hdr, status->size);
+	free(status);
+	errno = saved_errno;
+}
+
+int dlm_status_lease_count(struct dlm_status *status)
+{
+	assert(status);
+	return status->hdr->nleases;
+}
+
+int dlm_status_find_lease(struct dlm_status *status, const char *name)
+{
+	assert(status);
+
+	for (uint32_t i = 0; i < status->hdr->nleases; i++) {
+		if (!strcmp(status->entries[i].name, name))
+			return i;
+	}
+	return -1;
+}
+
+/* Sequence lock reader side.
+ * The copied data must be discarded if seq_read_retry() returns true,
+ * because an update was in progress or happened while copying. */
+static unsigned int seq_read_begin(atomic_uint *seq)
+{
+	return atomic_load_explicit(seq, memory_order_acquire);
+}
+
+static bool seq_read_retry(atomic_uint *seq, unsigned int start)
+{
+	atomic_thread_fence(memory_order_acquire);
+	return (start & 1) ||
+	       atomic_load_explicit(seq, memory_order_relaxed) != start;
+}
+
+int dlm_status_read(struct dlm_status *status, int index,
+		    struct dlm_lease_status *lease_status)
+{
+	assert(status);
+	assert(lease_status);
+
+	if (index < 0 || (uint32_t)index >= status->hdr->nleases) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!atomic_load(&status->hdr->active)) {
+		errno = ESTALE;
+		return -1;
+	}
+
+	/* Retry while the lease manager is updating the entry.
+	 * The number of retries is bounded, in case the lease manager
+	 * died in the middle of an update. */
+	struct dlm_status_entry *entry = &status->entries[index];
+	unsigned int seq;
+	int retries = 0;
+	do {
+		if (retries++ == STATUS_READ_RETRIES)
+			goto err_inconsistent;
+		seq = seq_read_begin(&entry->seq);
+
+		lease_status->granted = entry->granted;
+		lease_status->lessee_id = entry->lessee_id;
+		lease_status->client_pid = entry->client_pid;
+		lease_status->grant_count = entry->grant_count;
+		lease_status->last_transition_ns = entry->last_transition_ns;
+	} while (seq_read_retry(&entry->seq, seq));
+
+	retries = 0;
+	do {
+		if (retries++ == STATUS_READ_RETRIES)
+			goto err_inconsistent;
+		seq = seq_read_begin(&entry->frame_seq);
+
+		lease_status->frame_count = entry->frame_count;
+		lease_status->missed_frames = entry->missed_frames;
+		memcpy(lease_status->frame_intervals, entry->frame_intervals,
+		       sizeof(lease_status->frame_intervals));
+	} while (seq_read_retry(&entry->frame_seq, seq));
+
+	lease_status->name = entry->name;
+	return 0;
+
+err_inconsistent:
+	errno = EAGAIN;
+	return -1;
+}
@@ -24,6 +24,7 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stdint.h>
 
 /**
  * @brief Enable debug logging
@@ -57,6 +58,10 @@ struct dlm_lease;
  *
  *  This list is not exhaustive, and errno may be set to other error codes,
  *  especially those related to socket communication.
+ *
+ *  If there is no socket for the requested lease, the request is sent
+ *  through the lease manager's control socket instead.  In that case, a
+ *  request for an unknown lease is rejected with EACCESS.
  */
 struct dlm_lease *dlm_get_lease(const char *name);
 
@@ -70,6 +75,33 @@ struct dlm_lease *dlm_get_lease(const char *name);
  */
 void dlm_release_lease(struct dlm_lease *lease);
 
+/**
+ * @brief Temporarily give up a lease, keeping the lease handle
+ *
+ * @details The lease is revoked and any fd retrieved from dlm_lease_fd() is
+ *          closed, but the connection to the lease manager stays open, so
+ *          that the lease can be claimed again with dlm_lease_reacquire()
+ *          without repeating the full dlm_get_lease() handshake.
+ *          dlm_lease_fd() returns -1 until the lease is reacquired.
+ * @param[in] lease pointer to a lease handle
+ * @return 0 on success, -1 on error with errno set accordingly.
+ */
+int dlm_lease_yield(struct dlm_lease *lease);
+
+/**
+ * @brief Reclaim a lease given up with dlm_lease_yield()
+ *
+ * @details Also reconnects to the lease manager if the connection has been
+ *          closed in the meantime, e.g. after the lease was revoked.
+ *          On success, dlm_lease_fd() returns the new DRM Master fd.
+ * @param[in] lease pointer to a lease handle
+ * @return 0 on success, -1 on error with errno set accordingly.
+ *         The possible errors are the same as for dlm_get_lease().
+ *         On error the handle remains valid, and must still be released
+ *         with dlm_release_lease().
+ */
+int dlm_lease_reacquire(struct dlm_lease *lease);
+
 /**
  * @brief Get a DRM Master fd from a valid lease handle
  *
@@ -79,6 +111,262 @@ void dlm_release_lease(struct dlm_lease *lease);
  */
 int dlm_lease_fd(struct dlm_lease *lease);
 
+/**
+ * @brief Lease revocation callback
+ *
+ * @param[in] lease pointer to the revoked lease handle
+ * @param[in] data user data passed to dlm_lease_set_revoke_handler()
+ */
+typedef void (*dlm_revoke_handler)(struct dlm_lease *lease, void *data);
+
+/**
+ * @brief Get a pollable fd for lease manager events
+ *
+ * @details The fd becomes readable when the lease manager has sent an event
+ *          for this lease, such as the lease being revoked because it was
+ *          transferred to another client.  Call dlm_lease_dispatch() when
+ *          the fd is readable.
+ * @param[in] lease pointer to a lease handle
+ * @return A file descriptor to poll for POLLIN.
+ *         -1 is returned when called with a NULL lease handle.
+ */
+int dlm_lease_event_fd(struct dlm_lease *lease);
+
+/**
+ * @brief Set a callback to be called when the lease is revoked
+ *
+ * @details The handler is called from dlm_lease_dispatch(), at most once
+ *          per lease handle.  After revocation, DRM operations on the lease
+ *          fd will fail, and the client should release any resources
+ *          allocated for it and call dlm_release_lease(), or reclaim the
+ *          lease with dlm_lease_reacquire().  The revoked lease fd stays
+ *          open until then, so that those resources can be freed.
+ * @param[in] lease pointer to a lease handle
+ * @param[in] handler callback function, or NULL to remove the handler
+ * @param[in] data user data passed to the handler
+ */
+void dlm_lease_set_revoke_handler(struct dlm_lease *lease,
+				  dlm_revoke_handler handler, void *data);
+
+/**
+ * @brief Lease availability callback
+ *
+ * @param[in] lease pointer to the yielded lease handle
+ * @param[in] data user data passed to dlm_lease_set_available_handler()
+ */
+typedef void (*dlm_available_handler)(struct dlm_lease *lease, void *data);
+
+/**
+ * @brief Set a callback to be called when a yielded lease becomes available
+ *
+ * @details The lease manager offers a lease to the clients that have yielded
+ *          it when its owner is removed by the lease watchdog, so that a
+ *          standby client can take over the display.  The handler is called
+ *          from dlm_lease_dispatch(), and may call dlm_lease_reacquire().
+ * @param[in] lease pointer to a lease handle
+ * @param[in] handler callback function, or NULL to remove the handler
+ * @param[in] data user data passed to the handler
+ */
+void dlm_lease_set_available_handler(struct dlm_lease *lease,
+				     dlm_available_handler handler, void *data);
+
+/**
+ * @brief Process pending lease manager events
+ *
+ * @details Does not block, unless the lease is being recovered (see
+ *          dlm_lease_enable_recovery()).  Otherwise, a closed connection to
+ *          the lease manager is treated as a revocation.
+ * @param[in] lease pointer to a lease handle
+ * @return 0 on success, -1 on error with errno set accordingly.
+ */
+int dlm_lease_dispatch(struct dlm_lease *lease);
+
+/**
+ * @brief Check whether a lease has been revoked
+ *
+ * @details The state is updated by dlm_lease_dispatch().
+ * @param[in] lease pointer to a lease handle
+ * @return true if the lease has been revoked by the lease manager.
+ */
+bool dlm_lease_is_revoked(struct dlm_lease *lease);
+
+/**
+ * @brief Lease recovery callback
+ *
+ * @param[in] lease pointer to the recovered lease handle
+ * @param[in] lease_fd the new DRM Master fd for the lease
+ * @param[in] data user data passed to dlm_lease_enable_recovery()
+ */
+typedef void (*dlm_recovery_handler)(struct dlm_lease *lease, int lease_fd,
+				     void *data);
+
+/**
+ * @brief Automatically recover a lease after a lease manager restart
+ *
+ * @details When recovery is enabled and dlm_lease_dispatch() finds that the
+ *          connection to the lease manager has been closed without the lease
+ *          being revoked, it waits up to @p timeout_ms for the lease manager
+ *          socket to reappear, then requests the lease again.
+ *          On success the recovery handler is called with the new lease fd.
+ *          The previous lease fd is closed, and all DRM objects created with
+ *          it (framebuffers, etc.) must be recreated.
+ *          If the lease cannot be recovered, the lease is marked as revoked
+ *          and the revoke handler is called instead.
+ *
+ *          Note that dlm_lease_dispatch() blocks during recovery.
+ * @param[in] lease pointer to a lease handle
+ * @param[in] timeout_ms maximum time to wait for the lease manager to
+ *                       restart. 0 disables recovery.
+ * @param[in] handler callback function, or NULL
+ * @param[in] data user data passed to the handler
+ * @return 0 on success, -1 on error with errno set accordingly.
+ */
+int dlm_lease_enable_recovery(struct dlm_lease *lease, int timeout_ms,
+			      dlm_recovery_handler handler, void *data);
+
+/**
+ * @brief DRM object types included in a lease
+ */
+enum dlm_object_type {
+	DLM_OBJECT_CRTC,
+	DLM_OBJECT_CONNECTOR,
+	DLM_OBJECT_PLANE,
+};
+
+/**
+ * @brief Get the number of leased DRM objects of a given type
+ *
+ * @details The lease manager describes the leased DRM objects when the
+ *          lease is granted, so clients do not need to enumerate them with
+ *          drmModeGetResources() / drmModeGetPlaneResources().
+ * @param[in] lease pointer to a lease handle
+ * @param[in] type object type
+ * @return The number of objects of the given type in the lease.
+ *         -1 is returned if no lease topology is available, in which case
+ *         the lease fd should be queried directly.
+ */
+int dlm_lease_object_count(struct dlm_lease *lease, enum dlm_object_type type);
+
+/**
+ * @brief Get the id of a leased DRM object
+ *
+ * @param[in] lease pointer to a lease handle
+ * @param[in] type object type
+ * @param[in] index index of the object, in the range
+ *                  [0, dlm_lease_object_count())
+ * @return The DRM object id, or 0 if there is no such object.
+ */
+uint32_t dlm_lease_object_id(struct dlm_lease *lease, enum dlm_object_type type,
+			     int index);
+
+/**
+ * @brief Get the name of a leased connector
+ *
+ * @param[in] lease pointer to a lease handle
+ * @param[in] connector_id DRM connector id
+ * @return The connector name used in the lease manager configuration
+ *         (e.g. "HDMI-A-1"), or NULL if the connector is not known.
+ *         The string is valid until the lease handle is released.
+ */
+const char *dlm_lease_connector_name(struct dlm_lease *lease,
+				     uint32_t connector_id);
+
+/**
+ * @brief Look up the id of a DRM object property by name
+ *
+ * @param[in] lease pointer to a lease handle
+ * @param[in] object_id DRM object id
+ * @param[in] name property name (e.g. "CRTC_ID", "FB_ID", "MODE_ID")
+ * @return The property id, or 0 if the property is not known.
+ */
+uint32_t dlm_lease_property_id(struct dlm_lease *lease, uint32_t object_id,
+			       const char *name);
+
+/**
+ * @brief lease manager status handle
+ */
+struct dlm_status;
+
+/**
+ * @brief Number of buckets in the frame interval histogram
+ */
+#define DLM_FRAME_INTERVAL_BUCKETS 8
+
+/**
+ * @brief Status of a lease, as published by the lease manager
+ *
+ * @details The frame statistics are only collected if the lease manager
+ *          was started with the `--frame-monitor` option.
+ *          `frame_intervals[n]` counts the frames that stayed on screen for
+ *          n + 1 vblank periods.  The last bucket also counts all longer
+ *          intervals.
+ */
+struct dlm_lease_status {
+	const char *name;	     /**< lease name */
+	bool granted;		     /**< lease is currently granted */
+	uint32_t lessee_id;	     /**< DRM lessee id, or 0 */
+	int client_pid;		     /**< pid of the lease owner, or 0 */
+	uint64_t grant_count;	     /**< number of grants so far */
+	uint64_t last_transition_ns; /**< CLOCK_MONOTONIC time of the last
+					  grant or revocation, or 0 */
+	uint64_t frame_count;	     /**< number of frame intervals seen */
+	uint64_t missed_frames;	     /**< vblank periods without a new frame */
+	uint64_t frame_intervals[DLM_FRAME_INTERVAL_BUCKETS]; /**< histogram */
+};
+
+/**
+ * @brief Open the lease manager status page
+ *
+ * @details The lease manager publishes the state of all leases in a shared
+ *          memory page.  Reading the page does not need any system calls and
+ *          does not communicate with the lease manager, so it can be used for
+ *          monitoring without interfering with lease requests.
+ * @return A pointer to a status handle on success.
+ *         On error this function returns NULL and errno is set accordingly.
+ *         ENOENT means that the lease manager is not running.
+ */
+struct dlm_status *dlm_status_open(void);
+
+/**
+ * @brief Close a status handle
+ *
+ * @param[in] status pointer to a status handle
+ */
+void dlm_status_close(struct dlm_status *status);
+
+/**
+ * @brief Get the number of leases in the status page
+ *
+ * @param[in] status pointer to a status handle
+ * @return The number of leases managed by the lease manager.
+ */
+int dlm_status_lease_count(struct dlm_status *status);
+
+/**
+ * @brief Find a lease in the status page
+ *
+ * @param[in] status pointer to a status handle
+ * @param[in] name lease name
+ * @return The index of the lease, or -1 if there is no such lease.
+ */
+int dlm_status_find_lease(struct dlm_status *status, const char *name);
+
+/**
+ * @brief Read the status of a lease
+ *
+ * @param[in] status pointer to a status handle
+ * @param[in] index lease index, from 0 to dlm_status_lease_count() - 1
+ * @param[out] lease_status current status of the lease.
+ *             The name is valid until the status handle is closed.
+ * @return 0 on success, or -1 with errno set.
+ *         ESTALE means that the lease manager has exited. The status handle
+ *         should be closed and opened again once the lease manager restarts.
+ *         EAGAIN means that no consistent status could be read, because
+ *         the lease manager stopped while updating it.
+ */
+int dlm_status_read(struct dlm_status *status, int index,
+		    struct dlm_lease_status *lease_status);
+
 #ifdef __cplusplus
 }
 #endif
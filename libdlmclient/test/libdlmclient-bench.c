@@ -0,0 +1,298 @@
+/* Copyright 2020-2021 IGEL Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Client library round-trip benchmark
+ * Measures the latency, heap allocations and system calls of the client
+ * library calls against the test socket server.
+ *
+ * Allocations and system calls are counted by interposing the libc
+ * functions used by the client library, and only in the benchmark thread,
+ * so the test server does not affect the counts. */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "dlmclient.h"
+#include "latency-stats.h"
+#include "test-socket-server.h"
+
+#define SOCKETDIR "/tmp"
+#define BENCH_LEASE_NAME "bench-lease"
+#define DEFAULT_ITERATIONS 1000
+
+/**************  Call counting  *************/
+
+static __thread bool counting;
+static __thread uint64_t nallocs;
+static __thread uint64_t nsyscalls;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	if (counting)
+		nallocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	if (counting)
+		nallocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if (counting)
+		nallocs++;
+	return __libc_realloc(ptr, size);
+}
+
+#define COUNTED_SYSCALL(ret, name, params, args)                               \
+	ret name params                                                        \
+	{                                                                      \
+		static ret(*real) params;                                      \
+		if (!real)                                                     \
+			real = dlsym(RTLD_NEXT, #name);                        \
+		if (counting)                                                  \
+			nsyscalls++;                                           \
+		return real args;                                              \
+	}
+
+COUNTED_SYSCALL(int, socket, (int domain, int type, int protocol),
+		(domain, type, protocol))
+COUNTED_SYSCALL(int, connect,
+		(int fd, const struct sockaddr *addr, socklen_t len),
+		(fd, addr, len))
+COUNTED_SYSCALL(ssize_t, sendmsg, (int fd, const struct msghdr *msg, int flags),
+		(fd, msg, flags))
+COUNTED_SYSCALL(ssize_t, recvmsg, (int fd, struct msghdr *msg, int flags),
+		(fd, msg, flags))
+COUNTED_SYSCALL(ssize_t, send, (int fd, const void *buf, size_t n, int flags),
+		(fd, buf, n, flags))
+COUNTED_SYSCALL(ssize_t, recv, (int fd, void *buf, size_t n, int flags),
+		(fd, buf, n, flags))
+COUNTED_SYSCALL(int, close, (int fd), (fd))
+COUNTED_SYSCALL(int, fstat, (int fd, struct stat *st), (fd, st))
+COUNTED_SYSCALL(void *, mmap,
+		(void *addr, size_t len, int prot, int flags, int fd,
+		 off_t offset),
+		(addr, len, prot, flags, fd, offset))
+COUNTED_SYSCALL(int, munmap, (void *addr, size_t len), (addr, len))
+
+int fcntl(int fd, int cmd, ...)
+{
+	static int (*real)(int, int, ...);
+	if (!real)
+		real = dlsym(RTLD_NEXT, "fcntl");
+	if (counting)
+		nsyscalls++;
+
+	va_list ap;
+	va_start(ap, cmd);
+	void *arg = va_arg(ap, void *);
+	va_end(ap);
+	return real(fd, cmd, arg);
+}
+
+/**************  Measurements  *************/
+
+struct bench_call {
+	const char *name;
+	uint64_t *latency_ns;
+	int count;
+	uint64_t allocs;
+	uint64_t syscalls;
+};
+
+struct bench_sample {
+	uint64_t start_ns;
+	uint64_t allocs;
+	uint64_t syscalls;
+};
+
+static void sample_begin(struct bench_sample *sample)
+{
+	sample->allocs = nallocs;
+	sample->syscalls = nsyscalls;
+	counting = true;
+	sample->start_ns = monotonic_ns();
+}
+
+static void sample_end(struct bench_sample *sample, struct bench_call *call)
+{
+	uint64_t end_ns = monotonic_ns();
+	counting = false;
+
+	/* Iterations without a call array are for warming up */
+	if (!call)
+		return;
+
+	call->latency_ns[call->count++] = end_ns - sample->start_ns;
+	call->allocs += nallocs - sample->allocs;
+	call->syscalls += nsyscalls - sample->syscalls;
+}
+
+static void print_call(struct bench_call *call)
+{
+	if (!call->count)
+		return;
+
+	struct latency_stats stats;
+	latency_stats_compute(call->latency_ns, call->count, &stats);
+
+	printf("%-20s %6d %10.1f %10.1f %10.1f %8.1f %8.1f\n", call->name,
+	       call->count, stats.p50_us, stats.p99_us, stats.max_us,
+	       (double)call->allocs / call->count,
+	       (double)call->syscalls / call->count);
+}
+
+/**************  Scenarios  *************/
+
+enum bench_scenario {
+	BENCH_GET_RELEASE,
+	BENCH_GET_RELEASE_TOPOLOGY,
+	BENCH_YIELD_REACQUIRE,
+};
+
+static const char *const scenario_names[] = {
+    [BENCH_GET_RELEASE] = "get-release",
+    [BENCH_GET_RELEASE_TOPOLOGY] = "topology",
+    [BENCH_YIELD_REACQUIRE] = "reacquire",
+};
+
+enum {
+	CALL_GET,
+	CALL_YIELD,
+	CALL_REACQUIRE,
+	CALL_RELEASE,
+	NUM_CALLS,
+};
+
+static bool run_iteration(enum bench_scenario scenario,
+			  struct bench_call *calls)
+{
+	struct test_config config = {
+	    .lease_name = BENCH_LEASE_NAME,
+	    .nfds = 1,
+	    .send_topology = scenario == BENCH_GET_RELEASE_TOPOLOGY,
+	    .expect_reacquire = scenario == BENCH_YIELD_REACQUIRE,
+	};
+	struct server_state *sstate = test_server_start(&config);
+	struct bench_sample sample;
+	bool ok = false;
+
+	sample_begin(&sample);
+	struct dlm_lease *lease = dlm_get_lease(BENCH_LEASE_NAME);
+	sample_end(&sample, calls ? &calls[CALL_GET] : NULL);
+	if (!lease)
+		goto out;
+
+	if (scenario == BENCH_YIELD_REACQUIRE) {
+		sample_begin(&sample);
+		int ret = dlm_lease_yield(lease);
+		sample_end(&sample, calls ? &calls[CALL_YIELD] : NULL);
+
+		sample_begin(&sample);
+		ret |= dlm_lease_reacquire(lease);
+		sample_end(&sample, calls ? &calls[CALL_REACQUIRE] : NULL);
+		if (ret < 0) {
+			dlm_release_lease(lease);
+			goto out;
+		}
+	}
+
+	sample_begin(&sample);
+	dlm_release_lease(lease);
+	sample_end(&sample, calls ? &calls[CALL_RELEASE] : NULL);
+	ok = true;
+out:
+	test_server_stop(sstate);
+	test_config_cleanup(&config);
+	return ok;
+}
+
+static void usage(const char *progname)
+{
+	printf("Usage: %s <scenario> [<iterations>]\n\n"
+	       "Scenarios:\n"
+	       "get-release \tdlm_get_lease() / dlm_release_lease()\n"
+	       "topology \tthe same, with a lease topology\n"
+	       "reacquire \tdlm_lease_yield() / dlm_lease_reacquire()\n",
+	       progname);
+}
+
+int main(int argc, char **argv)
+{
+	int scenario = -1;
+	for (int i = 0; argc > 1 && i <= BENCH_YIELD_REACQUIRE; i++) {
+		if (!strcmp(argv[1], scenario_names[i]))
+			scenario = i;
+	}
+
+	int iterations = argc > 2 ? atoi(argv[2]) : DEFAULT_ITERATIONS;
+	if (scenario < 0 || iterations <= 0) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	setenv("DLM_RUNTIME_PATH", SOCKETDIR, 1);
+
+	struct bench_call calls[NUM_CALLS] = {
+	    [CALL_GET] = {.name = "dlm_get_lease"},
+	    [CALL_YIELD] = {.name = "dlm_lease_yield"},
+	    [CALL_REACQUIRE] = {.name = "dlm_lease_reacquire"},
+	    [CALL_RELEASE] = {.name = "dlm_release_lease"},
+	};
+	for (int i = 0; i < NUM_CALLS; i++)
+		calls[i].latency_ns = calloc(iterations, sizeof(uint64_t));
+
+	/* Resolve the interposed functions, and fill caches */
+	bool ok = run_iteration(scenario, NULL);
+
+	for (int i = 0; ok && i < iterations; i++)
+		ok = run_iteration(scenario, calls);
+
+	if (!ok) {
+		fprintf(stderr, "%s: lease request failed: %s\n",
+			scenario_names[scenario], strerror(errno));
+	} else {
+		printf("%-20s %6s %10s %10s %10s %8s %8s\n", "call", "count",
+		       "p50 us", "p99 us", "max us", "allocs", "syscalls");
+		for (int i = 0; i < NUM_CALLS; i++)
+			print_call(&calls[i]);
+	}
+
+	for (int i = 0; i < NUM_CALLS; i++)
+		free(calls[i].latency_ns);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
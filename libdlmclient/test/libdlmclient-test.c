@@ -17,11 +17,14 @@
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
 #include "config.h"
+#include "dlm-status.h"
 #include "dlmclient.h"
 #include "test-helpers.h"
 #include "test-socket-server.h"
@@ -258,6 +261,211 @@ START_TEST(verify_that_unused_fds_are_not_leaked)
 }
 END_TEST
 
+/* receive_topology_from_manager
+ *
+ * Test details: Receive a lease topology descriptor along with the lease fd.
+ * Expected results: The leased objects, connector names and property ids
+ *                   are available from the lease handle.
+ */
+START_TEST(receive_topology_from_manager)
+{
+	struct test_config config = {
+	    .lease_name = TEST_LEASE_NAME,
+	    .nfds = 1,
+	    .send_topology = true,
+	};
+
+	struct server_state *sstate = test_server_start(&config);
+
+	struct dlm_lease *lease = dlm_get_lease(TEST_LEASE_NAME);
+	ck_assert_ptr_ne(lease, NULL);
+	check_fd_equality(dlm_lease_fd(lease), config.fds[0]);
+
+	ck_assert_int_eq(dlm_lease_object_count(lease, DLM_OBJECT_CRTC), 1);
+	ck_assert_int_eq(dlm_lease_object_count(lease, DLM_OBJECT_CONNECTOR),
+			 1);
+	ck_assert_int_eq(dlm_lease_object_count(lease, DLM_OBJECT_PLANE), 1);
+
+	ck_assert_uint_eq(dlm_lease_object_id(lease, DLM_OBJECT_CRTC, 0),
+			  TEST_TOPOLOGY_CRTC_ID);
+	ck_assert_uint_eq(dlm_lease_object_id(lease, DLM_OBJECT_PLANE, 0),
+			  TEST_TOPOLOGY_PLANE_ID);
+	ck_assert_uint_eq(dlm_lease_object_id(lease, DLM_OBJECT_PLANE, 1), 0);
+
+	ck_assert_str_eq(
+	    dlm_lease_connector_name(lease, TEST_TOPOLOGY_CONNECTOR_ID),
+	    TEST_TOPOLOGY_CONNECTOR_NAME);
+	ck_assert_ptr_eq(dlm_lease_connector_name(lease, TEST_TOPOLOGY_CRTC_ID),
+			 NULL);
+
+	ck_assert_uint_eq(
+	    dlm_lease_property_id(lease, TEST_TOPOLOGY_PLANE_ID, "CRTC_ID"),
+	    TEST_TOPOLOGY_PLANE_CRTC_PROP);
+	ck_assert_uint_eq(
+	    dlm_lease_property_id(lease, TEST_TOPOLOGY_PLANE_ID, "FB_ID"),
+	    TEST_TOPOLOGY_PLANE_FB_PROP);
+	ck_assert_uint_eq(
+	    dlm_lease_property_id(lease, TEST_TOPOLOGY_CONNECTOR_ID, "CRTC_ID"),
+	    TEST_TOPOLOGY_CONNECTOR_CRTC_PROP);
+	ck_assert_uint_eq(
+	    dlm_lease_property_id(lease, TEST_TOPOLOGY_CRTC_ID, "MODE_ID"), 0);
+
+	dlm_release_lease(lease);
+
+	test_server_stop(sstate);
+	test_config_cleanup(&config);
+}
+END_TEST
+
+/* no_topology_from_manager
+ *
+ * Test details: Receive a lease fd without a topology descriptor.
+ * Expected results: dlm_get_lease() succeeds, but no topology is available.
+ */
+START_TEST(no_topology_from_manager)
+{
+	struct server_state *sstate = test_server_start(&default_test_config);
+
+	struct dlm_lease *lease = dlm_get_lease(TEST_LEASE_NAME);
+	ck_assert_ptr_ne(lease, NULL);
+
+	ck_assert_int_eq(dlm_lease_object_count(lease, DLM_OBJECT_CRTC), -1);
+	ck_assert_uint_eq(dlm_lease_object_id(lease, DLM_OBJECT_CRTC, 0), 0);
+
+	dlm_release_lease(lease);
+
+	test_server_stop(sstate);
+}
+END_TEST
+
+/* yield_and_reacquire_lease
+ *
+ * Test details: Yield a lease, then reacquire it using the same handle.
+ * Expected results: No lease fd is available while the lease is yielded.
+ *                   After reacquiring, the new lease fd is returned, and the
+ *                   topology received with the original lease is retained.
+ */
+START_TEST(yield_and_reacquire_lease)
+{
+	struct test_config config = {
+	    .lease_name = TEST_LEASE_NAME,
+	    .nfds = 1,
+	    .send_topology = true,
+	    .expect_reacquire = true,
+	};
+
+	struct server_state *sstate = test_server_start(&config);
+
+	struct dlm_lease *lease = dlm_get_lease(TEST_LEASE_NAME);
+	ck_assert_ptr_ne(lease, NULL);
+
+	ck_assert_int_eq(dlm_lease_yield(lease), 0);
+	ck_assert_int_eq(dlm_lease_fd(lease), -1);
+
+	ck_assert_int_eq(dlm_lease_reacquire(lease), 0);
+	check_fd_equality(dlm_lease_fd(lease), config.reacquired_fd);
+	ck_assert_int_eq(dlm_lease_object_count(lease, DLM_OBJECT_CRTC), 1);
+
+	dlm_release_lease(lease);
+
+	test_server_stop(sstate);
+	test_config_cleanup(&config);
+}
+END_TEST
+
+/* reacquire_with_queued_offer
+ *
+ * Test details: Yield a lease, then reacquire it while an offer of the lease
+ *               is queued ahead of the lease manager's reply.
+ * Expected results: The offer is skipped, and the new lease fd is returned.
+ */
+START_TEST(reacquire_with_queued_offer)
+{
+	default_test_config.expect_reacquire = true;
+	default_test_config.offer_before_reacquire = true;
+
+	struct server_state *sstate = test_server_start(&default_test_config);
+
+	struct dlm_lease *lease = dlm_get_lease(TEST_LEASE_NAME);
+	ck_assert_ptr_ne(lease, NULL);
+
+	ck_assert_int_eq(dlm_lease_yield(lease), 0);
+	ck_assert_int_eq(dlm_lease_reacquire(lease), 0);
+	ck_assert_int_eq(dlm_lease_is_revoked(lease), false);
+	check_fd_equality(dlm_lease_fd(lease),
+			  default_test_config.reacquired_fd);
+
+	dlm_release_lease(lease);
+	test_server_stop(sstate);
+}
+END_TEST
+
+/* lease_from_control_socket
+ *
+ * Test details: Request a lease that has no socket of its own, from a lease
+ *               manager that provides a control socket.
+ * Expected results: The lease is requested by name through the control
+ *                   socket, and the lease fd is received.
+ */
+START_TEST(lease_from_control_socket)
+{
+	default_test_config.use_control_socket = true;
+
+	struct server_state *sstate = test_server_start(&default_test_config);
+
+	struct dlm_lease *lease = dlm_get_lease(TEST_LEASE_NAME);
+	ck_assert_ptr_ne(lease, NULL);
+	check_fd_equality(dlm_lease_fd(lease), default_test_config.fds[0]);
+
+	dlm_release_lease(lease);
+	test_server_stop(sstate);
+}
+END_TEST
+
+/* lease_from_abstract_socket
+ *
+ * Test details: Request a lease from a lease manager using the abstract
+ *               socket namespace.
+ * Expected results: The lease fd is received.
+ */
+START_TEST(lease_from_abstract_socket)
+{
+	setenv("DLM_RUNTIME_PATH", "@drm-lease-manager-test", 1);
+
+	struct server_state *sstate = test_server_start(&default_test_config);
+
+	struct dlm_lease *lease = dlm_get_lease(TEST_LEASE_NAME);
+	ck_assert_ptr_ne(lease, NULL);
+	check_fd_equality(dlm_lease_fd(lease), default_test_config.fds[0]);
+
+	dlm_release_lease(lease);
+	test_server_stop(sstate);
+}
+END_TEST
+
+/* lease_from_abstract_control_socket
+ *
+ * Test details: Request a lease that has no socket of its own from a
+ *               lease manager using the abstract socket namespace.
+ * Expected results: The request falls back to the control socket, and
+ *                   the lease fd is received.
+ */
+START_TEST(lease_from_abstract_control_socket)
+{
+	setenv("DLM_RUNTIME_PATH", "@drm-lease-manager-test", 1);
+	default_test_config.use_control_socket = true;
+
+	struct server_state *sstate = test_server_start(&default_test_config);
+
+	struct dlm_lease *lease = dlm_get_lease(TEST_LEASE_NAME);
+	ck_assert_ptr_ne(lease, NULL);
+	check_fd_equality(dlm_lease_fd(lease), default_test_config.fds[0]);
+
+	dlm_release_lease(lease);
+	test_server_stop(sstate);
+}
+END_TEST
+
 static void add_lease_handling_tests(Suite *s)
 {
 	TCase *tc = tcase_create("Lease processing tests");
@@ -268,6 +476,463 @@ static void add_lease_handling_tests(Suite *s)
 	tcase_add_test(tc, lease_fd_is_closed_on_release);
 	tcase_add_test(tc, dlm_lease_fd_always_returns_same_lease);
 	tcase_add_test(tc, verify_that_unused_fds_are_not_leaked);
+	tcase_add_test(tc, receive_topology_from_manager);
+	tcase_add_test(tc, no_topology_from_manager);
+	tcase_add_test(tc, yield_and_reacquire_lease);
+	tcase_add_test(tc, reacquire_with_queued_offer);
+	tcase_add_test(tc, lease_from_control_socket);
+	tcase_add_test(tc, lease_from_abstract_socket);
+	tcase_add_test(tc, lease_from_abstract_control_socket);
+	suite_add_tcase(s, tc);
+}
+
+/**************  Lease revocation tests *************/
+
+static void count_revocations(struct dlm_lease *lease, void *data)
+{
+	ck_assert_ptr_ne(lease, NULL);
+	(*(int *)data)++;
+}
+
+static void wait_for_lease_event(struct dlm_lease *lease)
+{
+	struct pollfd pfd = {
+	    .fd = dlm_lease_event_fd(lease),
+	    .events = POLLIN,
+	};
+	ck_assert_int_eq(poll(&pfd, 1, 1000), 1);
+}
+
+/* lease_revoked_by_manager
+ *
+ * Test details: Lease manager sends a revocation event after granting a lease.
+ * Expected results: The event fd becomes readable, the revoke handler is
+ *                   called exactly once, and the lease is marked as revoked.
+ */
+START_TEST(lease_revoked_by_manager)
+{
+	int revocations = 0;
+	default_test_config.revoke_after_grant = true;
+
+	struct server_state *sstate = test_server_start(&default_test_config);
+
+	struct dlm_lease *lease = dlm_get_lease(TEST_LEASE_NAME);
+	ck_assert_ptr_ne(lease, NULL);
+	ck_assert_int_eq(dlm_lease_is_revoked(lease), false);
+	dlm_lease_set_revoke_handler(lease, count_revocations, &revocations);
+
+	wait_for_lease_event(lease);
+	ck_assert_int_eq(dlm_lease_dispatch(lease), 0);
+	ck_assert_int_eq(dlm_lease_is_revoked(lease), true);
+	ck_assert_int_eq(revocations, 1);
+
+	/* Further dispatching doesn't report the revocation again */
+	ck_assert_int_eq(dlm_lease_dispatch(lease), 0);
+	ck_assert_int_eq(revocations, 1);
+
+	dlm_release_lease(lease);
+	test_server_stop(sstate);
+}
+END_TEST
+
+/* reacquire_revoked_lease
+ *
+ * Test details: Reacquire a lease after it has been revoked.
+ * Expected results: The revoked lease fd stays open until reacquiring the
+ *                   lease reconnects to the lease manager to get a new one,
+ *                   and is closed then.
+ */
+START_TEST(reacquire_revoked_lease)
+{
+	default_test_config.revoke_after_grant = true;
+	default_test_config.regrant_after_revoke = true;
+
+	struct server_state *sstate = test_server_start(&default_test_config);
+
+	struct dlm_lease *lease = dlm_get_lease(TEST_LEASE_NAME);
+	ck_assert_ptr_ne(lease, NULL);
+
+	wait_for_lease_event(lease);
+	ck_assert_int_eq(dlm_lease_dispatch(lease), 0);
+	ck_assert_int_eq(dlm_lease_is_revoked(lease), true);
+	int revoked_fd = dlm_lease_fd(lease);
+	check_fd_equality(revoked_fd, default_test_config.fds[0]);
+
+	ck_assert_int_eq(dlm_lease_reacquire(lease), 0);
+	ck_assert_int_eq(dlm_lease_is_revoked(lease), false);
+	check_fd_equality(dlm_lease_fd(lease),
+			  default_test_config.reacquired_fd);
+	ck_assert_int_eq(fcntl(revoked_fd, F_GETFD), -1);
+
+	dlm_release_lease(lease);
+	test_server_stop(sstate);
+}
+END_TEST
+
+/* lease_revoked_on_manager_disconnect
+ *
+ * Test details: Lease manager closes the connection after granting a lease.
+ * Expected results: The lease is treated as revoked.
+ */
+START_TEST(lease_revoked_on_manager_disconnect)
+{
+	int revocations = 0;
+	default_test_config.disconnect_after_grant = true;
+
+	struct server_state *sstate = test_server_start(&default_test_config);
+
+	struct dlm_lease *lease = dlm_get_lease(TEST_LEASE_NAME);
+	ck_assert_ptr_ne(lease, NULL);
+	dlm_lease_set_revoke_handler(lease, count_revocations, &revocations);
+
+	wait_for_lease_event(lease);
+	ck_assert_int_eq(dlm_lease_dispatch(lease), 0);
+	ck_assert_int_eq(dlm_lease_is_revoked(lease), true);
+	ck_assert_int_eq(revocations, 1);
+
+	dlm_release_lease(lease);
+	test_server_stop(sstate);
+}
+END_TEST
+
+static void reacquire_available_lease(struct dlm_lease *lease, void *data)
+{
+	ck_assert_int_eq(dlm_lease_reacquire(lease), 0);
+	(*(int *)data)++;
+}
+
+/* yielded_lease_offered_by_manager
+ *
+ * Test details: Yield a lease, then have the lease manager offer it again.
+ * Expected results: The available handler is called, and can reacquire the
+ *                   lease.
+ */
+START_TEST(yielded_lease_offered_by_manager)
+{
+	int offers = 0;
+	default_test_config.expect_reacquire = true;
+	default_test_config.offer_after_yield = true;
+
+	struct server_state *sstate = test_server_start(&default_test_config);
+
+	struct dlm_lease *lease = dlm_get_lease(TEST_LEASE_NAME);
+	ck_assert_ptr_ne(lease, NULL);
+	dlm_lease_set_available_handler(lease, reacquire_available_lease,
+					&offers);
+
+	ck_assert_int_eq(dlm_lease_yield(lease), 0);
+
+	wait_for_lease_event(lease);
+	ck_assert_int_eq(dlm_lease_dispatch(lease), 0);
+	ck_assert_int_eq(offers, 1);
+	check_fd_equality(dlm_lease_fd(lease),
+			  default_test_config.reacquired_fd);
+
+	dlm_release_lease(lease);
+	test_server_stop(sstate);
+}
+END_TEST
+
+/* dispatch_without_events
+ *
+ * Test details: Call dlm_lease_dispatch() with no pending events.
+ * Expected results: dlm_lease_dispatch() returns immediately and the lease
+ *                   is still valid.
+ */
+START_TEST(dispatch_without_events)
+{
+	struct server_state *sstate = test_server_start(&default_test_config);
+
+	struct dlm_lease *lease = dlm_get_lease(TEST_LEASE_NAME);
+	ck_assert_ptr_ne(lease, NULL);
+
+	ck_assert_int_eq(dlm_lease_dispatch(lease), 0);
+	ck_assert_int_eq(dlm_lease_is_revoked(lease), false);
+
+	dlm_release_lease(lease);
+	test_server_stop(sstate);
+}
+END_TEST
+
+static void add_lease_revocation_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Lease revocation tests");
+
+	tcase_add_checked_fixture(tc, test_setup, test_shutdown);
+
+	tcase_add_test(tc, lease_revoked_by_manager);
+	tcase_add_test(tc, reacquire_revoked_lease);
+	tcase_add_test(tc, lease_revoked_on_manager_disconnect);
+	tcase_add_test(tc, yielded_lease_offered_by_manager);
+	tcase_add_test(tc, dispatch_without_events);
+	suite_add_tcase(s, tc);
+}
+
+/**************  Lease recovery tests *************/
+
+struct recovery_state {
+	int count;
+	int lease_fd;
+};
+
+static void record_recovery(struct dlm_lease *lease, int lease_fd, void *data)
+{
+	struct recovery_state *state = data;
+	ck_assert_ptr_ne(lease, NULL);
+	state->count++;
+	state->lease_fd = lease_fd;
+}
+
+/* lease_recovered_after_manager_restart
+ *
+ * Test details: Lease manager closes the connection after granting a lease,
+ *               and restarts after a short delay.
+ * Expected results: The lease is requested again from the new lease manager
+ *                   instance, and the new lease fd is reported through the
+ *                   recovery handler.
+ */
+START_TEST(lease_recovered_after_manager_restart)
+{
+	struct recovery_state recovery = {0};
+	int revocations = 0;
+
+	default_test_config.restart_after_grant = true;
+	default_test_config.restart_delay_ms = 50;
+
+	struct server_state *sstate = test_server_start(&default_test_config);
+
+	struct dlm_lease *lease = dlm_get_lease(TEST_LEASE_NAME);
+	ck_assert_ptr_ne(lease, NULL);
+	ck_assert_int_eq(
+	    dlm_lease_enable_recovery(lease, 1000, record_recovery, &recovery),
+	    0);
+	dlm_lease_set_revoke_handler(lease, count_revocations, &revocations);
+
+	wait_for_lease_event(lease);
+	ck_assert_int_eq(dlm_lease_dispatch(lease), 0);
+
+	ck_assert_int_eq(recovery.count, 1);
+	ck_assert_int_eq(revocations, 0);
+	ck_assert_int_eq(dlm_lease_is_revoked(lease), false);
+	ck_assert_int_eq(dlm_lease_fd(lease), recovery.lease_fd);
+	check_fd_equality(recovery.lease_fd, default_test_config.reacquired_fd);
+
+	dlm_release_lease(lease);
+	test_server_stop(sstate);
+}
+END_TEST
+
+/* lease_recovery_timeout
+ *
+ * Test details: Lease manager closes the connection after granting a lease,
+ *               and does not restart within the recovery timeout.
+ * Expected results: The lease is revoked.
+ */
+START_TEST(lease_recovery_timeout)
+{
+	struct recovery_state recovery = {0};
+	int revocations = 0;
+
+	default_test_config.disconnect_after_grant = true;
+
+	struct server_state *sstate = test_server_start(&default_test_config);
+
+	struct dlm_lease *lease = dlm_get_lease(TEST_LEASE_NAME);
+	ck_assert_ptr_ne(lease, NULL);
+	ck_assert_int_eq(
+	    dlm_lease_enable_recovery(lease, 50, record_recovery, &recovery),
+	    0);
+	dlm_lease_set_revoke_handler(lease, count_revocations, &revocations);
+
+	wait_for_lease_event(lease);
+	test_server_stop(sstate);
+
+	ck_assert_int_eq(dlm_lease_dispatch(lease), 0);
+	ck_assert_int_eq(recovery.count, 0);
+	ck_assert_int_eq(revocations, 1);
+	ck_assert_int_eq(dlm_lease_is_revoked(lease), true);
+	ck_assert_int_eq(dlm_lease_fd(lease), -1);
+
+	dlm_release_lease(lease);
+}
+END_TEST
+
+static void add_lease_recovery_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Lease recovery tests");
+
+	tcase_add_checked_fixture(tc, test_setup, test_shutdown);
+
+	tcase_add_test(tc, lease_recovered_after_manager_restart);
+	tcase_add_test(tc, lease_recovery_timeout);
+	suite_add_tcase(s, tc);
+}
+
+/**************  Lease status tests *************/
+
+#define STATUS_FILE SOCKETDIR "/" DLM_STATUS_FILE_NAME
+
+struct test_status_page {
+	struct dlm_status_header hdr;
+	struct dlm_status_entry entries[2];
+};
+
+static void write_status_page(struct test_status_page *page)
+{
+	FILE *f = fopen(STATUS_FILE, "wb");
+	ck_assert_ptr_ne(f, NULL);
+	ck_assert_int_eq(fwrite(page, sizeof(*page), 1, f), 1);
+	fclose(f);
+}
+
+static void init_status_page(struct test_status_page *page)
+{
+	*page = (struct test_status_page){
+	    .hdr =
+		{
+		    .magic = DLM_STATUS_MAGIC,
+		    .version = DLM_STATUS_VERSION,
+		    .nleases = 2,
+		    .entry_size = sizeof(struct dlm_status_entry),
+		    .active = 1,
+		},
+	    .entries =
+		{
+		    {.name = "lease-a"},
+		    {.name = "lease-b",
+		     .seq = 2,
+		     .granted = 1,
+		     .lessee_id = 7,
+		     .client_pid = 1234,
+		     .grant_count = 3,
+		     .last_transition_ns = 5000,
+		     .frame_seq = 4,
+		     .frame_count = 100,
+		     .missed_frames = 2,
+		     .frame_intervals = {98, 2}},
+		},
+	};
+}
+
+static void status_test_shutdown(void)
+{
+	unlink(STATUS_FILE);
+	test_shutdown();
+}
+
+/* read_lease_status
+ *
+ * Test details: Open a status page with one free and one granted lease.
+ * Expected results: The status of both leases can be read.
+ */
+START_TEST(read_lease_status)
+{
+	struct test_status_page page;
+	init_status_page(&page);
+	write_status_page(&page);
+
+	struct dlm_status *status = dlm_status_open();
+	ck_assert_ptr_ne(status, NULL);
+	ck_assert_int_eq(dlm_status_lease_count(status), 2);
+
+	int index = dlm_status_find_lease(status, "lease-b");
+	ck_assert_int_eq(index, 1);
+	ck_assert_int_eq(dlm_status_find_lease(status, "lease-c"), -1);
+
+	struct dlm_lease_status lease_status;
+	ck_assert_int_eq(dlm_status_read(status, index, &lease_status), 0);
+	ck_assert_str_eq(lease_status.name, "lease-b");
+	ck_assert(lease_status.granted);
+	ck_assert_uint_eq(lease_status.lessee_id, 7);
+	ck_assert_int_eq(lease_status.client_pid, 1234);
+	ck_assert_uint_eq(lease_status.grant_count, 3);
+	ck_assert_uint_eq(lease_status.last_transition_ns, 5000);
+	ck_assert_uint_eq(lease_status.frame_count, 100);
+	ck_assert_uint_eq(lease_status.missed_frames, 2);
+	ck_assert_uint_eq(lease_status.frame_intervals[0], 98);
+	ck_assert_uint_eq(lease_status.frame_intervals[1], 2);
+
+	ck_assert_int_eq(dlm_status_read(status, 0, &lease_status), 0);
+	ck_assert_str_eq(lease_status.name, "lease-a");
+	ck_assert(!lease_status.granted);
+
+	ck_assert_int_eq(dlm_status_read(status, 2, &lease_status), -1);
+	ck_assert_int_eq(errno, EINVAL);
+
+	dlm_status_close(status);
+}
+END_TEST
+
+/* status_page_not_available
+ *
+ * Test details: Open the status page when the lease manager is not running.
+ * Expected results: dlm_status_open() fails with ENOENT.
+ */
+START_TEST(status_page_not_available)
+{
+	unlink(STATUS_FILE);
+
+	ck_assert_ptr_eq(dlm_status_open(), NULL);
+	ck_assert_int_eq(errno, ENOENT);
+}
+END_TEST
+
+/* stale_status_page
+ *
+ * Test details: Read a status page left behind by an exited lease manager.
+ * Expected results: dlm_status_read() fails with ESTALE.
+ */
+START_TEST(stale_status_page)
+{
+	struct test_status_page page;
+	init_status_page(&page);
+	page.hdr.active = 0;
+	write_status_page(&page);
+
+	struct dlm_status *status = dlm_status_open();
+	ck_assert_ptr_ne(status, NULL);
+
+	struct dlm_lease_status lease_status;
+	ck_assert_int_eq(dlm_status_read(status, 0, &lease_status), -1);
+	ck_assert_int_eq(errno, ESTALE);
+
+	dlm_status_close(status);
+}
+END_TEST
+
+/* incomplete_status_update
+ *
+ * Test details: Read a lease entry that is in the middle of an update.
+ * Expected results: dlm_status_read() gives up with EAGAIN.
+ */
+START_TEST(incomplete_status_update)
+{
+	struct test_status_page page;
+	init_status_page(&page);
+	page.entries[1].seq = 3;
+	write_status_page(&page);
+
+	struct dlm_status *status = dlm_status_open();
+	ck_assert_ptr_ne(status, NULL);
+
+	struct dlm_lease_status lease_status;
+	ck_assert_int_eq(dlm_status_read(status, 1, &lease_status), -1);
+	ck_assert_int_eq(errno, EAGAIN);
+
+	dlm_status_close(status);
+}
+END_TEST
+
+static void add_lease_status_tests(Suite *s)
+{
+	TCase *tc = tcase_create("Lease status tests");
+
+	tcase_add_checked_fixture(tc, test_setup, status_test_shutdown);
+
+	tcase_add_test(tc, read_lease_status);
+	tcase_add_test(tc, status_page_not_available);
+	tcase_add_test(tc, stale_status_page);
+	tcase_add_test(tc, incomplete_status_update);
 	suite_add_tcase(s, tc);
 }
 
@@ -281,6 +946,9 @@ int main(void)
 
 	add_lease_manager_error_tests(s);
 	add_lease_handling_tests(s);
+	add_lease_revocation_tests(s);
+	add_lease_recovery_tests(s);
+	add_lease_status_tests(s);
 
 	sr = srunner_create(s);
 
@@ -26,6 +26,7 @@
 #include <unistd.h>
 
 #include "dlm-protocol.h"
+#include "dlm-topology.h"
 #include "socket-path.h"
 #include "test-helpers.h"
 
@@ -57,11 +58,68 @@ static void send_fd_list_over_socket(int socket, int nfds, int *fds)
 	free(buf);
 }
 
-static void expect_client_command(int socket, enum dlm_opcode opcode)
+static int create_test_topology(void)
+{
+	struct {
+		struct dlm_topology_header header;
+		struct dlm_topology_object objects[3];
+		struct dlm_topology_prop props[3];
+	} topology = {
+	    .header =
+		{
+		    .magic = DLM_TOPOLOGY_MAGIC,
+		    .version = DLM_TOPOLOGY_VERSION,
+		    .size = sizeof(topology),
+		    .nobjects = 3,
+		    .nprops = 3,
+		},
+	    .objects =
+		{
+		    {.id = TEST_TOPOLOGY_CRTC_ID, .type = DLM_TOPOLOGY_CRTC},
+		    {.id = TEST_TOPOLOGY_CONNECTOR_ID,
+		     .type = DLM_TOPOLOGY_CONNECTOR,
+		     .first_prop = 0,
+		     .nprops = 1,
+		     .name = TEST_TOPOLOGY_CONNECTOR_NAME},
+		    {.id = TEST_TOPOLOGY_PLANE_ID,
+		     .type = DLM_TOPOLOGY_PLANE,
+		     .first_prop = 1,
+		     .nprops = 2},
+		},
+	    .props =
+		{
+		    {.id = TEST_TOPOLOGY_CONNECTOR_CRTC_PROP,
+		     .name = "CRTC_ID"},
+		    {.id = TEST_TOPOLOGY_PLANE_FB_PROP, .name = "FB_ID"},
+		    {.id = TEST_TOPOLOGY_PLANE_CRTC_PROP, .name = "CRTC_ID"},
+		},
+	};
+
+	return get_sealed_memfd(&topology, sizeof(topology));
+}
+
+static uint32_t expect_client_command(int socket, enum dlm_opcode opcode)
 {
 	struct dlm_client_request req;
 	ck_assert_int_eq(receive_dlm_client_request(socket, &req), true);
 	ck_assert_int_eq(req.opcode, opcode);
+	return req.flags;
+}
+
+static void expect_lease_request(int socket, struct test_config *config)
+{
+	struct dlm_client_request req;
+	ck_assert_int_eq(receive_dlm_client_request(socket, &req), true);
+	ck_assert_int_eq(req.opcode, DLM_GET_LEASE);
+	if (config->use_control_socket)
+		ck_assert_str_eq(req.lease_name, config->lease_name);
+}
+
+static const char *server_socket_name(struct test_config *config)
+{
+	if (config->use_control_socket)
+		return DLM_CONTROL_SOCKET_NAME;
+	return config->lease_name;
 }
 
 struct server_state {
@@ -70,20 +128,41 @@ struct server_state {
 	pthread_cond_t cond;
 	bool is_server_started;
 
+	int server;
+	int client;
 	struct test_config *config;
 };
 
-static void *test_server_thread(void *arg)
+/* Runs when the server thread exits or is cancelled, so that sockets
+ * aren't leaked when a test stops the server early */
+static void close_server_sockets(void *arg)
 {
 	struct server_state *sstate = arg;
-	struct test_config *config = sstate->config;
 
+	if (sstate->client >= 0)
+		close(sstate->client);
+	if (sstate->server >= 0)
+		close(sstate->server);
+	sstate->client = sstate->server = -1;
+}
+
+static int create_server_socket(struct test_config *config)
+{
 	struct sockaddr_un address = {
 	    .sun_family = AF_UNIX,
 	};
 
-	ck_assert_int_eq(
-	    sockaddr_set_lease_server_path(&address, config->lease_name), true);
+	/* Make sure that the client can't find a socket for the lease */
+	if (config->use_control_socket) {
+		ck_assert_int_eq(sockaddr_set_lease_server_path(
+				     &address, config->lease_name),
+				 true);
+		unlink(address.sun_path);
+	}
+
+	ck_assert_int_eq(sockaddr_set_lease_server_path(
+			     &address, server_socket_name(config)),
+			 true);
 
 	int server = socket(PF_UNIX, SOCK_SEQPACKET, 0);
 	ck_assert_int_ge(server, 0);
@@ -91,32 +170,61 @@ static void *test_server_thread(void *arg)
 	unlink(address.sun_path);
 
 	int ret;
-	ret = bind(server, (struct sockaddr *)&address, sizeof(address));
+	ret = bind(server, (struct sockaddr *)&address,
+		   sockaddr_len(&address));
 	ck_assert_int_eq(ret, 0);
 
 	ret = listen(server, 1);
 	ck_assert_int_eq(ret, 0);
+	return server;
+}
+
+/* Simulate a lease manager restart: drop the client connection and the
+ * lease socket, and recreate it after a delay */
+static void restart_server(struct server_state *sstate)
+{
+	struct test_config *config = sstate->config;
+	struct sockaddr_un address = {
+	    .sun_family = AF_UNIX,
+	};
+	ck_assert_int_eq(sockaddr_set_lease_server_path(
+			     &address, server_socket_name(config)),
+			 true);
+
+	unlink(address.sun_path);
+	close_server_sockets(sstate);
+
+	usleep(config->restart_delay_ms * 1000);
+	sstate->server = create_server_socket(config);
+}
+
+static void *test_server_thread(void *arg)
+{
+	struct server_state *sstate = arg;
+	struct test_config *config = sstate->config;
+
+	pthread_cleanup_push(close_server_sockets, sstate);
+
+	sstate->server = create_server_socket(config);
 
 	sstate->is_server_started = true;
 	pthread_cond_signal(&sstate->cond);
 
-	int client = accept(server, NULL, NULL);
 	/* accept is the cancellation point for this thread. If
 	 * pthread_cancel() is called on this thread, accept() may return
 	 * -1, so don't assert on it. */
+	sstate->client = accept(sstate->server, NULL, NULL);
+	if (sstate->client < 0)
+		goto done;
 
-	if (client < 0) {
-		close(server);
-		return NULL;
-	}
-
-	expect_client_command(client, DLM_GET_LEASE);
+	int client = sstate->client;
+	expect_lease_request(client, config);
 
 	if (config->send_no_data)
 		goto done;
 
 	if (config->send_data_without_fd) {
-		char data;
+		char data = DLM_EVENT_NONE;
 		write(client, &data, 1);
 		goto done;
 	}
@@ -129,11 +237,69 @@ static void *test_server_thread(void *arg)
 	for (int i = 0; i < config->nfds; i++)
 		config->fds[i] = get_dummy_fd();
 
-	send_fd_list_over_socket(client, config->nfds, config->fds);
+	if (config->send_topology) {
+		config->topology_fd = create_test_topology();
+		int fds[] = {config->fds[0], config->topology_fd};
+		send_fd_list_over_socket(client, 2, fds);
+	} else {
+		send_fd_list_over_socket(client, config->nfds, config->fds);
+	}
+
+	if (config->revoke_after_grant) {
+		ck_assert_int_eq(
+		    send_dlm_event(client, DLM_EVENT_LEASE_REVOKED), true);
+		if (!config->regrant_after_revoke)
+			goto done;
+
+		/* The revoked client reconnects to claim the lease again */
+		sstate->client = accept(sstate->server, NULL, NULL);
+		close(client);
+		if (sstate->client < 0)
+			goto done;
+
+		client = sstate->client;
+		expect_client_command(client, DLM_GET_LEASE);
+		config->reacquired_fd = get_dummy_fd();
+		send_fd_list_over_socket(client, 1, &config->reacquired_fd);
+	}
+
+	if (config->disconnect_after_grant)
+		goto done;
+
+	if (config->restart_after_grant) {
+		restart_server(sstate);
+		sstate->client = accept(sstate->server, NULL, NULL);
+		if (sstate->client < 0)
+			goto done;
+
+		client = sstate->client;
+		expect_client_command(client, DLM_GET_LEASE);
+		config->reacquired_fd = get_dummy_fd();
+		send_fd_list_over_socket(client, 1, &config->reacquired_fd);
+	}
+
+	if (config->expect_reacquire) {
+		expect_client_command(client, DLM_YIELD_LEASE);
+		if (config->offer_after_yield)
+			ck_assert_int_eq(
+			    send_dlm_event(client, DLM_EVENT_LEASE_AVAILABLE),
+			    true);
+		uint32_t flags = expect_client_command(client, DLM_GET_LEASE);
+		/* Topology was already sent with the first lease */
+		if (config->send_topology)
+			ck_assert_int_eq(flags & DLM_REQUEST_TOPOLOGY, 0);
+		/* An offer queued while the request was being sent */
+		if (config->offer_before_reacquire)
+			ck_assert_int_eq(
+			    send_dlm_event(client, DLM_EVENT_LEASE_AVAILABLE),
+			    true);
+		config->reacquired_fd = get_dummy_fd();
+		send_fd_list_over_socket(client, 1, &config->reacquired_fd);
+	}
+
 	expect_client_command(client, DLM_RELEASE_LEASE);
 done:
-	close(client);
-	close(server);
+	pthread_cleanup_pop(true);
 	return NULL;
 }
 
@@ -145,6 +311,8 @@ struct server_state *test_server_start(struct test_config *test_config)
 	    .lock = PTHREAD_MUTEX_INITIALIZER,
 	    .cond = PTHREAD_COND_INITIALIZER,
 	    .is_server_started = false,
+	    .server = -1,
+	    .client = -1,
 	    .config = test_config,
 	};
 
@@ -170,6 +338,13 @@ void test_server_stop(struct server_state *sstate)
 
 void test_config_cleanup(struct test_config *config)
 {
+	if (config->send_topology)
+		close(config->topology_fd);
+
+	if (config->expect_reacquire || config->restart_after_grant ||
+	    config->regrant_after_revoke)
+		close(config->reacquired_fd);
+
 	if (!config->fds)
 		return;
 
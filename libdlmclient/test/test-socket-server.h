@@ -24,8 +24,29 @@ struct test_config {
 
 	bool send_data_without_fd;
 	bool send_no_data;
+	bool send_topology;
+	int topology_fd;
+	bool revoke_after_grant;
+	bool regrant_after_revoke;
+	bool disconnect_after_grant;
+	bool expect_reacquire;
+	bool offer_after_yield;
+	bool offer_before_reacquire;
+	int reacquired_fd;
+	bool restart_after_grant;
+	int restart_delay_ms;
+	bool use_control_socket;
 };
 
+/* Objects described in the topology sent with the send_topology option */
+#define TEST_TOPOLOGY_CRTC_ID 10
+#define TEST_TOPOLOGY_CONNECTOR_ID 20
+#define TEST_TOPOLOGY_PLANE_ID 30
+#define TEST_TOPOLOGY_CONNECTOR_NAME "HDMI-A-1"
+#define TEST_TOPOLOGY_CONNECTOR_CRTC_PROP 100
+#define TEST_TOPOLOGY_PLANE_FB_PROP 101
+#define TEST_TOPOLOGY_PLANE_CRTC_PROP 102
+
 void test_config_cleanup(struct test_config *config);
 
 struct server_state *test_server_start(struct test_config *test_config);